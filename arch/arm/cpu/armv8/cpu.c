@@ -13,6 +13,8 @@
 
 #include <common.h>
 #include <command.h>
+#include <efi_loader.h>
+#include <watchdog.h>
 #include <asm/system.h>
 #include <asm/secure.h>
 #include <linux/compiler.h>
@@ -77,3 +79,59 @@ void armv8_setup_psci(void)
 	secure_ram_addr(psci_arch_init)();
 }
 #endif
+
+#if defined(CONFIG_EFI_LOADER) && !defined(CONFIG_SPL_BUILD)
+/* Event stream fields of CNTKCTL_EL1 and CNTHCTL_EL2 */
+#define CNTCTL_EVNTEN		(1 << 2)
+#define CNTCTL_EVNTI_SHIFT	4
+#define CNTCTL_EVNT_MASK	0xfc
+
+static unsigned long get_cntctl(unsigned int el)
+{
+	unsigned long ctl;
+
+	if (el == 1)
+		asm volatile("mrs %0, cntkctl_el1" : "=r" (ctl));
+	else
+		asm volatile("mrs %0, cnthctl_el2" : "=r" (ctl));
+
+	return ctl;
+}
+
+static void set_cntctl(unsigned int el, unsigned long ctl)
+{
+	if (el == 1)
+		asm volatile("msr cntkctl_el1, %0" : : "r" (ctl));
+	else
+		asm volatile("msr cnthctl_el2, %0" : : "r" (ctl));
+	isb();
+}
+
+/*
+ * Sleep in WFE while an EFI payload waits for an event. U-Boot takes no
+ * interrupts, so the generic timer's event stream wakes the CPU up every
+ * 10us or less to see whether the time has come.
+ */
+void efi_idle(u64 until)
+{
+	unsigned int el = current_el();
+	unsigned long freq, ctl;
+	int evnti;
+
+	asm volatile("mrs %0, cntfrq_el0" : "=r" (freq));
+	/* Events come every 2^(evnti + 1) ticks */
+	evnti = fls(freq / 100000) - 2;
+	evnti = clamp(evnti, 0, 15);
+
+	ctl = get_cntctl(el);
+	set_cntctl(el, (ctl & ~CNTCTL_EVNT_MASK) | CNTCTL_EVNTEN |
+		   evnti << CNTCTL_EVNTI_SHIFT);
+
+	while (timer_get_us() < until) {
+		WATCHDOG_RESET();
+		asm volatile("wfe" : : : "memory");
+	}
+
+	set_cntctl(el, ctl);
+}
+#endif
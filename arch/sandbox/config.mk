@@ -3,7 +3,11 @@
 
 PLATFORM_CPPFLAGS += -D__SANDBOX__ -U_FORTIFY_SOURCE
 PLATFORM_CPPFLAGS += -DCONFIG_ARCH_MAP_SYSMEM
-PLATFORM_LIBS += -lrt
+PLATFORM_LIBS += -lrt -lpthread
+
+# Drop unused code, as other architectures do. UBIFS relies on this to leave
+# out its write paths.
+PLATFORM_RELFLAGS += -ffunction-sections -fdata-sections
 
 # Define this to avoid linking with SDL, which requires SDL libraries
 # This can solve 'sdl-config: Command not found' errors
@@ -18,7 +22,7 @@ endif
 
 cmd_u-boot__ = $(CC) -o $@ -Wl,-T u-boot.lds \
 	-Wl,--start-group $(u-boot-main) -Wl,--end-group \
-	$(PLATFORM_LIBS) -Wl,-Map -Wl,u-boot.map
+	$(PLATFORM_LIBS) -Wl,-Map -Wl,u-boot.map -Wl,--gc-sections
 
 cmd_u-boot-spl = (cd $(obj) && $(CC) -o $(SPL_BIN) -Wl,-T u-boot-spl.lds \
 	-Wl,--start-group $(patsubst $(obj)/%,%,$(u-boot-spl-main)) \
@@ -11,6 +11,7 @@
 #include <asm/io.h>
 #include <asm/state.h>
 #include <dm/root.h>
+#include <u-boot/lz4.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -104,6 +105,21 @@ void invalidate_dcache_range(unsigned long start, unsigned long stop)
 {
 }
 
+#ifdef CONFIG_LZ4_PARALLEL
+static void sandbox_lz4_job(void *item)
+{
+	struct ulz4_job *job = item;
+
+	job->ret = ulz4_decode_job(job);
+}
+
+/* Decompress the blocks of LZ4 frames on host threads */
+void ulz4_run_jobs(struct ulz4_job *jobs, int count)
+{
+	os_run_threads(sandbox_lz4_job, jobs, sizeof(*jobs), count);
+}
+#endif
+
 int sandbox_read_fdt_from_file(void)
 {
 	struct sandbox_state *state = state_get_current();
@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -206,6 +207,62 @@ uint64_t __attribute__((no_instrument_function)) os_get_nsec(void)
 #endif
 }
 
+/* Most threads os_run_threads() starts besides the calling one */
+#define OS_MAX_THREADS	63
+
+struct os_threads {
+	void (*func)(void *item);
+	char *items;
+	size_t size;
+	int count;
+	int next;		/* next item to hand out */
+};
+
+static void *os_thread_main(void *arg)
+{
+	struct os_threads *t = arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&t->next, 1, __ATOMIC_RELAXED)) <
+	       t->count)
+		t->func(t->items + i * t->size);
+
+	return NULL;
+}
+
+int os_run_threads(void (*func)(void *item), void *items, size_t size,
+		   int count)
+{
+	struct os_threads t = {
+		.func = func,
+		.items = items,
+		.size = size,
+		.count = count,
+	};
+	pthread_t threads[OS_MAX_THREADS];
+	long cpus;
+	int nthreads, i;
+
+	/* Use a second thread even on one CPU, so that it is tested there */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 2)
+		cpus = 2;
+	nthreads = cpus < count ? cpus - 1 : count - 1;
+	if (nthreads > OS_MAX_THREADS)
+		nthreads = OS_MAX_THREADS;
+	for (i = 0; i < nthreads; i++) {
+		/* The calling thread handles whatever is left over */
+		if (pthread_create(&threads[i], NULL, os_thread_main, &t))
+			break;
+	}
+	nthreads = i;
+	os_thread_main(&t);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	return nthreads + 1;
+}
+
 static char *short_opts;
 static struct option *long_opts;
 
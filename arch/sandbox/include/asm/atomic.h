@@ -0,0 +1,78 @@
+/*
+ * Sandbox runs on a single thread with no interrupts, so plain memory
+ * accesses are atomic enough.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ASM_SANDBOX_ATOMIC_H
+#define __ASM_SANDBOX_ATOMIC_H
+
+#include <linux/types.h>
+
+typedef struct { volatile int counter; } atomic_t;
+typedef struct { volatile long counter; } atomic64_t;
+
+#define ATOMIC_INIT(i)	{ (i) }
+
+#define atomic_read(v)		((v)->counter)
+#define atomic_set(v, i)	(((v)->counter) = (i))
+#define atomic64_read(v)	atomic_read(v)
+#define atomic64_set(v, i)	atomic_set(v, i)
+
+static inline void atomic_add(int i, atomic_t *v)
+{
+	v->counter += i;
+}
+
+static inline void atomic_sub(int i, atomic_t *v)
+{
+	v->counter -= i;
+}
+
+static inline void atomic_inc(atomic_t *v)
+{
+	v->counter++;
+}
+
+static inline void atomic_dec(atomic_t *v)
+{
+	v->counter--;
+}
+
+static inline int atomic_dec_and_test(atomic_t *v)
+{
+	return --v->counter == 0;
+}
+
+static inline int atomic_add_negative(int i, atomic_t *v)
+{
+	return (v->counter += i) < 0;
+}
+
+static inline void atomic64_add(long i, atomic64_t *v)
+{
+	v->counter += i;
+}
+
+static inline void atomic64_sub(long i, atomic64_t *v)
+{
+	v->counter -= i;
+}
+
+static inline void atomic64_inc(atomic64_t *v)
+{
+	v->counter++;
+}
+
+static inline void atomic64_dec(atomic64_t *v)
+{
+	v->counter--;
+}
+
+#define smp_mb__before_atomic_dec()	barrier()
+#define smp_mb__after_atomic_dec()	barrier()
+#define smp_mb__before_atomic_inc()	barrier()
+#define smp_mb__after_atomic_inc()	barrier()
+
+#endif /* __ASM_SANDBOX_ATOMIC_H */
@@ -258,6 +258,9 @@ static unsigned long do_bootefi_exec(void *efi, void *fdt)
 	/* Initialize and populate EFI object list */
 	if (!efi_obj_list_initalized)
 		efi_init_obj_list();
+#ifdef CONFIG_PARTITIONS
+	efi_disk_prepare();
+#endif
 
 	/* Call our payload! */
 	debug("%s:%d Jumping to 0x%lx\n", __func__, __LINE__, (long)entry);
@@ -318,6 +321,9 @@ static int do_bootefi(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	r = do_bootefi_exec((void *)addr, (void*)fdt_addr);
 	printf("## Application terminated, r = %lu\n",
 	       r & ~EFI_ERROR_MASK);
+#ifdef CONFIG_PARTITIONS
+	efi_disk_finish();
+#endif
 
 	if (r != EFI_SUCCESS)
 		return 1;
@@ -14,6 +14,7 @@
 #include <common.h>
 #include <command.h>
 #include <exports.h>
+#include <mapmem.h>
 #include <memalign.h>
 #include <nand.h>
 #include <onenand_uboot.h>
@@ -85,6 +86,16 @@ static void display_ubi_info(struct ubi_device *ubi)
 	ubi_msg("number of PEBs reserved for bad PEB handling: %d",
 			ubi->beb_rsvd_pebs);
 	ubi_msg("max/mean erase counter: %d/%d", ubi->max_ec, ubi->mean_ec);
+	ubi_msg("attached from:              %s",
+			ubi->attach_stats.fastmap ? "fastmap" : "scan");
+	ubi_msg("attach time:                %lu ms",
+			ubi->attach_stats.time_ms);
+	ubi_msg("PEBs scanned at attach:     %d (%d header reads)",
+			ubi->attach_stats.scanned_pebs,
+			ubi->attach_stats.hdr_reads);
+	ubi_msg("empty/corrupted PEBs at attach: %d/%d",
+			ubi->attach_stats.empty_pebs,
+			ubi->attach_stats.corr_pebs);
 }
 
 static int ubi_info(int layout)
@@ -621,6 +632,7 @@ static int do_ubi(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	}
 
 	if (strncmp(argv[1], "write", 5) == 0) {
+		void *buf;
 		int ret;
 
 		if (argc < 5) {
@@ -630,21 +642,23 @@ static int do_ubi(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 
 		addr = simple_strtoul(argv[2], NULL, 16);
 		size = simple_strtoul(argv[4], NULL, 16);
+		buf = map_sysmem(addr, size);
 
 		if (strlen(argv[1]) == 10 &&
 		    strncmp(argv[1] + 5, ".part", 5) == 0) {
 			if (argc < 6) {
-				ret = ubi_volume_continue_write(argv[3],
-						(void *)addr, size);
+				ret = ubi_volume_continue_write(argv[3], buf,
+								size);
 			} else {
 				size_t full_size;
 				full_size = simple_strtoul(argv[5], NULL, 16);
-				ret = ubi_volume_begin_write(argv[3],
-						(void *)addr, size, full_size);
+				ret = ubi_volume_begin_write(argv[3], buf,
+							size, full_size);
 			}
 		} else {
-			ret = ubi_volume_write(argv[3], (void *)addr, size);
+			ret = ubi_volume_write(argv[3], buf, size);
 		}
+		unmap_sysmem(buf);
 		if (!ret) {
 			printf("%lld bytes written to volume %s\n", size,
 			       argv[3]);
@@ -669,10 +683,17 @@ static int do_ubi(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 		}
 
 		if (argc == 3) {
+			char *buf;
+			int ret;
+
 			printf("Read %lld bytes from volume %s to %lx\n", size,
 			       argv[3], addr);
 
-			return ubi_volume_read(argv[3], (char *)addr, size);
+			buf = map_sysmem(addr, size);
+			ret = ubi_volume_read(argv[3], buf, size);
+			unmap_sysmem(buf);
+
+			return ret;
 		}
 	}
 
@@ -17,6 +17,7 @@
 
 #include <config.h>
 #include <command.h>
+#include <mapmem.h>
 
 #ifdef YAFFS2_DEBUG
 #define PRINTF(fmt, args...) printf(fmt, ##args)
@@ -190,7 +191,7 @@ int do_yrdm(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 	filename = argv[1];
 	addr = simple_strtoul(argv[2], NULL, 16);
 
-	cmd_yaffs_mread_file(filename, (char *)addr);
+	cmd_yaffs_mread_file(filename, map_sysmem(addr, 0));
 
 	return 0;
 }
@@ -210,7 +211,7 @@ int do_ywrm(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
 	addr = simple_strtoul(argv[2], NULL, 16);
 	size = simple_strtoul(argv[3], NULL, 16);
 
-	cmd_yaffs_mwrite_file(filename, (char *)addr, size);
+	cmd_yaffs_mwrite_file(filename, map_sysmem(addr, size), size);
 
 	return 0;
 }
@@ -14,6 +14,7 @@
 #include <config.h>
 #include <command.h>
 #include <image.h>
+#include <mapmem.h>
 #include <linux/ctype.h>
 #include <asm/byteorder.h>
 #include <zfs_common.h>
@@ -45,6 +46,7 @@ static int do_zfs_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]
 	const char *addr_str;
 	struct zfs_file zfile;
 	struct device_s vdev;
+	void *ptr;
 
 	if (argc < 3)
 		return CMD_RET_USAGE;
@@ -102,12 +104,15 @@ static int do_zfs_load(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]
 	if ((count < zfile.size) && (count != 0))
 		zfile.size = (uint64_t)count;
 
-	if (zfs_read(&zfile, (char *)addr, zfile.size) != zfile.size) {
+	ptr = map_sysmem(addr, zfile.size);
+	if (zfs_read(&zfile, ptr, zfile.size) != zfile.size) {
 		printf("** Unable to read \"%s\" from %s %d:%d **\n",
 			   filename, argv[1], dev, part);
+		unmap_sysmem(ptr);
 		zfs_close(&zfile);
 		return 1;
 	}
+	unmap_sysmem(ptr);
 
 	zfs_close(&zfile);
 
@@ -8,6 +8,7 @@
 #include <common.h>
 #include <command.h>
 #include <errno.h>
+#include <fs.h>
 #include <ide.h>
 #include <malloc.h>
 #include <part.h>
@@ -219,6 +220,7 @@ void part_init(struct blk_desc *dev_desc)
 	struct part_driver *entry;
 
 	blkcache_invalidate(dev_desc->if_type, dev_desc->devnum);
+	part_cache_invalidate(dev_desc->if_type, dev_desc->devnum);
 
 	dev_desc->part_type = PART_TYPE_UNKNOWN;
 	for (entry = drv; entry != drv + n_ents; entry++) {
@@ -297,11 +299,102 @@ void part_print(struct blk_desc *dev_desc)
 
 #endif /* HAVE_BLOCK_DEVICE */
 
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+/*
+ * Partition lookups are cached per block device and hardware partition.
+ * Each entry starts out unknown and is filled in by the partition driver
+ * on first access; negative results are remembered too, so that scanning
+ * for the boot partition only hits the device once per entry.
+ */
+enum {
+	PART_CACHE_UNKNOWN = 0,
+	PART_CACHE_VALID,
+	PART_CACHE_INVALID,
+};
+
+struct part_cache_node {
+	struct list_head lh;
+	int iftype;
+	int devnum;
+	int hwpart;
+	int part_type;
+	int max_entries;
+	u8 *state;
+	disk_partition_t *info;
+};
+
+static LIST_HEAD(part_cache);
+
+static void part_cache_free(struct part_cache_node *node)
+{
+	list_del(&node->lh);
+	free(node->state);
+	free(node->info);
+	free(node);
+}
+
+void part_cache_invalidate(int iftype, int devnum)
+{
+	struct part_cache_node *node, *n;
+
+	list_for_each_entry_safe(node, n, &part_cache, lh)
+		if ((node->iftype == iftype) && (node->devnum == devnum))
+			part_cache_free(node);
+#if defined(HAVE_BLOCK_DEVICE) && CONFIG_IS_ENABLED(EFI_PARTITION)
+	part_efi_cache_invalidate(iftype, devnum);
+#endif
+	fs_cache_invalidate();
+}
+
+#ifdef HAVE_BLOCK_DEVICE
+static struct part_cache_node *part_cache_get(struct blk_desc *dev_desc,
+					      struct part_driver *drv)
+{
+	struct part_cache_node *node;
+
+	list_for_each_entry(node, &part_cache, lh)
+		if ((node->iftype == dev_desc->if_type) &&
+		    (node->devnum == dev_desc->devnum) &&
+		    (node->hwpart == dev_desc->hwpart) &&
+		    (node->part_type == drv->part_type))
+			return node;
+
+	if (drv->max_entries <= 0)
+		return NULL;
+
+	node = malloc(sizeof(*node));
+	if (!node)
+		return NULL;
+	node->state = calloc(drv->max_entries, sizeof(*node->state));
+	node->info = calloc(drv->max_entries, sizeof(*node->info));
+	if (!node->state || !node->info) {
+		free(node->state);
+		free(node->info);
+		free(node);
+		return NULL;
+	}
+
+	node->iftype = dev_desc->if_type;
+	node->devnum = dev_desc->devnum;
+	node->hwpart = dev_desc->hwpart;
+	node->part_type = drv->part_type;
+	node->max_entries = drv->max_entries;
+	list_add(&node->lh, &part_cache);
+
+	return node;
+}
+#endif
+#endif /* PARTITION_CACHE */
+
 int part_get_info(struct blk_desc *dev_desc, int part,
 		       disk_partition_t *info)
 {
 #ifdef HAVE_BLOCK_DEVICE
 	struct part_driver *drv;
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	struct part_cache_node *node;
+#endif
+	int ret;
 
 #if CONFIG_IS_ENABLED(PARTITION_UUIDS)
 	/* The common case is no UUID support */
@@ -322,7 +415,32 @@ int part_get_info(struct blk_desc *dev_desc, int part,
 		       drv->name);
 		return -ENOSYS;
 	}
-	if (drv->get_info(dev_desc, part, info) == 0) {
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	node = part_cache_get(dev_desc, drv);
+	if (node && (part < 1 || part > node->max_entries))
+		node = NULL;
+	if (node) {
+		switch (node->state[part - 1]) {
+		case PART_CACHE_VALID:
+			*info = node->info[part - 1];
+			return 0;
+		case PART_CACHE_INVALID:
+			return -1;
+		}
+	}
+#endif
+	ret = drv->get_info(dev_desc, part, info);
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	if (node) {
+		if (!ret) {
+			node->state[part - 1] = PART_CACHE_VALID;
+			node->info[part - 1] = *info;
+		} else {
+			node->state[part - 1] = PART_CACHE_INVALID;
+		}
+	}
+#endif
+	if (ret == 0) {
 		PRINTF("## Valid %s partition found ##\n", drv->name);
 		return 0;
 	}
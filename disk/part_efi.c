@@ -266,24 +266,56 @@ void part_print_efi(struct blk_desc *dev_desc)
 	return;
 }
 
-int part_get_info_efi(struct blk_desc *dev_desc, int part,
-		      disk_partition_t *info)
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+/*
+ * The most recently validated GPT. Looking up several partitions of the
+ * same device then only reads and CRC-checks the table once.
+ */
+static struct {
+	int iftype;
+	int devnum;
+	int hwpart;
+	gpt_header head;
+	gpt_entry *pte;
+} gpt_cache;
+
+void part_efi_cache_invalidate(int iftype, int devnum)
 {
-	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
-	gpt_entry *gpt_pte = NULL;
+	if (gpt_cache.pte && gpt_cache.iftype == iftype &&
+	    gpt_cache.devnum == devnum) {
+		free(gpt_cache.pte);
+		gpt_cache.pte = NULL;
+	}
+}
+#endif
 
-	/* "part" argument must be at least 1 */
-	if (part < 1) {
-		printf("%s: Invalid Argument(s)\n", __func__);
-		return -1;
+/**
+ * find_valid_gpt() - read and validate the primary GPT, or else the backup
+ * @dev_desc - block device descriptor
+ * @gpt_head - returns the GPT header
+ * @pgpt_pte - returns the partition entries, release with put_valid_gpt()
+ *
+ * Description: returns 0 on success, -1 if neither GPT is valid.
+ */
+static int find_valid_gpt(struct blk_desc *dev_desc, gpt_header *gpt_head,
+			  gpt_entry **pgpt_pte)
+{
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	if (gpt_cache.pte && gpt_cache.iftype == dev_desc->if_type &&
+	    gpt_cache.devnum == dev_desc->devnum &&
+	    gpt_cache.hwpart == dev_desc->hwpart) {
+		memcpy(gpt_head, &gpt_cache.head, sizeof(gpt_header));
+		*pgpt_pte = gpt_cache.pte;
+		return 0;
 	}
+#endif
 
 	/* This function validates AND fills in the GPT header and PTE */
 	if (is_gpt_valid(dev_desc, GPT_PRIMARY_PARTITION_TABLE_LBA,
-			gpt_head, &gpt_pte) != 1) {
+			gpt_head, pgpt_pte) != 1) {
 		printf("%s: *** ERROR: Invalid GPT ***\n", __func__);
 		if (is_gpt_valid(dev_desc, (dev_desc->lba - 1),
-				 gpt_head, &gpt_pte) != 1) {
+				 gpt_head, pgpt_pte) != 1) {
 			printf("%s: *** ERROR: Invalid Backup GPT ***\n",
 			       __func__);
 			return -1;
@@ -293,11 +325,47 @@ int part_get_info_efi(struct blk_desc *dev_desc, int part,
 		}
 	}
 
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	free(gpt_cache.pte);
+	gpt_cache.iftype = dev_desc->if_type;
+	gpt_cache.devnum = dev_desc->devnum;
+	gpt_cache.hwpart = dev_desc->hwpart;
+	memcpy(&gpt_cache.head, gpt_head, sizeof(gpt_header));
+	gpt_cache.pte = *pgpt_pte;
+#endif
+
+	return 0;
+}
+
+static void put_valid_gpt(gpt_entry *gpt_pte)
+{
+#if CONFIG_IS_ENABLED(PARTITION_CACHE)
+	if (gpt_pte == gpt_cache.pte)
+		return;
+#endif
+	free(gpt_pte);
+}
+
+int part_get_info_efi(struct blk_desc *dev_desc, int part,
+		      disk_partition_t *info)
+{
+	ALLOC_CACHE_ALIGN_BUFFER_PAD(gpt_header, gpt_head, 1, dev_desc->blksz);
+	gpt_entry *gpt_pte = NULL;
+
+	/* "part" argument must be at least 1 */
+	if (part < 1) {
+		printf("%s: Invalid Argument(s)\n", __func__);
+		return -1;
+	}
+
+	if (find_valid_gpt(dev_desc, gpt_head, &gpt_pte))
+		return -1;
+
 	if (part > le32_to_cpu(gpt_head->num_partition_entries) ||
 	    !is_pte_valid(&gpt_pte[part - 1])) {
 		debug("%s: *** ERROR: Invalid partition number %d ***\n",
 			__func__, part);
-		free(gpt_pte);
+		put_valid_gpt(gpt_pte);
 		return -1;
 	}
 
@@ -324,8 +392,7 @@ int part_get_info_efi(struct blk_desc *dev_desc, int part,
 	debug("%s: start 0x" LBAF ", size 0x" LBAF ", name %s\n", __func__,
 	      info->start, info->size, info->name);
 
-	/* Remember to free pte */
-	free(gpt_pte);
+	put_valid_gpt(gpt_pte);
 	return 0;
 }
 
@@ -250,6 +250,7 @@ ulong blk_write_devnum(enum if_type if_type, int devnum, lbaint_t start,
 	ret = get_desc(drv, devnum, &desc);
 	if (ret)
 		return ret;
+	part_cache_invalidate(if_type, devnum);
 	return desc->block_write(desc, start, blkcnt, buffer);
 }
 
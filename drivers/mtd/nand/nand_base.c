@@ -1521,6 +1521,9 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 	unsigned int max_bitflips = 0;
 	int retry_mode = 0;
 	bool ecc_fail = false;
+	int ppb_mask = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
+	bool use_cache = NAND_HAS_CACHEREAD(chip);
+	bool cache_read = false;
 
 	chipnr = (int)(from >> chip->chip_shift);
 	chip->select_chip(mtd, chipnr);
@@ -1555,7 +1558,30 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 						 __func__, buf);
 
 read_retry:
-			chip->cmdfunc(mtd, NAND_CMD_READ0, 0x00, page);
+			/*
+			 * In a cache read sequence the array has already
+			 * started loading this page.
+			 */
+			if (!cache_read)
+				chip->cmdfunc(mtd, NAND_CMD_READ0, 0x00, page);
+
+			/*
+			 * If the next page is to be read from the same block,
+			 * move this one to the cache register and let the
+			 * array load the next page (tR) while this one is
+			 * being transferred. The last page ends the sequence.
+			 */
+			if (use_cache && readlen > bytes &&
+			    ((page + 1) & ppb_mask) &&
+			    (realpage + 1 != chip->pagebuf || oob)) {
+				chip->cmdfunc(mtd, NAND_CMD_READCACHESEQ,
+					      -1, -1);
+				cache_read = true;
+			} else if (cache_read) {
+				chip->cmdfunc(mtd, NAND_CMD_READCACHEEND,
+					      -1, -1);
+				cache_read = false;
+			}
 
 			/*
 			 * Now read the page into the buffer.  Absent an error,
@@ -1616,6 +1642,18 @@ read_retry:
 
 			if (mtd->ecc_stats.failed - ecc_failures) {
 				if (retry_mode + 1 < chip->read_retries) {
+					/*
+					 * Finish any cache read, the retry
+					 * reads this page again on its own.
+					 */
+					if (cache_read) {
+						chip->cmdfunc(mtd,
+							NAND_CMD_READCACHEEND,
+							-1, -1);
+						cache_read = false;
+					}
+					use_cache = false;
+
 					retry_mode++;
 					ret = nand_setup_read_retry(mtd,
 							retry_mode);
@@ -1665,6 +1703,9 @@ read_retry:
 			chip->select_chip(mtd, chipnr);
 		}
 	}
+	/* Leave the chip idle if a read failed in a cache read sequence */
+	if (cache_read)
+		chip->cmdfunc(mtd, NAND_CMD_READCACHEEND, -1, -1);
 	chip->select_chip(mtd, -1);
 
 	ops->retlen = ops->len - (size_t) readlen;
@@ -3733,6 +3774,20 @@ ident_done:
 	if (mtd->writesize > 512 && chip->cmdfunc == nand_command)
 		chip->cmdfunc = nand_command_lp;
 
+	/*
+	 * Sequential cache reads are only used when the chip advertises them
+	 * and the command function knows how to send them. nand_scan_tail()
+	 * turns them off again unless the page read hooks allow them.
+	 */
+#ifdef CONFIG_SYS_NAND_ONFI_DETECTION
+	if (chip->cmdfunc == nand_command_lp)
+		chip->options |= NAND_CACHEREAD;
+	if (!(onfi_opt_cmd(chip) & ONFI_OPT_CMD_READ_CACHE))
+		chip->options &= ~NAND_CACHEREAD;
+#else
+	chip->options &= ~NAND_CACHEREAD;
+#endif
+
 	pr_info("device found, Manufacturer ID: 0x%02x, Chip ID: 0x%02x\n",
 		*maf_id, *dev_id);
 
@@ -3927,6 +3982,22 @@ static bool nand_ecc_strength_good(struct mtd_info *mtd)
 	return corr >= ds_corr && ecc->strength >= chip->ecc_strength_ds;
 }
 
+/* Check whether the page read hooks can be used in a cache read sequence */
+static bool nand_cache_read_safe(struct nand_ecc_ctrl *ecc)
+{
+	if (ecc->read_page != nand_read_page_raw &&
+	    ecc->read_page != nand_read_page_swecc &&
+	    ecc->read_page != nand_read_page_hwecc &&
+	    ecc->read_page != nand_read_page_syndrome)
+		return false;
+
+	if (ecc->read_page_raw != nand_read_page_raw &&
+	    ecc->read_page_raw != nand_read_page_raw_syndrome)
+		return false;
+
+	return !ecc->read_subpage || ecc->read_subpage == nand_read_subpage;
+}
+
 /**
  * nand_scan_tail - [NAND Interface] Scan for the NAND device
  * @mtd: MTD device structure
@@ -4184,6 +4255,16 @@ int nand_scan_tail(struct mtd_info *mtd)
 		break;
 	}
 
+	/*
+	 * A cache read sequence keeps the chip busy loading the next page
+	 * while this one is read out, so the page read hooks must not send
+	 * commands of their own. Only the generic ones are known not to.
+	 * nand_read_page_hwecc_oob_first() reads the OOB area first with
+	 * READOOB and READ0, which would load the current page again.
+	 */
+	if (!nand_cache_read_safe(ecc))
+		chip->options &= ~NAND_CACHEREAD;
+
 	/* Fill in remaining MTD driver data */
 	mtd->type = nand_is_slc(chip) ? MTD_NANDFLASH : MTD_MLCNANDFLASH;
 	mtd->flags = (chip->options & NAND_ROM) ? MTD_CAP_ROM :
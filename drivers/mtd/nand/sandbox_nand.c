@@ -0,0 +1,689 @@
+/*
+ * Simulate a NAND flash chip
+ *
+ * The chip is connected with the --nand command line option and keeps its
+ * pages, including the spare area, in a file on the host:
+ *
+ *   --nand <file>[,<option>=<value>...]
+ *
+ * Options (defaults in brackets):
+ *   page=<bytes>	page size: 512, 2048 or 4096 [2048]
+ *   ppb=<n>		pages per erase block [64]
+ *   blocks=<n>		number of erase blocks [1024]
+ *   tr=<us>		page read time tR [25]
+ *   tprog=<us>		page program time tPROG [250]
+ *   tbers=<us>		block erase time tBERS [2000]
+ *   tcyc=<ns>		data transfer time per byte [25]
+ *   cache=<0|1>	support READ CACHE SEQUENTIAL (31h/3Fh) [1]
+ *   bad=<b>[:<b>...]	blocks carrying a factory bad block marker
+ *   flip=<n>		flip bits in every n-th page read [0, off]
+ *   flipbits=<n>	bits flipped per affected page read [1]
+ *
+ * The spare area is 1/32 of the page, so the chip works with the default
+ * software ECC layouts of nand_base. It answers the ONFI READID and PARAM
+ * commands so that its geometry and timings are discovered the same way as
+ * for real chips.
+ *
+ * Operations do not sleep. Instead the time the chip would have spent busy
+ * or transferring data is added to the sandbox timer, so that commands such
+ * as 'time nand read' report the duration the operation would take on real
+ * hardware, on top of the host's own run time. During a cache read the
+ * array loads the next page while the current one is transferred, so only
+ * the part of tR not covered by the transfer is charged.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <malloc.h>
+#include <nand.h>
+#include <os.h>
+#include <linux/log2.h>
+#include <linux/mtd/nand.h>
+
+#include <asm/getopt.h>
+#include <asm/state.h>
+#include <asm/test.h>
+
+#define SB_NAND_MFR_ID		NAND_MFR_MICRON
+#define SB_NAND_DEV_ID		0x01	/* Not in nand_flash_ids[] */
+
+enum sb_nand_output {
+	SB_OUT_NONE,
+	SB_OUT_PAGE,		/* Page register, from the current column */
+	SB_OUT_BUF,		/* ID, parameter page or feature bytes */
+	SB_OUT_STATUS,
+};
+
+struct sb_nand {
+	struct nand_chip chip;
+	int fd;
+
+	/* Geometry */
+	uint page_size;
+	uint oob_size;
+	uint ppb;
+	uint blocks;
+
+	/* Timing model, in nanoseconds */
+	ulong t_r;
+	ulong t_prog;
+	ulong t_bers;
+	ulong t_cyc;
+	ulong pending_ns;	/* Not yet added to the sandbox timer */
+	ulong array_ns;		/* Remaining busy time of the array */
+	bool cache;
+
+	/* Fault injection */
+	ulong *bad_map;
+	uint flip_interval;
+	uint flip_bits;
+	uint reads;
+	u32 rand;
+
+	/* Command state */
+	int cmd;
+	int page;
+	int seq_page;		/* Page the array is loading in a cache read */
+	uint column;
+	u8 status;
+	u8 *page_buf;		/* Page register: data followed by OOB */
+	u8 *erase_buf;
+	enum sb_nand_output output;
+	u8 out_buf[sizeof(struct nand_onfi_params) * 3];
+	uint out_len;
+	uint out_pos;
+	u8 features[256][ONFI_SUBFEATURE_PARAM_LEN];
+	int feature_addr;
+};
+
+static const char *sb_nand_spec;
+
+static struct sb_nand *mtd_to_sb_nand(struct mtd_info *mtd)
+{
+	return container_of(mtd_to_nand(mtd), struct sb_nand, chip);
+}
+
+/* Account for time the chip spends busy or transferring data */
+static void sb_nand_delay(struct sb_nand *sb, ulong ns)
+{
+	sb->array_ns -= min(sb->array_ns, ns);
+	sb->pending_ns += ns;
+	if (sb->pending_ns >= 1000000) {
+		sandbox_timer_add_offset(sb->pending_ns / 1000000);
+		sb->pending_ns %= 1000000;
+	}
+}
+
+static uint sb_nand_raw_size(struct sb_nand *sb)
+{
+	return sb->page_size + sb->oob_size;
+}
+
+static bool sb_nand_is_bad(struct sb_nand *sb, int page)
+{
+	return test_bit(page / sb->ppb, sb->bad_map);
+}
+
+static int sb_nand_load(struct sb_nand *sb, int page)
+{
+	uint size = sb_nand_raw_size(sb);
+
+	if (page < 0 || page >= sb->blocks * sb->ppb)
+		return -EINVAL;
+	if (os_lseek(sb->fd, (off_t)page * size, OS_SEEK_SET) < 0 ||
+	    os_read(sb->fd, sb->page_buf, size) != size)
+		return -EIO;
+
+	return 0;
+}
+
+static int sb_nand_store(struct sb_nand *sb, int page, const u8 *buf,
+			 uint len)
+{
+	if (os_lseek(sb->fd, (off_t)page * sb_nand_raw_size(sb),
+		     OS_SEEK_SET) < 0 ||
+	    os_write(sb->fd, buf, len) != len)
+		return -EIO;
+
+	return 0;
+}
+
+static u32 sb_nand_random(struct sb_nand *sb)
+{
+	/* xorshift32 */
+	sb->rand ^= sb->rand << 13;
+	sb->rand ^= sb->rand >> 17;
+	sb->rand ^= sb->rand << 5;
+
+	return sb->rand;
+}
+
+static void sb_nand_inject_flips(struct sb_nand *sb)
+{
+	uint bit;
+	int i;
+
+	if (!sb->flip_interval || ++sb->reads % sb->flip_interval)
+		return;
+
+	for (i = 0; i < sb->flip_bits; i++) {
+		bit = sb_nand_random(sb) % (sb->page_size * 8);
+		sb->page_buf[bit / 8] ^= 1 << (bit % 8);
+	}
+}
+
+static void sb_nand_read_page(struct sb_nand *sb, int page, uint column)
+{
+	sb->page = page;
+	sb->column = column;
+	sb->output = SB_OUT_PAGE;
+	sb->status = NAND_STATUS_READY | NAND_STATUS_WP;
+
+	if (sb_nand_load(sb, page)) {
+		memset(sb->page_buf, 0, sb_nand_raw_size(sb));
+		sb->status |= NAND_STATUS_FAIL;
+		return;
+	}
+	sb_nand_inject_flips(sb);
+	sb_nand_delay(sb, sb->t_r);
+	sb->seq_page = page;
+}
+
+/*
+ * READ CACHE SEQUENTIAL (31h) and READ CACHE END (3Fh): wait for the array,
+ * move the page it holds to the output, and for 31h start loading the next
+ * page.
+ */
+static void sb_nand_read_cache(struct sb_nand *sb, bool next)
+{
+	sb_nand_delay(sb, sb->array_ns);
+	sb->column = 0;
+	sb->output = SB_OUT_PAGE;
+	sb->status = NAND_STATUS_READY | NAND_STATUS_WP;
+
+	if (sb->page != sb->seq_page) {
+		sb->page = sb->seq_page;
+		if (sb_nand_load(sb, sb->page)) {
+			memset(sb->page_buf, 0, sb_nand_raw_size(sb));
+			sb->status |= NAND_STATUS_FAIL;
+			return;
+		}
+		sb_nand_inject_flips(sb);
+	}
+
+	if (next) {
+		sb->seq_page++;
+		sb->array_ns = sb->t_r;
+	}
+}
+
+static void sb_nand_program(struct sb_nand *sb)
+{
+	uint size = sb_nand_raw_size(sb);
+	u8 *buf = sb->erase_buf;
+	int i;
+
+	sb->status = NAND_STATUS_READY | NAND_STATUS_WP;
+	sb_nand_delay(sb, sb->t_prog);
+
+	if (sb_nand_is_bad(sb, sb->page)) {
+		sb->status |= NAND_STATUS_FAIL;
+		return;
+	}
+
+	/* Programming can only clear bits */
+	if (os_lseek(sb->fd, (off_t)sb->page * size, OS_SEEK_SET) < 0 ||
+	    os_read(sb->fd, buf, size) != size) {
+		sb->status |= NAND_STATUS_FAIL;
+		return;
+	}
+	for (i = 0; i < size; i++)
+		buf[i] &= sb->page_buf[i];
+	if (sb_nand_store(sb, sb->page, buf, size))
+		sb->status |= NAND_STATUS_FAIL;
+}
+
+static void sb_nand_erase(struct sb_nand *sb)
+{
+	int page = sb->page - sb->page % sb->ppb;
+
+	sb->status = NAND_STATUS_READY | NAND_STATUS_WP;
+	sb_nand_delay(sb, sb->t_bers);
+
+	if (page < 0 || page >= sb->blocks * sb->ppb ||
+	    sb_nand_is_bad(sb, page)) {
+		sb->status |= NAND_STATUS_FAIL;
+		return;
+	}
+
+	memset(sb->erase_buf, 0xff, sb->ppb * sb_nand_raw_size(sb));
+	if (sb_nand_store(sb, page, sb->erase_buf,
+			  sb->ppb * sb_nand_raw_size(sb)))
+		sb->status |= NAND_STATUS_FAIL;
+}
+
+/* The ONFI parameter page CRC: CRC-16, polynomial 0x8005, MSB first */
+static u16 sb_nand_onfi_crc16(u16 crc, const u8 *p, size_t len)
+{
+	int i;
+
+	while (len--) {
+		crc ^= *p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^ ((crc & 0x8000) ? 0x8005 : 0);
+	}
+
+	return crc;
+}
+
+static void sb_nand_param_page(struct sb_nand *sb)
+{
+	struct nand_onfi_params *p = (struct nand_onfi_params *)sb->out_buf;
+	int i;
+
+	memset(p, 0, sizeof(*p));
+	memcpy(p->sig, "ONFI", 4);
+	p->revision = cpu_to_le16(1 << 2);	/* ONFI 2.0 */
+	p->opt_cmd = cpu_to_le16(ONFI_OPT_CMD_SET_GET_FEATURES |
+				 (sb->cache && sb->page_size > 512 ?
+				  ONFI_OPT_CMD_READ_CACHE : 0));
+	memcpy(p->manufacturer, "SANDBOX     ", sizeof(p->manufacturer));
+	memcpy(p->model, "SANDBOX NAND        ", sizeof(p->model));
+	p->jedec_id = SB_NAND_MFR_ID;
+	p->byte_per_page = cpu_to_le32(sb->page_size);
+	p->spare_bytes_per_page = cpu_to_le16(sb->oob_size);
+	p->pages_per_block = cpu_to_le32(sb->ppb);
+	p->blocks_per_lun = cpu_to_le32(sb->blocks);
+	p->lun_count = 1;
+	p->addr_cycles = 0x23;
+	p->bits_per_cell = 1;
+	p->programs_per_page = 4;
+	p->ecc_bits = 1;
+	p->async_timing_mode = cpu_to_le16(0x1f);
+	p->t_prog = cpu_to_le16(DIV_ROUND_UP(sb->t_prog, 1000));
+	p->t_bers = cpu_to_le16(DIV_ROUND_UP(sb->t_bers, 1000));
+	p->t_r = cpu_to_le16(DIV_ROUND_UP(sb->t_r, 1000));
+	p->crc = cpu_to_le16(sb_nand_onfi_crc16(ONFI_CRC_BASE, (u8 *)p, 254));
+
+	/* The parameter page is repeated for redundancy */
+	for (i = 1; i < 3; i++)
+		memcpy(sb->out_buf + i * sizeof(*p), p, sizeof(*p));
+	sb->out_len = 3 * sizeof(*p);
+}
+
+static void sb_nand_cmdfunc(struct mtd_info *mtd, unsigned int command,
+			    int column, int page_addr)
+{
+	struct sb_nand *sb = mtd_to_sb_nand(mtd);
+
+	sb->cmd = command;
+	sb->out_pos = 0;
+
+	switch (command) {
+	case NAND_CMD_RESET:
+		sb->output = SB_OUT_NONE;
+		sb->array_ns = 0;
+		sb->status = NAND_STATUS_READY | NAND_STATUS_WP;
+		break;
+
+	case NAND_CMD_READID:
+		sb->output = SB_OUT_BUF;
+		if (column == 0x20) {
+			memcpy(sb->out_buf, "ONFI", 4);
+			sb->out_len = 4;
+		} else {
+			memset(sb->out_buf, 0, 8);
+			sb->out_buf[0] = SB_NAND_MFR_ID;
+			sb->out_buf[1] = SB_NAND_DEV_ID;
+			sb->out_len = 8;
+		}
+		break;
+
+	case NAND_CMD_PARAM:
+		sb->output = SB_OUT_BUF;
+		sb_nand_param_page(sb);
+		sb_nand_delay(sb, sb->t_r);
+		break;
+
+	case NAND_CMD_GET_FEATURES:
+		sb->output = SB_OUT_BUF;
+		memcpy(sb->out_buf, sb->features[column & 0xff],
+		       ONFI_SUBFEATURE_PARAM_LEN);
+		sb->out_len = ONFI_SUBFEATURE_PARAM_LEN;
+		break;
+
+	case NAND_CMD_SET_FEATURES:
+		sb->output = SB_OUT_NONE;
+		sb->feature_addr = column & 0xff;
+		sb->column = 0;
+		break;
+
+	case NAND_CMD_READOOB:
+		sb_nand_read_page(sb, page_addr, sb->page_size + column);
+		break;
+
+	case NAND_CMD_READ0:
+		sb_nand_read_page(sb, page_addr, column);
+		break;
+
+	case NAND_CMD_READCACHESEQ:
+	case NAND_CMD_READCACHEEND:
+		sb_nand_read_cache(sb, command == NAND_CMD_READCACHESEQ);
+		break;
+
+	case NAND_CMD_RNDOUT:
+	case NAND_CMD_RNDIN:
+		sb->column = column;
+		break;
+
+	case NAND_CMD_SEQIN:
+		sb->output = SB_OUT_NONE;
+		sb->page = page_addr;
+		sb->column = column;
+		sb->feature_addr = -1;
+		memset(sb->page_buf, 0xff, sb_nand_raw_size(sb));
+		break;
+
+	case NAND_CMD_PAGEPROG:
+		sb_nand_program(sb);
+		break;
+
+	case NAND_CMD_ERASE1:
+		sb->page = page_addr;
+		break;
+
+	case NAND_CMD_ERASE2:
+		sb_nand_erase(sb);
+		break;
+
+	case NAND_CMD_STATUS:
+		sb->output = SB_OUT_STATUS;
+		break;
+
+	default:
+		debug("%s: unsupported command %#x\n", __func__, command);
+		break;
+	}
+}
+
+static uint8_t sb_nand_read_byte(struct mtd_info *mtd)
+{
+	struct sb_nand *sb = mtd_to_sb_nand(mtd);
+	u8 val = 0xff;
+
+	switch (sb->output) {
+	case SB_OUT_PAGE:
+		if (sb->column < sb_nand_raw_size(sb))
+			val = sb->page_buf[sb->column++];
+		break;
+	case SB_OUT_BUF:
+		if (sb->out_pos < sb->out_len)
+			val = sb->out_buf[sb->out_pos++];
+		break;
+	case SB_OUT_STATUS:
+		val = sb->status;
+		break;
+	default:
+		break;
+	}
+	sb_nand_delay(sb, sb->t_cyc);
+
+	return val;
+}
+
+static void sb_nand_read_buf(struct mtd_info *mtd, uint8_t *buf, int len)
+{
+	struct sb_nand *sb = mtd_to_sb_nand(mtd);
+	uint avail;
+
+	if (sb->output != SB_OUT_PAGE) {
+		while (len--)
+			*buf++ = sb_nand_read_byte(mtd);
+		return;
+	}
+
+	avail = sb_nand_raw_size(sb) - min(sb->column, sb_nand_raw_size(sb));
+	memcpy(buf, sb->page_buf + sb->column, min_t(uint, len, avail));
+	if (len > avail)
+		memset(buf + avail, 0xff, len - avail);
+	sb->column += min_t(uint, len, avail);
+	sb_nand_delay(sb, len * sb->t_cyc);
+}
+
+static void sb_nand_write_buf(struct mtd_info *mtd, const uint8_t *buf,
+			      int len)
+{
+	struct sb_nand *sb = mtd_to_sb_nand(mtd);
+	uint avail;
+
+	sb_nand_delay(sb, len * sb->t_cyc);
+
+	if (sb->cmd == NAND_CMD_SET_FEATURES) {
+		while (len-- && sb->column < ONFI_SUBFEATURE_PARAM_LEN)
+			sb->features[sb->feature_addr][sb->column++] = *buf++;
+		return;
+	}
+
+	avail = sb_nand_raw_size(sb) - min(sb->column, sb_nand_raw_size(sb));
+	memcpy(sb->page_buf + sb->column, buf, min_t(uint, len, avail));
+	sb->column += min_t(uint, len, avail);
+}
+
+static int sb_nand_dev_ready(struct mtd_info *mtd)
+{
+	/* Busy time has already been accounted for */
+	return 1;
+}
+
+static void sb_nand_select_chip(struct mtd_info *mtd, int chipnr)
+{
+}
+
+static int sb_nand_parse_spec(struct sb_nand *sb, const char *spec,
+			      char **fname)
+{
+	char *str, *opt, *val, *next, *dup = NULL;
+	ulong bad;
+
+	sb->page_size = 2048;
+	sb->ppb = 64;
+	sb->blocks = 1024;
+	sb->t_r = 25000;
+	sb->t_prog = 250000;
+	sb->t_bers = 2000000;
+	sb->t_cyc = 25;
+	sb->flip_bits = 1;
+	sb->cache = true;
+	sb->rand = 0x2545f491;
+
+	str = strdup(spec);
+	if (!str)
+		return -ENOMEM;
+	*fname = strsep(&str, ",");
+
+	while ((opt = strsep(&str, ",")) != NULL) {
+		val = strchr(opt, '=');
+		if (!val)
+			goto err;
+		*val++ = '\0';
+
+		if (!strcmp(opt, "page"))
+			sb->page_size = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "ppb"))
+			sb->ppb = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "blocks"))
+			sb->blocks = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "tr"))
+			sb->t_r = simple_strtoul(val, NULL, 0) * 1000;
+		else if (!strcmp(opt, "tprog"))
+			sb->t_prog = simple_strtoul(val, NULL, 0) * 1000;
+		else if (!strcmp(opt, "tbers"))
+			sb->t_bers = simple_strtoul(val, NULL, 0) * 1000;
+		else if (!strcmp(opt, "tcyc"))
+			sb->t_cyc = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "cache"))
+			sb->cache = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "flip"))
+			sb->flip_interval = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "flipbits"))
+			sb->flip_bits = simple_strtoul(val, NULL, 0);
+		else if (!strcmp(opt, "bad"))
+			continue;	/* Needs the geometry, see below */
+		else
+			goto err;
+	}
+
+	if ((sb->page_size != 512 && sb->page_size != 2048 &&
+	     sb->page_size != 4096) || !is_power_of_2(sb->ppb) ||
+	    !is_power_of_2(sb->blocks)) {
+		printf("sandbox_nand: unsupported geometry\n");
+		return -EINVAL;
+	}
+	sb->oob_size = sb->page_size / 32;
+
+	sb->bad_map = calloc(DIV_ROUND_UP(sb->blocks, BITS_PER_LONG), sizeof(ulong));
+	if (!sb->bad_map)
+		return -ENOMEM;
+
+	/* Second pass for the bad block list */
+	str = strdup(spec);
+	if (!str)
+		return -ENOMEM;
+	dup = str;
+	while ((opt = strsep(&str, ",")) != NULL) {
+		if (strncmp(opt, "bad=", 4))
+			continue;
+		for (val = opt + 4; *val; val = next) {
+			bad = simple_strtoul(val, &next, 0);
+			if (next == val || bad >= sb->blocks)
+				goto err;
+			__set_bit(bad, sb->bad_map);
+			if (*next == ':')
+				next++;
+		}
+	}
+	free(dup);
+
+	return 0;
+
+err:
+	printf("sandbox_nand: invalid option '%s'\n", opt);
+	free(dup);
+	return -EINVAL;
+}
+
+/* Size the backing file and write the factory bad block markers */
+static int sb_nand_init_file(struct sb_nand *sb, const char *fname)
+{
+	uint raw = sb_nand_raw_size(sb);
+	uint block_size = sb->ppb * raw;
+	off_t size, want = (off_t)sb->blocks * block_size;
+	uint badpos = sb->page_size > 512 ? NAND_LARGE_BADBLOCK_POS :
+					    NAND_SMALL_BADBLOCK_POS;
+	int i;
+
+	sb->fd = os_open(fname, OS_O_RDWR | OS_O_CREAT);
+	if (sb->fd < 0) {
+		printf("sandbox_nand: cannot open '%s'\n", fname);
+		return -ENOENT;
+	}
+
+	/* Anything not yet in the file is erased */
+	size = os_lseek(sb->fd, 0, OS_SEEK_END);
+	if (size < want) {
+		size -= size % block_size;
+		memset(sb->erase_buf, 0xff, block_size);
+		for (; size < want; size += block_size) {
+			if (os_lseek(sb->fd, size, OS_SEEK_SET) < 0 ||
+			    os_write(sb->fd, sb->erase_buf, block_size) !=
+			    block_size)
+				return -EIO;
+		}
+	}
+
+	for (i = 0; i < sb->blocks; i++) {
+		if (!test_bit(i, sb->bad_map))
+			continue;
+		memset(sb->page_buf, 0xff, raw);
+		sb->page_buf[sb->page_size + badpos] = 0;
+		if (sb_nand_store(sb, i * sb->ppb, sb->page_buf, raw))
+			return -EIO;
+	}
+
+	return 0;
+}
+
+static int sb_nand_init(const char *spec)
+{
+	struct sb_nand *sb;
+	struct mtd_info *mtd;
+	char *fname;
+	int ret;
+
+	sb = calloc(1, sizeof(*sb));
+	if (!sb)
+		return -ENOMEM;
+	sb->fd = -1;
+
+	ret = sb_nand_parse_spec(sb, spec, &fname);
+	if (ret)
+		goto err;
+
+	sb->page_buf = malloc(sb_nand_raw_size(sb));
+	sb->erase_buf = malloc(sb->ppb * sb_nand_raw_size(sb));
+	if (!sb->page_buf || !sb->erase_buf) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	ret = sb_nand_init_file(sb, fname);
+	if (ret)
+		goto err;
+
+	sb->chip.cmdfunc = sb_nand_cmdfunc;
+	sb->chip.read_byte = sb_nand_read_byte;
+	sb->chip.read_buf = sb_nand_read_buf;
+	sb->chip.write_buf = sb_nand_write_buf;
+	sb->chip.dev_ready = sb_nand_dev_ready;
+	sb->chip.select_chip = sb_nand_select_chip;
+	sb->chip.ecc.mode = NAND_ECC_SOFT;
+	/* Cache reads are handled, nand_scan keeps them if advertised */
+	sb->chip.options = NAND_CACHEREAD;
+
+	mtd = nand_to_mtd(&sb->chip);
+	ret = nand_scan(mtd, 1);
+	if (ret)
+		goto err;
+
+	return nand_register(0, mtd);
+
+err:
+	if (sb->fd >= 0)
+		os_close(sb->fd);
+	free(sb->erase_buf);
+	free(sb->page_buf);
+	free(sb->bad_map);
+	free(sb);
+	return ret;
+}
+
+void board_nand_init(void)
+{
+	if (!sb_nand_spec)
+		return;
+
+	if (sb_nand_init(sb_nand_spec))
+		puts("sandbox_nand: init failed\n");
+}
+
+static int sandbox_cmdline_cb_nand(struct sandbox_state *state,
+				   const char *arg)
+{
+	/* The argument comes from the command line so can be kept */
+	sb_nand_spec = arg;
+
+	return 0;
+}
+SANDBOX_CMDLINE_OPT(nand, 1, "connect a NAND flash: <file>[,<opt>=<val>...]");
@@ -90,6 +90,60 @@ static int self_check_ai(struct ubi_device *ubi, struct ubi_attach_info *ai);
 /* Temporary variables used during scanning */
 static struct ubi_ec_hdr *ech;
 static struct ubi_vid_hdr *vidh;
+/* Buffer holding both headers if they are read together, see alloc_hdrs() */
+static void *hdrs;
+
+/**
+ * alloc_hdrs - allocate the header buffers used during scanning.
+ * @ubi: UBI device description object
+ *
+ * When the VID header is in the first min. I/O unit of the PEB, as is the
+ * case with sub-page writes, both headers are read at once into a single
+ * buffer: reading them separately would load the same page twice. Otherwise
+ * separate buffers are used and the VID header is only read when the EC
+ * header shows that the PEB is not empty.
+ *
+ * Returns zero in case of success and %-ENOMEM in case of failure.
+ */
+static int alloc_hdrs(struct ubi_device *ubi)
+{
+	if (ubi->vid_hdr_aloffset < ubi->min_io_size) {
+		hdrs = kzalloc(ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize,
+			       GFP_KERNEL);
+		if (!hdrs)
+			return -ENOMEM;
+		ech = hdrs;
+		vidh = hdrs + ubi->vid_hdr_offset;
+		return 0;
+	}
+
+	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	if (!ech)
+		return -ENOMEM;
+
+	vidh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vidh) {
+		kfree(ech);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * free_hdrs - free the header buffers allocated by alloc_hdrs().
+ * @ubi: UBI device description object
+ */
+static void free_hdrs(struct ubi_device *ubi)
+{
+	if (hdrs) {
+		kfree(hdrs);
+		hdrs = NULL;
+	} else {
+		ubi_free_vid_hdr(ubi, vidh);
+		kfree(ech);
+	}
+}
 
 /**
  * add_to_list - add physical eraseblock to a list.
@@ -816,7 +870,7 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		    int pnum, int *vid, unsigned long long *sqnum)
 {
 	long long uninitialized_var(ec);
-	int err, bitflips = 0, vol_id = -1, ec_err = 0;
+	int err, bitflips = 0, vol_id = -1, ec_err = 0, read_err = 0;
 
 	dbg_bld("scan PEB %d", pnum);
 
@@ -829,7 +883,14 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		return 0;
 	}
 
-	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	ubi->attach_stats.scanned_pebs += 1;
+	ubi->attach_stats.hdr_reads += 1;
+	if (hdrs) {
+		read_err = ubi_io_read_hdrs(ubi, pnum, hdrs);
+		err = ubi_io_check_ec_hdr(ubi, pnum, ech, read_err, 0);
+	} else {
+		err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	}
 	if (err < 0)
 		return err;
 	switch (err) {
@@ -912,7 +973,12 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 
 	/* OK, we've done with the EC header, let's look at the VID header */
 
-	err = ubi_io_read_vid_hdr(ubi, pnum, vidh, 0);
+	if (hdrs) {
+		err = ubi_io_check_vid_hdr(ubi, pnum, vidh, read_err, 0);
+	} else {
+		ubi->attach_stats.hdr_reads += 1;
+		err = ubi_io_read_vid_hdr(ubi, pnum, vidh, 0);
+	}
 	if (err < 0)
 		return err;
 	switch (err) {
@@ -1229,23 +1295,17 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 	struct ubi_ainf_volume *av;
 	struct ubi_ainf_peb *aeb;
 
-	err = -ENOMEM;
-
-	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
-	if (!ech)
+	err = alloc_hdrs(ubi);
+	if (err)
 		return err;
 
-	vidh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
-	if (!vidh)
-		goto out_ech;
-
 	for (pnum = start; pnum < ubi->peb_count; pnum++) {
 		cond_resched();
 
 		dbg_gen("process PEB %d", pnum);
 		err = scan_peb(ubi, ai, pnum, NULL, NULL);
 		if (err < 0)
-			goto out_vidh;
+			goto out_hdrs;
 	}
 
 	ubi_msg(ubi, "scanning is finished");
@@ -1256,7 +1316,7 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 
 	err = late_analysis(ubi, ai);
 	if (err)
-		goto out_vidh;
+		goto out_hdrs;
 
 	/*
 	 * In case of unknown erase counter we use the mean erase counter
@@ -1282,18 +1342,9 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 			aeb->ec = ai->mean_ec;
 
 	err = self_check_ai(ubi, ai);
-	if (err)
-		goto out_vidh;
 
-	ubi_free_vid_hdr(ubi, vidh);
-	kfree(ech);
-
-	return 0;
-
-out_vidh:
-	ubi_free_vid_hdr(ubi, vidh);
-out_ech:
-	kfree(ech);
+out_hdrs:
+	free_hdrs(ubi);
 	return err;
 }
 
@@ -1338,15 +1389,9 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 	int err, pnum, fm_anchor = -1;
 	unsigned long long max_sqnum = 0;
 
-	err = -ENOMEM;
-
-	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
-	if (!ech)
-		goto out;
-
-	vidh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
-	if (!vidh)
-		goto out_ech;
+	err = alloc_hdrs(ubi);
+	if (err)
+		return err;
 
 	for (pnum = 0; pnum < UBI_FM_MAX_START; pnum++) {
 		int vol_id = -1;
@@ -1356,7 +1401,7 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 		dbg_gen("process PEB %d", pnum);
 		err = scan_peb(ubi, *ai, pnum, &vol_id, &sqnum);
 		if (err < 0)
-			goto out_vidh;
+			goto out_hdrs;
 
 		if (vol_id == UBI_FM_SB_VOLUME_ID && sqnum > max_sqnum) {
 			max_sqnum = sqnum;
@@ -1364,8 +1409,7 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 		}
 	}
 
-	ubi_free_vid_hdr(ubi, vidh);
-	kfree(ech);
+	free_hdrs(ubi);
 
 	if (fm_anchor < 0)
 		return UBI_NO_FASTMAP;
@@ -1377,11 +1421,8 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 
 	return ubi_scan_fastmap(ubi, *ai, fm_anchor);
 
-out_vidh:
-	ubi_free_vid_hdr(ubi, vidh);
-out_ech:
-	kfree(ech);
-out:
+out_hdrs:
+	free_hdrs(ubi);
 	return err;
 }
 
@@ -1399,6 +1440,9 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 {
 	int err;
 	struct ubi_attach_info *ai;
+	unsigned long start = get_timer(0);
+
+	memset(&ubi->attach_stats, 0, sizeof(ubi->attach_stats));
 
 	ai = alloc_ai();
 	if (!ai)
@@ -1439,6 +1483,9 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	ubi->corr_peb_count = ai->corr_peb_count;
 	ubi->max_ec = ai->max_ec;
 	ubi->mean_ec = ai->mean_ec;
+	ubi->attach_stats.empty_pebs = ai->empty_peb_count;
+	ubi->attach_stats.corr_pebs = ai->corr_peb_count;
+	ubi->attach_stats.fastmap = !!ubi->fm;
 	dbg_gen("max. sequence number:       %llu", ai->max_sqnum);
 
 	err = ubi_read_volume_table(ubi, ai);
@@ -1477,7 +1524,22 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	}
 #endif
 
+	/*
+	 * The VID headers of the PEBs used according to the fastmap have not
+	 * been read, they are checked when first read from instead.
+	 */
+	if (ubi->fm) {
+		ubi->fm_checked = kzalloc(DIV_ROUND_UP(ubi->peb_count,
+						       BITS_PER_LONG) *
+					  sizeof(unsigned long), GFP_KERNEL);
+		if (!ubi->fm_checked) {
+			err = -ENOMEM;
+			goto out_wl;
+		}
+	}
+
 	destroy_ai(ai);
+	ubi->attach_stats.time_ms = get_timer(start);
 	return 0;
 
 out_wl:
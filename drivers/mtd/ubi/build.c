@@ -1062,12 +1062,19 @@ int ubi_attach_mtd_dev(struct mtd_info *mtd, int ubi_num,
 #else
 	/*
 	 * U-Boot special: We have no bgt_thread in U-Boot!
-	 * So just call do_work() here directly.
+	 * So just run the works queued during attach here directly. When
+	 * attached from a fastmap they are left queued instead, so that only
+	 * reading the device does not write to it; they run as further works
+	 * get scheduled by writes.
 	 */
-	err = do_work(ubi);
-	if (err) {
-		ubi_err(ubi, "%s: work failed with error code %d",
-			ubi->bgt_name, err);
+	if (!ubi->fm) {
+		do {
+			err = do_work(ubi);
+		} while (!err && ubi->works_count);
+		if (err) {
+			ubi_err(ubi, "%s: work failed with error code %d",
+				ubi->bgt_name, err);
+		}
 	}
 #endif
 
@@ -1090,6 +1097,7 @@ out_detach:
 out_free:
 	vfree(ubi->peb_buf);
 	vfree(ubi->fm_buf);
+	kfree(ubi->fm_checked);
 	if (ref)
 		put_device(&ubi->dev);
 	else
@@ -1169,6 +1177,7 @@ int ubi_detach_mtd_dev(int ubi_num, int anyway)
 	put_mtd_device(ubi->mtd);
 	vfree(ubi->peb_buf);
 	vfree(ubi->fm_buf);
+	kfree(ubi->fm_checked);
 	ubi_msg(ubi, "mtd%d is detached", ubi->mtd->index);
 	put_device(&ubi->dev);
 	return 0;
@@ -343,6 +343,53 @@ out_unlock:
 	return err;
 }
 
+/**
+ * check_fm_mapping - check a LEB to PEB mapping taken from the fastmap.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock the LEB is mapped to
+ * @vol_id: volume ID
+ * @lnum: logical eraseblock number
+ *
+ * When attaching from a fastmap, the VID headers of the PEBs it lists as used
+ * are not read. This function reads the VID header of @pnum the first time
+ * the PEB is read from and makes sure that it belongs to LEB @lnum of volume
+ * @vol_id. Returns zero if it does, and a negative error code if not or in
+ * case of failure.
+ */
+static int check_fm_mapping(struct ubi_device *ubi, int pnum, int vol_id,
+			    int lnum)
+{
+	struct ubi_vid_hdr *vid_hdr;
+	int err;
+
+	if (test_bit(pnum, ubi->fm_checked))
+		return 0;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 1);
+	if (err == UBI_IO_BITFLIPS)
+		err = 0;
+	if (err > 0) {
+		ubi_err(ubi, "no valid VID header at PEB %d, mapped to LEB %d:%d by fastmap",
+			pnum, vol_id, lnum);
+		err = -EBADMSG;
+	} else if (!err && (be32_to_cpu(vid_hdr->vol_id) != vol_id ||
+			    be32_to_cpu(vid_hdr->lnum) != lnum)) {
+		ubi_err(ubi, "PEB %d holds LEB %d:%d, mapped to LEB %d:%d by fastmap",
+			pnum, be32_to_cpu(vid_hdr->vol_id),
+			be32_to_cpu(vid_hdr->lnum), vol_id, lnum);
+		err = -EINVAL;
+	}
+	if (!err)
+		__set_bit(pnum, ubi->fm_checked);
+
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return err;
+}
+
 /**
  * ubi_eba_read_leb - read data.
  * @ubi: UBI device description object
@@ -394,6 +441,12 @@ int ubi_eba_read_leb(struct ubi_device *ubi, struct ubi_volume *vol, int lnum,
 	if (vol->vol_type == UBI_DYNAMIC_VOLUME)
 		check = 0;
 
+	if (ubi->fm_checked) {
+		err = check_fm_mapping(ubi, pnum, vol_id, lnum);
+		if (err)
+			goto out_unlock;
+	}
+
 retry:
 	if (check) {
 		vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
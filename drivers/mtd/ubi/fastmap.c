@@ -1497,6 +1497,14 @@ int ubi_update_fastmap(struct ubi_device *ubi)
 	struct ubi_fastmap_layout *new_fm, *old_fm;
 	struct ubi_wl_entry *tmp_e;
 
+	/*
+	 * Nothing was written since the fastmap on flash was read or written,
+	 * so it still describes the device. This keeps attaching from a
+	 * fastmap and detaching again free of writes.
+	 */
+	if (ubi->fm && !ubi->fm_dirty)
+		return 0;
+
 	down_write(&ubi->fm_protect);
 
 	ubi_refill_pools(ubi);
@@ -1631,6 +1639,8 @@ int ubi_update_fastmap(struct ubi_device *ubi)
 	if (ret)
 		goto err;
 
+	ubi->fm_dirty = 0;
+
 out_unlock:
 	up_write(&ubi->fm_protect);
 	kfree(old_fm);
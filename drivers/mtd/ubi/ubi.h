@@ -412,6 +412,24 @@ struct ubi_debug_info {
 	struct dentry *dfs_power_cut_max;
 };
 
+/**
+ * struct ubi_attach_stats - statistics of attaching an MTD device.
+ * @time_ms: how long 'ubi_attach()' took, in milliseconds
+ * @scanned_pebs: count of PEBs whose headers were read
+ * @hdr_reads: count of flash reads issued for EC and VID headers
+ * @empty_pebs: count of PEBs found empty
+ * @corr_pebs: count of PEBs found corrupted
+ * @fastmap: non-zero if the device was attached from a fastmap
+ */
+struct ubi_attach_stats {
+	unsigned long time_ms;
+	int scanned_pebs;
+	int hdr_reads;
+	int empty_pebs;
+	int corr_pebs;
+	int fastmap;
+};
+
 /**
  * struct ubi_device - UBI device description structure
  * @dev: UBI device object to use the the Linux device model
@@ -463,6 +481,10 @@ struct ubi_debug_info {
  * @fm_eba_sem: allows ubi_update_fastmap() to block EBA table changes
  * @fm_work: fastmap work queue
  * @fm_work_scheduled: non-zero if fastmap work was scheduled
+ * @fm_dirty: non-zero if the flash was written since the fastmap on it was
+ *	      read or written
+ * @fm_checked: bitmap of PEBs whose VID header was checked against the
+ *		mapping taken from the fastmap, %NULL if not attached by fastmap
  *
  * @used: RB-tree of used physical eraseblocks
  * @erroneous: RB-tree of erroneous used physical eraseblocks
@@ -526,6 +548,7 @@ struct ubi_debug_info {
  * @ckvol_mutex: serializes static volume checking when opening
  *
  * @dbg: debugging information for this UBI device
+ * @attach_stats: statistics of attaching the MTD device
  */
 struct ubi_device {
 	struct cdev cdev;
@@ -573,6 +596,8 @@ struct ubi_device {
 	struct work_struct fm_work;
 #endif
 	int fm_work_scheduled;
+	int fm_dirty;
+	unsigned long *fm_checked;
 
 	/* Wear-leveling sub-system's stuff */
 	struct rb_root used;
@@ -625,6 +650,7 @@ struct ubi_device {
 	struct mutex ckvol_mutex;
 
 	struct ubi_debug_info dbg;
+	struct ubi_attach_stats attach_stats;
 };
 
 /**
@@ -889,10 +915,16 @@ int ubi_io_is_bad(const struct ubi_device *ubi, int pnum);
 int ubi_io_mark_bad(const struct ubi_device *ubi, int pnum);
 int ubi_io_read_ec_hdr(struct ubi_device *ubi, int pnum,
 		       struct ubi_ec_hdr *ec_hdr, int verbose);
+int ubi_io_check_ec_hdr(struct ubi_device *ubi, int pnum,
+			struct ubi_ec_hdr *ec_hdr, int read_err, int verbose);
 int ubi_io_write_ec_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_ec_hdr *ec_hdr);
 int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_vid_hdr *vid_hdr, int verbose);
+int ubi_io_check_vid_hdr(struct ubi_device *ubi, int pnum,
+			 struct ubi_vid_hdr *vid_hdr, int read_err,
+			 int verbose);
+int ubi_io_read_hdrs(struct ubi_device *ubi, int pnum, void *buf);
 int ubi_io_write_vid_hdr(struct ubi_device *ubi, int pnum,
 			 struct ubi_vid_hdr *vid_hdr);
 
@@ -549,12 +549,17 @@ static void __schedule_ubi_work(struct ubi_device *ubi, struct ubi_work *wrk)
 	int err;
 	/*
 	 * U-Boot special: We have no bgt_thread in U-Boot!
-	 * So just call do_work() here directly.
+	 * So just call do_work() here directly. Works scheduled while the
+	 * device is still being attached (e.g. scrubbing a PEB with bit-flips
+	 * found by the scan) must wait, as the EBA tables do not exist yet.
+	 * They are run once ubi_attach_mtd_dev() sets @thread_enabled.
 	 */
-	err = do_work(ubi);
-	if (err) {
-		ubi_err(ubi, "%s: work failed with error code %d",
-			ubi->bgt_name, err);
+	if (ubi->thread_enabled) {
+		err = do_work(ubi);
+		if (err) {
+			ubi_err(ubi, "%s: work failed with error code %d",
+				ubi->bgt_name, err);
+		}
 	}
 #endif
 	spin_unlock(&ubi->wl_lock);
@@ -0,0 +1,1518 @@
+/*
+ * btrfs.c
+ *
+ * R/O Btrfs filesystem implementation
+ *
+ * Everything in Btrfs lives in B-trees of fixed size blocks addressed by
+ * logical byte numbers, which the chunk tree maps onto the device. The
+ * root tree holds one tree per subvolume; a subvolume tree holds the
+ * inodes, directory entries and file extents of the files in it. Only
+ * filesystems on a single device, or mirrored ones read from one of their
+ * devices, are supported.
+ *
+ * The chunk map is read in full when the filesystem is mounted and kept
+ * sorted for lookups, and recently used tree blocks are kept in a small
+ * LRU cache. The extent items of the file read last are kept too, so that
+ * reading a file in pieces does not walk its tree again, and are used to
+ * merge runs of uncompressed extents lying one after the other on the
+ * device into a single device read straight into the destination buffer.
+ * Compressed extents are fetched from the device in requests spanning as
+ * many of them as the read buffer holds, and the one decompressed last is
+ * kept in case the next read starts where the previous one stopped.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <btrfs.h>
+#include <fs.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <part.h>
+#include <asm/unaligned.h>
+#include <linux/log2.h>
+#include <linux/lzo.h>
+#include <u-boot/crc.h>
+#include <u-boot/zstd.h>
+
+/* Directory levels remembered to resolve "..", and symlinks followed */
+#define BTRFS_MAX_DEPTH		32
+#define BTRFS_MAX_LINKS		8
+#define BTRFS_MAX_SYMLINK	4096
+/* Segments of LZO compressed extents start with their length */
+#define BTRFS_LZO_LEN		4
+/* Btrfs writes zstd frames with windows of at most 128 KiB */
+#define BTRFS_ZSTD_WINDOWLOG	17
+
+struct btrfs_key {
+	u64 objectid;
+	u8 type;
+	u64 offset;
+};
+
+/* A logical range of a chunk and where it is stored on our device */
+struct btrfs_chunk_map {
+	u64 logical;
+	u64 length;
+	u64 physical;
+};
+
+struct btrfs_node_cache {
+	u64 bytenr;		/* Logical address of the block, or -1 */
+	u32 used;		/* LRU stamp */
+	u8 *data;
+};
+
+/* Position in a tree: the block and slot at every level */
+struct btrfs_path {
+	u64 nodes[BTRFS_MAX_LEVEL];
+	u32 slots[BTRFS_MAX_LEVEL];
+	int level;		/* Level of the root block */
+};
+
+struct btrfs_root {
+	u64 objectid;
+	u64 bytenr;
+	u8 level;
+};
+
+struct btrfs_inode {
+	struct btrfs_root root;
+	u64 ino;
+	u64 size;
+	u32 mode;
+};
+
+struct btrfs_extent {
+	u64 file_off;		/* Offset in the file */
+	u64 len;		/* Bytes of the file it covers */
+	u64 disk_bytenr;	/* Logical address of the data, 0 for holes */
+	u64 disk_len;		/* Bytes stored on disk or inline */
+	u64 offset;		/* Offset of file_off in the decoded data */
+	u64 ram_bytes;		/* Size of the decoded data */
+	u8 type;
+	u8 comp;
+	u8 *inline_data;
+};
+
+static struct blk_desc *cur_dev;
+static disk_partition_t cur_part_info;
+
+static struct {
+	u64 devid;
+	u32 sectorsize;
+	u32 nodesize;
+	u16 csum_type;
+	struct btrfs_root tree_root;
+	struct btrfs_root fs_root;	/* Default subvolume */
+	u64 root_dirid;
+	struct btrfs_chunk_map *chunks;
+	int nr_chunks;
+	int max_chunks;
+	struct btrfs_node_cache *nodes;
+	int nr_nodes;
+	u32 clock;
+	u8 *rbuf;		/* Data read from the device */
+	u32 rbuf_blks;
+	lbaint_t rbuf_blk;	/* First block held in rbuf, or -1 */
+	u32 rbuf_cnt;		/* Number of blocks held in rbuf */
+	/* Extent items of the file read last */
+	u64 ext_root;
+	u64 ext_ino;
+	struct btrfs_extent *exts;
+	int nr_exts;
+	/* Compressed extent decompressed last */
+	u64 dec_bytenr;
+	u32 dec_len;
+	u8 *dec_buf;
+	void *zstd_ws;		/* Allocated on the first zstd extent */
+} btrfs;
+
+/*
+ * Return a pointer to len bytes at device offset pos, read into rbuf along
+ * with up to ahead more bytes that the caller is going to ask for next.
+ */
+static u8 *btrfs_read_raw(u64 pos, u32 len, u64 ahead)
+{
+	int log2blksz = cur_dev->log2blksz;
+	lbaint_t blk = pos >> log2blksz;
+	u32 lead = pos & (cur_dev->blksz - 1);
+	u64 want;
+	lbaint_t n;
+
+	if (btrfs.rbuf_blk != (lbaint_t)-1 && blk >= btrfs.rbuf_blk &&
+	    pos + len <= (u64)(btrfs.rbuf_blk + btrfs.rbuf_cnt) << log2blksz)
+		return btrfs.rbuf + (pos - ((u64)btrfs.rbuf_blk << log2blksz));
+
+	n = DIV_ROUND_UP((u64)lead + len, cur_dev->blksz);
+	if (n > btrfs.rbuf_blks || blk + n > cur_part_info.size)
+		return NULL;
+	want = DIV_ROUND_UP((u64)lead + len + ahead, cur_dev->blksz);
+	n = min_t(u64, max_t(u64, n, want), btrfs.rbuf_blks);
+	n = min_t(u64, n, cur_part_info.size - blk);
+
+	btrfs.rbuf_blk = -1;
+	if (blk_dread(cur_dev, cur_part_info.start + blk, n, btrfs.rbuf) != n)
+		return NULL;
+	btrfs.rbuf_blk = blk;
+	btrfs.rbuf_cnt = n;
+
+	return btrfs.rbuf + lead;
+}
+
+/*
+ * Copy len bytes at device offset pos into buf. Whole blocks are read
+ * straight into buf when it is suitably aligned, so a long run of file
+ * data takes a single device request.
+ */
+static int btrfs_read_bytes(u64 pos, void *buf, u64 len)
+{
+	u32 max = (btrfs.rbuf_blks - 1) << cur_dev->log2blksz;
+	int log2blksz = cur_dev->log2blksz;
+	u8 *dst = buf;
+	lbaint_t blk, n;
+	u64 chunk;
+	u8 *src;
+
+	while (len) {
+		blk = pos >> log2blksz;
+		if (!(pos & (cur_dev->blksz - 1)) && len >= cur_dev->blksz &&
+		    !((ulong)dst & (ARCH_DMA_MINALIGN - 1))) {
+			n = len >> log2blksz;
+			if (blk + n > cur_part_info.size)
+				return -EIO;
+			if (blk_dread(cur_dev, cur_part_info.start + blk, n,
+				      dst) != n)
+				return -EIO;
+			chunk = (u64)n << log2blksz;
+		} else {
+			chunk = min_t(u64, len, max);
+			src = btrfs_read_raw(pos, chunk, 0);
+			if (!src)
+				return -EIO;
+			memcpy(dst, src, chunk);
+		}
+		dst += chunk;
+		pos += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int btrfs_comp_keys(const struct btrfs_disk_key *disk,
+			   const struct btrfs_key *key)
+{
+	u64 objectid = le64_to_cpu(disk->objectid);
+	u64 offset = le64_to_cpu(disk->offset);
+
+	if (objectid != key->objectid)
+		return objectid < key->objectid ? -1 : 1;
+	if (disk->type != key->type)
+		return disk->type < key->type ? -1 : 1;
+	if (offset != key->offset)
+		return offset < key->offset ? -1 : 1;
+
+	return 0;
+}
+
+static void btrfs_disk_key_to_cpu(const struct btrfs_disk_key *disk,
+				  struct btrfs_key *key)
+{
+	key->objectid = le64_to_cpu(disk->objectid);
+	key->type = disk->type;
+	key->offset = le64_to_cpu(disk->offset);
+}
+
+/* Return the device offset of len bytes at logical address, or -1 */
+static u64 btrfs_map(u64 logical, u64 len)
+{
+	struct btrfs_chunk_map *c;
+	int lo = 0, hi = btrfs.nr_chunks, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (btrfs.chunks[mid].logical <= logical)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return -1ULL;
+
+	c = &btrfs.chunks[lo - 1];
+	if (logical + len > c->logical + c->length)
+		return -1ULL;
+
+	return c->physical + logical - c->logical;
+}
+
+/* Add a chunk item to the chunk map, keeping it sorted */
+static int btrfs_add_chunk(u64 logical, const struct btrfs_chunk *chunk,
+			   u32 size)
+{
+	struct btrfs_chunk_map *c;
+	u16 num_stripes;
+	u64 physical = -1ULL;
+	int i;
+
+	if (size < sizeof(*chunk))
+		return -EINVAL;
+	num_stripes = le16_to_cpu(chunk->num_stripes);
+	if (!num_stripes ||
+	    size < sizeof(*chunk) + num_stripes * sizeof(chunk->stripe[0]))
+		return -EINVAL;
+	if (le64_to_cpu(chunk->type) & BTRFS_BLOCK_GROUP_STRIPED) {
+		printf("Btrfs: striped chunk profiles are not supported\n");
+		return -EOPNOTSUPP;
+	}
+
+	/* Any copy of a mirrored chunk will do, but it must be on our device */
+	for (i = 0; i < num_stripes; i++) {
+		if (le64_to_cpu(chunk->stripe[i].devid) == btrfs.devid) {
+			physical = le64_to_cpu(chunk->stripe[i].offset);
+			break;
+		}
+	}
+	if (physical == -1ULL)
+		return 0;
+
+	for (i = 0; i < btrfs.nr_chunks; i++) {
+		if (btrfs.chunks[i].logical == logical)
+			return 0;
+		if (btrfs.chunks[i].logical > logical)
+			break;
+	}
+
+	if (btrfs.nr_chunks == btrfs.max_chunks) {
+		c = realloc(btrfs.chunks,
+			    (btrfs.max_chunks + 16) * sizeof(*c));
+		if (!c)
+			return -ENOMEM;
+		btrfs.chunks = c;
+		btrfs.max_chunks += 16;
+	}
+	memmove(&btrfs.chunks[i + 1], &btrfs.chunks[i],
+		(btrfs.nr_chunks - i) * sizeof(*c));
+	btrfs.nr_chunks++;
+	c = &btrfs.chunks[i];
+	c->logical = logical;
+	c->length = le64_to_cpu(chunk->length);
+	c->physical = physical;
+
+	return 0;
+}
+
+static bool btrfs_csum_ok(const u8 *buf, u32 len)
+{
+	u32 crc;
+
+	/* Newer checksum types are not verified */
+	if (btrfs.csum_type != BTRFS_CSUM_TYPE_CRC32)
+		return true;
+
+	crc = ~crc32c(~0, buf + BTRFS_CSUM_SIZE, len - BTRFS_CSUM_SIZE);
+
+	return get_unaligned_le32(buf) == crc;
+}
+
+/* Return the tree block at logical address bytenr, reading it if needed */
+static struct btrfs_header *btrfs_read_node(u64 bytenr)
+{
+	struct btrfs_node_cache *victim = NULL, *e;
+	struct btrfs_header *hdr;
+	u32 nritems, max;
+	u64 pos;
+	int i;
+
+	for (i = 0, e = btrfs.nodes; i < btrfs.nr_nodes; i++, e++) {
+		if (e->bytenr == bytenr) {
+			e->used = ++btrfs.clock;
+			return (struct btrfs_header *)e->data;
+		}
+		if (!victim || e->used < victim->used)
+			victim = e;
+	}
+
+	pos = btrfs_map(bytenr, btrfs.nodesize);
+	if (pos == -1ULL)
+		return NULL;
+	if (!victim->data) {
+		victim->data = malloc_cache_aligned(btrfs.nodesize);
+		if (!victim->data)
+			return NULL;
+	}
+	victim->bytenr = -1ULL;
+	if (btrfs_read_bytes(pos, victim->data, btrfs.nodesize))
+		return NULL;
+
+	hdr = (struct btrfs_header *)victim->data;
+	nritems = le32_to_cpu(hdr->nritems);
+	max = (btrfs.nodesize - sizeof(*hdr)) /
+	      (hdr->level ? sizeof(struct btrfs_key_ptr) :
+			    sizeof(struct btrfs_item));
+	if (le64_to_cpu(hdr->bytenr) != bytenr ||
+	    hdr->level >= BTRFS_MAX_LEVEL || nritems > max ||
+	    !btrfs_csum_ok(victim->data, btrfs.nodesize)) {
+		printf("Btrfs: bad tree block at %llu\n", bytenr);
+		return NULL;
+	}
+	victim->bytenr = bytenr;
+	victim->used = ++btrfs.clock;
+
+	return hdr;
+}
+
+/* Return the data of the item at slot in a leaf, checking its bounds */
+static void *btrfs_item_ptr(struct btrfs_header *leaf, u32 slot,
+			    struct btrfs_key *key, u32 *size)
+{
+	struct btrfs_item *item = (struct btrfs_item *)(leaf + 1) + slot;
+	u32 offset = le32_to_cpu(item->offset);
+	u32 len = le32_to_cpu(item->size);
+
+	if (offset > btrfs.nodesize - sizeof(*leaf) ||
+	    len > btrfs.nodesize - sizeof(*leaf) - offset)
+		return NULL;
+	if (key)
+		btrfs_disk_key_to_cpu(&item->key, key);
+	*size = len;
+
+	return (u8 *)(leaf + 1) + offset;
+}
+
+/* Move the path to the first item of the next leaf */
+static int btrfs_next_leaf(struct btrfs_path *path)
+{
+	struct btrfs_header *hdr;
+	struct btrfs_key_ptr *ptr;
+	u64 bytenr;
+	int level;
+
+	do {
+		for (level = 1; level <= path->level; level++) {
+			hdr = btrfs_read_node(path->nodes[level]);
+			if (!hdr)
+				return -EIO;
+			if (path->slots[level] + 1 < le32_to_cpu(hdr->nritems))
+				break;
+		}
+		if (level > path->level)
+			return -ENOENT;
+
+		path->slots[level]++;
+		while (level) {
+			hdr = btrfs_read_node(path->nodes[level]);
+			if (!hdr)
+				return -EIO;
+			ptr = (struct btrfs_key_ptr *)(hdr + 1) +
+			      path->slots[level];
+			bytenr = le64_to_cpu(ptr->blockptr);
+			hdr = btrfs_read_node(bytenr);
+			if (!hdr || hdr->level != --level)
+				return -EIO;
+			path->nodes[level] = bytenr;
+			path->slots[level] = 0;
+		}
+	} while (!le32_to_cpu(hdr->nritems));
+
+	return 0;
+}
+
+static int btrfs_next_item(struct btrfs_path *path)
+{
+	struct btrfs_header *leaf;
+
+	leaf = btrfs_read_node(path->nodes[0]);
+	if (!leaf)
+		return -EIO;
+	if (++path->slots[0] < le32_to_cpu(leaf->nritems))
+		return 0;
+
+	return btrfs_next_leaf(path);
+}
+
+/*
+ * Position the path on the first item of the tree not less than key.
+ * Returns -ENOENT when there is none.
+ */
+static int btrfs_search(const struct btrfs_root *root,
+			const struct btrfs_key *key, struct btrfs_path *path)
+{
+	struct btrfs_header *hdr;
+	struct btrfs_key_ptr *ptrs;
+	struct btrfs_item *items;
+	u64 bytenr = root->bytenr;
+	int level = root->level;
+	u32 lo, hi, mid, n;
+
+	path->level = level;
+	for (;;) {
+		hdr = btrfs_read_node(bytenr);
+		if (!hdr || hdr->level != level)
+			return -EIO;
+		n = le32_to_cpu(hdr->nritems);
+		path->nodes[level] = bytenr;
+
+		if (!level) {
+			items = (struct btrfs_item *)(hdr + 1);
+			lo = 0;
+			hi = n;
+			while (lo < hi) {
+				mid = (lo + hi) / 2;
+				if (btrfs_comp_keys(&items[mid].key, key) < 0)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			path->slots[0] = lo;
+			if (lo < n)
+				return 0;
+			return btrfs_next_leaf(path);
+		}
+
+		/* Follow the last pointer not greater than the key */
+		if (!n)
+			return -EIO;
+		ptrs = (struct btrfs_key_ptr *)(hdr + 1);
+		lo = 0;
+		hi = n;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (btrfs_comp_keys(&ptrs[mid].key, key) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		path->slots[level] = lo ? lo - 1 : 0;
+		bytenr = le64_to_cpu(ptrs[path->slots[level]].blockptr);
+		level--;
+	}
+}
+
+/*
+ * Return the data of the item the path is on. The pointer is only valid
+ * until the next tree block is read.
+ */
+static void *btrfs_path_item(struct btrfs_path *path, struct btrfs_key *key,
+			     u32 *size)
+{
+	struct btrfs_header *leaf;
+
+	leaf = btrfs_read_node(path->nodes[0]);
+	if (!leaf)
+		return NULL;
+
+	return btrfs_item_ptr(leaf, path->slots[0], key, size);
+}
+
+/* Find the item with exactly this key */
+static void *btrfs_lookup_item(const struct btrfs_root *root,
+			       const struct btrfs_key *key, u32 *size)
+{
+	struct btrfs_path path;
+	struct btrfs_key found;
+	void *data;
+
+	if (btrfs_search(root, key, &path))
+		return NULL;
+	data = btrfs_path_item(&path, &found, size);
+	if (!data || found.objectid != key->objectid ||
+	    found.type != key->type || found.offset != key->offset)
+		return NULL;
+
+	return data;
+}
+
+static int btrfs_read_root(u64 objectid, struct btrfs_root *root,
+			   u64 *dirid)
+{
+	struct btrfs_root_item *ri;
+	struct btrfs_path path;
+	struct btrfs_key key = {
+		.objectid = objectid,
+		.type = BTRFS_ROOT_ITEM_KEY,
+	};
+	u32 size;
+
+	/* Snapshots have their creation transaction as offset */
+	if (btrfs_search(&btrfs.tree_root, &key, &path))
+		return -ENOENT;
+	ri = btrfs_path_item(&path, &key, &size);
+	if (!ri || key.objectid != objectid || key.type != BTRFS_ROOT_ITEM_KEY)
+		return -ENOENT;
+	if (size < offsetof(struct btrfs_root_item, level) + 1)
+		return -EINVAL;
+
+	root->objectid = objectid;
+	root->bytenr = le64_to_cpu(ri->bytenr);
+	root->level = ri->level;
+	if (dirid)
+		*dirid = le64_to_cpu(ri->root_dirid);
+
+	return 0;
+}
+
+static int btrfs_read_inode(const struct btrfs_root *root, u64 ino,
+			    struct btrfs_inode *inode)
+{
+	struct btrfs_inode_item *ii;
+	struct btrfs_key key = {
+		.objectid = ino,
+		.type = BTRFS_INODE_ITEM_KEY,
+		.offset = 0,
+	};
+	u32 size;
+
+	ii = btrfs_lookup_item(root, &key, &size);
+	if (!ii || size < sizeof(*ii))
+		return -ENOENT;
+
+	inode->root = *root;
+	inode->ino = ino;
+	inode->size = le64_to_cpu(ii->size);
+	inode->mode = le32_to_cpu(ii->mode);
+
+	return 0;
+}
+
+static inline bool btrfs_is_dir(struct btrfs_inode *inode)
+{
+	return (inode->mode & BTRFS_S_IFMT) == BTRFS_S_IFDIR;
+}
+
+static inline bool btrfs_is_reg(struct btrfs_inode *inode)
+{
+	return (inode->mode & BTRFS_S_IFMT) == BTRFS_S_IFREG;
+}
+
+static inline bool btrfs_is_symlink(struct btrfs_inode *inode)
+{
+	return (inode->mode & BTRFS_S_IFMT) == BTRFS_S_IFLNK;
+}
+
+/* Read the inode a directory entry points to, entering subvolumes */
+static int btrfs_read_entry(const struct btrfs_root *root,
+			    const struct btrfs_disk_key *location,
+			    struct btrfs_inode *inode)
+{
+	struct btrfs_root subvol;
+	u64 dirid;
+	int ret;
+
+	if (location->type != BTRFS_ROOT_ITEM_KEY)
+		return btrfs_read_inode(root, le64_to_cpu(location->objectid),
+					inode);
+
+	ret = btrfs_read_root(le64_to_cpu(location->objectid), &subvol,
+			      &dirid);
+	if (ret)
+		return ret;
+
+	return btrfs_read_inode(&subvol, dirid, inode);
+}
+
+static void btrfs_free_extents(void)
+{
+	int i;
+
+	for (i = 0; i < btrfs.nr_exts; i++)
+		free(btrfs.exts[i].inline_data);
+	free(btrfs.exts);
+	btrfs.exts = NULL;
+	btrfs.nr_exts = 0;
+	btrfs.ext_ino = 0;
+}
+
+static int btrfs_add_extent(const struct btrfs_key *key,
+			    const struct btrfs_file_extent_item *fi, u32 size,
+			    int *max)
+{
+	struct btrfs_extent *ext;
+	u32 len;
+
+	if (size < BTRFS_FILE_EXTENT_INLINE_DATA_START)
+		return -EINVAL;
+
+	if (btrfs.nr_exts == *max) {
+		ext = realloc(btrfs.exts, (*max + 32) * sizeof(*ext));
+		if (!ext)
+			return -ENOMEM;
+		btrfs.exts = ext;
+		*max += 32;
+	}
+	ext = &btrfs.exts[btrfs.nr_exts];
+	memset(ext, 0, sizeof(*ext));
+	ext->file_off = key->offset;
+	ext->type = fi->type;
+	ext->comp = fi->compression;
+	ext->ram_bytes = le64_to_cpu(fi->ram_bytes);
+	if (fi->encryption || fi->other_encoding)
+		return -EOPNOTSUPP;
+
+	if (ext->type == BTRFS_FILE_EXTENT_INLINE) {
+		len = size - BTRFS_FILE_EXTENT_INLINE_DATA_START;
+		ext->inline_data = malloc(len);
+		if (!ext->inline_data)
+			return -ENOMEM;
+		memcpy(ext->inline_data,
+		       (u8 *)fi + BTRFS_FILE_EXTENT_INLINE_DATA_START, len);
+		ext->disk_len = len;
+		ext->len = ext->comp ? ext->ram_bytes : len;
+	} else {
+		if (size < sizeof(*fi))
+			return -EINVAL;
+		/* Preallocated extents read as zeroes, like holes */
+		if (ext->type == BTRFS_FILE_EXTENT_REG)
+			ext->disk_bytenr = le64_to_cpu(fi->disk_bytenr);
+		ext->disk_len = le64_to_cpu(fi->disk_num_bytes);
+		ext->offset = le64_to_cpu(fi->offset);
+		ext->len = le64_to_cpu(fi->num_bytes);
+	}
+	btrfs.nr_exts++;
+
+	return 0;
+}
+
+/* Load the extent items of a file, unless they are the ones held already */
+static int btrfs_load_extents(struct btrfs_inode *inode)
+{
+	struct btrfs_file_extent_item *fi;
+	struct btrfs_path path;
+	struct btrfs_key key = {
+		.objectid = inode->ino,
+		.type = BTRFS_EXTENT_DATA_KEY,
+		.offset = 0,
+	};
+	int max = 0, ret;
+	u32 size;
+
+	if (btrfs.ext_ino == inode->ino &&
+	    btrfs.ext_root == inode->root.objectid)
+		return 0;
+	btrfs_free_extents();
+
+	ret = btrfs_search(&inode->root, &key, &path);
+	while (!ret) {
+		fi = btrfs_path_item(&path, &key, &size);
+		if (!fi) {
+			ret = -EIO;
+			break;
+		}
+		if (key.objectid != inode->ino ||
+		    key.type != BTRFS_EXTENT_DATA_KEY)
+			break;
+		ret = btrfs_add_extent(&key, fi, size, &max);
+		if (!ret)
+			ret = btrfs_next_item(&path);
+	}
+	if (ret && ret != -ENOENT) {
+		btrfs_free_extents();
+		return ret;
+	}
+
+	btrfs.ext_root = inode->root.objectid;
+	btrfs.ext_ino = inode->ino;
+
+	return 0;
+}
+
+#ifdef CONFIG_LZO
+/*
+ * LZO compressed extents are a sequence of segments, each decompressing to
+ * at most a sector. Segment headers never straddle a sector boundary; the
+ * end of a sector too short to hold one is padding.
+ */
+static int btrfs_decompress_lzo(u8 *src, u32 srclen, u8 *dst, u32 dstlen)
+{
+	u32 sector = btrfs.sectorsize;
+	u32 total, pos, seglen, out = 0;
+	size_t len;
+
+	if (srclen < BTRFS_LZO_LEN)
+		return -EINVAL;
+	total = get_unaligned_le32(src);
+	if (total > srclen)
+		return -EINVAL;
+
+	pos = BTRFS_LZO_LEN;
+	while (pos < total && out < dstlen) {
+		if (sector - pos % sector < BTRFS_LZO_LEN)
+			pos = roundup(pos, sector);
+		if (total - pos < BTRFS_LZO_LEN)
+			return -EINVAL;
+		seglen = get_unaligned_le32(src + pos);
+		pos += BTRFS_LZO_LEN;
+		if (seglen > total - pos)
+			return -EINVAL;
+
+		len = dstlen - out;
+		if (lzo1x_decompress_safe(src + pos, seglen, dst + out,
+					  &len) != LZO_E_OK)
+			return -EIO;
+		out += len;
+		pos += seglen;
+	}
+
+	return out;
+}
+#endif
+
+#ifdef CONFIG_ZSTD
+/*
+ * A zstd compressed extent holds one frame. The rest of the last sector
+ * is padding, which a whole-buffer decompression would take for another
+ * frame, so stream it and stop at the end of the first.
+ */
+static int btrfs_decompress_zstd(u8 *src, u32 srclen, u8 *dst, u32 dstlen)
+{
+	size_t size = zstd_stream_workspace_size(BTRFS_ZSTD_WINDOWLOG);
+	struct zstd_stream zs;
+	size_t in, len;
+	u32 out = 0;
+	int ret;
+
+	if (!btrfs.zstd_ws) {
+		btrfs.zstd_ws = malloc(size);
+		if (!btrfs.zstd_ws)
+			return -ENOMEM;
+	}
+	ret = zstd_stream_init(&zs, btrfs.zstd_ws, size, BTRFS_ZSTD_WINDOWLOG);
+	if (ret)
+		return ret;
+
+	do {
+		in = srclen;
+		len = dstlen - out;
+		ret = zstd_stream_decompress(&zs, src, &in, dst + out, &len);
+		if (ret < 0)
+			return -EIO;
+		src += in;
+		srclen -= in;
+		out += len;
+	} while (!ret && (in || len));
+
+	/* Truncated frame, or more data than the extent holds */
+	return ret ? out : -EIO;
+}
+#endif
+
+/* Decompress an extent, returning its decompressed length */
+static int btrfs_decompress(u8 comp, u8 *src, u32 srclen, u8 *dst,
+			    u32 dstlen)
+{
+	switch (comp) {
+#ifdef CONFIG_GZIP
+	case BTRFS_COMPRESS_ZLIB: {
+		unsigned long len = srclen;
+
+		/* zlib stream: skip the two byte header, ignore the Adler-32 */
+		if (zunzip(dst, dstlen, src, &len, 1, 2))
+			return -EIO;
+		return len;
+	}
+#endif
+#ifdef CONFIG_LZO
+	case BTRFS_COMPRESS_LZO:
+		return btrfs_decompress_lzo(src, srclen, dst, dstlen);
+#endif
+#ifdef CONFIG_ZSTD
+	case BTRFS_COMPRESS_ZSTD:
+		return btrfs_decompress_zstd(src, srclen, dst, dstlen);
+#endif
+	}
+
+	printf("Btrfs: unsupported compression type %u\n", comp);
+	return -EPROTONOSUPPORT;
+}
+
+/* Copy len bytes at skip into the file range covered by an inline extent */
+static int btrfs_read_inline(struct btrfs_extent *ext, u64 skip, u8 *dst,
+			     u64 len)
+{
+	u8 *buf;
+	int ret;
+
+	if (!ext->comp) {
+		if (skip + len > ext->disk_len)
+			return -EINVAL;
+		memcpy(dst, ext->inline_data + skip, len);
+		return 0;
+	}
+
+	if (ext->ram_bytes > btrfs.sectorsize)
+		return -EINVAL;
+	buf = malloc(ext->ram_bytes);
+	if (!buf)
+		return -ENOMEM;
+	ret = btrfs_decompress(ext->comp, ext->inline_data, ext->disk_len,
+			       buf, ext->ram_bytes);
+	if (ret >= 0) {
+		/* Anything past the decompressed data reads as zeroes */
+		memset(buf + ret, 0, ext->ram_bytes - ret);
+		if (skip + len > ext->ram_bytes)
+			ret = -EINVAL;
+		else
+			memcpy(dst, buf + skip, len);
+	}
+	free(buf);
+
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * Copy len bytes at skip into the file range covered by a compressed
+ * extent. Extents wanted in full are decompressed straight into dst.
+ */
+static int btrfs_read_compressed(struct btrfs_extent *ext, u64 skip, u8 *dst,
+				 u64 len, u64 ahead)
+{
+	u64 start = ext->offset + skip;
+	u64 pos;
+	u8 *src;
+	int ret;
+
+	if (ext->ram_bytes > BTRFS_MAX_UNCOMPRESSED ||
+	    ext->disk_len > BTRFS_MAX_UNCOMPRESSED)
+		return -EINVAL;
+
+	if (btrfs.dec_bytenr != ext->disk_bytenr) {
+		pos = btrfs_map(ext->disk_bytenr, ext->disk_len);
+		if (pos == -1ULL)
+			return -EIO;
+		src = btrfs_read_raw(pos, ext->disk_len, ahead);
+		if (!src)
+			return -EIO;
+
+		if (!start && len == ext->ram_bytes) {
+			ret = btrfs_decompress(ext->comp, src, ext->disk_len,
+					       dst, len);
+			if (ret >= 0 && ret != len)
+				ret = -EINVAL;
+			return ret < 0 ? ret : 0;
+		}
+
+		btrfs.dec_bytenr = -1ULL;
+		ret = btrfs_decompress(ext->comp, src, ext->disk_len,
+				       btrfs.dec_buf, ext->ram_bytes);
+		if (ret < 0)
+			return ret;
+		btrfs.dec_bytenr = ext->disk_bytenr;
+		btrfs.dec_len = ret;
+	}
+
+	if (start + len > btrfs.dec_len)
+		return -EINVAL;
+	memcpy(dst, btrfs.dec_buf + start, len);
+
+	return 0;
+}
+
+static inline bool btrfs_ext_plain(struct btrfs_extent *ext)
+{
+	return ext->type != BTRFS_FILE_EXTENT_INLINE && ext->disk_bytenr &&
+	       !ext->comp;
+}
+
+/* Return the first extent ending after offset */
+static int btrfs_find_extent(u64 offset)
+{
+	int lo = 0, hi = btrfs.nr_exts, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (btrfs.exts[mid].file_off + btrfs.exts[mid].len <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Return how many bytes of compressed extents following extent i lie right
+ * after it on the device, up to the end of the read and the read buffer.
+ */
+static u64 btrfs_readahead(int i, u64 end)
+{
+	u32 max = btrfs.rbuf_blks << cur_dev->log2blksz;
+	struct btrfs_extent *ext = &btrfs.exts[i];
+	u64 next = ext->disk_bytenr + ext->disk_len;
+	u64 ahead = 0;
+
+	while (++i < btrfs.nr_exts && ahead < max) {
+		ext = &btrfs.exts[i];
+		if (ext->file_off >= end || !ext->comp ||
+		    ext->type == BTRFS_FILE_EXTENT_INLINE ||
+		    ext->disk_bytenr != next)
+			break;
+		ahead += ext->disk_len;
+		next += ext->disk_len;
+	}
+
+	return ahead;
+}
+
+/* Read len bytes at offset within a regular file */
+static int btrfs_file_read(struct btrfs_inode *inode, u64 offset, u8 *dst,
+			   u64 len)
+{
+	struct btrfs_extent *ext, *next;
+	u64 end = offset + len;
+	u64 skip, chunk, pos;
+	int i, ret;
+
+	ret = btrfs_load_extents(inode);
+	if (ret)
+		return ret;
+
+	i = btrfs_find_extent(offset);
+	while (offset < end) {
+		ext = i < btrfs.nr_exts ? &btrfs.exts[i] : NULL;
+		if (!ext || ext->file_off > offset) {
+			/* Holes are not stored with the NO_HOLES feature */
+			chunk = (ext ? min(ext->file_off, end) : end) - offset;
+			memset(dst, 0, chunk);
+			dst += chunk;
+			offset += chunk;
+			continue;
+		}
+
+		skip = offset - ext->file_off;
+		chunk = min(ext->len - skip, end - offset);
+		if (ext->type == BTRFS_FILE_EXTENT_INLINE) {
+			ret = btrfs_read_inline(ext, skip, dst, chunk);
+		} else if (!ext->disk_bytenr) {
+			memset(dst, 0, chunk);
+		} else if (ext->comp) {
+			ret = btrfs_read_compressed(ext, skip, dst, chunk,
+						    btrfs_readahead(i, end));
+		} else {
+			/* Extend the read over extents that follow on disk */
+			pos = ext->disk_bytenr + ext->offset + skip;
+			while (offset + chunk < end && i + 1 < btrfs.nr_exts) {
+				next = &btrfs.exts[i + 1];
+				if (!btrfs_ext_plain(next) ||
+				    next->file_off != offset + chunk ||
+				    next->disk_bytenr + next->offset !=
+				    pos + chunk ||
+				    btrfs_map(pos, chunk + next->len) == -1ULL)
+					break;
+				chunk += min(next->len, end - offset - chunk);
+				i++;
+			}
+			pos = btrfs_map(pos, chunk);
+			if (pos == -1ULL)
+				return -EIO;
+			ret = btrfs_read_bytes(pos, dst, chunk);
+		}
+		if (ret)
+			return ret;
+
+		dst += chunk;
+		offset += chunk;
+		i++;
+	}
+
+	return 0;
+}
+
+/* Return the target of a symlink in a newly allocated string */
+static char *btrfs_read_symlink(struct btrfs_inode *inode)
+{
+	char *target;
+
+	if (inode->size > BTRFS_MAX_SYMLINK)
+		return NULL;
+	target = malloc(inode->size + 1);
+	if (!target)
+		return NULL;
+	if (btrfs_file_read(inode, 0, (u8 *)target, inode->size)) {
+		free(target);
+		return NULL;
+	}
+	target[inode->size] = '\0';
+
+	return target;
+}
+
+struct btrfs_dirent {
+	char name[BTRFS_NAME_LEN + 1];
+	u8 type;
+	struct btrfs_disk_key location;
+};
+
+/*
+ * Call iter() for every entry of the directory, in the order they were
+ * created, until it returns non-zero, and return that value.
+ */
+static int btrfs_iterate(struct btrfs_inode *dir,
+			 int (*iter)(struct btrfs_inode *dir,
+				     struct btrfs_dirent *d, void *priv),
+			 void *priv)
+{
+	struct btrfs_dirent *d;
+	struct btrfs_dir_item *di;
+	struct btrfs_path path;
+	struct btrfs_key key = {
+		.objectid = dir->ino,
+		.type = BTRFS_DIR_INDEX_KEY,
+		.offset = 0,
+	};
+	u32 size, len;
+	int ret;
+
+	d = malloc(sizeof(*d));
+	if (!d)
+		return -ENOMEM;
+
+	ret = btrfs_search(&dir->root, &key, &path);
+	while (!ret) {
+		di = btrfs_path_item(&path, &key, &size);
+		if (!di) {
+			ret = -EIO;
+			break;
+		}
+		if (key.objectid != dir->ino || key.type != BTRFS_DIR_INDEX_KEY)
+			break;
+
+		len = size < sizeof(*di) ? 0 : le16_to_cpu(di->name_len);
+		if (!len || len > BTRFS_NAME_LEN || sizeof(*di) + len > size) {
+			ret = -EINVAL;
+			break;
+		}
+		memcpy(d->name, di + 1, len);
+		d->name[len] = '\0';
+		d->type = di->type;
+		d->location = di->location;
+
+		ret = iter(dir, d, priv);
+		if (!ret)
+			ret = btrfs_next_item(&path);
+	}
+	free(d);
+
+	return ret == -ENOENT ? 0 : ret;
+}
+
+static u32 btrfs_name_hash(const char *name, int len)
+{
+	return crc32c((u32)~1, name, len);
+}
+
+/* Look a name up in a directory */
+static int btrfs_lookup(struct btrfs_inode *dir, const char *name, int len,
+			struct btrfs_inode *inode)
+{
+	struct btrfs_dir_item *di;
+	struct btrfs_disk_key location;
+	struct btrfs_key key = {
+		.objectid = dir->ino,
+		.type = BTRFS_DIR_ITEM_KEY,
+		.offset = btrfs_name_hash(name, len),
+	};
+	u32 size, nlen, total;
+	u8 *p;
+
+	p = btrfs_lookup_item(&dir->root, &key, &size);
+	if (!p)
+		return -ENOENT;
+
+	/* Names with the same hash share the item */
+	while (size >= sizeof(*di)) {
+		di = (struct btrfs_dir_item *)p;
+		nlen = le16_to_cpu(di->name_len);
+		total = sizeof(*di) + nlen + le16_to_cpu(di->data_len);
+		if (total > size)
+			return -EINVAL;
+		if (nlen == len && !memcmp(di + 1, name, len)) {
+			location = di->location;
+			return btrfs_read_entry(&dir->root, &location, inode);
+		}
+		p += total;
+		size -= total;
+	}
+
+	return -ENOENT;
+}
+
+/* Directories walked through so far, to go back up on ".." */
+struct btrfs_walk {
+	struct btrfs_inode dirs[BTRFS_MAX_DEPTH];
+	int depth;
+	int links;
+};
+
+/*
+ * Resolve a path relative to the directory at the top of the walk, which
+ * inode holds on entry, following symlinks. Subvolumes are entered like
+ * any other directory.
+ */
+static int btrfs_walk(struct btrfs_walk *walk, const char *path,
+		      struct btrfs_inode *inode)
+{
+	const char *p = path, *name;
+	char *target;
+	int len, ret;
+
+	if (*p == '/') {
+		walk->depth = 0;
+		*inode = walk->dirs[0];
+	}
+
+	while (*p) {
+		while (*p == '/')
+			p++;
+		if (!*p)
+			break;
+
+		name = p;
+		while (*p && *p != '/')
+			p++;
+		len = p - name;
+
+		if (len == 1 && name[0] == '.')
+			continue;
+		if (len == 2 && name[0] == '.' && name[1] == '.') {
+			if (walk->depth)
+				walk->depth--;
+			*inode = walk->dirs[walk->depth];
+			continue;
+		}
+
+		if (!btrfs_is_dir(inode))
+			return -ENOTDIR;
+		if (len > BTRFS_NAME_LEN)
+			return -ENOENT;
+		ret = btrfs_lookup(inode, name, len, inode);
+		if (ret)
+			return ret;
+
+		if (btrfs_is_symlink(inode)) {
+			if (++walk->links > BTRFS_MAX_LINKS)
+				return -ELOOP;
+			target = btrfs_read_symlink(inode);
+			if (!target)
+				return -EIO;
+			/* The target is relative to the directory holding it */
+			*inode = walk->dirs[walk->depth];
+			ret = btrfs_walk(walk, target, inode);
+			free(target);
+			if (ret)
+				return ret;
+		} else if (btrfs_is_dir(inode)) {
+			if (walk->depth + 1 >= BTRFS_MAX_DEPTH)
+				return -ENAMETOOLONG;
+			walk->dirs[++walk->depth] = *inode;
+		}
+	}
+
+	return 0;
+}
+
+static int btrfs_find(const char *path, struct btrfs_inode *inode)
+{
+	struct btrfs_walk *walk;
+	int ret;
+
+	walk = malloc(sizeof(*walk));
+	if (!walk)
+		return -ENOMEM;
+	walk->depth = 0;
+	walk->links = 0;
+
+	ret = btrfs_read_inode(&btrfs.fs_root, btrfs.root_dirid,
+			       &walk->dirs[0]);
+	if (!ret) {
+		*inode = walk->dirs[0];
+		ret = btrfs_walk(walk, path, inode);
+	}
+	free(walk);
+
+	return ret;
+}
+
+struct btrfs_ls_counts {
+	int files;
+	int dirs;
+};
+
+static int btrfs_ls_iter(struct btrfs_inode *dir, struct btrfs_dirent *d,
+			 void *priv)
+{
+	struct btrfs_ls_counts *counts = priv;
+	struct btrfs_inode inode;
+	char *target;
+	int ret;
+
+	if (d->type == BTRFS_FT_DIR) {
+		printf("            %s/\n", d->name);
+		counts->dirs++;
+		return 0;
+	}
+
+	ret = btrfs_read_entry(&dir->root, &d->location, &inode);
+	if (ret)
+		return ret;
+	if (btrfs_is_symlink(&inode)) {
+		target = btrfs_read_symlink(&inode);
+		printf("    <SYM>   %s -> %s\n", d->name, target ? target : "?");
+		free(target);
+	} else if (btrfs_is_reg(&inode)) {
+		printf(" %8llu   %s\n", inode.size, d->name);
+	} else {
+		printf("            %s\n", d->name);
+	}
+	counts->files++;
+
+	return 0;
+}
+
+int btrfs_ls(const char *dirname)
+{
+	struct btrfs_ls_counts counts = { 0, 0 };
+	struct btrfs_inode inode;
+	int ret;
+
+	ret = btrfs_find(dirname, &inode);
+	if (ret) {
+		printf("** Can not find directory %s **\n", dirname);
+		return ret;
+	}
+
+	if (btrfs_is_dir(&inode)) {
+		ret = btrfs_iterate(&inode, btrfs_ls_iter, &counts);
+		if (ret)
+			return ret;
+	} else {
+		printf(" %8llu   %s\n", inode.size, dirname);
+		counts.files++;
+	}
+	printf("\n%d file(s), %d dir(s)\n\n", counts.files, counts.dirs);
+
+	return 0;
+}
+
+int btrfs_exists(const char *filename)
+{
+	struct btrfs_inode inode;
+
+	return btrfs_find(filename, &inode) == 0;
+}
+
+int btrfs_size(const char *filename, loff_t *size)
+{
+	struct btrfs_inode inode;
+	int ret;
+
+	ret = btrfs_find(filename, &inode);
+	if (!ret)
+		*size = inode.size;
+
+	return ret;
+}
+
+int btrfs_read_file(const char *filename, void *buf, loff_t offset,
+		    loff_t len, loff_t *actread)
+{
+	struct btrfs_inode inode;
+	int ret;
+
+	*actread = 0;
+	ret = btrfs_find(filename, &inode);
+	if (ret) {
+		printf("** File not found %s **\n", filename);
+		return ret;
+	}
+	if (!btrfs_is_reg(&inode))
+		return btrfs_is_dir(&inode) ? -EISDIR : -EINVAL;
+
+	if (offset >= inode.size)
+		return 0;
+	if (!len || len > inode.size - offset)
+		len = inode.size - offset;
+
+	ret = btrfs_file_read(&inode, offset, buf, len);
+	if (ret) {
+		printf("** Error reading file %s **\n", filename);
+		return ret;
+	}
+	*actread = len;
+
+	return 0;
+}
+
+void btrfs_close(void)
+{
+	int i;
+
+	btrfs_free_extents();
+	for (i = 0; i < btrfs.nr_nodes; i++)
+		free(btrfs.nodes[i].data);
+	free(btrfs.nodes);
+	free(btrfs.chunks);
+	free(btrfs.rbuf);
+	free(btrfs.dec_buf);
+	free(btrfs.zstd_ws);
+	btrfs.nodes = NULL;
+	btrfs.nr_nodes = 0;
+	btrfs.chunks = NULL;
+	btrfs.nr_chunks = 0;
+	btrfs.max_chunks = 0;
+	btrfs.rbuf = NULL;
+	btrfs.dec_buf = NULL;
+	btrfs.zstd_ws = NULL;
+	cur_dev = NULL;
+}
+
+/* Read the chunk items of the system chunk array and the chunk tree */
+static int btrfs_read_chunks(struct btrfs_super_block *sb)
+{
+	u32 len = le32_to_cpu(sb->sys_chunk_array_size);
+	struct btrfs_disk_key *dkey;
+	struct btrfs_chunk *chunk;
+	struct btrfs_path path;
+	struct btrfs_root root;
+	struct btrfs_key key;
+	u32 pos = 0, size;
+	int ret;
+
+	if (len > BTRFS_SYSTEM_CHUNK_ARRAY_SIZE)
+		return -EINVAL;
+	while (pos < len) {
+		if (len - pos < sizeof(*dkey) + sizeof(*chunk))
+			return -EINVAL;
+		dkey = (struct btrfs_disk_key *)(sb->sys_chunk_array + pos);
+		chunk = (struct btrfs_chunk *)(dkey + 1);
+		if (dkey->type != BTRFS_CHUNK_ITEM_KEY)
+			return -EINVAL;
+		pos += sizeof(*dkey);
+		size = sizeof(*chunk) + le16_to_cpu(chunk->num_stripes) *
+		       sizeof(chunk->stripe[0]);
+		if (size > len - pos)
+			return -EINVAL;
+		ret = btrfs_add_chunk(le64_to_cpu(dkey->offset), chunk, size);
+		if (ret)
+			return ret;
+		pos += size;
+	}
+
+	root.objectid = 0;
+	root.bytenr = le64_to_cpu(sb->chunk_root);
+	root.level = sb->chunk_root_level;
+	key.objectid = BTRFS_FIRST_CHUNK_TREE_OBJECTID;
+	key.type = BTRFS_CHUNK_ITEM_KEY;
+	key.offset = 0;
+	ret = btrfs_search(&root, &key, &path);
+	while (!ret) {
+		chunk = btrfs_path_item(&path, &key, &size);
+		if (!chunk)
+			return -EIO;
+		if (key.type == BTRFS_CHUNK_ITEM_KEY) {
+			ret = btrfs_add_chunk(key.offset, chunk, size);
+			if (ret)
+				return ret;
+		}
+		ret = btrfs_next_item(&path);
+	}
+
+	return ret == -ENOENT ? 0 : ret;
+}
+
+/* Find the subvolume mounted by default, set with "btrfs subvolume" */
+static u64 btrfs_default_subvol(void)
+{
+	struct btrfs_dir_item *di;
+	struct btrfs_key key = {
+		.objectid = BTRFS_ROOT_TREE_DIR_OBJECTID,
+		.type = BTRFS_DIR_ITEM_KEY,
+		.offset = btrfs_name_hash("default", 7),
+	};
+	u32 size;
+
+	di = btrfs_lookup_item(&btrfs.tree_root, &key, &size);
+	if (!di || size < sizeof(*di) + 7 || le16_to_cpu(di->name_len) != 7 ||
+	    memcmp(di + 1, "default", 7))
+		return BTRFS_FS_TREE_OBJECTID;
+
+	return le64_to_cpu(di->location.objectid);
+}
+
+int btrfs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info)
+{
+	struct btrfs_super_block *sb;
+	struct btrfs_inode root;
+	u64 incompat;
+	int i;
+
+	fs_cache_invalidate();
+	btrfs_close();
+
+	cur_dev = rbdd;
+	cur_part_info = *info;
+
+	/* Room for a whole compressed extent however it is aligned */
+	btrfs.rbuf_blks = DIV_ROUND_UP(max_t(u32, CONFIG_BTRFS_READ_BUF_SIZE,
+					     BTRFS_MAX_UNCOMPRESSED),
+				       rbdd->blksz) + 2;
+	btrfs.rbuf = malloc_cache_aligned(btrfs.rbuf_blks * rbdd->blksz);
+	btrfs.rbuf_blk = -1;
+	sb = malloc_cache_aligned(BTRFS_SUPER_INFO_SIZE);
+	if (!btrfs.rbuf || !sb)
+		goto err;
+	if (btrfs_read_bytes(BTRFS_SUPER_INFO_OFFSET, sb,
+			     BTRFS_SUPER_INFO_SIZE) ||
+	    le64_to_cpu(sb->magic) != BTRFS_MAGIC)
+		goto err;
+
+	btrfs.devid = le64_to_cpu(sb->dev_item.devid);
+	btrfs.sectorsize = le32_to_cpu(sb->sectorsize);
+	btrfs.nodesize = le32_to_cpu(sb->nodesize);
+	btrfs.csum_type = le16_to_cpu(sb->csum_type);
+	incompat = le64_to_cpu(sb->incompat_flags);
+	if (le64_to_cpu(sb->bytenr) != BTRFS_SUPER_INFO_OFFSET ||
+	    !btrfs_csum_ok((u8 *)sb, BTRFS_SUPER_INFO_SIZE) ||
+	    !is_power_of_2(btrfs.sectorsize) || btrfs.sectorsize < 4096 ||
+	    !is_power_of_2(btrfs.nodesize) || btrfs.nodesize < 4096 ||
+	    btrfs.nodesize > 65536) {
+		printf("Btrfs: unsupported or corrupt superblock\n");
+		goto err;
+	}
+	if (incompat & ~(BTRFS_FEATURE_INCOMPAT_RAID1C34 * 2 - 1)) {
+		printf("Btrfs: unsupported features %llx\n", incompat);
+		goto err;
+	}
+
+	btrfs.nr_nodes = max(CONFIG_BTRFS_NODE_CACHE, 2 * BTRFS_MAX_LEVEL);
+	btrfs.nodes = calloc(btrfs.nr_nodes, sizeof(*btrfs.nodes));
+	btrfs.dec_buf = malloc(BTRFS_MAX_UNCOMPRESSED);
+	btrfs.dec_bytenr = -1ULL;
+	if (!btrfs.nodes || !btrfs.dec_buf) {
+		btrfs.nr_nodes = 0;
+		goto err;
+	}
+	for (i = 0; i < btrfs.nr_nodes; i++)
+		btrfs.nodes[i].bytenr = -1ULL;
+
+	if (btrfs_read_chunks(sb))
+		goto err;
+
+	btrfs.tree_root.objectid = BTRFS_ROOT_TREE_OBJECTID;
+	btrfs.tree_root.bytenr = le64_to_cpu(sb->root);
+	btrfs.tree_root.level = sb->root_level;
+	if (btrfs_read_root(btrfs_default_subvol(), &btrfs.fs_root,
+			    &btrfs.root_dirid) ||
+	    btrfs_read_inode(&btrfs.fs_root, btrfs.root_dirid, &root) ||
+	    !btrfs_is_dir(&root))
+		goto err;
+	free(sb);
+
+	return 0;
+
+err:
+	free(sb);
+	btrfs_close();
+	return -1;
+}
@@ -0,0 +1,587 @@
+/*
+ * exfat.c
+ *
+ * R/O exFAT filesystem implementation
+ *
+ * Files are described by a directory entry set: a file entry followed by a
+ * stream extension, which holds the first cluster and the length, and the
+ * name entries. When the stream extension has the NoFatChain flag set the
+ * file occupies consecutive clusters and the FAT is not consulted at all, so
+ * any range of it is read with a single block device request. Otherwise the
+ * FAT chain is followed and runs of consecutive clusters are still read in
+ * one request each.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <exfat.h>
+#include <fs.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <part.h>
+#include <linux/ctype.h>
+
+/* Device blocks of the FAT kept in memory for chain lookups */
+#define EXFAT_FAT_CACHE_BLKS	8
+/* Bounce buffer used when the destination is not suitably aligned */
+#define EXFAT_BOUNCE_SIZE	(64 * 1024)
+
+struct exfat_node {
+	u32 start;		/* First cluster */
+	u64 size;		/* Allocated data length */
+	u64 valid_size;		/* Bytes actually written */
+	u8 flags;		/* EXFAT_SF_* */
+	u16 attr;		/* EXFAT_ATTR_* */
+	char name[EXFAT_MAX_NAME_LEN * 3 + 1];
+};
+
+static struct blk_desc *cur_dev;
+static disk_partition_t cur_part_info;
+
+static struct {
+	u64 fat_pos;		/* Byte offset of the active FAT */
+	u64 heap_pos;		/* Byte offset of cluster 2 */
+	u32 cluster_count;
+	int cluster_bits;	/* log2 of the cluster size in bytes */
+	u32 serial;
+	struct exfat_node root;
+	u8 *fat_buf;
+	lbaint_t fat_blk;	/* First block held in fat_buf, or -1 */
+	u8 *bounce;
+} exfat;
+
+/*
+ * Read len bytes starting at byte offset pos of the partition. Whole device
+ * blocks are transferred straight into buf when it is aligned for DMA;
+ * partial blocks at either end go through the bounce buffer.
+ */
+static int exfat_read_bytes(u64 pos, void *buf, u64 len)
+{
+	ulong blksz = cur_dev->blksz;
+	lbaint_t blk = cur_part_info.start + (pos >> cur_dev->log2blksz);
+	ulong off = pos & (blksz - 1);
+	u8 *dst = buf;
+	lbaint_t n;
+	ulong chunk;
+
+	if (off) {
+		chunk = min_t(u64, blksz - off, len);
+		if (blk_dread(cur_dev, blk, 1, exfat.bounce) != 1)
+			return -EIO;
+		memcpy(dst, exfat.bounce + off, chunk);
+		dst += chunk;
+		len -= chunk;
+		blk++;
+	}
+
+	n = len >> cur_dev->log2blksz;
+	if (n && !((ulong)dst & (ARCH_DMA_MINALIGN - 1))) {
+		if (blk_dread(cur_dev, blk, n, dst) != n)
+			return -EIO;
+		dst += n << cur_dev->log2blksz;
+		len -= n << cur_dev->log2blksz;
+		blk += n;
+	}
+
+	while (len) {
+		n = min_t(u64, DIV_ROUND_UP(len, blksz),
+			  EXFAT_BOUNCE_SIZE >> cur_dev->log2blksz);
+		if (blk_dread(cur_dev, blk, n, exfat.bounce) != n)
+			return -EIO;
+		chunk = min_t(u64, n << cur_dev->log2blksz, len);
+		memcpy(dst, exfat.bounce, chunk);
+		dst += chunk;
+		len -= chunk;
+		blk += n;
+	}
+
+	return 0;
+}
+
+static u64 exfat_cluster_pos(u32 cluster)
+{
+	return exfat.heap_pos +
+	       ((u64)(cluster - EXFAT_FIRST_CLUSTER) << exfat.cluster_bits);
+}
+
+static bool exfat_cluster_valid(u32 cluster)
+{
+	return cluster >= EXFAT_FIRST_CLUSTER &&
+	       cluster - EXFAT_FIRST_CLUSTER < exfat.cluster_count;
+}
+
+/*
+ * Return the cluster following the given one in its FAT chain, or
+ * EXFAT_EOF_CLUSTER at the end of the chain or on error.
+ */
+static u32 exfat_next_cluster(u32 cluster)
+{
+	u64 pos = exfat.fat_pos + (u64)cluster * sizeof(__le32);
+	lbaint_t blk = pos >> cur_dev->log2blksz;
+	ulong off;
+	u32 next;
+
+	if (exfat.fat_blk == (lbaint_t)-1 || blk < exfat.fat_blk ||
+	    blk >= exfat.fat_blk + EXFAT_FAT_CACHE_BLKS) {
+		if (blk_dread(cur_dev, cur_part_info.start + blk,
+			      EXFAT_FAT_CACHE_BLKS, exfat.fat_buf) !=
+		    EXFAT_FAT_CACHE_BLKS) {
+			exfat.fat_blk = -1;
+			printf("Error reading exFAT FAT\n");
+			return EXFAT_EOF_CLUSTER;
+		}
+		exfat.fat_blk = blk;
+	}
+
+	off = pos - ((u64)exfat.fat_blk << cur_dev->log2blksz);
+	next = le32_to_cpu(*(__le32 *)(exfat.fat_buf + off));
+	if (!exfat_cluster_valid(next))
+		return EXFAT_EOF_CLUSTER;
+
+	return next;
+}
+
+/*
+ * Read len bytes at offset within a file or directory. Data past the valid
+ * length of the file reads as zeroes.
+ */
+static int exfat_node_read(struct exfat_node *node, u64 offset, void *buf,
+			   u64 len)
+{
+	u64 csize = 1ULL << exfat.cluster_bits;
+	u32 cluster = node->start;
+	u8 *dst = buf;
+	u64 valid, run, skip;
+	u32 first, next;
+	int ret;
+
+	if (offset >= node->valid_size) {
+		memset(buf, 0, len);
+		return 0;
+	}
+	valid = min(len, node->valid_size - offset);
+	memset(dst + valid, 0, len - valid);
+	len = valid;
+
+	if (!exfat_cluster_valid(cluster))
+		return -EINVAL;
+
+	if (node->flags & EXFAT_SF_CONTIGUOUS)
+		return exfat_read_bytes(exfat_cluster_pos(cluster) + offset,
+					dst, len);
+
+	for (skip = offset >> exfat.cluster_bits; skip; skip--) {
+		cluster = exfat_next_cluster(cluster);
+		if (cluster == EXFAT_EOF_CLUSTER)
+			return -EINVAL;
+	}
+	offset &= csize - 1;
+
+	while (len) {
+		/* Gather a run of consecutive clusters */
+		first = cluster;
+		next = EXFAT_EOF_CLUSTER;
+		run = csize - offset;
+		while (run < len) {
+			next = exfat_next_cluster(cluster);
+			if (next != cluster + 1)
+				break;
+			cluster = next;
+			run += csize;
+		}
+		run = min(run, len);
+
+		ret = exfat_read_bytes(exfat_cluster_pos(first) + offset, dst,
+				       run);
+		if (ret)
+			return ret;
+		dst += run;
+		len -= run;
+		offset = 0;
+
+		if (len) {
+			if (next == EXFAT_EOF_CLUSTER)
+				return -EINVAL;
+			cluster = next;
+		}
+	}
+
+	return 0;
+}
+
+/* Append the UTF-8 encoding of count UTF-16 characters to name */
+static int exfat_utf16_to_utf8(char *name, int len, const u8 *s, int count)
+{
+	u32 c, lo;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		c = s[2 * i] | s[2 * i + 1] << 8;
+		if (c >= 0xd800 && c < 0xdc00 && i + 1 < count) {
+			lo = s[2 * i + 2] | s[2 * i + 3] << 8;
+			if (lo >= 0xdc00 && lo < 0xe000) {
+				c = 0x10000 + ((c - 0xd800) << 10) +
+				    (lo - 0xdc00);
+				i++;
+			}
+		}
+
+		if (c < 0x80) {
+			name[len++] = c;
+		} else if (c < 0x800) {
+			name[len++] = 0xc0 | (c >> 6);
+			name[len++] = 0x80 | (c & 0x3f);
+		} else if (c < 0x10000) {
+			name[len++] = 0xe0 | (c >> 12);
+			name[len++] = 0x80 | ((c >> 6) & 0x3f);
+			name[len++] = 0x80 | (c & 0x3f);
+		} else {
+			name[len++] = 0xf0 | (c >> 18);
+			name[len++] = 0x80 | ((c >> 12) & 0x3f);
+			name[len++] = 0x80 | ((c >> 6) & 0x3f);
+			name[len++] = 0x80 | (c & 0x3f);
+		}
+	}
+	name[len] = '\0';
+
+	return len;
+}
+
+/*
+ * Call iter() for every file in the directory until it returns non-zero,
+ * and return that value. The directory is read in one go so that entry sets
+ * crossing a cluster boundary need no special handling.
+ */
+static int exfat_iterate(struct exfat_node *dir,
+			 int (*iter)(struct exfat_node *node, void *priv),
+			 void *priv)
+{
+	struct exfat_dentry *dents, *d;
+	struct exfat_node *node;
+	ulong count, i, j;
+	int name_len, chars, ret;
+
+	if (!dir->size || dir->size > EXFAT_MAX_DIR_SIZE)
+		return 0;
+
+	dents = malloc_cache_aligned(dir->size);
+	node = malloc(sizeof(*node));
+	if (!dents || !node) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = exfat_node_read(dir, 0, dents, dir->size);
+	if (ret)
+		goto out;
+
+	count = dir->size / sizeof(*dents);
+	for (i = 0; i < count; i++) {
+		d = &dents[i];
+		if (d->type == EXFAT_ENTRY_EOD)
+			break;
+		if (d->type != EXFAT_ENTRY_FILE)
+			continue;
+		if (d->file.secondary_count < 2 ||
+		    i + d->file.secondary_count >= count ||
+		    d[1].type != EXFAT_ENTRY_STREAM)
+			continue;
+
+		node->attr = le16_to_cpu(d->file.attr);
+		node->flags = d[1].stream.flags;
+		node->start = le32_to_cpu(d[1].stream.start_cluster);
+		node->size = le64_to_cpu(d[1].stream.size);
+		node->valid_size = min(le64_to_cpu(d[1].stream.valid_size),
+				       node->size);
+
+		name_len = 0;
+		chars = d[1].stream.name_len;
+		for (j = 2; j <= d->file.secondary_count && chars > 0; j++) {
+			if (d[j].type != EXFAT_ENTRY_NAME)
+				break;
+			name_len = exfat_utf16_to_utf8(node->name, name_len,
+						       (u8 *)d[j].name.name,
+						       min(chars,
+							   EXFAT_NAME_CHARS));
+			chars -= EXFAT_NAME_CHARS;
+		}
+		i += d->file.secondary_count;
+		if (chars > 0)
+			continue;
+
+		ret = iter(node, priv);
+		if (ret)
+			break;
+	}
+
+out:
+	free(node);
+	free(dents);
+	return ret;
+}
+
+struct exfat_lookup {
+	const char *name;
+	int len;
+	struct exfat_node *found;
+};
+
+static int exfat_lookup_iter(struct exfat_node *node, void *priv)
+{
+	struct exfat_lookup *lookup = priv;
+
+	/* Only ASCII is folded, the up-case table is not consulted */
+	if (strlen(node->name) != lookup->len ||
+	    strncasecmp(node->name, lookup->name, lookup->len))
+		return 0;
+
+	memcpy(lookup->found, node, sizeof(*node));
+
+	return 1;
+}
+
+/* Resolve a path relative to the root directory */
+static int exfat_find(const char *path, struct exfat_node *node)
+{
+	struct exfat_lookup lookup = { .found = node };
+	const char *p = path;
+	int ret;
+
+	memcpy(node, &exfat.root, sizeof(*node));
+
+	while (*p) {
+		while (*p == '/' || *p == '\\')
+			p++;
+		if (!*p)
+			break;
+
+		lookup.name = p;
+		while (*p && *p != '/' && *p != '\\')
+			p++;
+		lookup.len = p - lookup.name;
+
+		if (!(node->attr & EXFAT_ATTR_DIR))
+			return -ENOTDIR;
+		/* The directory is read in full before node is overwritten */
+		ret = exfat_iterate(node, exfat_lookup_iter, &lookup);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			return -ENOENT;
+	}
+
+	return 0;
+}
+
+struct exfat_ls_counts {
+	int files;
+	int dirs;
+};
+
+static void exfat_ls_print(struct exfat_node *node)
+{
+	if (node->attr & EXFAT_ATTR_DIR)
+		printf("            %s/\n", node->name);
+	else
+		printf(" %8llu   %s\n", node->size, node->name);
+}
+
+static int exfat_ls_iter(struct exfat_node *node, void *priv)
+{
+	struct exfat_ls_counts *counts = priv;
+
+	exfat_ls_print(node);
+	if (node->attr & EXFAT_ATTR_DIR)
+		counts->dirs++;
+	else
+		counts->files++;
+
+	return 0;
+}
+
+int exfat_ls(const char *dirname)
+{
+	struct exfat_ls_counts counts = { 0, 0 };
+	struct exfat_node *node;
+	int ret;
+
+	node = malloc(sizeof(*node));
+	if (!node)
+		return -ENOMEM;
+
+	ret = exfat_find(dirname, node);
+	if (ret) {
+		printf("** Can not find directory %s **\n", dirname);
+		goto out;
+	}
+
+	if (node->attr & EXFAT_ATTR_DIR) {
+		ret = exfat_iterate(node, exfat_ls_iter, &counts);
+		if (ret)
+			goto out;
+	} else {
+		exfat_ls_print(node);
+		counts.files++;
+	}
+	printf("\n%d file(s), %d dir(s)\n\n", counts.files, counts.dirs);
+
+out:
+	free(node);
+	return ret;
+}
+
+int exfat_exists(const char *filename)
+{
+	struct exfat_node *node;
+	int ret;
+
+	node = malloc(sizeof(*node));
+	if (!node)
+		return 0;
+	ret = exfat_find(filename, node);
+	free(node);
+
+	return ret == 0;
+}
+
+int exfat_size(const char *filename, loff_t *size)
+{
+	struct exfat_node *node;
+	int ret;
+
+	node = malloc(sizeof(*node));
+	if (!node)
+		return -ENOMEM;
+
+	ret = exfat_find(filename, node);
+	if (!ret)
+		*size = node->size;
+	free(node);
+
+	return ret;
+}
+
+int exfat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
+		    loff_t *actread)
+{
+	struct exfat_node *node;
+	int ret;
+
+	*actread = 0;
+	node = malloc(sizeof(*node));
+	if (!node)
+		return -ENOMEM;
+
+	ret = exfat_find(filename, node);
+	if (ret) {
+		printf("** File not found %s **\n", filename);
+		goto out;
+	}
+	if (node->attr & EXFAT_ATTR_DIR) {
+		ret = -EISDIR;
+		goto out;
+	}
+
+	if (offset >= node->size)
+		goto out;
+	if (!len || len > node->size - offset)
+		len = node->size - offset;
+
+	ret = exfat_node_read(node, offset, buf, len);
+	if (ret) {
+		printf("** Error reading file %s **\n", filename);
+		goto out;
+	}
+	*actread = len;
+
+out:
+	free(node);
+	return ret;
+}
+
+int exfat_uuid(char *uuid_str)
+{
+	sprintf(uuid_str, "%04X-%04X", exfat.serial >> 16,
+		exfat.serial & 0xffff);
+
+	return 0;
+}
+
+void exfat_close(void)
+{
+	free(exfat.fat_buf);
+	free(exfat.bounce);
+	exfat.fat_buf = NULL;
+	exfat.bounce = NULL;
+	cur_dev = NULL;
+}
+
+int exfat_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info)
+{
+	struct exfat_boot_sector *bs;
+	u32 cluster;
+	int sector_shift;
+
+	fs_cache_invalidate();
+	exfat_close();
+
+	if (rbdd->blksz < sizeof(*bs) || rbdd->blksz > EXFAT_BOUNCE_SIZE)
+		return -1;
+
+	cur_dev = rbdd;
+	cur_part_info = *info;
+	exfat.bounce = malloc_cache_aligned(EXFAT_BOUNCE_SIZE);
+	exfat.fat_buf = malloc_cache_aligned(EXFAT_FAT_CACHE_BLKS *
+					     rbdd->blksz);
+	exfat.fat_blk = -1;
+	if (!exfat.bounce || !exfat.fat_buf)
+		goto err;
+
+	if (blk_dread(cur_dev, cur_part_info.start, 1, exfat.bounce) != 1)
+		goto err;
+	bs = (struct exfat_boot_sector *)exfat.bounce;
+	if (memcmp(bs->fs_name, EXFAT_SIGN, EXFAT_SIGNLEN))
+		goto err;
+
+	sector_shift = bs->sector_shift;
+	if (sector_shift < 9 || sector_shift > 12 ||
+	    sector_shift + bs->cluster_shift > 25 ||
+	    (1 << sector_shift) < rbdd->blksz ||
+	    bs->num_fats < 1 || bs->num_fats > 2) {
+		printf("exFAT: unsupported geometry\n");
+		goto err;
+	}
+
+	exfat.cluster_bits = sector_shift + bs->cluster_shift;
+	exfat.cluster_count = le32_to_cpu(bs->cluster_count);
+	exfat.serial = le32_to_cpu(bs->serial);
+	exfat.fat_pos = (u64)le32_to_cpu(bs->fat_offset) << sector_shift;
+	/* ActiveFat selects the second FAT on TexFAT volumes */
+	if (bs->num_fats == 2 && (le16_to_cpu(bs->flags) & 1))
+		exfat.fat_pos += (u64)le32_to_cpu(bs->fat_length) <<
+				 sector_shift;
+	exfat.heap_pos = (u64)le32_to_cpu(bs->cluster_heap_offset) <<
+			 sector_shift;
+
+	/* The root directory has no stream extension to give its length */
+	memset(&exfat.root, 0, sizeof(exfat.root));
+	exfat.root.start = le32_to_cpu(bs->root_cluster);
+	exfat.root.attr = EXFAT_ATTR_DIR;
+	if (!exfat_cluster_valid(exfat.root.start))
+		goto err;
+	for (cluster = exfat.root.start; cluster != EXFAT_EOF_CLUSTER;
+	     cluster = exfat_next_cluster(cluster)) {
+		exfat.root.size += 1ULL << exfat.cluster_bits;
+		if (exfat.root.size > EXFAT_MAX_DIR_SIZE)
+			goto err;
+	}
+	exfat.root.valid_size = exfat.root.size;
+
+	return 0;
+
+err:
+	exfat_close();
+	return -1;
+}
@@ -28,6 +28,7 @@
 #include <config.h>
 #include <memalign.h>
 #include <ext4fs.h>
+#include <fs.h>
 #include <ext_common.h>
 #include "ext4_common.h"
 
@@ -39,6 +40,7 @@ static disk_partition_t *part_info;
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info)
 {
 	assert(rbdd->blksz == (1 << rbdd->log2blksz));
+	fs_cache_invalidate();
 	ext4fs_blk_desc = rbdd;
 	get_fs()->dev_desc = rbdd;
 	part_info = info;
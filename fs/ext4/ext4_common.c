@@ -29,6 +29,7 @@
 #include <linux/stat.h>
 #include <linux/time.h>
 #include <asm/byteorder.h>
+#include <u-boot/crc.h>
 #include "ext4_common.h"
 
 struct ext2_data *ext4fs_root;
@@ -44,6 +45,7 @@ __le32 *ext4fs_indir3_block;
 int ext4fs_indir3_size;
 int ext4fs_indir3_blkno = -1;
 struct ext2_inode *g_parent_inode;
+int g_parent_inode_no;
 static int symlinknest;
 
 #if defined(CONFIG_EXT4_WRITE)
@@ -94,17 +96,22 @@ static inline void ext4fs_bg_free_blocks_dec
 		bg->free_blocks_high = cpu_to_le16(free_blocks >> 16);
 }
 
-static inline void ext4fs_bg_itable_unused_dec
-	(struct ext2_block_group *bg, const struct ext_filesystem *fs)
+/* The inode table of the group is in use up to its @idx'th inode */
+static inline void ext4fs_bg_itable_unused_update
+	(struct ext2_block_group *bg, const struct ext_filesystem *fs,
+	 uint32_t idx)
 {
-	uint32_t free_inodes = le16_to_cpu(bg->bg_itable_unused);
+	uint32_t inodes_per_grp = le32_to_cpu(fs->sb->inodes_per_group);
+	uint32_t unused = le16_to_cpu(bg->bg_itable_unused);
 	if (fs->gdsize == 64)
-		free_inodes += le16_to_cpu(bg->bg_itable_unused_high) << 16;
-	free_inodes--;
+		unused += le16_to_cpu(bg->bg_itable_unused_high) << 16;
+	if (inodes_per_grp - idx >= unused)
+		return;
+	unused = inodes_per_grp - idx;
 
-	bg->bg_itable_unused = cpu_to_le16(free_inodes & 0xffff);
+	bg->bg_itable_unused = cpu_to_le16(unused & 0xffff);
 	if (fs->gdsize == 64)
-		bg->bg_itable_unused_high = cpu_to_le16(free_inodes >> 16);
+		bg->bg_itable_unused_high = cpu_to_le16(unused >> 16);
 }
 
 uint64_t ext4fs_sb_get_free_blocks(const struct ext2_sblock *sb)
@@ -129,6 +136,15 @@ uint32_t ext4fs_bg_get_free_blocks(const struct ext2_block_group *bg,
 	return free_blocks;
 }
 
+static inline void ext4fs_bg_set_free_blocks(struct ext2_block_group *bg,
+					      const struct ext_filesystem *fs,
+					      uint32_t free_blocks)
+{
+	bg->free_blocks = cpu_to_le16(free_blocks & 0xffff);
+	if (fs->gdsize == 64)
+		bg->free_blocks_high = cpu_to_le16(free_blocks >> 16);
+}
+
 static inline
 uint32_t ext4fs_bg_get_free_inodes(const struct ext2_block_group *bg,
 				   const struct ext_filesystem *fs)
@@ -305,6 +321,7 @@ static int _get_new_blk_no(unsigned char *buffer)
 
 int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 {
+	struct ext_filesystem *fs = get_fs();
 	int i, remainder, status;
 	unsigned char *ptr = buffer;
 	unsigned char operand;
@@ -313,6 +330,7 @@ int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 	int blocksize = EXT2_BLOCK_SIZE(ext4fs_root);
 
 	i = i - (index * blocksize);
+	fs->bmap_dirty[index] |= EXT4_BMAP_DIRTY_BLOCK;
 	if (blocksize != 1024) {
 		ptr = ptr + i;
 		operand = 1 << remainder;
@@ -341,6 +359,7 @@ int ext4fs_set_block_bmap(long int blockno, unsigned char *buffer, int index)
 
 void ext4fs_reset_block_bmap(long int blockno, unsigned char *buffer, int index)
 {
+	struct ext_filesystem *fs = get_fs();
 	int i, remainder, status;
 	unsigned char *ptr = buffer;
 	unsigned char operand;
@@ -349,6 +368,7 @@ void ext4fs_reset_block_bmap(long int blockno, unsigned char *buffer, int index)
 	int blocksize = EXT2_BLOCK_SIZE(ext4fs_root);
 
 	i = i - (index * blocksize);
+	fs->bmap_dirty[index] |= EXT4_BMAP_DIRTY_BLOCK;
 	if (blocksize != 1024) {
 		ptr = ptr + i;
 		operand = (1 << remainder);
@@ -371,10 +391,12 @@ void ext4fs_reset_block_bmap(long int blockno, unsigned char *buffer, int index)
 
 int ext4fs_set_inode_bmap(int inode_no, unsigned char *buffer, int index)
 {
+	struct ext_filesystem *fs = get_fs();
 	int i, remainder, status;
 	unsigned char *ptr = buffer;
 	unsigned char operand;
 
+	fs->bmap_dirty[index] |= EXT4_BMAP_DIRTY_INODE;
 	inode_no -= (index * le32_to_cpu(ext4fs_root->sblock.inodes_per_group));
 	i = inode_no / 8;
 	remainder = inode_no % 8;
@@ -396,10 +418,12 @@ int ext4fs_set_inode_bmap(int inode_no, unsigned char *buffer, int index)
 
 void ext4fs_reset_inode_bmap(int inode_no, unsigned char *buffer, int index)
 {
+	struct ext_filesystem *fs = get_fs();
 	int i, remainder, status;
 	unsigned char *ptr = buffer;
 	unsigned char operand;
 
+	fs->bmap_dirty[index] |= EXT4_BMAP_DIRTY_INODE;
 	inode_no -= (index * le32_to_cpu(ext4fs_root->sblock.inodes_per_group));
 	i = inode_no / 8;
 	remainder = inode_no % 8;
@@ -415,23 +439,190 @@ void ext4fs_reset_inode_bmap(int inode_no, unsigned char *buffer, int index)
 		*ptr = *ptr & ~(operand);
 }
 
+static inline int ext4fs_has_metadata_csum(const struct ext_filesystem *fs)
+{
+	return le32_to_cpu(fs->sb->feature_ro_compat) &
+		EXT4_FEATURE_RO_COMPAT_METADATA_CSUM;
+}
+
+void ext4fs_csum_init(void)
+{
+	struct ext_filesystem *fs = get_fs();
+	char *sb = (char *)fs->sb;
+
+	fs->csum_seed = 0;
+	if (!ext4fs_has_metadata_csum(fs))
+		return;
+
+	if (le32_to_cpu(fs->sb->feature_incompat) &
+	    EXT4_FEATURE_INCOMPAT_CSUM_SEED)
+		fs->csum_seed = le32_to_cpu(*(__le32 *)(sb +
+				EXT4_SB_CHECKSUM_SEED_OFFSET));
+	else
+		fs->csum_seed = crc32c(~0, fs->sb->unique_id,
+				       sizeof(fs->sb->unique_id));
+}
+
+void ext4fs_sb_csum_set(struct ext2_sblock *sb)
+{
+	struct ext_filesystem *fs = get_fs();
+	uint32_t csum;
+
+	if (!ext4fs_has_metadata_csum(fs))
+		return;
+
+	csum = crc32c(~0, sb, EXT4_SB_CHECKSUM_OFFSET);
+	*(__le32 *)((char *)sb + EXT4_SB_CHECKSUM_OFFSET) = cpu_to_le32(csum);
+}
+
+static uint32_t ext4fs_inode_csum_seed(int inodeno,
+				       const struct ext2_inode *inode)
+{
+	struct ext_filesystem *fs = get_fs();
+	__le32 le32_ino = cpu_to_le32(inodeno);
+	uint32_t csum;
+
+	csum = crc32c(fs->csum_seed, &le32_ino, sizeof(le32_ino));
+	return crc32c(csum, &inode->version, sizeof(inode->version));
+}
+
+/* @inode points to the full on-disk inode of fs->inodesz bytes */
+void ext4fs_inode_csum_set(int inodeno, struct ext2_inode *inode)
+{
+	struct ext_filesystem *fs = get_fs();
+	char *raw = (char *)inode;
+	__le16 dummy_csum = 0;
+	int offset = EXT4_INODE_CHECKSUM_LO_OFFSET;
+	int has_hi = 0;
+	uint32_t csum;
+
+	if (!ext4fs_has_metadata_csum(fs))
+		return;
+
+	if (fs->inodesz > EXT2_GOOD_OLD_INODE_SIZE) {
+		uint16_t extra_isize = le16_to_cpu(*(__le16 *)(raw +
+					EXT4_INODE_EXTRA_ISIZE_OFFSET));
+
+		has_hi = EXT2_GOOD_OLD_INODE_SIZE + extra_isize >=
+			 EXT4_INODE_CHECKSUM_HI_OFFSET + sizeof(dummy_csum);
+	}
+
+	csum = crc32c(ext4fs_inode_csum_seed(inodeno, inode), raw, offset);
+	csum = crc32c(csum, &dummy_csum, sizeof(dummy_csum));
+	offset += sizeof(dummy_csum);
+	csum = crc32c(csum, raw + offset, EXT2_GOOD_OLD_INODE_SIZE - offset);
+	if (fs->inodesz > EXT2_GOOD_OLD_INODE_SIZE) {
+		offset = EXT4_INODE_CHECKSUM_HI_OFFSET;
+		csum = crc32c(csum, raw + EXT2_GOOD_OLD_INODE_SIZE,
+			      offset - EXT2_GOOD_OLD_INODE_SIZE);
+		if (has_hi) {
+			csum = crc32c(csum, &dummy_csum, sizeof(dummy_csum));
+			offset += sizeof(dummy_csum);
+		}
+		csum = crc32c(csum, raw + offset, fs->inodesz - offset);
+	}
+
+	*(__le16 *)(raw + EXT4_INODE_CHECKSUM_LO_OFFSET) =
+		cpu_to_le16(csum & 0xffff);
+	if (has_hi)
+		*(__le16 *)(raw + EXT4_INODE_CHECKSUM_HI_OFFSET) =
+			cpu_to_le16(csum >> 16);
+}
+
+/* Update the checksum in the tail of a directory leaf block, if it has one */
+void ext4fs_dirblock_csum_set(int inodeno, const struct ext2_inode *inode,
+			      char *block)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4_dir_entry_tail *tail;
+	uint32_t csum;
+
+	if (!ext4fs_has_metadata_csum(fs))
+		return;
+
+	tail = (struct ext4_dir_entry_tail *)(block + fs->blksz -
+					      sizeof(*tail));
+	if (tail->det_reserved_zero1 ||
+	    le16_to_cpu(tail->det_rec_len) != sizeof(*tail) ||
+	    tail->det_reserved_ft != EXT4_DIR_TAIL_FT)
+		return;
+
+	csum = crc32c(ext4fs_inode_csum_seed(inodeno, inode), block,
+		      (char *)tail - block);
+	tail->det_checksum = cpu_to_le32(csum);
+}
+
+void ext4fs_extent_block_csum_set(int inodeno, const struct ext2_inode *inode,
+				  struct ext4_extent_header *eh)
+{
+	struct ext_filesystem *fs = get_fs();
+	int offset;
+	uint32_t csum;
+
+	if (!ext4fs_has_metadata_csum(fs))
+		return;
+
+	offset = sizeof(*eh) + le16_to_cpu(eh->eh_max) *
+		 sizeof(struct ext4_extent);
+	csum = crc32c(ext4fs_inode_csum_seed(inodeno, inode), eh, offset);
+	*(__le32 *)((char *)eh + offset) = cpu_to_le32(csum);
+}
+
+void ext4fs_bg_bitmap_csum_set(uint32_t i)
+{
+	struct ext2_block_group *desc;
+	struct ext_filesystem *fs = get_fs();
+	uint32_t csum;
+
+	if (!ext4fs_has_metadata_csum(fs))
+		return;
+
+	desc = ext4fs_get_group_descriptor(fs, i);
+
+	csum = crc32c(fs->csum_seed, fs->blk_bmaps[i],
+		      le32_to_cpu(fs->sb->blocks_per_group) / 8);
+	desc->bg_block_id_csum = cpu_to_le16(csum & 0xffff);
+	if (fs->gdsize == 64)
+		desc->bg_block_id_csum_high = cpu_to_le16(csum >> 16);
+
+	csum = crc32c(fs->csum_seed, fs->inode_bmaps[i],
+		      le32_to_cpu(fs->sb->inodes_per_group) / 8);
+	desc->bg_inode_id_csum = cpu_to_le16(csum & 0xffff);
+	if (fs->gdsize == 64)
+		desc->bg_inode_id_csum_high = cpu_to_le16(csum >> 16);
+}
+
 uint16_t ext4fs_checksum_update(uint32_t i)
 {
 	struct ext2_block_group *desc;
 	struct ext_filesystem *fs = get_fs();
 	uint16_t crc = 0;
 	__le32 le32_i = cpu_to_le32(i);
+	__le16 dummy_csum = 0;
+	int offset = offsetof(struct ext2_block_group, bg_checksum);
 
 	desc = ext4fs_get_group_descriptor(fs, i);
-	if (le32_to_cpu(fs->sb->feature_ro_compat) & EXT4_FEATURE_RO_COMPAT_GDT_CSUM) {
-		int offset = offsetof(struct ext2_block_group, bg_checksum);
-
+	if (ext4fs_has_metadata_csum(fs)) {
+		uint32_t csum32;
+
+		csum32 = crc32c(fs->csum_seed, &le32_i, sizeof(le32_i));
+		csum32 = crc32c(csum32, desc, offset);
+		csum32 = crc32c(csum32, &dummy_csum, sizeof(dummy_csum));
+		offset += sizeof(dummy_csum);
+		if (offset < fs->gdsize)
+			csum32 = crc32c(csum32, (char *)desc + offset,
+					fs->gdsize - offset);
+		crc = csum32 & 0xffff;
+	} else if (le32_to_cpu(fs->sb->feature_ro_compat) &
+		   EXT4_FEATURE_RO_COMPAT_GDT_CSUM) {
 		crc = ext2fs_crc16(~0, fs->sb->unique_id,
 				   sizeof(fs->sb->unique_id));
 		crc = ext2fs_crc16(crc, &le32_i, sizeof(le32_i));
 		crc = ext2fs_crc16(crc, desc, offset);
 		offset += sizeof(desc->bg_checksum);	/* skip checksum */
-		assert(offset == sizeof(*desc));
+		if (offset < fs->gdsize)
+			crc = ext2fs_crc16(crc, (char *)desc + offset,
+					   fs->gdsize - offset);
 	}
 
 	return crc;
@@ -611,6 +802,8 @@ restart_read:
 	memcpy(temp_dir, filename, strlen(filename));
 
 	/* update or write  the 1st block of root inode */
+	ext4fs_dirblock_csum_set(g_parent_inode_no, g_parent_inode,
+				 root_first_block_buffer);
 	if (ext4fs_put_metadata(root_first_block_buffer,
 				first_block_no_of_root))
 		goto fail;
@@ -909,6 +1102,8 @@ static int unlink_filename(char *filename, unsigned int blknr)
 			/* invalidate dir entry */
 			dir->inode = 0;
 		}
+		ext4fs_dirblock_csum_set(g_parent_inode_no, g_parent_inode,
+					 block_buffer);
 		if (ext4fs_put_metadata(block_buffer, blknr))
 			goto fail;
 		ret = inodeno;
@@ -942,6 +1137,105 @@ int ext4fs_filename_unlink(char *filename)
 	return -1;
 }
 
+static int ext4fs_test_root(uint32_t a, uint32_t b)
+{
+	uint32_t num = b;
+
+	while (a > num)
+		num *= b;
+
+	return num == a;
+}
+
+/* Does block group @group hold a superblock and GDT backup? */
+static int ext4fs_bg_has_super(uint32_t group)
+{
+	if (group <= 1)
+		return 1;
+	if (!(le32_to_cpu(ext4fs_root->sblock.feature_ro_compat) &
+	      EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER))
+		return 1;
+	if (!(group & 1))
+		return 0;
+
+	return ext4fs_test_root(group, 3) || ext4fs_test_root(group, 5) ||
+	       ext4fs_test_root(group, 7);
+}
+
+static void ext4fs_mark_bitmap_range(unsigned char *bmap, uint32_t start,
+				     uint32_t end)
+{
+	for (; start < end && (start & 7); start++)
+		bmap[start >> 3] |= 1 << (start & 7);
+	if (end - start >= 8) {
+		memset(bmap + (start >> 3), 0xff, (end - start) >> 3);
+		start += (end - start) & ~7;
+	}
+	for (; start < end; start++)
+		bmap[start >> 3] |= 1 << (start & 7);
+}
+
+/*
+ * Build the block bitmap of a BLOCK_UNINIT group: its superblock backup,
+ * group descriptors, own bitmaps and inode table are in use, as are the
+ * bits past the end of a short last group.
+ */
+static void ext4fs_init_block_bitmap(uint32_t group)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_block_group *bgd = ext4fs_get_group_descriptor(fs, group);
+	unsigned char *bmap = fs->blk_bmaps[group];
+	uint32_t blk_per_grp = le32_to_cpu(fs->sb->blocks_per_group);
+	uint64_t first = le32_to_cpu(fs->sb->first_data_block) +
+			 (uint64_t)group * blk_per_grp;
+	uint64_t total = le32_to_cpu(fs->sb->total_blocks);
+	uint32_t itable_blocks = le32_to_cpu(fs->sb->inodes_per_group) *
+				 fs->inodesz / fs->blksz;
+	uint64_t blk;
+	uint32_t nblocks = blk_per_grp;
+
+	memset(bmap, 0, fs->blksz);
+	if (ext4fs_bg_has_super(group))
+		ext4fs_mark_bitmap_range(bmap, 0, 1 + fs->no_blk_pergdt +
+				le16_to_cpu(fs->sb->reserved_gdt_blocks));
+
+	blk = ext4fs_bg_get_block_id(bgd, fs);
+	if (blk >= first && blk < first + blk_per_grp)
+		ext4fs_mark_bitmap_range(bmap, blk - first, blk - first + 1);
+	blk = ext4fs_bg_get_inode_id(bgd, fs);
+	if (blk >= first && blk < first + blk_per_grp)
+		ext4fs_mark_bitmap_range(bmap, blk - first, blk - first + 1);
+	blk = ext4fs_bg_get_inode_table_id(bgd, fs);
+	if (blk >= first && blk < first + blk_per_grp)
+		ext4fs_mark_bitmap_range(bmap, blk - first,
+					 min_t(uint64_t, blk - first +
+					       itable_blocks, blk_per_grp));
+
+	if (total - first < nblocks)
+		nblocks = total - first;
+	ext4fs_mark_bitmap_range(bmap, nblocks, fs->blksz * 8);
+
+	ext4fs_bg_set_flags(bgd, ext4fs_bg_get_flags(bgd) &
+			    ~EXT4_BG_BLOCK_UNINIT);
+	fs->bmap_dirty[group] |= EXT4_BMAP_DIRTY_BLOCK;
+}
+
+static void ext4fs_init_inode_bitmap(uint32_t group)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_block_group *bgd = ext4fs_get_group_descriptor(fs, group);
+	unsigned char *bmap = fs->inode_bmaps[group];
+
+	memset(bmap, 0, fs->blksz);
+	ext4fs_mark_bitmap_range(bmap,
+				 le32_to_cpu(fs->sb->inodes_per_group),
+				 fs->blksz * 8);
+
+	ext4fs_bg_set_flags(bgd, ext4fs_bg_get_flags(bgd) &
+			    ~EXT4_BG_INODE_UNINIT);
+	fs->bmap_dirty[group] |= EXT4_BMAP_DIRTY_INODE;
+}
+
 uint32_t ext4fs_get_new_blk_no(void)
 {
 	short i;
@@ -952,8 +1246,7 @@ uint32_t ext4fs_get_new_blk_no(void)
 	unsigned int blk_per_grp = le32_to_cpu(ext4fs_root->sblock.blocks_per_group);
 	struct ext_filesystem *fs = get_fs();
 	char *journal_buffer = zalloc(fs->blksz);
-	char *zero_buffer = zalloc(fs->blksz);
-	if (!journal_buffer || !zero_buffer)
+	if (!journal_buffer)
 		goto fail;
 
 	if (fs->first_pass_bbmap == 0) {
@@ -964,19 +1257,14 @@ uint32_t ext4fs_get_new_blk_no(void)
 				uint16_t bg_flags = ext4fs_bg_get_flags(bgd);
 				uint64_t b_bitmap_blk =
 					ext4fs_bg_get_block_id(bgd, fs);
-				if (bg_flags & EXT4_BG_BLOCK_UNINIT) {
-					memcpy(fs->blk_bmaps[i], zero_buffer,
-					       fs->blksz);
-					put_ext4(b_bitmap_blk * fs->blksz,
-						 fs->blk_bmaps[i], fs->blksz);
-					bg_flags &= ~EXT4_BG_BLOCK_UNINIT;
-					ext4fs_bg_set_flags(bgd, bg_flags);
-				}
+				if (bg_flags & EXT4_BG_BLOCK_UNINIT)
+					ext4fs_init_block_bitmap(i);
 				fs->curr_blkno =
 				    _get_new_blk_no(fs->blk_bmaps[i]);
 				if (fs->curr_blkno == -1)
 					/* block bitmap is completely filled */
 					continue;
+				fs->bmap_dirty[i] |= EXT4_BMAP_DIRTY_BLOCK;
 				fs->curr_blkno = fs->curr_blkno +
 						(i * fs->blksz * 8);
 				fs->first_pass_bbmap++;
@@ -1028,13 +1316,8 @@ restart:
 
 		uint16_t bg_flags = ext4fs_bg_get_flags(bgd);
 		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
-		if (bg_flags & EXT4_BG_BLOCK_UNINIT) {
-			memcpy(fs->blk_bmaps[bg_idx], zero_buffer, fs->blksz);
-			put_ext4(b_bitmap_blk * fs->blksz,
-				 zero_buffer, fs->blksz);
-			bg_flags &= ~EXT4_BG_BLOCK_UNINIT;
-			ext4fs_bg_set_flags(bgd, bg_flags);
-		}
+		if (bg_flags & EXT4_BG_BLOCK_UNINIT)
+			ext4fs_init_block_bitmap(bg_idx);
 
 		if (ext4fs_set_block_bmap(fs->curr_blkno, fs->blk_bmaps[bg_idx],
 				   bg_idx) != 0) {
@@ -1061,12 +1344,10 @@ restart:
 	}
 success:
 	free(journal_buffer);
-	free(zero_buffer);
 
 	return fs->curr_blkno;
 fail:
 	free(journal_buffer);
-	free(zero_buffer);
 
 	return -1;
 }
@@ -1080,11 +1361,11 @@ int ext4fs_get_new_inode_no(void)
 	unsigned int inodes_per_grp = le32_to_cpu(ext4fs_root->sblock.inodes_per_group);
 	struct ext_filesystem *fs = get_fs();
 	char *journal_buffer = zalloc(fs->blksz);
-	char *zero_buffer = zalloc(fs->blksz);
-	if (!journal_buffer || !zero_buffer)
+	if (!journal_buffer)
 		goto fail;
 	int has_gdt_chksum = le32_to_cpu(fs->sb->feature_ro_compat) &
-		EXT4_FEATURE_RO_COMPAT_GDT_CSUM ? 1 : 0;
+		(EXT4_FEATURE_RO_COMPAT_GDT_CSUM |
+		 EXT4_FEATURE_RO_COMPAT_METADATA_CSUM) ? 1 : 0;
 
 	if (fs->first_pass_ibmap == 0) {
 		for (i = 0; i < fs->no_blkgrp; i++) {
@@ -1096,27 +1377,21 @@ int ext4fs_get_new_inode_no(void)
 				uint16_t bg_flags = ext4fs_bg_get_flags(bgd);
 				uint64_t i_bitmap_blk =
 					ext4fs_bg_get_inode_id(bgd, fs);
-				if (has_gdt_chksum)
-					bgd->bg_itable_unused = free_inodes;
-				if (bg_flags & EXT4_BG_INODE_UNINIT) {
-					put_ext4(i_bitmap_blk * fs->blksz,
-						 zero_buffer, fs->blksz);
-					bg_flags &= ~EXT4_BG_INODE_UNINIT;
-					ext4fs_bg_set_flags(bgd, bg_flags);
-					memcpy(fs->inode_bmaps[i],
-					       zero_buffer, fs->blksz);
-				}
+				if (bg_flags & EXT4_BG_INODE_UNINIT)
+					ext4fs_init_inode_bitmap(i);
 				fs->curr_inode_no =
 				    _get_new_inode_no(fs->inode_bmaps[i]);
 				if (fs->curr_inode_no == -1)
 					/* inode bitmap is completely filled */
 					continue;
+				fs->bmap_dirty[i] |= EXT4_BMAP_DIRTY_INODE;
+				if (has_gdt_chksum)
+					ext4fs_bg_itable_unused_update(bgd, fs,
+							fs->curr_inode_no);
 				fs->curr_inode_no = fs->curr_inode_no +
 							(i * inodes_per_grp);
 				fs->first_pass_ibmap++;
 				ext4fs_bg_free_inodes_dec(bgd, fs);
-				if (has_gdt_chksum)
-					ext4fs_bg_itable_unused_dec(bgd, fs);
 				ext4fs_sb_free_inodes_dec(fs->sb);
 				status = ext4fs_devread(i_bitmap_blk *
 							fs->sect_perblk,
@@ -1142,14 +1417,8 @@ restart:
 		uint16_t bg_flags = ext4fs_bg_get_flags(bgd);
 		uint64_t i_bitmap_blk = ext4fs_bg_get_inode_id(bgd, fs);
 
-		if (bg_flags & EXT4_BG_INODE_UNINIT) {
-			put_ext4(i_bitmap_blk * fs->blksz,
-				 zero_buffer, fs->blksz);
-			bg_flags &= ~EXT4_BG_INODE_UNINIT;
-			ext4fs_bg_set_flags(bgd, bg_flags);
-			memcpy(fs->inode_bmaps[ibmap_idx], zero_buffer,
-				fs->blksz);
-		}
+		if (bg_flags & EXT4_BG_INODE_UNINIT)
+			ext4fs_init_inode_bitmap(ibmap_idx);
 
 		if (ext4fs_set_inode_bmap(fs->curr_inode_no,
 					  fs->inode_bmaps[ibmap_idx],
@@ -1172,19 +1441,18 @@ restart:
 		}
 		ext4fs_bg_free_inodes_dec(bgd, fs);
 		if (has_gdt_chksum)
-			bgd->bg_itable_unused = bgd->free_inodes;
+			ext4fs_bg_itable_unused_update(bgd, fs,
+				fs->curr_inode_no - ibmap_idx * inodes_per_grp);
 		ext4fs_sb_free_inodes_dec(fs->sb);
 		goto success;
 	}
 
 success:
 	free(journal_buffer);
-	free(zero_buffer);
 
 	return fs->curr_inode_no;
 fail:
 	free(journal_buffer);
-	free(zero_buffer);
 
 	return -1;
 
@@ -1507,6 +1775,292 @@ void ext4fs_allocate_blocks(struct ext2_inode *file_inode,
 	*total_no_of_block += no_blks_reqd;
 }
 
+/* Journal the on-disk block bitmap of @group before it is first modified */
+static int ext4fs_log_block_bmap(uint32_t group)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext2_block_group *bgd = ext4fs_get_group_descriptor(fs, group);
+	uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
+	char *journal_buffer;
+	int ret = -1;
+
+	if (fs->bmap_dirty[group] & EXT4_BMAP_DIRTY_BLOCK)
+		return 0;
+
+	journal_buffer = zalloc(fs->blksz);
+	if (!journal_buffer)
+		return -ENOMEM;
+	if (ext4fs_devread(b_bitmap_blk * fs->sect_perblk, 0, fs->blksz,
+			   journal_buffer))
+		ret = ext4fs_log_journal(journal_buffer, b_bitmap_blk);
+	free(journal_buffer);
+	fs->bmap_dirty[group] |= EXT4_BMAP_DIRTY_BLOCK;
+
+	return ret;
+}
+
+/*
+ * Allocate up to @want contiguous blocks, searching from block @goal
+ * onwards. The group's bitmap and free counts are updated once for the
+ * whole run. Returns the length of the run, its first block in @start,
+ * or 0 if no free block is left.
+ */
+static uint32_t ext4fs_alloc_blk_run(uint64_t goal, uint32_t want,
+				     uint64_t *start)
+{
+	struct ext_filesystem *fs = get_fs();
+	uint32_t blk_per_grp = le32_to_cpu(fs->sb->blocks_per_group);
+	uint32_t first_data_block = le32_to_cpu(fs->sb->first_data_block);
+	uint32_t group, bit, end, len, free_blocks, n;
+	struct ext2_block_group *bgd;
+	unsigned char *bmap;
+
+	if (goal < first_data_block)
+		goal = first_data_block;
+	group = (goal - first_data_block) / blk_per_grp;
+	bit = (goal - first_data_block) % blk_per_grp;
+	if (group >= fs->no_blkgrp)
+		group = bit = 0;
+
+	for (n = 0; n <= fs->no_blkgrp; n++) {
+		bgd = ext4fs_get_group_descriptor(fs, group);
+		free_blocks = ext4fs_bg_get_free_blocks(bgd, fs);
+		if (!free_blocks)
+			goto next;
+
+		if (ext4fs_bg_get_flags(bgd) & EXT4_BG_BLOCK_UNINIT) {
+			if (ext4fs_log_block_bmap(group))
+				return 0;
+			ext4fs_init_block_bitmap(group);
+		}
+		bmap = fs->blk_bmaps[group];
+
+		/* find the first free block, skipping full bytes */
+		while (bit < blk_per_grp) {
+			if (!(bit & 7) && bmap[bit >> 3] == 0xff)
+				bit += 8;
+			else if (bmap[bit >> 3] & (1 << (bit & 7)))
+				bit++;
+			else
+				break;
+		}
+		if (bit >= blk_per_grp)
+			goto next;
+
+		end = bit + min(want, free_blocks);
+		if (end > blk_per_grp)
+			end = blk_per_grp;
+		for (len = 1; bit + len < end; len++)
+			if (bmap[(bit + len) >> 3] & (1 << ((bit + len) & 7)))
+				break;
+
+		if (ext4fs_log_block_bmap(group))
+			return 0;
+		ext4fs_mark_bitmap_range(bmap, bit, bit + len);
+		ext4fs_bg_set_free_blocks(bgd, fs, free_blocks - len);
+		ext4fs_sb_set_free_blocks(fs->sb,
+				ext4fs_sb_get_free_blocks(fs->sb) - len);
+
+		*start = first_data_block + (uint64_t)group * blk_per_grp + bit;
+		return len;
+next:
+		bit = 0;
+		if (++group >= fs->no_blkgrp)
+			group = 0;
+	}
+
+	return 0;
+}
+
+static void ext4fs_free_blk_run(uint64_t start, uint32_t len)
+{
+	struct ext_filesystem *fs = get_fs();
+	uint32_t blk_per_grp = le32_to_cpu(fs->sb->blocks_per_group);
+	uint32_t first_data_block = le32_to_cpu(fs->sb->first_data_block);
+	struct ext2_block_group *bgd;
+	uint32_t group, bit, count, i;
+
+	while (len) {
+		group = (start - first_data_block) / blk_per_grp;
+		bit = (start - first_data_block) % blk_per_grp;
+		count = min(len, blk_per_grp - bit);
+		if (group >= fs->no_blkgrp || ext4fs_log_block_bmap(group))
+			return;
+
+		bgd = ext4fs_get_group_descriptor(fs, group);
+		for (i = bit; i < bit + count; i++)
+			fs->blk_bmaps[group][i >> 3] &= ~(1 << (i & 7));
+		ext4fs_bg_set_free_blocks(bgd, fs,
+				ext4fs_bg_get_free_blocks(bgd, fs) + count);
+		ext4fs_sb_set_free_blocks(fs->sb,
+				ext4fs_sb_get_free_blocks(fs->sb) + count);
+		debug("EXT4 Blocks releasing %llu+%u: %u\n",
+		      (unsigned long long)start, count, group);
+
+		start += count;
+		len -= count;
+	}
+}
+
+static inline uint64_t ext4fs_ext_pblock(const struct ext4_extent *ext)
+{
+	return le32_to_cpu(ext->ee_start_lo) +
+	       ((uint64_t)le16_to_cpu(ext->ee_start_hi) << 32);
+}
+
+/*
+ * Allocate @total_blocks blocks to an extent mapped inode as a few
+ * contiguous runs. Up to four extents live in the inode itself, more
+ * are placed in a single leaf block.
+ */
+int ext4fs_allocate_extents(struct ext2_inode *file_inode, int inodeno,
+			    unsigned int total_blocks,
+			    unsigned int *total_no_of_block)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4_extent_header *eh =
+		(struct ext4_extent_header *)file_inode->b.blocks.dir_blocks;
+	int max_inode = (sizeof(file_inode->b) -
+			 sizeof(*eh)) / sizeof(struct ext4_extent);
+	int max_leaf = (fs->blksz - sizeof(*eh)) / sizeof(struct ext4_extent);
+	struct ext4_extent *ext, *exts;
+	uint32_t blk_per_grp = le32_to_cpu(fs->sb->blocks_per_group);
+	uint64_t goal, start, leaf_blk;
+	uint32_t lblk = 0, len;
+	char *leaf = NULL;
+	int n = 0;
+
+	exts = zalloc(max_leaf * sizeof(*exts));
+	if (!exts)
+		return -ENOMEM;
+
+	/* start looking in the inode's own group */
+	goal = le32_to_cpu(fs->sb->first_data_block) + (uint64_t)blk_per_grp *
+	       ((inodeno - 1) / le32_to_cpu(fs->sb->inodes_per_group));
+	while (lblk < total_blocks) {
+		len = ext4fs_alloc_blk_run(goal, min_t(uint32_t,
+					   total_blocks - lblk,
+					   EXT4_EXT_INIT_MAX_LEN), &start);
+		if (!len) {
+			printf("no block left to assign\n");
+			goto fail;
+		}
+
+		ext = n ? &exts[n - 1] : NULL;
+		if (ext && ext4fs_ext_pblock(ext) + le16_to_cpu(ext->ee_len) ==
+		    start && le16_to_cpu(ext->ee_len) + len <=
+		    EXT4_EXT_INIT_MAX_LEN) {
+			ext->ee_len = cpu_to_le16(le16_to_cpu(ext->ee_len) +
+						  len);
+		} else {
+			if (n == max_leaf) {
+				printf("file too fragmented\n");
+				goto fail;
+			}
+			ext = &exts[n++];
+			ext->ee_block = cpu_to_le32(lblk);
+			ext->ee_len = cpu_to_le16(len);
+			ext->ee_start_hi = cpu_to_le16(start >> 32);
+			ext->ee_start_lo = cpu_to_le32(start & 0xffffffff);
+		}
+		debug("EXT %u: %llu+%u\n", lblk, (unsigned long long)start,
+		      len);
+		lblk += len;
+		goal = start + len;
+	}
+
+	eh->eh_magic = cpu_to_le16(EXT4_EXT_MAGIC);
+	eh->eh_max = cpu_to_le16(max_inode);
+	if (n <= max_inode) {
+		eh->eh_entries = cpu_to_le16(n);
+		eh->eh_depth = 0;
+		memcpy(eh + 1, exts, n * sizeof(*exts));
+	} else {
+		struct ext4_extent_header *leh;
+		struct ext4_extent_idx *idx;
+
+		if (ext4fs_alloc_blk_run(goal, 1, &leaf_blk) != 1) {
+			printf("no block left to assign\n");
+			goto fail;
+		}
+		leaf = zalloc(fs->blksz);
+		if (!leaf)
+			goto fail;
+		leh = (struct ext4_extent_header *)leaf;
+		leh->eh_magic = cpu_to_le16(EXT4_EXT_MAGIC);
+		leh->eh_entries = cpu_to_le16(n);
+		leh->eh_max = cpu_to_le16(max_leaf);
+		memcpy(leh + 1, exts, n * sizeof(*exts));
+		ext4fs_extent_block_csum_set(inodeno, file_inode, leh);
+		put_ext4(leaf_blk * fs->blksz, leaf, fs->blksz);
+
+		eh->eh_entries = cpu_to_le16(1);
+		eh->eh_depth = cpu_to_le16(1);
+		idx = (struct ext4_extent_idx *)(eh + 1);
+		idx->ei_block = 0;
+		idx->ei_leaf_lo = cpu_to_le32(leaf_blk & 0xffffffff);
+		idx->ei_leaf_hi = cpu_to_le16(leaf_blk >> 32);
+		(*total_no_of_block)++;
+	}
+	file_inode->flags = cpu_to_le32(le32_to_cpu(file_inode->flags) |
+					EXT4_EXTENTS_FL);
+
+	free(leaf);
+	free(exts);
+	return 0;
+fail:
+	free(leaf);
+	free(exts);
+	return -1;
+}
+
+static void ext4fs_free_extent_tree(struct ext4_extent_header *eh)
+{
+	struct ext_filesystem *fs = get_fs();
+	int entries = le16_to_cpu(eh->eh_entries);
+	int i;
+
+	if (le16_to_cpu(eh->eh_magic) != EXT4_EXT_MAGIC)
+		return;
+
+	if (!eh->eh_depth) {
+		struct ext4_extent *ext = (struct ext4_extent *)(eh + 1);
+
+		for (i = 0; i < entries; i++, ext++) {
+			uint32_t len = le16_to_cpu(ext->ee_len);
+
+			/* uninitialized extents have the top bit set */
+			if (len > EXT4_EXT_INIT_MAX_LEN)
+				len -= EXT4_EXT_INIT_MAX_LEN;
+			ext4fs_free_blk_run(ext4fs_ext_pblock(ext), len);
+		}
+	} else {
+		struct ext4_extent_idx *idx = (struct ext4_extent_idx *)(eh + 1);
+		char *buf = zalloc(fs->blksz);
+
+		if (!buf)
+			return;
+		for (i = 0; i < entries; i++, idx++) {
+			uint64_t blk = le32_to_cpu(idx->ei_leaf_lo) +
+				((uint64_t)le16_to_cpu(idx->ei_leaf_hi) << 32);
+
+			if (ext4fs_devread(blk * fs->sect_perblk, 0, fs->blksz,
+					   buf))
+				ext4fs_free_extent_tree(
+					(struct ext4_extent_header *)buf);
+			ext4fs_free_blk_run(blk, 1);
+		}
+		free(buf);
+	}
+}
+
+/* Release all data and extent tree blocks of an extent mapped inode */
+void ext4fs_free_extents(struct ext2_inode *inode)
+{
+	ext4fs_free_extent_tree((struct ext4_extent_header *)
+				inode->b.blocks.dir_blocks);
+}
+
 #endif
 
 static struct ext4_extent_header *ext4fs_get_extent_block
@@ -1991,6 +2545,40 @@ void ext4fs_close(void)
 	ext4fs_reinit_global();
 }
 
+fs_dirent_cb ext4fs_dirent_cb;
+void *ext4fs_dirent_priv;
+
+/*
+ * Print an entry of a directory listing, or hand it to ext4fs_readdir()'s
+ * callback
+ */
+static void ext4fs_ls_entry(const char *name, int type, u32 size)
+{
+	if (ext4fs_dirent_cb) {
+		if (type == FILETYPE_DIRECTORY)
+			ext4fs_dirent_cb(ext4fs_dirent_priv, name, 0, true);
+		else
+			ext4fs_dirent_cb(ext4fs_dirent_priv, name, size, false);
+		return;
+	}
+
+	switch (type) {
+	case FILETYPE_DIRECTORY:
+		printf("<DIR> ");
+		break;
+	case FILETYPE_SYMLINK:
+		printf("<SYM> ");
+		break;
+	case FILETYPE_REG:
+		printf("      ");
+		break;
+	default:
+		printf("< ? > ");
+		break;
+	}
+	printf("%10u %s\n", size, name);
+}
+
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 				struct ext2fs_node **fnode, int *ftype)
 {
@@ -2101,23 +2689,8 @@ int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 					}
 					fdiro->inode_read = 1;
 				}
-				switch (type) {
-				case FILETYPE_DIRECTORY:
-					printf("<DIR> ");
-					break;
-				case FILETYPE_SYMLINK:
-					printf("<SYM> ");
-					break;
-				case FILETYPE_REG:
-					printf("      ");
-					break;
-				default:
-					printf("< ? > ");
-					break;
-				}
-				printf("%10u %s\n",
-				       le32_to_cpu(fdiro->inode.size),
-					filename);
+				ext4fs_ls_entry(filename, type,
+						le32_to_cpu(fdiro->inode.size));
 			}
 			free(fdiro);
 		}
@@ -2290,7 +2863,11 @@ int ext4fs_open(const char *filename, loff_t *len)
 	if (ext4fs_root == NULL)
 		return -1;
 
-	ext4fs_file = NULL;
+	/* The mount may be kept between commands, so drop the last file */
+	if (ext4fs_file) {
+		ext4fs_free_node(ext4fs_file, &ext4fs_root->diropen);
+		ext4fs_file = NULL;
+	}
 	status = ext4fs_find_file(filename, &ext4fs_root->diropen, &fdiro,
 				  FILETYPE_REG);
 	if (status == 0)
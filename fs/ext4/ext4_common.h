@@ -41,6 +41,33 @@
 #define SUPERBLOCK_SIZE	1024
 #define F_FILE			1
 
+/* On-disk offsets of fields not covered by struct ext2_sblock/ext2_inode */
+#define EXT4_SB_CHECKSUM_SEED_OFFSET	0x270
+#define EXT4_SB_CHECKSUM_OFFSET		0x3fc
+#define EXT2_GOOD_OLD_INODE_SIZE	128
+#define EXT4_INODE_CHECKSUM_LO_OFFSET	0x7c
+#define EXT4_INODE_EXTRA_ISIZE_OFFSET	0x80
+#define EXT4_INODE_CHECKSUM_HI_OFFSET	0x82
+#define EXT4_INODE_EXTRA_ISIZE		32
+
+/* Maximum length of an initialized extent */
+#define EXT4_EXT_INIT_MAX_LEN		(1 << 15)
+
+/* ext4fs_bmap_dirty flags, per block group */
+#define EXT4_BMAP_DIRTY_BLOCK		0x1
+#define EXT4_BMAP_DIRTY_INODE		0x2
+
+/* Fake directory entry at the end of a leaf block holding its checksum */
+struct ext4_dir_entry_tail {
+	__le32 det_reserved_zero1;
+	__le16 det_rec_len;
+	__u8 det_reserved_zero2;
+	__u8 det_reserved_ft;
+	__le32 det_checksum;
+};
+
+#define EXT4_DIR_TAIL_FT		0xde
+
 static inline void *zalloc(size_t size)
 {
 	void *p = memalign(ARCH_DMA_MINALIGN, size);
@@ -54,6 +81,9 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos, loff_t len,
 		     char *buf, loff_t *actread);
 int ext4fs_find_file(const char *path, struct ext2fs_node *rootnode,
 			struct ext2fs_node **foundnode, int expecttype);
+/* Set by ext4fs_readdir() to be handed the entries "ls" would print */
+extern fs_dirent_cb ext4fs_dirent_cb;
+extern void *ext4fs_dirent_priv;
 int ext4fs_iterate_dir(struct ext2fs_node *dir, char *name,
 			struct ext2fs_node **fnode, int *ftype);
 
@@ -86,5 +116,17 @@ uint64_t ext4fs_sb_get_free_blocks(const struct ext2_sblock *sb);
 void ext4fs_sb_set_free_blocks(struct ext2_sblock *sb, uint64_t free_blocks);
 uint32_t ext4fs_bg_get_free_blocks(const struct ext2_block_group *bg,
 	const struct ext_filesystem *fs);
+void ext4fs_csum_init(void);
+void ext4fs_sb_csum_set(struct ext2_sblock *sb);
+void ext4fs_inode_csum_set(int inodeno, struct ext2_inode *inode);
+void ext4fs_dirblock_csum_set(int inodeno, const struct ext2_inode *inode,
+			      char *block);
+void ext4fs_extent_block_csum_set(int inodeno, const struct ext2_inode *inode,
+				  struct ext4_extent_header *eh);
+void ext4fs_bg_bitmap_csum_set(uint32_t i);
+int ext4fs_allocate_extents(struct ext2_inode *file_inode, int inodeno,
+			    unsigned int total_blocks,
+			    unsigned int *total_no_of_block);
+void ext4fs_free_extents(struct ext2_inode *inode);
 #endif
 #endif
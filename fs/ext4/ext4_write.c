@@ -72,24 +72,27 @@ static void ext4fs_update(void)
 	struct ext2_block_group *bgd = NULL;
 
 	/* update  super block */
+	ext4fs_sb_csum_set(fs->sb);
 	put_ext4((uint64_t)(SUPERBLOCK_SIZE),
 		 (struct ext2_sblock *)fs->sb, (uint32_t)SUPERBLOCK_SIZE);
 
-	/* update block bitmaps */
+	/* update the bitmaps of the block groups that were modified */
 	for (i = 0; i < fs->no_blkgrp; i++) {
 		bgd = ext4fs_get_group_descriptor(fs, i);
+		if (fs->bmap_dirty[i])
+			ext4fs_bg_bitmap_csum_set(i);
 		bgd->bg_checksum = cpu_to_le16(ext4fs_checksum_update(i));
-		uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
-		put_ext4(b_bitmap_blk * fs->blksz,
-			 fs->blk_bmaps[i], fs->blksz);
-	}
-
-	/* update inode bitmaps */
-	for (i = 0; i < fs->no_blkgrp; i++) {
-		bgd = ext4fs_get_group_descriptor(fs, i);
-		uint64_t i_bitmap_blk = ext4fs_bg_get_inode_id(bgd, fs);
-		put_ext4(i_bitmap_blk * fs->blksz,
-			 fs->inode_bmaps[i], fs->blksz);
+		if (fs->bmap_dirty[i] & EXT4_BMAP_DIRTY_BLOCK) {
+			uint64_t b_bitmap_blk = ext4fs_bg_get_block_id(bgd, fs);
+			put_ext4(b_bitmap_blk * fs->blksz,
+				 fs->blk_bmaps[i], fs->blksz);
+		}
+		if (fs->bmap_dirty[i] & EXT4_BMAP_DIRTY_INODE) {
+			uint64_t i_bitmap_blk = ext4fs_bg_get_inode_id(bgd, fs);
+			put_ext4(i_bitmap_blk * fs->blksz,
+				 fs->inode_bmaps[i], fs->blksz);
+		}
+		fs->bmap_dirty[i] = 0;
 	}
 
 	/* update the block group descriptor table */
@@ -467,11 +470,9 @@ static int ext4fs_delete_file(int inodeno)
 		no_blocks++;
 
 	if (le32_to_cpu(inode.flags) & EXT4_EXTENTS_FL) {
-		/* FIXME delete extent index blocks, i.e. eh_depth >= 1 */
-		struct ext4_extent_header *eh =
-			(struct ext4_extent_header *)
-				inode.b.blocks.dir_blocks;
-		debug("del: dep=%d entries=%d\n", eh->eh_depth, eh->eh_entries);
+		/* extents are released as whole runs, index blocks included */
+		ext4fs_free_extents(&inode);
+		no_blocks = 0;
 	} else {
 		delete_single_indirect_block(&inode);
 		delete_double_indirect_block(&inode);
@@ -600,6 +601,7 @@ int ext4fs_init(void)
 		return -ENOMEM;
 	if (!ext4_read_superblock((char *)fs->sb))
 		goto fail;
+	ext4fs_csum_init();
 
 	/* init journal */
 	if (ext4fs_init_journal())
@@ -618,6 +620,10 @@ int ext4fs_init(void)
 		goto fail;
 	}
 
+	fs->bmap_dirty = zalloc(fs->no_blkgrp);
+	if (!fs->bmap_dirty)
+		goto fail;
+
 	/* load all the available bitmap block of the partition */
 	fs->blk_bmaps = zalloc(fs->no_blkgrp * sizeof(char *));
 	if (!fs->blk_bmaps)
@@ -712,6 +718,7 @@ void ext4fs_deinit(void)
 	new_feature_incompat = le32_to_cpu(fs->sb->feature_incompat);
 	new_feature_incompat &= ~EXT3_FEATURE_INCOMPAT_RECOVER;
 	fs->sb->feature_incompat = cpu_to_le32(new_feature_incompat);
+	ext4fs_sb_csum_set(fs->sb);
 	put_ext4((uint64_t)(SUPERBLOCK_SIZE),
 		 (struct ext2_sblock *)fs->sb, (uint32_t)SUPERBLOCK_SIZE);
 	free(fs->sb);
@@ -735,7 +742,8 @@ void ext4fs_deinit(void)
 		fs->inode_bmaps = NULL;
 	}
 
-
+	free(fs->bmap_dirty);
+	fs->bmap_dirty = NULL;
 	free(fs->gdtable);
 	fs->gdtable = NULL;
 	/*
@@ -831,6 +839,66 @@ static int ext4fs_write_file(struct ext2_inode *file_inode,
 	return len;
 }
 
+/*
+ * Write the content of a newly allocated extent mapped file. Every
+ * extent is a single contiguous request, only the last partial block
+ * goes through a bounce buffer.
+ */
+static int ext4fs_write_extents(struct ext2_inode *file_inode,
+				unsigned int len, char *buf)
+{
+	struct ext_filesystem *fs = get_fs();
+	struct ext4_extent_header *eh =
+		(struct ext4_extent_header *)file_inode->b.blocks.dir_blocks;
+	struct ext4_extent *ext;
+	char *leaf = NULL, *bounce = NULL;
+	unsigned int pos = 0;
+	int i, ret = -1;
+
+	if (eh->eh_depth) {
+		struct ext4_extent_idx *idx = (struct ext4_extent_idx *)(eh + 1);
+		uint64_t blk = le32_to_cpu(idx->ei_leaf_lo) +
+			((uint64_t)le16_to_cpu(idx->ei_leaf_hi) << 32);
+
+		leaf = zalloc(fs->blksz);
+		if (!leaf)
+			return -1;
+		if (ext4fs_devread(blk * fs->sect_perblk, 0, fs->blksz,
+				   leaf) == 0)
+			goto fail;
+		eh = (struct ext4_extent_header *)leaf;
+	}
+
+	ext = (struct ext4_extent *)(eh + 1);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries) && pos < len; i++, ext++) {
+		uint64_t off = (le32_to_cpu(ext->ee_start_lo) +
+				((uint64_t)le16_to_cpu(ext->ee_start_hi) << 32)) *
+			       fs->blksz;
+		unsigned int bytes = min(len - pos,
+					 le16_to_cpu(ext->ee_len) * fs->blksz);
+		unsigned int tail = bytes & (fs->blksz - 1);
+
+		if (bytes - tail)
+			put_ext4(off, buf + pos, bytes - tail);
+		if (tail) {
+			if (!bounce) {
+				bounce = zalloc(fs->blksz);
+				if (!bounce)
+					goto fail;
+			}
+			memcpy(bounce, buf + pos + bytes - tail, tail);
+			put_ext4(off + bytes - tail, bounce, fs->blksz);
+		}
+		pos += bytes;
+	}
+	ret = pos;
+fail:
+	free(bounce);
+	free(leaf);
+
+	return ret;
+}
+
 int ext4fs_write(const char *fname, unsigned char *buffer,
 					unsigned long sizebytes)
 {
@@ -869,6 +937,7 @@ int ext4fs_write(const char *fname, unsigned char *buffer,
 	parent_inodeno = ext4fs_get_parent_inode_num(fname, filename, F_FILE);
 	if (parent_inodeno == -1)
 		goto fail;
+	g_parent_inode_no = parent_inodeno;
 	if (ext4fs_iget(parent_inodeno, g_parent_inode))
 		goto fail;
 	/* do not mess up a directory using hash trees */
@@ -918,10 +987,21 @@ int ext4fs_write(const char *fname, unsigned char *buffer,
 	file_inode->ctime = cpu_to_le32(timestamp);
 	file_inode->nlinks = cpu_to_le16(1);
 	file_inode->size = cpu_to_le32(sizebytes);
+	if (fs->inodesz >= EXT2_GOOD_OLD_INODE_SIZE + EXT4_INODE_EXTRA_ISIZE)
+		*(__le16 *)(inode_buffer + EXT4_INODE_EXTRA_ISIZE_OFFSET) =
+			cpu_to_le16(EXT4_INODE_EXTRA_ISIZE);
 
 	/* Allocate data blocks */
-	ext4fs_allocate_blocks(file_inode, blocks_remaining,
-			       &blks_reqd_for_file);
+	if (le32_to_cpu(fs->sb->feature_incompat) &
+	    EXT4_FEATURE_INCOMPAT_EXTENTS) {
+		if (ext4fs_allocate_extents(file_inode, inodeno,
+					    blocks_remaining,
+					    &blks_reqd_for_file))
+			goto fail;
+	} else {
+		ext4fs_allocate_blocks(file_inode, blocks_remaining,
+				       &blks_reqd_for_file);
+	}
 	file_inode->blockcnt = cpu_to_le32((blks_reqd_for_file * fs->blksz) >>
 		fs->dev_desc->log2blksz);
 
@@ -941,10 +1021,18 @@ int ext4fs_write(const char *fname, unsigned char *buffer,
 		goto fail;
 
 	memcpy(temp_ptr + blkoff, inode_buffer, fs->inodesz);
+	ext4fs_inode_csum_set(inodeno + 1,
+			      (struct ext2_inode *)(temp_ptr + blkoff));
 	if (ext4fs_put_metadata(temp_ptr, itable_blkno))
 		goto fail;
 	/* copy the file content into data blocks */
-	if (ext4fs_write_file(file_inode, 0, sizebytes, (char *)buffer) == -1) {
+	if (le32_to_cpu(file_inode->flags) & EXT4_EXTENTS_FL)
+		ret = ext4fs_write_extents(file_inode, sizebytes,
+					   (char *)buffer);
+	else
+		ret = ext4fs_write_file(file_inode, 0, sizebytes,
+					(char *)buffer);
+	if (ret == -1) {
 		printf("Error in copying content\n");
 		/* FIXME: Deallocate data blocks */
 		goto fail;
@@ -963,7 +1051,10 @@ int ext4fs_write(const char *fname, unsigned char *buffer,
 		if (ext4fs_log_journal(temp_ptr, parent_itable_blkno))
 			goto fail;
 
-		memcpy(temp_ptr + blkoff, g_parent_inode, fs->inodesz);
+		memcpy(temp_ptr + blkoff, g_parent_inode,
+		       sizeof(struct ext2_inode));
+		ext4fs_inode_csum_set(g_parent_inode_no,
+				      (struct ext2_inode *)(temp_ptr + blkoff));
 		if (ext4fs_put_metadata(temp_ptr, parent_itable_blkno))
 			goto fail;
 	} else {
@@ -971,7 +1062,10 @@ int ext4fs_write(const char *fname, unsigned char *buffer,
 		 * If parent and child fall in same inode table block
 		 * both should be kept in 1 buffer
 		 */
-		memcpy(temp_ptr + blkoff, g_parent_inode, fs->inodesz);
+		memcpy(temp_ptr + blkoff, g_parent_inode,
+		       sizeof(struct ext2_inode));
+		ext4fs_inode_csum_set(g_parent_inode_no,
+				      (struct ext2_inode *)(temp_ptr + blkoff));
 		gd_index--;
 		if (ext4fs_put_metadata(temp_ptr, itable_blkno))
 			goto fail;
@@ -176,6 +176,25 @@ int ext4fs_ls(const char *dirname)
 	return 0;
 }
 
+int ext4fs_readdir(const char *dirname, fs_dirent_cb cb, void *priv)
+{
+	struct ext2fs_node *dirnode;
+	int status;
+
+	status = ext4fs_find_file(dirname, &ext4fs_root->diropen, &dirnode,
+				  FILETYPE_DIRECTORY);
+	if (status != 1)
+		return -1;
+
+	ext4fs_dirent_cb = cb;
+	ext4fs_dirent_priv = priv;
+	ext4fs_iterate_dir(dirnode, NULL, NULL, NULL);
+	ext4fs_dirent_cb = NULL;
+	ext4fs_free_node(dirnode, &ext4fs_root->diropen);
+
+	return 0;
+}
+
 int ext4fs_exists(const char *filename)
 {
 	loff_t file_len;
@@ -14,6 +14,7 @@
 #include <config.h>
 #include <exports.h>
 #include <fat.h>
+#include <fs.h>
 #include <asm/byteorder.h>
 #include <part.h>
 #include <malloc.h>
@@ -64,6 +65,7 @@ int fat_set_blk_dev(struct blk_desc *dev_desc, disk_partition_t *info)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, buffer, dev_desc->blksz);
 
+	fs_cache_invalidate();
 	cur_dev = dev_desc;
 	cur_part_info = *info;
 
@@ -162,7 +164,32 @@ static void get_name(dir_entry *dirent, char *s_name)
 	downcase(s_name);
 }
 
+/* Set by fat_readdir() to be handed the entries "ls" would print */
+static fs_dirent_cb fat_dirent_cb;
+static void *fat_dirent_priv;
+
+/*
+ * Print an entry of a directory listing, or hand it to fat_readdir()'s
+ * callback
+ */
+static void fat_ls_entry(const char *name, __u32 size, int isdir)
+{
+	if (fat_dirent_cb)
+		fat_dirent_cb(fat_dirent_priv, name, isdir ? 0 : size, isdir);
+	else if (isdir)
+		printf("            %s/\n", name);
+	else
+		printf(" %8u   %s \n", size, name);
+}
+
+static void fat_ls_summary(int files, int dirs)
+{
+	if (!fat_dirent_cb)
+		printf("\n%d file(s), %d dir(s)\n\n", files, dirs);
+}
+
 static int flush_dirty_fat_buffer(fsdata *mydata);
+static int fill_fat_buffer(fsdata *mydata, __u32 bufnum);
 #if !defined(CONFIG_FAT_WRITE)
 /* Stub for read only operation */
 int flush_dirty_fat_buffer(fsdata *mydata)
@@ -170,6 +197,29 @@ int flush_dirty_fat_buffer(fsdata *mydata)
 	(void)(mydata);
 	return 0;
 }
+
+/*
+ * Read FAT window 'bufnum' into the FAT buffer
+ */
+static int fill_fat_buffer(fsdata *mydata, __u32 bufnum)
+{
+	__u32 getsize = FATBUFBLOCKS;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > mydata->fatlength)
+		getsize = mydata->fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	if (disk_read(startblock, getsize, mydata->fatbuf) < 0) {
+		debug("Error reading FAT blocks\n");
+		return -1;
+	}
+	mydata->fatbufnum = bufnum;
+
+	return 0;
+}
 #endif
 
 /*
@@ -211,26 +261,12 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 
 	/* Read a new block of FAT entries into the cache. */
 	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
 		/* Write back the fatbuf to the disk */
 		if (flush_dirty_fat_buffer(mydata) < 0)
 			return -1;
 
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
+		if (fill_fat_buffer(mydata, bufnum) < 0)
 			return ret;
-		}
-		mydata->fatbufnum = bufnum;
 	}
 
 	/* Get the actual entry from the table */
@@ -620,34 +656,23 @@ static dir_entry *get_dentfromdir(fsdata *mydata, int startsect,
 						     dentptr, l_name);
 					if (dols) {
 						int isdir;
-						char dirc;
 						int doit = 0;
 
 						isdir = (dentptr->attr & ATTR_DIR);
 
 						if (isdir) {
 							dirs++;
-							dirc = '/';
 							doit = 1;
 						} else {
-							dirc = ' ';
 							if (l_name[0] != 0) {
 								files++;
 								doit = 1;
 							}
 						}
-						if (doit) {
-							if (dirc == ' ') {
-								printf(" %8u   %s%c\n",
-								       FAT2CPU32(dentptr->size),
-									l_name,
-									dirc);
-							} else {
-								printf("            %s%c\n",
-									l_name,
-									dirc);
-							}
-						}
+						if (doit)
+							fat_ls_entry(l_name,
+								     FAT2CPU32(dentptr->size),
+								     isdir);
 						dentptr++;
 						continue;
 					}
@@ -659,10 +684,8 @@ static dir_entry *get_dentfromdir(fsdata *mydata, int startsect,
 				}
 			}
 			if (dentptr->name[0] == 0) {
-				if (dols) {
-					printf("\n%d file(s), %d dir(s)\n\n",
-						files, dirs);
-				}
+				if (dols)
+					fat_ls_summary(files, dirs);
 				debug("Dentname == NULL - %d\n", i);
 				return NULL;
 			}
@@ -678,31 +701,22 @@ static dir_entry *get_dentfromdir(fsdata *mydata, int startsect,
 			get_name(dentptr, s_name);
 			if (dols) {
 				int isdir = (dentptr->attr & ATTR_DIR);
-				char dirc;
 				int doit = 0;
 
 				if (isdir) {
 					dirs++;
-					dirc = '/';
 					doit = 1;
 				} else {
-					dirc = ' ';
 					if (s_name[0] != 0) {
 						files++;
 						doit = 1;
 					}
 				}
 
-				if (doit) {
-					if (dirc == ' ') {
-						printf(" %8u   %s%c\n",
-						       FAT2CPU32(dentptr->size),
-							s_name, dirc);
-					} else {
-						printf("            %s%c\n",
-							s_name, dirc);
-					}
-				}
+				if (doit)
+					fat_ls_entry(s_name,
+						     FAT2CPU32(dentptr->size),
+						     isdir);
 
 				dentptr++;
 				continue;
@@ -995,34 +1009,23 @@ root_reparse:
 						     dentptr, l_name);
 
 					if (dols == LS_ROOT) {
-						char dirc;
 						int doit = 0;
 						int isdir =
 							(dentptr->attr & ATTR_DIR);
 
 						if (isdir) {
 							dirs++;
-							dirc = '/';
 							doit = 1;
 						} else {
-							dirc = ' ';
 							if (l_name[0] != 0) {
 								files++;
 								doit = 1;
 							}
 						}
-						if (doit) {
-							if (dirc == ' ') {
-								printf(" %8u   %s%c\n",
-								       FAT2CPU32(dentptr->size),
-									l_name,
-									dirc);
-							} else {
-								printf("            %s%c\n",
-									l_name,
-									dirc);
-							}
-						}
+						if (doit)
+							fat_ls_entry(l_name,
+								     FAT2CPU32(dentptr->size),
+								     isdir);
 						dentptr++;
 						continue;
 					}
@@ -1036,8 +1039,7 @@ root_reparse:
 			} else if (dentptr->name[0] == 0) {
 				debug("RootDentname == NULL - %d\n", i);
 				if (dols == LS_ROOT) {
-					printf("\n%d file(s), %d dir(s)\n\n",
-						files, dirs);
+					fat_ls_summary(files, dirs);
 					ret = 0;
 				}
 				goto exit;
@@ -1053,32 +1055,23 @@ root_reparse:
 
 			if (dols == LS_ROOT) {
 				int isdir = (dentptr->attr & ATTR_DIR);
-				char dirc;
 				int doit = 0;
 
 				if (isdir) {
-					dirc = '/';
 					if (s_name[0] != 0) {
 						dirs++;
 						doit = 1;
 					}
 				} else {
-					dirc = ' ';
 					if (s_name[0] != 0) {
 						files++;
 						doit = 1;
 					}
 				}
-				if (doit) {
-					if (dirc == ' ') {
-						printf(" %8u   %s%c\n",
-						       FAT2CPU32(dentptr->size),
-							s_name, dirc);
-					} else {
-						printf("            %s%c\n",
-							s_name, dirc);
-					}
-				}
+				if (doit)
+					fat_ls_entry(s_name,
+						     FAT2CPU32(dentptr->size),
+						     isdir);
 				dentptr++;
 				continue;
 			}
@@ -1139,9 +1132,9 @@ root_reparse:
 		/* If end of rootdir reached */
 		if (rootdir_end) {
 			if (dols == LS_ROOT) {
-				printf("\n%d file(s), %d dir(s)\n\n",
-				       files, dirs);
+				fat_ls_summary(files, dirs);
 				*size = 0;
+				ret = 0;
 			}
 			goto exit;
 		}
@@ -1179,8 +1172,10 @@ rootdir_done:
 
 		if (get_dentfromdir(mydata, startsect, subname, dentptr,
 				     isdir ? 0 : dols) == NULL) {
-			if (dols && !isdir)
+			if (dols && !isdir) {
 				*size = 0;
+				ret = 0;
+			}
 			goto exit;
 		}
 
@@ -1307,6 +1302,19 @@ int file_fat_ls(const char *dir)
 	return do_fat_read(dir, NULL, 0, LS_YES, &size);
 }
 
+int fat_readdir(const char *dirname, fs_dirent_cb cb, void *priv)
+{
+	loff_t size;
+	int ret;
+
+	fat_dirent_cb = cb;
+	fat_dirent_priv = priv;
+	ret = do_fat_read(dirname, NULL, 0, LS_YES, &size);
+	fat_dirent_cb = NULL;
+
+	return ret;
+}
+
 int fat_exists(const char *filename)
 {
 	int ret;
@@ -11,6 +11,7 @@
 #include <config.h>
 #include <fat.h>
 #include <asm/byteorder.h>
+#include <asm/unaligned.h>
 #include <part.h>
 #include <linux/ctype.h>
 #include <div64.h>
@@ -101,21 +102,30 @@ static void set_name(dir_entry *dirent, const char *filename)
 }
 
 static __u8 num_of_fats;
+
 /*
- * Write fat buffer into block device
+ * State kept for the duration of a write. FAT windows modified by
+ * set_fatent_value() are held in memory and written back only once, by
+ * flush_fat_windows(). A bitmap of the clusters in use, built from the
+ * FAT when the write starts, is used to allocate contiguous cluster runs
+ * without rescanning the FAT.
  */
-static int flush_dirty_fat_buffer(fsdata *mydata)
+static __u8 **fat_windows;	/* modified FAT windows, indexed by bufnum */
+static __u32 fat_num_windows;
+static __u8 *clust_bitmap;	/* set bit: cluster in use */
+static __u32 clust_max;		/* first invalid cluster number */
+static __u32 clust_free;	/* number of free clusters */
+static __u32 clust_next;	/* where to look for free clusters first */
+static __u32 fsinfo_sect;	/* FAT32 FSInfo sector, 0 if none */
+
+/*
+ * Write FAT window 'bufnum' from 'buf' into all FATs on the block device
+ */
+static int write_fat_window(fsdata *mydata, __u32 bufnum, __u8 *buf)
 {
 	int getsize = FATBUFBLOCKS;
 	__u32 fatlength = mydata->fatlength;
-	__u8 *bufptr = mydata->fatbuf;
-	__u32 startblock = mydata->fatbufnum * FATBUFBLOCKS;
-
-	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
-	      (int)mydata->fat_dirty);
-
-	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
-		return 0;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
 
 	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
 	if (startblock + getsize > fatlength)
@@ -124,7 +134,7 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 	startblock += mydata->fat_sect;
 
 	/* Write FAT buf */
-	if (disk_write(startblock, getsize, bufptr) < 0) {
+	if (disk_write(startblock, getsize, buf) < 0) {
 		debug("error: writing FAT blocks\n");
 		return -1;
 	}
@@ -132,14 +142,308 @@ static int flush_dirty_fat_buffer(fsdata *mydata)
 	if (num_of_fats == 2) {
 		/* Update corresponding second FAT blocks */
 		startblock += mydata->fatlength;
-		if (disk_write(startblock, getsize, bufptr) < 0) {
+		if (disk_write(startblock, getsize, buf) < 0) {
 			debug("error: writing second FAT blocks\n");
 			return -1;
 		}
 	}
+
+	return 0;
+}
+
+/*
+ * Evict the FAT buffer. If it was modified it is kept with the other
+ * modified windows until flush_fat_windows() is called.
+ */
+static int flush_dirty_fat_buffer(fsdata *mydata)
+{
+	__u8 *win;
+
+	debug("debug: evicting %d, dirty: %d\n", mydata->fatbufnum,
+	      (int)mydata->fat_dirty);
+
+	if ((!mydata->fat_dirty) || (mydata->fatbufnum == -1))
+		return 0;
+
+	if (!fat_windows)
+		goto write;
+
+	win = fat_windows[mydata->fatbufnum];
+	if (!win) {
+		win = malloc_cache_aligned(FATBUFSIZE);
+		if (!win)
+			goto write;
+		fat_windows[mydata->fatbufnum] = win;
+	}
+	memcpy(win, mydata->fatbuf, FATBUFSIZE);
 	mydata->fat_dirty = 0;
 
 	return 0;
+write:
+	if (write_fat_window(mydata, mydata->fatbufnum, mydata->fatbuf) < 0)
+		return -1;
+	mydata->fat_dirty = 0;
+
+	return 0;
+}
+
+/*
+ * Load FAT window 'bufnum' into the FAT buffer, from memory if it has
+ * been modified during this write, from the block device otherwise
+ */
+static int fill_fat_buffer(fsdata *mydata, __u32 bufnum)
+{
+	__u32 getsize = FATBUFBLOCKS;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+
+	if (fat_windows && fat_windows[bufnum]) {
+		memcpy(mydata->fatbuf, fat_windows[bufnum], FATBUFSIZE);
+		mydata->fatbufnum = bufnum;
+		return 0;
+	}
+
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > mydata->fatlength)
+		getsize = mydata->fatlength - startblock;
+
+	startblock += mydata->fat_sect;
+
+	if (disk_read(startblock, getsize, mydata->fatbuf) < 0) {
+		debug("Error reading FAT blocks\n");
+		return -1;
+	}
+	mydata->fatbufnum = bufnum;
+
+	return 0;
+}
+
+/*
+ * Write all FAT windows modified during this write to the block device
+ */
+static int flush_fat_windows(fsdata *mydata)
+{
+	__u32 i;
+
+	if (flush_dirty_fat_buffer(mydata) < 0)
+		return -1;
+
+	for (i = 0; fat_windows && i < fat_num_windows; i++) {
+		if (!fat_windows[i])
+			continue;
+		if (write_fat_window(mydata, i, fat_windows[i]) < 0)
+			return -1;
+		free(fat_windows[i]);
+		fat_windows[i] = NULL;
+	}
+
+	return 0;
+}
+
+static inline int clust_in_use(__u32 clust)
+{
+	return clust_bitmap[clust >> 3] & (1 << (clust & 7));
+}
+
+static inline void clust_set_used(__u32 clust)
+{
+	clust_bitmap[clust >> 3] |= 1 << (clust & 7);
+}
+
+static inline void clust_set_free(__u32 clust)
+{
+	clust_bitmap[clust >> 3] &= ~(1 << (clust & 7));
+}
+
+/*
+ * Read the whole FAT, in chunks much larger than a FAT window, and note
+ * which clusters are in use
+ */
+static int init_clust_bitmap(fsdata *mydata)
+{
+	/* a multiple of 3 sectors always holds whole FAT12 entries */
+	__u32 chunk = FATBUFBLOCKS * 16;
+	__u32 sect, nsect, first, last, entry, off, val;
+	__u8 *buf;
+
+	clust_max = (total_sector - mydata->data_begin) / mydata->clust_size;
+	last = mydata->fatlength * mydata->sect_size * 8 / mydata->fatsize;
+	if (clust_max > last)
+		clust_max = last;
+	last = (mydata->fatsize == 32) ? 0x0ffffff7 :
+	       (mydata->fatsize == 16) ? 0xfff7 : 0xff7;
+	if (clust_max > last)
+		clust_max = last;
+
+	fat_num_windows = DIV_ROUND_UP(mydata->fatlength, FATBUFBLOCKS);
+	fat_windows = calloc(fat_num_windows, sizeof(*fat_windows));
+	clust_bitmap = calloc(DIV_ROUND_UP(clust_max, 8), 1);
+	buf = malloc_cache_aligned(chunk * mydata->sect_size);
+	if (!fat_windows || !clust_bitmap || !buf) {
+		free(buf);
+		return -1;
+	}
+
+	clust_set_used(0);
+	clust_set_used(1);
+	clust_free = 0;
+	for (sect = 0; sect < mydata->fatlength; sect += chunk) {
+		nsect = min(chunk, mydata->fatlength - sect);
+		if (disk_read(mydata->fat_sect + sect, nsect, buf) < 0) {
+			debug("Error reading FAT blocks\n");
+			free(buf);
+			return -1;
+		}
+
+		first = sect * mydata->sect_size * 8 / mydata->fatsize;
+		last = first + nsect * mydata->sect_size * 8 / mydata->fatsize;
+		if (last > clust_max)
+			last = clust_max;
+		for (entry = max(first, 2U); entry < last; entry++) {
+			off = entry - first;
+			switch (mydata->fatsize) {
+			case 32:
+				val = FAT2CPU32(((__u32 *)buf)[off]) &
+				      0x0fffffff;
+				break;
+			case 16:
+				val = FAT2CPU16(((__u16 *)buf)[off]);
+				break;
+			default:
+				val = buf[off * 3 / 2] +
+				      (buf[off * 3 / 2 + 1] << 8);
+				if (off & 1)
+					val >>= 4;
+				val &= 0xfff;
+				break;
+			}
+			if (val)
+				clust_set_used(entry);
+			else
+				clust_free++;
+		}
+	}
+	free(buf);
+
+	if (clust_next < 2 || clust_next >= clust_max)
+		clust_next = 2;
+	debug("FAT%d: %u clusters, %u free\n", mydata->fatsize, clust_max - 2,
+	      clust_free);
+
+	return 0;
+}
+
+static void free_clust_bitmap(void)
+{
+	__u32 i;
+
+	for (i = 0; fat_windows && i < fat_num_windows; i++)
+		free(fat_windows[i]);
+	free(fat_windows);
+	fat_windows = NULL;
+	free(clust_bitmap);
+	clust_bitmap = NULL;
+}
+
+/*
+ * Find the first free cluster at or after 'goal', wrapping around at the
+ * end of the filesystem. There must be at least one free cluster.
+ */
+static __u32 find_free_clust(__u32 goal)
+{
+	__u32 clust = goal;
+
+	if (clust < 2 || clust >= clust_max)
+		clust = 2;
+
+	while (clust_in_use(clust)) {
+		if (!(clust & 7) && clust + 8 <= clust_max &&
+		    clust_bitmap[clust >> 3] == 0xff)
+			clust += 8;
+		else
+			clust++;
+		if (clust >= clust_max)
+			clust = 2;
+	}
+
+	return clust;
+}
+
+/*
+ * Reserve up to 'want' contiguous free clusters, looking from 'goal'
+ * onwards. Return the length of the run and its first cluster in
+ * '*start', or 0 if the filesystem is full. The FAT is not modified.
+ */
+static __u32 alloc_clust_run(__u32 goal, __u32 want, __u32 *start)
+{
+	__u32 clust, len;
+
+	if (!clust_free || !want)
+		return 0;
+
+	clust = find_free_clust(goal);
+	for (len = 1; len < want && clust + len < clust_max; len++)
+		if (clust_in_use(clust + len))
+			break;
+
+	for (*start = clust; clust < *start + len; clust++)
+		clust_set_used(clust);
+	clust_free -= len;
+	clust_next = clust;
+
+	return len;
+}
+
+/*
+ * Update the free cluster count and next free cluster hints in the FAT32
+ * FSInfo sector
+ */
+static int update_fsinfo(fsdata *mydata)
+{
+	__u8 *buf;
+	int ret = -1;
+
+	if (mydata->fatsize != 32 || !fsinfo_sect)
+		return 0;
+
+	buf = malloc_cache_aligned(mydata->sect_size);
+	if (!buf)
+		return -1;
+	if (disk_read(fsinfo_sect, 1, buf) < 0)
+		goto out;
+
+	ret = 0;
+	if (get_unaligned_le32(buf) != FSINFO_LEAD_SIG ||
+	    get_unaligned_le32(buf + FSINFO_STRUC_SIG_OFF) != FSINFO_STRUC_SIG)
+		goto out;
+
+	put_unaligned_le32(clust_free, buf + FSINFO_FREE_COUNT_OFF);
+	put_unaligned_le32(clust_next, buf + FSINFO_NEXT_FREE_OFF);
+	if (disk_write(fsinfo_sect, 1, buf) < 0)
+		ret = -1;
+out:
+	free(buf);
+	return ret;
+}
+
+/*
+ * Read the next free cluster hint from the FAT32 FSInfo sector
+ */
+static void read_fsinfo(fsdata *mydata)
+{
+	__u8 *buf;
+
+	clust_next = 2;
+	if (mydata->fatsize != 32 || !fsinfo_sect)
+		return;
+
+	buf = malloc_cache_aligned(mydata->sect_size);
+	if (!buf)
+		return;
+	if (disk_read(fsinfo_sect, 1, buf) >= 0 &&
+	    get_unaligned_le32(buf) == FSINFO_LEAD_SIG &&
+	    get_unaligned_le32(buf + FSINFO_STRUC_SIG_OFF) == FSINFO_STRUC_SIG)
+		clust_next = get_unaligned_le32(buf + FSINFO_NEXT_FREE_OFF);
+	free(buf);
 }
 
 /*
@@ -388,25 +692,11 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 
 	/* Read a new block of FAT entries into the cache. */
 	if (bufnum != mydata->fatbufnum) {
-		int getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
 		if (flush_dirty_fat_buffer(mydata) < 0)
 			return -1;
 
-		startblock += mydata->fat_sect;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
+		if (fill_fat_buffer(mydata, bufnum) < 0)
 			return -1;
-		}
-		mydata->fatbufnum = bufnum;
 	}
 
 	/* Mark as dirty */
@@ -466,29 +756,6 @@ static int set_fatent_value(fsdata *mydata, __u32 entry, __u32 entry_value)
 	return 0;
 }
 
-/*
- * Determine the next free cluster after 'entry' in a FAT (12/16/32) table
- * and link it to 'entry'. EOC marker is not set on returned entry.
- */
-static __u32 determine_fatent(fsdata *mydata, __u32 entry)
-{
-	__u32 next_fat, next_entry = entry + 1;
-
-	while (1) {
-		next_fat = get_fatent(mydata, next_entry);
-		if (next_fat == 0) {
-			/* found free entry, link to entry */
-			set_fatent_value(mydata, entry, next_entry);
-			break;
-		}
-		next_entry++;
-	}
-	debug("FAT%d: entry: %08x, entry_value: %04x\n",
-	       mydata->fatsize, entry, next_entry);
-
-	return next_entry;
-}
-
 /*
  * Write at most 'size' bytes from 'buffer' into the specified cluster.
  * Return 0 on success, -1 otherwise.
@@ -558,16 +825,10 @@ set_cluster(fsdata *mydata, __u32 clustnum, __u8 *buffer,
  */
 static int find_empty_cluster(fsdata *mydata)
 {
-	__u32 fat_val, entry = 3;
-
-	while (1) {
-		fat_val = get_fatent(mydata, entry);
-		if (fat_val == 0)
-			break;
-		entry++;
-	}
+	if (!clust_free)
+		return -1;
 
-	return entry;
+	return find_free_clust(clust_next);
 }
 
 /*
@@ -575,7 +836,7 @@ static int find_empty_cluster(fsdata *mydata)
  */
 static void flush_dir_table(fsdata *mydata, dir_entry **dentptr)
 {
-	int dir_newclust = 0;
+	__u32 dir_newclust = 0;
 
 	if (set_cluster(mydata, dir_curclust,
 		    get_dentfromdir_block,
@@ -583,7 +844,10 @@ static void flush_dir_table(fsdata *mydata, dir_entry **dentptr)
 		printf("error: wrinting directory entry\n");
 		return;
 	}
-	dir_newclust = find_empty_cluster(mydata);
+	if (!alloc_clust_run(clust_next, 1, &dir_newclust)) {
+		printf("error: no free cluster for directory\n");
+		return;
+	}
 	set_fatent_value(mydata, dir_curclust, dir_newclust);
 	if (mydata->fatsize == 32)
 		set_fatent_value(mydata, dir_newclust, 0xffffff8);
@@ -617,6 +881,11 @@ static int clear_fatent(fsdata *mydata, __u32 entry)
 		else
 			break;
 
+		if (entry < clust_max && clust_in_use(entry)) {
+			clust_set_free(entry);
+			clust_free++;
+		}
+
 		entry = fat_val;
 	}
 
@@ -627,6 +896,18 @@ static int clear_fatent(fsdata *mydata, __u32 entry)
 	return 0;
 }
 
+/*
+ * Set start cluster in directory entry
+ */
+static void set_start_cluster(const fsdata *mydata, dir_entry *dentptr,
+				__u32 start_cluster)
+{
+	if (mydata->fatsize == 32)
+		dentptr->starthi =
+			cpu_to_le16((start_cluster & 0xffff0000) >> 16);
+	dentptr->start = cpu_to_le16(start_cluster & 0xffff);
+}
+
 /*
  * Write at most 'maxsize' bytes from 'buffer' into
  * the file associated with 'dentptr'
@@ -641,6 +922,7 @@ set_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
 	__u32 curclust = START(dentptr);
 	__u32 endclust = 0, newclust = 0;
+	__u32 clustcount, len;
 	loff_t actsize;
 
 	*gotsize = 0;
@@ -659,72 +941,48 @@ set_contents(fsdata *mydata, dir_entry *dentptr, __u8 *buffer,
 		return 0;
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = determine_fatent(mydata, endclust);
-
-			if ((newclust - 1) != endclust)
-				goto getit;
-
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("newclust: 0x%x\n", newclust);
-				debug("Invalid FAT entry\n");
-				return 0;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* set remaining bytes */
-		actsize = filesize;
-		if (set_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			debug("error: writing cluster\n");
+	clustcount = DIV_ROUND_UP(filesize, bytesperclust);
+	while (clustcount) {
+		/* allocate as many consecutive clusters as possible */
+		len = alloc_clust_run(curclust, clustcount, &newclust);
+		if (!len) {
+			printf("Error: no free clusters left\n");
 			return -1;
 		}
-		*gotsize += actsize;
-
-		/* Mark end of file in FAT */
-		if (mydata->fatsize == 12)
-			newclust = 0xfff;
-		else if (mydata->fatsize == 16)
-			newclust = 0xffff;
-		else if (mydata->fatsize == 32)
-			newclust = 0xfffffff;
-		set_fatent_value(mydata, endclust, newclust);
+		debug("run: 0x%x+%u\n", newclust, len);
 
-		return 0;
-getit:
-		if (set_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+		if (endclust)
+			set_fatent_value(mydata, endclust, newclust);
+		else
+			set_start_cluster(mydata, dentptr, newclust);
+		for (curclust = newclust; curclust < newclust + len - 1;
+		     curclust++)
+			set_fatent_value(mydata, curclust, curclust + 1);
+		endclust = curclust;
+
+		actsize = min_t(loff_t, filesize, (loff_t)len * bytesperclust);
+		if (set_cluster(mydata, newclust, buffer,
+				(unsigned long)actsize) != 0) {
 			debug("error: writing cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
 		filesize -= actsize;
 		buffer += actsize;
+		clustcount -= len;
+		curclust = endclust + 1;
+	}
 
-		if (CHECK_CLUST(newclust, mydata->fatsize)) {
-			debug("newclust: 0x%x\n", newclust);
-			debug("Invalid FAT entry\n");
-			return 0;
-		}
-		actsize = bytesperclust;
-		curclust = endclust = newclust;
-	} while (1);
-}
+	/* Mark end of file in FAT */
+	if (mydata->fatsize == 12)
+		newclust = 0xfff;
+	else if (mydata->fatsize == 16)
+		newclust = 0xffff;
+	else if (mydata->fatsize == 32)
+		newclust = 0xfffffff;
+	set_fatent_value(mydata, endclust, newclust);
 
-/*
- * Set start cluster in directory entry
- */
-static void set_start_cluster(const fsdata *mydata, dir_entry *dentptr,
-				__u32 start_cluster)
-{
-	if (mydata->fatsize == 32)
-		dentptr->starthi =
-			cpu_to_le16((start_cluster & 0xffff0000) >> 16);
-	dentptr->start = cpu_to_le16(start_cluster & 0xffff);
+	return 0;
 }
 
 /*
@@ -742,27 +1000,35 @@ static void fill_dentry(fsdata *mydata, dir_entry *dentptr,
 }
 
 /*
- * Check whether adding a file makes the file system to
- * exceed the size of the block device
- * Return -1 when overflow occurs, otherwise return 0
+ * Count the clusters clear_fatent() frees from 'entry' to the end of a file
  */
-static int check_overflow(fsdata *mydata, __u32 clustnum, loff_t size)
+static __u32 count_fatent(fsdata *mydata, __u32 entry)
 {
-	__u32 startsect, sect_num, offset;
-
-	if (clustnum > 0) {
-		startsect = mydata->data_begin +
-				clustnum * mydata->clust_size;
-	} else {
-		startsect = mydata->rootdir_sect;
+	__u32 count = 0, n;
+
+	for (n = 0; n < clust_max && !CHECK_CLUST(entry, mydata->fatsize);
+	     n++) {
+		if (entry < clust_max && clust_in_use(entry))
+			count++;
+		entry = get_fatent(mydata, entry);
+		if (!entry)
+			break;
 	}
 
-	sect_num = div_u64_rem(size, mydata->sect_size, &offset);
+	return count;
+}
 
-	if (offset != 0)
-		sect_num++;
+/*
+ * Check whether 'size' bytes fit in the free clusters, plus 'freed'
+ * clusters about to be released. Files are allocated wherever there is
+ * room and may be fragmented, so only the amount of free space counts.
+ * Return -1 when overflow occurs, otherwise return 0
+ */
+static int check_overflow(fsdata *mydata, __u32 freed, loff_t size)
+{
+	__u32 bytesperclust = mydata->clust_size * mydata->sect_size;
 
-	if (startsect + sect_num > total_sector)
+	if ((loff_t)(clust_free + freed) * bytesperclust < size)
 		return -1;
 	return 0;
 }
@@ -966,6 +1232,13 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		return -1;
 	}
 
+	fsinfo_sect = (mydata->fatsize == 32) ? bs.info_sector : 0;
+	read_fsinfo(mydata);
+	if (init_clust_bitmap(mydata)) {
+		printf("Error: reading FAT\n");
+		goto exit;
+	}
+
 	if (disk_read(cursect,
 		(mydata->fatsize == 32) ?
 		(mydata->clust_size) :
@@ -993,8 +1266,9 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 
 		if (start_cluster) {
 			if (size) {
-				ret = check_overflow(mydata, start_cluster,
-							size);
+				ret = check_overflow(mydata,
+					count_fatent(mydata, start_cluster),
+					size);
 				if (ret) {
 					printf("Error: %llu overflow\n", size);
 					goto exit;
@@ -1016,7 +1290,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 				goto exit;
 			}
 
-			ret = check_overflow(mydata, start_cluster, size);
+			ret = check_overflow(mydata, 0, size);
 			if (ret) {
 				printf("Error: %llu overflow\n", size);
 				goto exit;
@@ -1036,7 +1310,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 				goto exit;
 			}
 
-			ret = check_overflow(mydata, start_cluster, size);
+			ret = check_overflow(mydata, 0, size);
 			if (ret) {
 				printf("Error: %llu overflow\n", size);
 				goto exit;
@@ -1059,13 +1333,19 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 	}
 	debug("attempt to write 0x%llx bytes\n", *actwrite);
 
-	/* Flush fat buffer */
-	ret = flush_dirty_fat_buffer(mydata);
+	/* Write back all modified FAT windows at once */
+	ret = flush_fat_windows(mydata);
 	if (ret) {
 		printf("Error: flush fat buffer\n");
 		goto exit;
 	}
 
+	ret = update_fsinfo(mydata);
+	if (ret) {
+		printf("Error: updating FSInfo sector\n");
+		goto exit;
+	}
+
 	/* Write directory table to device */
 	ret = set_cluster(mydata, dir_curclust, get_dentfromdir_block,
 			mydata->clust_size * mydata->sect_size);
@@ -1073,6 +1353,7 @@ static int do_fat_write(const char *filename, void *buffer, loff_t size,
 		printf("Error: writing directory entry\n");
 
 exit:
+	free_clust_bitmap();
 	free(mydata->fatbuf);
 	return ret;
 }
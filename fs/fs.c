@@ -7,15 +7,20 @@
 #include <config.h>
 #include <errno.h>
 #include <common.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <part.h>
+#include <btrfs.h>
+#include <exfat.h>
 #include <ext4fs.h>
 #include <fat.h>
 #include <fs.h>
 #include <sandboxfs.h>
+#include <squashfs.h>
 #include <ubifs_uboot.h>
 #include <asm/io.h>
 #include <div64.h>
+#include <linux/list.h>
 #include <linux/math64.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -36,6 +41,12 @@ static inline int fs_ls_unsupported(const char *dirname)
 	return -1;
 }
 
+static inline int fs_readdir_unsupported(const char *dirname,
+					 fs_dirent_cb cb, void *priv)
+{
+	return -1;
+}
+
 static inline int fs_exists_unsupported(const char *filename)
 {
 	return 0;
@@ -84,6 +95,7 @@ struct fstype_info {
 	int (*probe)(struct blk_desc *fs_dev_desc,
 		     disk_partition_t *fs_partition);
 	int (*ls)(const char *dirname);
+	int (*readdir)(const char *dirname, fs_dirent_cb cb, void *priv);
 	int (*exists)(const char *filename);
 	int (*size)(const char *filename, loff_t *size);
 	int (*read)(const char *filename, void *buf, loff_t offset,
@@ -103,6 +115,7 @@ static struct fstype_info fstypes[] = {
 		.probe = fat_set_blk_dev,
 		.close = fat_close,
 		.ls = file_fat_ls,
+		.readdir = fat_readdir,
 		.exists = fat_exists,
 		.size = fat_size,
 		.read = fat_read_file,
@@ -114,6 +127,22 @@ static struct fstype_info fstypes[] = {
 		.uuid = fs_uuid_unsupported,
 	},
 #endif
+#ifdef CONFIG_FS_EXFAT
+	{
+		.fstype = FS_TYPE_EXFAT,
+		.name = "exfat",
+		.null_dev_desc_ok = false,
+		.probe = exfat_set_blk_dev,
+		.close = exfat_close,
+		.ls = exfat_ls,
+		.readdir = fs_readdir_unsupported,
+		.exists = exfat_exists,
+		.size = exfat_size,
+		.read = exfat_read_file,
+		.write = fs_write_unsupported,
+		.uuid = exfat_uuid,
+	},
+#endif
 #ifdef CONFIG_FS_EXT4
 	{
 		.fstype = FS_TYPE_EXT,
@@ -122,6 +151,7 @@ static struct fstype_info fstypes[] = {
 		.probe = ext4fs_probe,
 		.close = ext4fs_close,
 		.ls = ext4fs_ls,
+		.readdir = ext4fs_readdir,
 		.exists = ext4fs_exists,
 		.size = ext4fs_size,
 		.read = ext4_read_file,
@@ -133,6 +163,38 @@ static struct fstype_info fstypes[] = {
 		.uuid = ext4fs_uuid,
 	},
 #endif
+#ifdef CONFIG_FS_SQUASHFS
+	{
+		.fstype = FS_TYPE_SQUASHFS,
+		.name = "squashfs",
+		.null_dev_desc_ok = false,
+		.probe = squashfs_set_blk_dev,
+		.close = squashfs_close,
+		.ls = squashfs_ls,
+		.readdir = fs_readdir_unsupported,
+		.exists = squashfs_exists,
+		.size = squashfs_size,
+		.read = squashfs_read_file,
+		.write = fs_write_unsupported,
+		.uuid = fs_uuid_unsupported,
+	},
+#endif
+#ifdef CONFIG_FS_BTRFS
+	{
+		.fstype = FS_TYPE_BTRFS,
+		.name = "btrfs",
+		.null_dev_desc_ok = false,
+		.probe = btrfs_set_blk_dev,
+		.close = btrfs_close,
+		.ls = btrfs_ls,
+		.readdir = fs_readdir_unsupported,
+		.exists = btrfs_exists,
+		.size = btrfs_size,
+		.read = btrfs_read_file,
+		.write = fs_write_unsupported,
+		.uuid = fs_uuid_unsupported,
+	},
+#endif
 #ifdef CONFIG_SANDBOX
 	{
 		.fstype = FS_TYPE_SANDBOX,
@@ -141,6 +203,7 @@ static struct fstype_info fstypes[] = {
 		.probe = sandbox_fs_set_blk_dev,
 		.close = sandbox_fs_close,
 		.ls = sandbox_fs_ls,
+		.readdir = fs_readdir_unsupported,
 		.exists = sandbox_fs_exists,
 		.size = sandbox_fs_size,
 		.read = fs_read_sandbox,
@@ -156,6 +219,7 @@ static struct fstype_info fstypes[] = {
 		.probe = ubifs_set_blk_dev,
 		.close = ubifs_close,
 		.ls = ubifs_ls,
+		.readdir = fs_readdir_unsupported,
 		.exists = ubifs_exists,
 		.size = ubifs_size,
 		.read = ubifs_read,
@@ -170,6 +234,7 @@ static struct fstype_info fstypes[] = {
 		.probe = fs_probe_unsupported,
 		.close = fs_close_unsupported,
 		.ls = fs_ls_unsupported,
+		.readdir = fs_readdir_unsupported,
 		.exists = fs_exists_unsupported,
 		.size = fs_size_unsupported,
 		.read = fs_read_unsupported,
@@ -192,6 +257,147 @@ static struct fstype_info *fs_get_info(int fstype)
 	return info;
 }
 
+#if CONFIG_IS_ENABLED(FS_CACHE)
+/*
+ * The filesystem most recently probed on a block device stays mounted
+ * after the command that used it. Lookups made through it are remembered
+ * by path until the mount goes away.
+ */
+#define FS_DENTRY_CACHE_MAX	64
+
+struct fs_dentry {
+	struct list_head lh;
+	char *path;
+	int exists;		/* -1 if not looked up yet */
+	int size_ret;		/* 1 if not looked up yet */
+	loff_t size;
+};
+
+static struct {
+	struct blk_desc *dev_desc;
+	int hwpart;
+	lbaint_t part_start;
+	lbaint_t part_size;
+	int fstype;
+	bool stale;
+	int dentries;
+} fs_mount = {
+	.fstype = FS_TYPE_ANY,
+};
+
+static LIST_HEAD(fs_dentry_cache);
+
+void fs_cache_invalidate(void)
+{
+	fs_mount.stale = true;
+}
+
+static bool fs_is_mounted(void)
+{
+	return fs_type != FS_TYPE_ANY && fs_type == fs_mount.fstype &&
+	       fs_dev_desc == fs_mount.dev_desc &&
+	       fs_dev_desc->hwpart == fs_mount.hwpart;
+}
+
+static void fs_dentry_free(struct fs_dentry *dentry)
+{
+	list_del(&dentry->lh);
+	free(dentry->path);
+	free(dentry);
+	fs_mount.dentries--;
+}
+
+static struct fs_dentry *fs_dentry_get(const char *path)
+{
+	struct fs_dentry *dentry;
+
+	if (!fs_is_mounted() || fs_mount.stale)
+		return NULL;
+
+	list_for_each_entry(dentry, &fs_dentry_cache, lh) {
+		if (!strcmp(dentry->path, path)) {
+			/* maintain MRU ordering */
+			list_move(&dentry->lh, &fs_dentry_cache);
+			return dentry;
+		}
+	}
+
+	if (fs_mount.dentries >= FS_DENTRY_CACHE_MAX)
+		fs_dentry_free(list_last_entry(&fs_dentry_cache,
+					       struct fs_dentry, lh));
+
+	dentry = malloc(sizeof(*dentry));
+	if (!dentry)
+		return NULL;
+	dentry->path = strdup(path);
+	if (!dentry->path) {
+		free(dentry);
+		return NULL;
+	}
+	dentry->exists = -1;
+	dentry->size_ret = 1;
+	list_add(&dentry->lh, &fs_dentry_cache);
+	fs_mount.dentries++;
+
+	return dentry;
+}
+
+static void fs_unmount(void)
+{
+	struct fs_dentry *dentry, *n;
+
+	list_for_each_entry_safe(dentry, n, &fs_dentry_cache, lh)
+		fs_dentry_free(dentry);
+
+	if (fs_mount.fstype != FS_TYPE_ANY)
+		fs_get_info(fs_mount.fstype)->close();
+	fs_mount.dev_desc = NULL;
+	fs_mount.fstype = FS_TYPE_ANY;
+	fs_mount.stale = false;
+}
+
+/* Reuse the mounted filesystem if it is the one being asked for */
+static int fs_remount(int fstype)
+{
+	if (fs_mount.fstype == FS_TYPE_ANY || fs_mount.stale ||
+	    !fs_dev_desc || fs_dev_desc != fs_mount.dev_desc ||
+	    fs_dev_desc->hwpart != fs_mount.hwpart ||
+	    fs_partition.start != fs_mount.part_start ||
+	    fs_partition.size != fs_mount.part_size)
+		return -1;
+
+	if (fstype != FS_TYPE_ANY && fstype != fs_mount.fstype)
+		return -1;
+
+	fs_type = fs_mount.fstype;
+
+	return 0;
+}
+
+static void fs_mount_done(void)
+{
+	/* Virtual filesystems are not backed by a device we can watch */
+	if (!fs_dev_desc)
+		return;
+
+	fs_mount.dev_desc = fs_dev_desc;
+	/* eMMC hardware partitions share a blk_desc and may match in size */
+	fs_mount.hwpart = fs_dev_desc->hwpart;
+	fs_mount.part_start = fs_partition.start;
+	fs_mount.part_size = fs_partition.size;
+	fs_mount.fstype = fs_type;
+	fs_mount.stale = false;
+}
+#else
+static inline int fs_remount(int fstype)
+{
+	return -1;
+}
+
+static inline void fs_unmount(void) {}
+static inline void fs_mount_done(void) {}
+#endif
+
 int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 {
 	struct fstype_info *info;
@@ -218,6 +424,10 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 	if (part < 0)
 		return -1;
 
+	if (!fs_remount(fstype))
+		return 0;
+	fs_unmount();
+
 	for (i = 0, info = fstypes; i < ARRAY_SIZE(fstypes); i++, info++) {
 		if (fstype != FS_TYPE_ANY && info->fstype != FS_TYPE_ANY &&
 				fstype != info->fstype)
@@ -228,6 +438,7 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype)
 
 		if (!info->probe(fs_dev_desc, &fs_partition)) {
 			fs_type = info->fstype;
+			fs_mount_done();
 			return 0;
 		}
 	}
@@ -239,6 +450,13 @@ static void fs_close(void)
 {
 	struct fstype_info *info = fs_get_info(fs_type);
 
+#if CONFIG_IS_ENABLED(FS_CACHE)
+	/* Keep it around for the next command */
+	if (fs_is_mounted()) {
+		fs_type = FS_TYPE_ANY;
+		return;
+	}
+#endif
 	info->close();
 
 	fs_type = FS_TYPE_ANY;
@@ -265,13 +483,52 @@ int fs_ls(const char *dirname)
 	return ret;
 }
 
+struct fs_readdir_priv {
+	fs_dirent_cb cb;
+	void *priv;
+};
+
+static void fs_readdir_entry(void *priv, const char *name, loff_t size,
+			     bool isdir)
+{
+	struct fs_readdir_priv *rp = priv;
+
+	if (!strcmp(name, ".") || !strcmp(name, ".."))
+		return;
+	rp->cb(rp->priv, name, size, isdir);
+}
+
+int fs_readdir(const char *dirname, fs_dirent_cb cb, void *priv)
+{
+	struct fstype_info *info = fs_get_info(fs_type);
+	struct fs_readdir_priv rp = { cb, priv };
+	int ret;
+
+	ret = info->readdir(dirname, fs_readdir_entry, &rp);
+	fs_close();
+
+	return ret;
+}
+
 int fs_exists(const char *filename)
 {
 	int ret;
 
 	struct fstype_info *info = fs_get_info(fs_type);
+#if CONFIG_IS_ENABLED(FS_CACHE)
+	struct fs_dentry *dentry = fs_dentry_get(filename);
+
+	if (dentry && dentry->exists != -1) {
+		fs_close();
+		return dentry->exists;
+	}
+#endif
 
 	ret = info->exists(filename);
+#if CONFIG_IS_ENABLED(FS_CACHE)
+	if (dentry)
+		dentry->exists = ret;
+#endif
 
 	fs_close();
 
@@ -283,8 +540,23 @@ int fs_size(const char *filename, loff_t *size)
 	int ret;
 
 	struct fstype_info *info = fs_get_info(fs_type);
+#if CONFIG_IS_ENABLED(FS_CACHE)
+	struct fs_dentry *dentry = fs_dentry_get(filename);
+
+	if (dentry && dentry->size_ret <= 0) {
+		*size = dentry->size;
+		fs_close();
+		return dentry->size_ret;
+	}
+#endif
 
 	ret = info->size(filename, size);
+#if CONFIG_IS_ENABLED(FS_CACHE)
+	if (dentry) {
+		dentry->size_ret = ret < 0 ? -1 : 0;
+		dentry->size = *size;
+	}
+#endif
 
 	fs_close();
 
@@ -324,6 +596,7 @@ int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	buf = map_sysmem(addr, len);
 	ret = info->write(filename, buf, offset, len, actwrite);
 	unmap_sysmem(buf);
+	fs_cache_invalidate();
 
 	if (ret < 0 && len != *actwrite) {
 		printf("** Unable to write file %s **\n", filename);
@@ -165,19 +165,95 @@ static struct part_info *current_part;
 #define NAND_PAGE_MASK (~(NAND_PAGE_SIZE-1))
 
 #ifndef NAND_CACHE_PAGES
-#define NAND_CACHE_PAGES 16
+#define NAND_CACHE_PAGES 64
 #endif
 #define NAND_CACHE_SIZE (NAND_CACHE_PAGES*NAND_PAGE_SIZE)
 
-static u8* nand_cache = NULL;
-static u32 nand_cache_off = (u32)-1;
+/*
+ * Number of cached windows. The scan looks at both ends of an eraseblock
+ * before reading the nodes in it, and files are read fragment by fragment
+ * from wherever they were written, so one window is not enough to avoid
+ * reading the same pages over and over.
+ */
+#ifndef NAND_CACHE_BLOCKS
+#define NAND_CACHE_BLOCKS 4
+#endif
+
+static struct nand_cache_blk {
+	u8 *data;
+	u32 off;
+	u32 size;
+	u32 used;
+} nand_cache[NAND_CACHE_BLOCKS];
+static u32 nand_cache_clock;
+static u32 nand_cache_next = (u32)-1;	/* end of the last read from flash */
+
+/*
+ * Return a cache window holding the byte at @off, reading it from flash if
+ * needed. A whole window is only read when the flash is read sequentially;
+ * otherwise, as when probing the start or the end of every eraseblock
+ * during a scan, only the pages covering the @len bytes requested are.
+ */
+static struct nand_cache_blk *nand_cache_get(struct mtd_info *mtd, u32 off,
+					     u32 len)
+{
+	struct nand_cache_blk *blk, *victim = nand_cache;
+	u32 size = min_t(u32, NAND_CACHE_SIZE, mtd->erasesize);
+	u32 start, end;
+	size_t retlen;
+	int ret;
+	int i;
+
+	for (i = 0; i < NAND_CACHE_BLOCKS; i++) {
+		blk = &nand_cache[i];
+		if (blk->size && off >= blk->off && off < blk->off + blk->size) {
+			blk->used = ++nand_cache_clock;
+			return blk;
+		}
+		if (blk->used < victim->used)
+			victim = blk;
+	}
+
+	blk = victim;
+	if (!blk->data) {
+		/* This memory never gets freed but 'cause
+		   it's a bootloader, nobody cares */
+		blk->data = malloc(NAND_CACHE_SIZE);
+		if (!blk->data) {
+			printf("read_nand_cached: can't alloc cache size %d bytes\n",
+			       NAND_CACHE_SIZE);
+			return NULL;
+		}
+	}
+
+	/* Windows never span two eraseblocks */
+	start = off & ~(mtd->writesize - 1);
+	end = (off & ~(size - 1)) + size;
+	if (start != nand_cache_next)
+		end = min_t(u32, end, roundup(off + len, mtd->writesize));
+
+	blk->off = start;
+	blk->size = 0;
+	retlen = end - start;
+	ret = nand_read(mtd, start, &retlen, blk->data);
+	if ((ret && ret != -EUCLEAN) || retlen != end - start) {
+		printf("read_nand_cached: error reading nand off %#x size %d bytes\n",
+		       start, end - start);
+		return NULL;
+	}
+	blk->size = end - start;
+	blk->used = ++nand_cache_clock;
+	nand_cache_next = end;
+
+	return blk;
+}
 
 static int read_nand_cached(u32 off, u32 size, u_char *buf)
 {
 	struct mtdids *id = current_part->dev->id;
+	struct nand_cache_blk *blk;
 	struct mtd_info *mtd;
 	u32 bytes_read = 0;
-	size_t retlen;
 	int cpy_bytes;
 
 	mtd = get_nand_dev_by_index(id->num);
@@ -185,34 +261,14 @@ static int read_nand_cached(u32 off, u32 size, u_char *buf)
 		return -1;
 
 	while (bytes_read < size) {
-		if ((off + bytes_read < nand_cache_off) ||
-		    (off + bytes_read >= nand_cache_off+NAND_CACHE_SIZE)) {
-			nand_cache_off = (off + bytes_read) & NAND_PAGE_MASK;
-			if (!nand_cache) {
-				/* This memory never gets freed but 'cause
-				   it's a bootloader, nobody cares */
-				nand_cache = malloc(NAND_CACHE_SIZE);
-				if (!nand_cache) {
-					printf("read_nand_cached: can't alloc cache size %d bytes\n",
-					       NAND_CACHE_SIZE);
-					return -1;
-				}
-			}
-
-			retlen = NAND_CACHE_SIZE;
-			if (nand_read(mtd, nand_cache_off,
-				      &retlen, nand_cache) != 0 ||
-					retlen != NAND_CACHE_SIZE) {
-				printf("read_nand_cached: error reading nand off %#x size %d bytes\n",
-						nand_cache_off, NAND_CACHE_SIZE);
-				return -1;
-			}
-		}
-		cpy_bytes = nand_cache_off + NAND_CACHE_SIZE - (off + bytes_read);
+		blk = nand_cache_get(mtd, off + bytes_read, size - bytes_read);
+		if (!blk)
+			return -1;
+		cpy_bytes = blk->off + blk->size - (off + bytes_read);
 		if (cpy_bytes > size - bytes_read)
 			cpy_bytes = size - bytes_read;
 		memcpy(buf + bytes_read,
-		       nand_cache + off + bytes_read - nand_cache_off,
+		       blk->data + off + bytes_read - blk->off,
 		       cpy_bytes);
 		bytes_read += cpy_bytes;
 	}
@@ -548,7 +604,7 @@ add_node(struct b_list *list)
 }
 
 static struct b_node *
-insert_node(struct b_list *list, u32 offset)
+insert_node(struct b_list *list, u32 offset, u32 ino, u32 version)
 {
 	struct b_node *new;
 
@@ -557,6 +613,8 @@ insert_node(struct b_list *list, u32 offset)
 		return NULL;
 	}
 	new->offset = offset;
+	new->ino = ino;
+	new->version = version;
 	new->next = NULL;
 
 	if (list->listTail != NULL)
@@ -574,18 +632,8 @@ insert_node(struct b_list *list, u32 offset)
  */
 static int compare_inodes(struct b_node *new, struct b_node *old)
 {
-	/*
-	 * Only read in the version info from flash, not the entire inode.
-	 * This can make a big difference to speed if flash is slow.
-	 */
-	u32 new_version;
-	u32 old_version;
-	get_fl_mem(new->offset + offsetof(struct jffs2_raw_inode, version),
-		   sizeof(new_version), &new_version);
-	get_fl_mem(old->offset + offsetof(struct jffs2_raw_inode, version),
-		   sizeof(old_version), &old_version);
-
-	return new_version > old_version;
+	/* The version was recorded by the scan, no need to read the node */
+	return new->version > old->version;
 }
 
 /* Sort directory entries so all entries in the same directory
@@ -600,11 +648,17 @@ static int compare_dirents(struct b_node *new, struct b_node *old)
 	 * being read. This makes most comparisons much quicker as only one
 	 * or two entries from the node will be used most of the time.
 	 */
-	struct jffs2_raw_dirent *jNew = get_node_mem(new->offset, NULL);
-	struct jffs2_raw_dirent *jOld = get_node_mem(old->offset, NULL);
+	struct jffs2_raw_dirent *jNew;
+	struct jffs2_raw_dirent *jOld;
 	int cmp;
 	int ret;
 
+	/* ascending sort by pino, recorded by the scan */
+	if (new->ino != old->ino)
+		return new->ino > old->ino;
+
+	jNew = get_node_mem(new->offset, NULL);
+	jOld = get_node_mem(old->offset, NULL);
 	if (jNew->pino != jOld->pino) {
 		/* ascending sort by pino */
 		ret = jNew->pino > jOld->pino;
@@ -691,6 +745,8 @@ jffs2_1pass_read_inode(struct b_lists *pL, u32 inode, char *dest)
 	 * we will live with it.
 	 */
 	for (b = pL->frag.listHead; b != NULL; b = b->next) {
+		if (b->ino != inode)
+			continue;
 		jNode = (struct jffs2_raw_inode *) get_fl_mem(b->offset,
 			sizeof(struct jffs2_raw_inode), pL->readbuf);
 		if ((inode == jNode->ino)) {
@@ -711,6 +767,8 @@ jffs2_1pass_read_inode(struct b_lists *pL, u32 inode, char *dest)
 #endif
 
 	for (b = pL->frag.listHead; b != NULL; b = b->next) {
+		if (b->ino != inode)
+			continue;
 		/*
 		 * Copy just the node and not the data at this point,
 		 * since we don't yet know if we need this data.
@@ -831,6 +889,8 @@ jffs2_1pass_find_inode(struct b_lists * pL, const char *name, u32 pino)
 	counter = 0;
 	/* we need to search all and return the inode with the highest version */
 	for(b = pL->dir.listHead; b; b = b->next, counter++) {
+		if (b->ino != pino)
+			continue;
 		jDir = (struct jffs2_raw_dirent *) get_node_mem(b->offset,
 								pL->readbuf);
 		if ((pino == jDir->pino) && (len == jDir->nsize) &&
@@ -952,6 +1012,8 @@ jffs2_1pass_list_inodes(struct b_lists * pL, u32 pino)
 	struct jffs2_raw_dirent *jDir;
 
 	for (b = pL->dir.listHead; b; b = b->next) {
+		if (b->ino != pino)
+			continue;
 		jDir = (struct jffs2_raw_dirent *) get_node_mem(b->offset,
 								pL->readbuf);
 		if (pino == jDir->pino) {
@@ -990,6 +1052,8 @@ jffs2_1pass_list_inodes(struct b_lists * pL, u32 pino)
 			}
 
 			for (b2 = pL->frag.listHead; b2; b2 = b2->next) {
+				if (b2->ino != jDir->ino)
+					continue;
 				jNode = (struct jffs2_raw_inode *)
 					get_fl_mem(b2->offset, sizeof(*jNode),
 						   NULL);
@@ -1121,6 +1185,10 @@ jffs2_1pass_resolve_inode(struct b_lists * pL, u32 ino)
 	/* it's a soft link so we follow it again. */
 	b2 = pL->frag.listHead;
 	while (b2) {
+		if (b2->ino != jDirFoundIno) {
+			b2 = b2->next;
+			continue;
+		}
 		jNode = (struct jffs2_raw_inode *) get_node_mem(b2->offset,
 								pL->readbuf);
 		if (jNode->ino == jDirFoundIno) {
@@ -1227,13 +1295,20 @@ jffs2_1pass_rescan_needed(struct part_info *part)
 					(unsigned long) b->offset);
 			return 1;
 		}
+#ifdef CONFIG_JFFS2_CACHE_LISTS
+		/* only check the first and the last entry */
+		if (b != pL->dir.listTail)
+			b = pL->dir.listTail;
+		else
+			break;
+#else
 		b = b->next;
+#endif
 	}
 	return 0;
 }
 
-#ifdef CONFIG_JFFS2_SUMMARY
-static u32 sum_get_unaligned32(u32 *ptr)
+static u32 sum_get_unaligned32(void *ptr)
 {
 	u32 val;
 	u8 *p = (u8 *)ptr;
@@ -1243,7 +1318,7 @@ static u32 sum_get_unaligned32(u32 *ptr)
 	return __le32_to_cpu(val);
 }
 
-static u16 sum_get_unaligned16(u16 *ptr)
+static u16 sum_get_unaligned16(void *ptr)
 {
 	u16 val;
 	u8 *p = (u8 *)ptr;
@@ -1261,8 +1336,9 @@ static u16 sum_get_unaligned16(u16 *ptr)
 
 static int jffs2_sum_process_sum_data(struct part_info *part, uint32_t offset,
 				struct jffs2_raw_summary *summary,
-				struct b_lists *pL)
+				struct b_lists *pL, u32 *max_totlen)
 {
+	u32 totlen;
 	void *sp;
 	int i, pass;
 	void *ret;
@@ -1279,12 +1355,20 @@ static int jffs2_sum_process_sum_data(struct part_info *part, uint32_t offset,
 				struct jffs2_sum_inode_flash *spi;
 					if (pass) {
 						spi = sp;
+						totlen = sum_get_unaligned32(
+								&spi->totlen);
+						if (*max_totlen < totlen)
+							*max_totlen = totlen;
 
 						ret = insert_node(&pL->frag,
 							(u32)part->offset +
 							offset +
 							sum_get_unaligned32(
-								&spi->offset));
+								&spi->offset),
+							sum_get_unaligned32(
+								&spi->inode),
+							sum_get_unaligned32(
+								&spi->version));
 						if (ret == NULL)
 							return -1;
 					}
@@ -1297,11 +1381,19 @@ static int jffs2_sum_process_sum_data(struct part_info *part, uint32_t offset,
 					struct jffs2_sum_dirent_flash *spd;
 					spd = sp;
 					if (pass) {
+						totlen = sum_get_unaligned32(
+								&spd->totlen);
+						if (*max_totlen < totlen)
+							*max_totlen = totlen;
 						ret = insert_node(&pL->dir,
 							(u32) part->offset +
 							offset +
 							sum_get_unaligned32(
-								&spd->offset));
+								&spd->offset),
+							sum_get_unaligned32(
+								&spd->pino),
+							sum_get_unaligned32(
+								&spd->version));
 						if (ret == NULL)
 							return -1;
 					}
@@ -1331,7 +1423,7 @@ static int jffs2_sum_process_sum_data(struct part_info *part, uint32_t offset,
 /* Process the summary node - called from jffs2_scan_eraseblock() */
 int jffs2_sum_scan_sumnode(struct part_info *part, uint32_t offset,
 			   struct jffs2_raw_summary *summary, uint32_t sumsize,
-			   struct b_lists *pL)
+			   struct b_lists *pL, u32 *max_totlen)
 {
 	struct jffs2_unknown_node crcnode;
 	int ret, __maybe_unused ofs;
@@ -1378,7 +1470,8 @@ int jffs2_sum_scan_sumnode(struct part_info *part, uint32_t offset,
 	if (summary->cln_mkr)
 		dbg_summary("Summary : CLEANMARKER node \n");
 
-	ret = jffs2_sum_process_sum_data(part, offset, summary, pL);
+	ret = jffs2_sum_process_sum_data(part, offset, summary, pL,
+					 max_totlen);
 	if (ret == -EBADMSG)
 		return 0;
 	if (ret)
@@ -1391,7 +1484,6 @@ crc_err:
 
 	return 0;
 }
-#endif /* CONFIG_JFFS2_SUMMARY */
 
 #ifdef DEBUG_FRAGMENTS
 static void
@@ -1498,12 +1590,10 @@ jffs2_1pass_build_lists(struct part_info * part)
 		uint32_t buf_ofs = sector_ofs;
 		uint32_t buf_len;
 		uint32_t ofs, prevofs;
-#ifdef CONFIG_JFFS2_SUMMARY
-		struct jffs2_sum_marker *sm;
-		void *sumptr = NULL;
+		struct jffs2_sum_marker smbuf, *sm;
+		void *sumptr;
 		uint32_t sumlen;
 		int ret;
-#endif
 		/* Indicates a sector with a CLEANMARKER was found */
 		int clean_sector = 0;
 
@@ -1511,61 +1601,6 @@ jffs2_1pass_build_lists(struct part_info * part)
 		buf_size = DEFAULT_EMPTY_SCAN_SIZE;
 		WATCHDOG_RESET();
 
-#ifdef CONFIG_JFFS2_SUMMARY
-		buf_len = sizeof(*sm);
-
-		/* Read as much as we want into the _end_ of the preallocated
-		 * buffer
-		 */
-		get_fl_mem(part->offset + sector_ofs + part->sector_size -
-				buf_len, buf_len, buf + buf_size - buf_len);
-
-		sm = (void *)buf + buf_size - sizeof(*sm);
-		if (sm->magic == JFFS2_SUM_MAGIC) {
-			sumlen = part->sector_size - sm->offset;
-			sumptr = buf + buf_size - sumlen;
-
-			/* Now, make sure the summary itself is available */
-			if (sumlen > buf_size) {
-				/* Need to kmalloc for this. */
-				sumptr = malloc(sumlen);
-				if (!sumptr) {
-					putstr("Can't get memory for summary "
-							"node!\n");
-					free(buf);
-					jffs2_free_cache(part);
-					return 0;
-				}
-				memcpy(sumptr + sumlen - buf_len, buf +
-						buf_size - buf_len, buf_len);
-			}
-			if (buf_len < sumlen) {
-				/* Need to read more so that the entire summary
-				 * node is present
-				 */
-				get_fl_mem(part->offset + sector_ofs +
-						part->sector_size - sumlen,
-						sumlen - buf_len, sumptr);
-			}
-		}
-
-		if (sumptr) {
-			ret = jffs2_sum_scan_sumnode(part, sector_ofs, sumptr,
-					sumlen, pL);
-
-			if (buf_size && sumlen > buf_size)
-				free(sumptr);
-			if (ret < 0) {
-				free(buf);
-				jffs2_free_cache(part);
-				return 0;
-			}
-			if (ret)
-				continue;
-
-		}
-#endif /* CONFIG_JFFS2_SUMMARY */
-
 		buf_len = EMPTY_SCAN_SIZE(part->sector_size);
 
 		get_fl_mem((u32)part->offset + buf_ofs, buf_len, buf);
@@ -1581,6 +1616,37 @@ jffs2_1pass_build_lists(struct part_info * part)
 		if (ofs == EMPTY_SCAN_SIZE(part->sector_size))
 			continue;
 
+		/*
+		 * Eraseblocks written with summary support end with a list of
+		 * the nodes they hold: use it instead of scanning the block.
+		 */
+		sm = get_fl_mem(part->offset + sector_ofs + part->sector_size -
+				sizeof(smbuf), sizeof(smbuf), &smbuf);
+		if (sm->magic == JFFS2_SUM_MAGIC &&
+		    sm->offset <= part->sector_size - JFFS2_SUMMARY_FRAME_SIZE) {
+			sumlen = part->sector_size - sm->offset;
+			sumptr = malloc(sumlen);
+			if (!sumptr) {
+				putstr("Can't get memory for summary node!\n");
+				free(buf);
+				jffs2_free_cache(part);
+				return 0;
+			}
+			get_fl_mem(part->offset + sector_ofs + sm->offset,
+				   sumlen, sumptr);
+
+			ret = jffs2_sum_scan_sumnode(part, sector_ofs, sumptr,
+					sumlen, pL, &max_totlen);
+			free(sumptr);
+			if (ret < 0) {
+				free(buf);
+				jffs2_free_cache(part);
+				return 0;
+			}
+			if (ret)
+				continue;
+		}
+
 		ofs += sector_ofs;
 		prevofs = ofs - 1;
 		/*
@@ -1695,7 +1761,10 @@ jffs2_1pass_build_lists(struct part_info * part)
 					break;
 
 				if (insert_node(&pL->frag, (u32) part->offset +
-						ofs) == NULL) {
+						ofs, ((struct jffs2_raw_inode *)
+						      node)->ino,
+						((struct jffs2_raw_inode *)
+						 node)->version) == NULL) {
 					free(buf);
 					jffs2_free_cache(part);
 					return 0;
@@ -1730,7 +1799,10 @@ jffs2_1pass_build_lists(struct part_info * part)
 				if (! (counterN%100))
 					puts ("\b\b.  ");
 				if (insert_node(&pL->dir, (u32) part->offset +
-						ofs) == NULL) {
+						ofs, ((struct jffs2_raw_dirent *)
+						      node)->pino,
+						((struct jffs2_raw_dirent *)
+						 node)->version) == NULL) {
 					free(buf);
 					jffs2_free_cache(part);
 					return 0;
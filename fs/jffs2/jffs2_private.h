@@ -6,6 +6,8 @@
 
 struct b_node {
 	u32 offset;
+	u32 ino;	/* inode number, parent inode number for dirents */
+	u32 version;
 	struct b_node *next;
 	enum { CRC_UNKNOWN = 0, CRC_OK, CRC_BAD } datacrc;
 };
@@ -89,9 +91,9 @@ inode_crc(struct jffs2_raw_inode *node)
 static inline int
 data_crc(struct jffs2_raw_inode *node)
 {
-	if (node->data_crc != crc32_no_comp(0, (unsigned char *)
-					    ((int) &node->node_crc + sizeof (node->node_crc)),
-					     node->csize)) {
+	if (node->data_crc != crc32_no_comp(0, (unsigned char *)node +
+					    sizeof(struct jffs2_raw_inode),
+					    node->csize)) {
 		return 0;
 	} else {
 		return 1;
@@ -0,0 +1,1052 @@
+/*
+ * squashfs.c
+ *
+ * R/O SquashFS 4.0 filesystem implementation
+ *
+ * Inodes and directories live in tables of metadata blocks of up to 8 KiB,
+ * each compressed on its own. File data is stored as a list of compressed
+ * blocks of the filesystem block size, and the tail of a file may be packed
+ * with the tails of other files into a shared fragment block.
+ *
+ * Decompressed metadata, data and fragment blocks are kept in small LRU
+ * caches for as long as the filesystem stays mounted, so that reading a
+ * file in pieces or loading several small files sharing a fragment block
+ * does not decompress the same block twice. Data blocks that are wanted in
+ * full are decompressed straight into the destination buffer instead, and
+ * the compressed blocks of a file are fetched from the device in requests
+ * spanning as many of them as the read buffer holds.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <fs.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <part.h>
+#include <squashfs.h>
+#include <asm/unaligned.h>
+#include <linux/lzo.h>
+#include <lzma/LzmaTypes.h>
+#include <lzma/LzmaDec.h>
+#include <lzma/LzmaTools.h>
+
+/* Decompressed metadata blocks kept for directory and inode lookups */
+#define SQFS_META_CACHE		8
+/* Smallest device request used to read compressed blocks ahead */
+#define SQFS_READAHEAD		(128 * 1024)
+/* Directory levels remembered to resolve "..", and symlinks followed */
+#define SQFS_MAX_DEPTH		32
+#define SQFS_MAX_LINKS		8
+#define SQFS_MAX_SYMLINK	4096
+/* Fragment entries per metadata block of the fragment table */
+#define SQFS_FRAGS_PER_BLOCK	(SQUASHFS_METADATA_SIZE / \
+				 sizeof(struct squashfs_fragment_entry))
+
+struct sqfs_cache_entry {
+	u64 pos;		/* Device offset of the block, or -1 */
+	u64 next;		/* Metadata only: offset of the following block */
+	u32 size;		/* Decompressed length */
+	u32 used;		/* LRU stamp */
+	u8 *data;
+};
+
+struct sqfs_cache {
+	struct sqfs_cache_entry *entries;
+	int count;
+	u32 block_size;		/* Allocation size of each entry's data */
+	u32 clock;
+};
+
+/* Position within a table of metadata blocks */
+struct sqfs_meta_pos {
+	u64 block;		/* Device offset of the current block */
+	u32 offset;		/* Offset within its decompressed data */
+};
+
+struct sqfs_node {
+	u16 type;		/* SQUASHFS_*_TYPE, extended types folded */
+	u64 size;
+	u64 start;		/* First data block, or directory block */
+	u32 offset;		/* Offset in the fragment or directory block */
+	u32 fragment;
+	struct sqfs_meta_pos tail;	/* Block list or symlink target */
+};
+
+struct sqfs_dirent {
+	const char *name;
+	u16 type;
+	u64 ref;
+};
+
+static struct blk_desc *cur_dev;
+static disk_partition_t cur_part_info;
+
+static struct {
+	u32 block_size;
+	int block_log;
+	u16 comp;
+	u32 fragments;
+	u64 bytes_used;
+	u64 root_ref;
+	u64 inode_table;
+	u64 dir_table;
+	u64 *frag_index;	/* Device offsets of the fragment table blocks */
+	u8 *rbuf;		/* Compressed data read from the device */
+	u32 rbuf_blks;
+	lbaint_t rbuf_blk;	/* First block held in rbuf, or -1 */
+	u32 rbuf_cnt;		/* Number of blocks held in rbuf */
+	struct sqfs_cache meta;
+	struct sqfs_cache data;
+	struct sqfs_cache frag;
+} sqfs;
+
+/*
+ * Return a pointer to len bytes at device offset pos, read into rbuf along
+ * with up to ahead more bytes that the caller is going to ask for next.
+ */
+static u8 *sqfs_read_raw(u64 pos, u32 len, u64 ahead)
+{
+	int log2blksz = cur_dev->log2blksz;
+	lbaint_t blk = pos >> log2blksz;
+	u32 lead = pos & (cur_dev->blksz - 1);
+	u64 want;
+	lbaint_t n;
+
+	if (sqfs.rbuf_blk != (lbaint_t)-1 && blk >= sqfs.rbuf_blk &&
+	    pos + len <= (u64)(sqfs.rbuf_blk + sqfs.rbuf_cnt) << log2blksz)
+		return sqfs.rbuf + (pos - ((u64)sqfs.rbuf_blk << log2blksz));
+
+	n = DIV_ROUND_UP((u64)lead + len, cur_dev->blksz);
+	if (n > sqfs.rbuf_blks || blk + n > cur_part_info.size)
+		return NULL;
+	want = DIV_ROUND_UP((u64)lead + len + ahead, cur_dev->blksz);
+	n = min_t(u64, max_t(u64, n, want), sqfs.rbuf_blks);
+	n = min_t(u64, n, cur_part_info.size - blk);
+
+	sqfs.rbuf_blk = -1;
+	if (blk_dread(cur_dev, cur_part_info.start + blk, n, sqfs.rbuf) != n)
+		return NULL;
+	sqfs.rbuf_blk = blk;
+	sqfs.rbuf_cnt = n;
+
+	return sqfs.rbuf + lead;
+}
+
+/* Copy len bytes at device offset pos into buf, whatever their size */
+static int sqfs_read_bytes(u64 pos, void *buf, u64 len)
+{
+	u32 max = (sqfs.rbuf_blks - 1) << cur_dev->log2blksz;
+	u8 *dst = buf;
+	u32 chunk;
+	u8 *src;
+
+	while (len) {
+		chunk = min_t(u64, len, max);
+		src = sqfs_read_raw(pos, chunk, 0);
+		if (!src)
+			return -EIO;
+		memcpy(dst, src, chunk);
+		dst += chunk;
+		pos += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static bool sqfs_comp_supported(u16 comp)
+{
+	switch (comp) {
+#ifdef CONFIG_GZIP
+	case SQUASHFS_COMP_GZIP:
+#endif
+#ifdef CONFIG_LZMA
+	case SQUASHFS_COMP_LZMA:
+#endif
+#ifdef CONFIG_LZO
+	case SQUASHFS_COMP_LZO:
+#endif
+#ifdef CONFIG_LZ4
+	case SQUASHFS_COMP_LZ4:
+#endif
+		return true;
+	}
+
+	return false;
+}
+
+/* Decompress a block, returning its decompressed length */
+static int sqfs_decompress(void *dst, u32 dstlen, void *src, u32 srclen)
+{
+	int ret = -EPROTONOSUPPORT;
+
+	switch (sqfs.comp) {
+#ifdef CONFIG_GZIP
+	case SQUASHFS_COMP_GZIP: {
+		unsigned long len = srclen;
+
+		/* zlib stream: skip the two byte header, ignore the Adler-32 */
+		if (zunzip(dst, dstlen, src, &len, 1, 2))
+			return -EIO;
+		ret = len;
+		break;
+	}
+#endif
+#ifdef CONFIG_LZMA
+	case SQUASHFS_COMP_LZMA: {
+		SizeT len = dstlen;
+
+		if (lzmaBuffToBuffDecompress(dst, &len, src, srclen) != SZ_OK)
+			return -EIO;
+		ret = len;
+		break;
+	}
+#endif
+#ifdef CONFIG_LZO
+	case SQUASHFS_COMP_LZO: {
+		size_t len = dstlen;
+
+		if (lzo1x_decompress_safe(src, srclen, dst, &len) != LZO_E_OK)
+			return -EIO;
+		ret = len;
+		break;
+	}
+#endif
+#ifdef CONFIG_LZ4
+	case SQUASHFS_COMP_LZ4: {
+		size_t len = dstlen;
+
+		if (ulz4_block(src, srclen, dst, &len))
+			return -EIO;
+		ret = len;
+		break;
+	}
+#endif
+	}
+
+	return ret;
+}
+
+/*
+ * Read the data block or fragment block at device offset pos whose on-disk
+ * size word is bsize, and return its decompressed length.
+ */
+static int sqfs_read_data(u64 pos, u32 bsize, void *dst, u32 dstlen,
+			  u64 ahead)
+{
+	u32 len = SQUASHFS_DATA_LEN(bsize);
+	u8 *src;
+
+	if (!len || len > sqfs.block_size)
+		return -EINVAL;
+	src = sqfs_read_raw(pos, len, ahead);
+	if (!src)
+		return -EIO;
+
+	if (bsize & SQUASHFS_DATA_UNCOMP) {
+		if (len > dstlen)
+			return -EINVAL;
+		memcpy(dst, src, len);
+		return len;
+	}
+
+	return sqfs_decompress(dst, dstlen, src, len);
+}
+
+static void sqfs_cache_init(struct sqfs_cache *cache, int count,
+			    u32 block_size)
+{
+	int i;
+
+	cache->entries = calloc(count, sizeof(*cache->entries));
+	cache->count = cache->entries ? count : 0;
+	cache->block_size = block_size;
+	cache->clock = 0;
+	for (i = 0; i < cache->count; i++)
+		cache->entries[i].pos = -1ULL;
+}
+
+static void sqfs_cache_free(struct sqfs_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->count; i++)
+		free(cache->entries[i].data);
+	free(cache->entries);
+	cache->entries = NULL;
+	cache->count = 0;
+}
+
+static struct sqfs_cache_entry *sqfs_cache_lookup(struct sqfs_cache *cache,
+						  u64 pos)
+{
+	struct sqfs_cache_entry *e;
+	int i;
+
+	for (i = 0, e = cache->entries; i < cache->count; i++, e++) {
+		if (e->pos == pos) {
+			e->used = ++cache->clock;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+/* Pick the least recently used entry for a new block */
+static struct sqfs_cache_entry *sqfs_cache_victim(struct sqfs_cache *cache)
+{
+	struct sqfs_cache_entry *victim = NULL, *e;
+	int i;
+
+	for (i = 0, e = cache->entries; i < cache->count; i++, e++) {
+		if (!victim || e->used < victim->used)
+			victim = e;
+	}
+	if (!victim)
+		return NULL;
+
+	if (!victim->data) {
+		victim->data = malloc(cache->block_size);
+		if (!victim->data)
+			return NULL;
+	}
+	victim->pos = -1ULL;
+	victim->used = ++cache->clock;
+
+	return victim;
+}
+
+/* Return the data or fragment block at pos, decompressing it if needed */
+static int sqfs_cache_block(struct sqfs_cache *cache, u64 pos, u32 bsize,
+			    u64 ahead, struct sqfs_cache_entry **ep)
+{
+	struct sqfs_cache_entry *e;
+	int ret;
+
+	e = sqfs_cache_lookup(cache, pos);
+	if (!e) {
+		e = sqfs_cache_victim(cache);
+		if (!e)
+			return -ENOMEM;
+		ret = sqfs_read_data(pos, bsize, e->data, cache->block_size,
+				     ahead);
+		if (ret < 0)
+			return ret;
+		e->pos = pos;
+		e->size = ret;
+	}
+	*ep = e;
+
+	return 0;
+}
+
+/* Return the metadata block at pos, decompressing it if needed */
+static int sqfs_meta_block(u64 pos, struct sqfs_cache_entry **ep)
+{
+	struct sqfs_cache_entry *e;
+	u32 len, hdr;
+	u8 *src;
+	int ret;
+
+	e = sqfs_cache_lookup(&sqfs.meta, pos);
+	if (e) {
+		*ep = e;
+		return 0;
+	}
+
+	src = sqfs_read_raw(pos, sizeof(__le16), SQUASHFS_METADATA_SIZE);
+	if (!src)
+		return -EIO;
+	hdr = get_unaligned_le16(src);
+	len = SQUASHFS_META_LEN(hdr);
+	if (!len || len > SQUASHFS_METADATA_SIZE)
+		return -EINVAL;
+	src = sqfs_read_raw(pos + sizeof(__le16), len, SQUASHFS_METADATA_SIZE);
+	if (!src)
+		return -EIO;
+
+	e = sqfs_cache_victim(&sqfs.meta);
+	if (!e)
+		return -ENOMEM;
+	if (hdr & SQUASHFS_META_UNCOMP) {
+		memcpy(e->data, src, len);
+		ret = len;
+	} else {
+		ret = sqfs_decompress(e->data, SQUASHFS_METADATA_SIZE, src, len);
+		if (ret <= 0)
+			return ret ? ret : -EINVAL;
+	}
+	e->pos = pos;
+	e->next = pos + sizeof(__le16) + len;
+	e->size = ret;
+	*ep = e;
+
+	return 0;
+}
+
+/* Read len bytes from a metadata table, advancing the position */
+static int sqfs_meta_read(struct sqfs_meta_pos *mp, void *buf, u32 len)
+{
+	struct sqfs_cache_entry *e;
+	u8 *dst = buf;
+	u32 chunk;
+	int ret;
+
+	while (len) {
+		ret = sqfs_meta_block(mp->block, &e);
+		if (ret)
+			return ret;
+		if (mp->offset >= e->size) {
+			mp->offset -= e->size;
+			mp->block = e->next;
+			continue;
+		}
+
+		chunk = min(len, e->size - mp->offset);
+		memcpy(dst, e->data + mp->offset, chunk);
+		dst += chunk;
+		len -= chunk;
+		mp->offset += chunk;
+	}
+
+	return 0;
+}
+
+static int sqfs_read_inode(u64 ref, struct sqfs_node *node)
+{
+	struct sqfs_meta_pos mp = {
+		.block = sqfs.inode_table + SQUASHFS_REF_BLOCK(ref),
+		.offset = SQUASHFS_REF_OFFSET(ref),
+	};
+	union {
+		struct squashfs_base_inode base;
+		struct squashfs_dir_inode dir;
+		struct squashfs_ldir_inode ldir;
+		struct squashfs_reg_inode reg;
+		struct squashfs_lreg_inode lreg;
+		struct squashfs_symlink_inode symlink;
+	} i;
+	u32 len;
+	int ret;
+
+	ret = sqfs_meta_read(&mp, &i.base, sizeof(i.base));
+	if (ret)
+		return ret;
+
+	memset(node, 0, sizeof(*node));
+	node->type = le16_to_cpu(i.base.inode_type);
+	switch (node->type) {
+	case SQUASHFS_DIR_TYPE:
+		len = sizeof(i.dir);
+		break;
+	case SQUASHFS_LDIR_TYPE:
+		len = sizeof(i.ldir);
+		break;
+	case SQUASHFS_REG_TYPE:
+		len = sizeof(i.reg);
+		break;
+	case SQUASHFS_LREG_TYPE:
+		len = sizeof(i.lreg);
+		break;
+	case SQUASHFS_SYMLINK_TYPE:
+	case SQUASHFS_LSYMLINK_TYPE:
+		len = sizeof(i.symlink);
+		break;
+	default:
+		/* Devices, FIFOs and sockets carry nothing we can read */
+		return 0;
+	}
+
+	ret = sqfs_meta_read(&mp, (u8 *)&i + sizeof(i.base),
+			     len - sizeof(i.base));
+	if (ret)
+		return ret;
+	node->tail = mp;
+
+	switch (node->type) {
+	case SQUASHFS_DIR_TYPE:
+		node->type = SQUASHFS_DIR_TYPE;
+		node->start = le32_to_cpu(i.dir.start_block);
+		node->offset = le16_to_cpu(i.dir.offset);
+		node->size = le16_to_cpu(i.dir.file_size);
+		break;
+	case SQUASHFS_LDIR_TYPE:
+		node->type = SQUASHFS_DIR_TYPE;
+		node->start = le32_to_cpu(i.ldir.start_block);
+		node->offset = le16_to_cpu(i.ldir.offset);
+		node->size = le32_to_cpu(i.ldir.file_size);
+		break;
+	case SQUASHFS_REG_TYPE:
+		node->start = le32_to_cpu(i.reg.start_block);
+		node->fragment = le32_to_cpu(i.reg.fragment);
+		node->offset = le32_to_cpu(i.reg.offset);
+		node->size = le32_to_cpu(i.reg.file_size);
+		break;
+	case SQUASHFS_LREG_TYPE:
+		node->type = SQUASHFS_REG_TYPE;
+		node->start = le64_to_cpu(i.lreg.start_block);
+		node->fragment = le32_to_cpu(i.lreg.fragment);
+		node->offset = le32_to_cpu(i.lreg.offset);
+		node->size = le64_to_cpu(i.lreg.file_size);
+		break;
+	default:
+		node->type = SQUASHFS_SYMLINK_TYPE;
+		node->size = le32_to_cpu(i.symlink.symlink_size);
+		break;
+	}
+
+	return 0;
+}
+
+/* Return the target of a symlink in a newly allocated string */
+static char *sqfs_read_symlink(struct sqfs_node *node)
+{
+	struct sqfs_meta_pos mp = node->tail;
+	char *target;
+
+	if (node->size > SQFS_MAX_SYMLINK)
+		return NULL;
+	target = malloc(node->size + 1);
+	if (!target)
+		return NULL;
+	if (sqfs_meta_read(&mp, target, node->size)) {
+		free(target);
+		return NULL;
+	}
+	target[node->size] = '\0';
+
+	return target;
+}
+
+/*
+ * Call iter() for every entry of the directory until it returns non-zero,
+ * and return that value. Entries are sorted by name.
+ */
+static int sqfs_iterate(struct sqfs_node *dir,
+			int (*iter)(struct sqfs_dirent *d, void *priv),
+			void *priv)
+{
+	struct sqfs_meta_pos mp = {
+		.block = sqfs.dir_table + dir->start,
+		.offset = dir->offset,
+	};
+	struct squashfs_dir_header hdr;
+	struct squashfs_dir_entry ent;
+	struct sqfs_dirent d;
+	char *name;
+	u64 left;
+	u32 count, len;
+	int ret = 0;
+
+	/* The size accounts for the "." and ".." entries, which are not stored */
+	if (dir->size <= 3)
+		return 0;
+	left = dir->size - 3;
+
+	name = malloc(SQUASHFS_NAME_LEN + 1);
+	if (!name)
+		return -ENOMEM;
+	d.name = name;
+
+	while (left > sizeof(hdr)) {
+		ret = sqfs_meta_read(&mp, &hdr, sizeof(hdr));
+		if (ret)
+			break;
+		left -= sizeof(hdr);
+		count = le32_to_cpu(hdr.count) + 1;
+		if (count > SQUASHFS_DIR_COUNT) {
+			ret = -EINVAL;
+			break;
+		}
+
+		while (count--) {
+			ret = sqfs_meta_read(&mp, &ent, sizeof(ent));
+			if (ret)
+				goto out;
+			len = le16_to_cpu(ent.size) + 1;
+			if (len > SQUASHFS_NAME_LEN ||
+			    left < sizeof(ent) + len) {
+				ret = -EINVAL;
+				goto out;
+			}
+			ret = sqfs_meta_read(&mp, name, len);
+			if (ret)
+				goto out;
+			name[len] = '\0';
+			left -= sizeof(ent) + len;
+
+			d.type = le16_to_cpu(ent.type);
+			d.ref = (u64)le32_to_cpu(hdr.start_block) << 16 |
+				le16_to_cpu(ent.offset);
+			ret = iter(&d, priv);
+			if (ret)
+				goto out;
+		}
+	}
+
+out:
+	free(name);
+	return ret;
+}
+
+struct sqfs_lookup {
+	char name[SQUASHFS_NAME_LEN + 1];
+	u64 ref;
+};
+
+static int sqfs_lookup_iter(struct sqfs_dirent *d, void *priv)
+{
+	struct sqfs_lookup *lookup = priv;
+	int cmp = strcmp(d->name, lookup->name);
+
+	if (!cmp) {
+		lookup->ref = d->ref;
+		return 1;
+	}
+
+	/* Sorted: the name cannot come after a greater one */
+	return cmp > 0 ? -ENOENT : 0;
+}
+
+/* Directories walked through so far, to go back up on ".." */
+struct sqfs_walk {
+	u64 refs[SQFS_MAX_DEPTH];
+	int depth;
+	int links;
+};
+
+/*
+ * Resolve a path relative to the directory at the top of the walk, which
+ * node holds on entry, following symlinks.
+ */
+static int sqfs_walk(struct sqfs_walk *walk, const char *path,
+		     struct sqfs_node *node)
+{
+	struct sqfs_lookup *lookup;
+	const char *p = path, *name;
+	char *target;
+	int len, ret = 0;
+
+	lookup = malloc(sizeof(*lookup));
+	if (!lookup)
+		return -ENOMEM;
+
+	if (*p == '/') {
+		walk->depth = 0;
+		ret = sqfs_read_inode(walk->refs[0], node);
+		if (ret)
+			goto out;
+	}
+
+	while (*p) {
+		while (*p == '/')
+			p++;
+		if (!*p)
+			break;
+
+		name = p;
+		while (*p && *p != '/')
+			p++;
+		len = p - name;
+
+		if (len == 1 && name[0] == '.')
+			continue;
+		if (len == 2 && name[0] == '.' && name[1] == '.') {
+			if (walk->depth)
+				walk->depth--;
+			ret = sqfs_read_inode(walk->refs[walk->depth], node);
+			if (ret)
+				goto out;
+			continue;
+		}
+
+		if (node->type != SQUASHFS_DIR_TYPE) {
+			ret = -ENOTDIR;
+			goto out;
+		}
+		if (len > SQUASHFS_NAME_LEN) {
+			ret = -ENOENT;
+			goto out;
+		}
+		memcpy(lookup->name, name, len);
+		lookup->name[len] = '\0';
+		ret = sqfs_iterate(node, sqfs_lookup_iter, lookup);
+		if (!ret)
+			ret = -ENOENT;
+		if (ret < 0)
+			goto out;
+		ret = sqfs_read_inode(lookup->ref, node);
+		if (ret)
+			goto out;
+
+		if (node->type == SQUASHFS_SYMLINK_TYPE) {
+			if (++walk->links > SQFS_MAX_LINKS) {
+				ret = -ELOOP;
+				goto out;
+			}
+			target = sqfs_read_symlink(node);
+			if (!target) {
+				ret = -EIO;
+				goto out;
+			}
+			/* The target is relative to the directory holding it */
+			ret = sqfs_read_inode(walk->refs[walk->depth], node);
+			if (!ret)
+				ret = sqfs_walk(walk, target, node);
+			free(target);
+			if (ret)
+				goto out;
+		} else if (node->type == SQUASHFS_DIR_TYPE) {
+			if (walk->depth + 1 >= SQFS_MAX_DEPTH) {
+				ret = -ENAMETOOLONG;
+				goto out;
+			}
+			walk->refs[++walk->depth] = lookup->ref;
+		}
+	}
+
+out:
+	free(lookup);
+	return ret;
+}
+
+static int sqfs_find(const char *path, struct sqfs_node *node)
+{
+	struct sqfs_walk *walk;
+	int ret;
+
+	walk = malloc(sizeof(*walk));
+	if (!walk)
+		return -ENOMEM;
+	walk->refs[0] = sqfs.root_ref;
+	walk->depth = 0;
+	walk->links = 0;
+
+	ret = sqfs_read_inode(sqfs.root_ref, node);
+	if (!ret)
+		ret = sqfs_walk(walk, path, node);
+	free(walk);
+
+	return ret;
+}
+
+static int sqfs_read_fragment(struct sqfs_node *node, u64 foff, u8 *dst,
+			      u32 len)
+{
+	struct squashfs_fragment_entry frag;
+	struct sqfs_cache_entry *e;
+	struct sqfs_meta_pos mp;
+	int ret;
+
+	if (node->fragment >= sqfs.fragments)
+		return -EINVAL;
+	mp.block = sqfs.frag_index[node->fragment / SQFS_FRAGS_PER_BLOCK];
+	mp.offset = node->fragment % SQFS_FRAGS_PER_BLOCK * sizeof(frag);
+	ret = sqfs_meta_read(&mp, &frag, sizeof(frag));
+	if (ret)
+		return ret;
+
+	ret = sqfs_cache_block(&sqfs.frag, le64_to_cpu(frag.start_block),
+			       le32_to_cpu(frag.size), 0, &e);
+	if (ret)
+		return ret;
+	if (node->offset + foff + len > e->size)
+		return -EINVAL;
+	memcpy(dst, e->data + node->offset + foff, len);
+
+	return 0;
+}
+
+/* Read len bytes at offset within a regular file */
+static int sqfs_file_read(struct sqfs_node *node, u64 offset, u8 *dst,
+			  u64 len)
+{
+	u32 bs = sqfs.block_size;
+	struct sqfs_cache_entry *e;
+	u64 nblocks, first, last, i, pos, end = offset + len;
+	u32 bsize, boff, chunk;
+	u64 ahead;
+	__le32 *list;
+	int ret;
+
+	if (node->fragment == SQUASHFS_NO_FRAGMENT)
+		nblocks = DIV_ROUND_UP(node->size, bs);
+	else
+		nblocks = node->size >> sqfs.block_log;
+
+	first = offset >> sqfs.block_log;
+	last = min(DIV_ROUND_UP(end, bs), nblocks);
+	if (first < last) {
+		/* Sizes of the blocks before the first give its position */
+		list = malloc(last * sizeof(*list));
+		if (!list)
+			return -ENOMEM;
+		ret = sqfs_meta_read(&node->tail, list, last * sizeof(*list));
+		if (ret)
+			goto out;
+
+		pos = node->start;
+		for (i = 0; i < first; i++)
+			pos += SQUASHFS_DATA_LEN(le32_to_cpu(list[i]));
+		ahead = 0;
+		for (i = first; i < last; i++)
+			ahead += SQUASHFS_DATA_LEN(le32_to_cpu(list[i]));
+
+		for (i = first; i < last; i++) {
+			bsize = le32_to_cpu(list[i]);
+			ahead -= SQUASHFS_DATA_LEN(bsize);
+			boff = offset - (i << sqfs.block_log);
+			chunk = min_t(u64, bs - boff, end - offset);
+
+			if (!SQUASHFS_DATA_LEN(bsize)) {
+				/* Sparse block */
+				memset(dst, 0, chunk);
+			} else if (!boff &&
+				   chunk == min_t(u64, bs, node->size - offset)) {
+				ret = sqfs_read_data(pos, bsize, dst, chunk,
+						     ahead);
+				if (ret >= 0 && ret != chunk)
+					ret = -EINVAL;
+				if (ret < 0)
+					goto out;
+			} else {
+				ret = sqfs_cache_block(&sqfs.data, pos, bsize,
+						       ahead, &e);
+				if (ret)
+					goto out;
+				if (boff + chunk > e->size) {
+					ret = -EINVAL;
+					goto out;
+				}
+				memcpy(dst, e->data + boff, chunk);
+			}
+
+			pos += SQUASHFS_DATA_LEN(bsize);
+			dst += chunk;
+			offset += chunk;
+		}
+		ret = 0;
+out:
+		free(list);
+		if (ret)
+			return ret;
+	}
+
+	if (offset < end) {
+		if (node->fragment == SQUASHFS_NO_FRAGMENT)
+			return -EINVAL;
+		return sqfs_read_fragment(node, offset - (nblocks << sqfs.block_log),
+					  dst, end - offset);
+	}
+
+	return 0;
+}
+
+struct sqfs_ls_counts {
+	int files;
+	int dirs;
+};
+
+static int sqfs_ls_iter(struct sqfs_dirent *d, void *priv)
+{
+	struct sqfs_ls_counts *counts = priv;
+	struct sqfs_node node;
+	char *target;
+	int ret;
+
+	if (d->type == SQUASHFS_DIR_TYPE) {
+		printf("            %s/\n", d->name);
+		counts->dirs++;
+		return 0;
+	}
+
+	ret = sqfs_read_inode(d->ref, &node);
+	if (ret)
+		return ret;
+	if (node.type == SQUASHFS_SYMLINK_TYPE) {
+		target = sqfs_read_symlink(&node);
+		printf("    <SYM>   %s -> %s\n", d->name, target ? target : "?");
+		free(target);
+	} else if (node.type == SQUASHFS_REG_TYPE) {
+		printf(" %8llu   %s\n", node.size, d->name);
+	} else {
+		printf("            %s\n", d->name);
+	}
+	counts->files++;
+
+	return 0;
+}
+
+int squashfs_ls(const char *dirname)
+{
+	struct sqfs_ls_counts counts = { 0, 0 };
+	struct sqfs_node node;
+	int ret;
+
+	ret = sqfs_find(dirname, &node);
+	if (ret) {
+		printf("** Can not find directory %s **\n", dirname);
+		return ret;
+	}
+
+	if (node.type == SQUASHFS_DIR_TYPE) {
+		ret = sqfs_iterate(&node, sqfs_ls_iter, &counts);
+		if (ret)
+			return ret;
+	} else {
+		printf(" %8llu   %s\n", node.size, dirname);
+		counts.files++;
+	}
+	printf("\n%d file(s), %d dir(s)\n\n", counts.files, counts.dirs);
+
+	return 0;
+}
+
+int squashfs_exists(const char *filename)
+{
+	struct sqfs_node node;
+
+	return sqfs_find(filename, &node) == 0;
+}
+
+int squashfs_size(const char *filename, loff_t *size)
+{
+	struct sqfs_node node;
+	int ret;
+
+	ret = sqfs_find(filename, &node);
+	if (!ret)
+		*size = node.size;
+
+	return ret;
+}
+
+int squashfs_read_file(const char *filename, void *buf, loff_t offset,
+		       loff_t len, loff_t *actread)
+{
+	struct sqfs_node node;
+	int ret;
+
+	*actread = 0;
+	ret = sqfs_find(filename, &node);
+	if (ret) {
+		printf("** File not found %s **\n", filename);
+		return ret;
+	}
+	if (node.type != SQUASHFS_REG_TYPE)
+		return node.type == SQUASHFS_DIR_TYPE ? -EISDIR : -EINVAL;
+
+	if (offset >= node.size)
+		return 0;
+	if (!len || len > node.size - offset)
+		len = node.size - offset;
+
+	ret = sqfs_file_read(&node, offset, buf, len);
+	if (ret) {
+		printf("** Error reading file %s **\n", filename);
+		return ret;
+	}
+	*actread = len;
+
+	return 0;
+}
+
+void squashfs_close(void)
+{
+	sqfs_cache_free(&sqfs.meta);
+	sqfs_cache_free(&sqfs.data);
+	sqfs_cache_free(&sqfs.frag);
+	free(sqfs.frag_index);
+	free(sqfs.rbuf);
+	sqfs.frag_index = NULL;
+	sqfs.rbuf = NULL;
+	cur_dev = NULL;
+}
+
+int squashfs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info)
+{
+	struct squashfs_super_block *sb;
+	struct sqfs_node root;
+	u64 frag_table;
+	u32 n;
+
+	fs_cache_invalidate();
+	squashfs_close();
+
+	cur_dev = rbdd;
+	cur_part_info = *info;
+
+	/* Enough for the superblock until the block size is known */
+	sqfs.rbuf_blks = DIV_ROUND_UP(sizeof(*sb), rbdd->blksz);
+	sqfs.rbuf = malloc_cache_aligned(sqfs.rbuf_blks * rbdd->blksz);
+	sqfs.rbuf_blk = -1;
+	if (!sqfs.rbuf)
+		goto err;
+	sb = (struct squashfs_super_block *)sqfs_read_raw(0, sizeof(*sb), 0);
+	if (!sb || le32_to_cpu(sb->s_magic) != SQUASHFS_MAGIC)
+		goto err;
+
+	sqfs.block_size = le32_to_cpu(sb->block_size);
+	sqfs.block_log = le16_to_cpu(sb->block_log);
+	sqfs.comp = le16_to_cpu(sb->compression);
+	sqfs.fragments = le32_to_cpu(sb->fragments);
+	sqfs.bytes_used = le64_to_cpu(sb->bytes_used);
+	sqfs.root_ref = le64_to_cpu(sb->root_inode);
+	sqfs.inode_table = le64_to_cpu(sb->inode_table_start);
+	sqfs.dir_table = le64_to_cpu(sb->directory_table_start);
+	frag_table = le64_to_cpu(sb->fragment_table_start);
+	if (le16_to_cpu(sb->s_major) != SQUASHFS_MAJOR ||
+	    sqfs.block_log < 12 || sqfs.block_log > SQUASHFS_MAX_BLOCK_LOG ||
+	    sqfs.block_size != 1 << sqfs.block_log ||
+	    sqfs.inode_table >= sqfs.bytes_used ||
+	    sqfs.dir_table >= sqfs.bytes_used) {
+		printf("SquashFS: unsupported or corrupt superblock\n");
+		goto err;
+	}
+	if (!sqfs_comp_supported(sqfs.comp)) {
+		printf("SquashFS: unsupported compression type %u\n",
+		       sqfs.comp);
+		goto err;
+	}
+
+	/* Room for a whole compressed block however it is aligned */
+	free(sqfs.rbuf);
+	sqfs.rbuf_blks = DIV_ROUND_UP(max_t(u32, sqfs.block_size,
+					    SQFS_READAHEAD), rbdd->blksz) + 2;
+	sqfs.rbuf = malloc_cache_aligned(sqfs.rbuf_blks * rbdd->blksz);
+	sqfs.rbuf_blk = -1;
+	if (!sqfs.rbuf)
+		goto err;
+
+	sqfs_cache_init(&sqfs.meta, SQFS_META_CACHE, SQUASHFS_METADATA_SIZE);
+	sqfs_cache_init(&sqfs.data, CONFIG_SQUASHFS_CACHE_BLOCKS,
+			sqfs.block_size);
+	sqfs_cache_init(&sqfs.frag, CONFIG_SQUASHFS_FRAGMENT_CACHE,
+			sqfs.block_size);
+	if (!sqfs.meta.count || !sqfs.data.count || !sqfs.frag.count)
+		goto err;
+
+	if (sqfs.fragments) {
+		n = DIV_ROUND_UP(sqfs.fragments, SQFS_FRAGS_PER_BLOCK);
+		sqfs.frag_index = malloc(n * sizeof(u64));
+		if (!sqfs.frag_index ||
+		    sqfs_read_bytes(frag_table, sqfs.frag_index,
+				    n * sizeof(u64)))
+			goto err;
+		while (n--)
+			sqfs.frag_index[n] = le64_to_cpu(sqfs.frag_index[n]);
+	}
+
+	if (sqfs_read_inode(sqfs.root_ref, &root) ||
+	    root.type != SQUASHFS_DIR_TYPE)
+		goto err;
+
+	return 0;
+
+err:
+	squashfs_close();
+	return -1;
+}
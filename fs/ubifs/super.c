@@ -2223,6 +2223,10 @@ static struct ubifs_info *alloc_ubifs_info(struct ubi_volume_desc *ubi)
 		INIT_LIST_HEAD(&c->orph_list);
 		INIT_LIST_HEAD(&c->orph_new);
 		c->no_chk_data_crc = 1;
+#ifdef CONFIG_UBIFS_BULK_READ
+		/* Files are read sequentially, so bulk-read always pays off */
+		c->bulk_read = 1;
+#endif
 
 		c->highest_inum = UBIFS_FIRST_INO;
 		c->lhead_lnum = c->ltail_lnum = UBIFS_LOG_LNUM;
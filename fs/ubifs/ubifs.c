@@ -13,6 +13,7 @@
  */
 
 #include <common.h>
+#include <mapmem.h>
 #include <memalign.h>
 #include "ubifs.h"
 #include <u-boot/zlib.h>
@@ -681,23 +682,13 @@ static inline void *kmap(struct page *page)
 	return page->addr;
 }
 
-static int read_block(struct inode *inode, void *addr, unsigned int block,
-		      struct ubifs_data_node *dn)
+static int decompress_block(struct inode *inode, void *addr,
+			    unsigned int block, struct ubifs_data_node *dn)
 {
 	struct ubifs_info *c = inode->i_sb->s_fs_info;
 	int err, len, out_len;
-	union ubifs_key key;
 	unsigned int dlen;
 
-	data_key_init(c, &key, inode->i_ino, block);
-	err = ubifs_tnc_lookup(c, &key, dn);
-	if (err) {
-		if (err == -ENOENT)
-			/* Not found, so it must be a hole */
-			memset(addr, 0, UBIFS_BLOCK_SIZE);
-		return err;
-	}
-
 	ubifs_assert(le64_to_cpu(dn->ch.sqnum) > ubifs_inode(inode)->creat_sqnum);
 
 	len = le32_to_cpu(dn->size);
@@ -728,6 +719,82 @@ dump:
 	return -EINVAL;
 }
 
+static int read_block(struct inode *inode, void *addr, unsigned int block,
+		      struct ubifs_data_node *dn)
+{
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	union ubifs_key key;
+	int err;
+
+	data_key_init(c, &key, inode->i_ino, block);
+	err = ubifs_tnc_lookup(c, &key, dn);
+	if (err) {
+		if (err == -ENOENT)
+			/* Not found, so it must be a hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		return err;
+	}
+
+	return decompress_block(inode, addr, block, dn);
+}
+
+/**
+ * read_blocks_bulk - read consecutive blocks of an inode in one go.
+ * @c: UBIFS file-system description object
+ * @inode: inode to read from
+ * @addr: where to store the blocks
+ * @block: first block to read
+ * @count: maximum number of blocks to read
+ *
+ * Data nodes of consecutive blocks of a file are usually stored next to each
+ * other in the same LEB. Look up as many of them as fit the bulk-read buffer,
+ * read them with a single LEB read and decompress them from the buffer. Holes
+ * between the nodes are zeroed.
+ *
+ * Returns the number of blocks stored at @addr, zero if bulk-read could not
+ * be used and the caller should read block @block on its own, or a negative
+ * error code in case of failure.
+ */
+static int read_blocks_bulk(struct ubifs_info *c, struct inode *inode,
+			    void *addr, unsigned int block, unsigned int count)
+{
+	struct bu_info *bu = &c->bu;
+	struct ubifs_data_node *dn;
+	int err, i, n = 0;
+
+	bu->buf_len = c->max_bu_buf_len;
+	data_key_init(c, &bu->key, inode->i_ino, block);
+	err = ubifs_tnc_get_bu_keys(c, bu);
+	if (err)
+		return err;
+
+	/* A single node is read just as well by read_block() */
+	if (bu->cnt < 2)
+		return 0;
+
+	err = ubifs_tnc_bulk_read(c, bu);
+	if (err)
+		return err == -EAGAIN ? 0 : err;
+
+	count = min_t(unsigned int, count, bu->blk_cnt);
+	for (i = 0; i < count; i++, addr += UBIFS_BLOCK_SIZE) {
+		if (n < bu->cnt &&
+		    key_block(c, &bu->zbranch[n].key) == block + i) {
+			dn = bu->buf + bu->zbranch[n].offs -
+			     bu->zbranch[0].offs;
+			err = decompress_block(inode, addr, block + i, dn);
+			if (err)
+				return err;
+			n++;
+		} else {
+			/* Hole */
+			memset(addr, 0, UBIFS_BLOCK_SIZE);
+		}
+	}
+
+	return count;
+}
+
 static int do_readpage(struct ubifs_info *c, struct inode *inode,
 		       struct page *page, int last_block_size)
 {
@@ -847,7 +914,7 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	struct inode *inode;
 	struct page page;
 	int err = 0;
-	int i;
+	int i, n;
 	int count;
 	int last_block_size = 0;
 
@@ -897,19 +964,35 @@ int ubifs_read(const char *filename, void *buf, loff_t offset,
 	page.addr = buf;
 	page.index = offset / PAGE_SIZE;
 	page.inode = inode;
-	for (i = 0; i < count; i++) {
+	for (i = 0; i < count; i += n) {
 		/*
-		 * Make sure to not read beyond the requested size
+		 * Bulk-read all but the last block, which may have to be
+		 * truncated to the requested size
 		 */
-		if (((i + 1) == count) && (size < inode->i_size))
-			last_block_size = size - (i * PAGE_SIZE);
-
-		err = do_readpage(c, inode, &page, last_block_size);
-		if (err)
+		n = 0;
+		if (c->bulk_read && (i + 1) < count)
+			n = read_blocks_bulk(c, inode, page.addr,
+					     page.index, count - 1 - i);
+		if (n < 0) {
+			err = n;
 			break;
+		}
+
+		if (!n) {
+			/*
+			 * Make sure to not read beyond the requested size
+			 */
+			if (((i + 1) == count) && (size < inode->i_size))
+				last_block_size = size - (i * PAGE_SIZE);
+
+			err = do_readpage(c, inode, &page, last_block_size);
+			if (err)
+				break;
+			n = 1;
+		}
 
-		page.addr += PAGE_SIZE;
-		page.index++;
+		page.addr += n * PAGE_SIZE;
+		page.index += n;
 	}
 
 	if (err) {
@@ -935,11 +1018,14 @@ void ubifs_close(void)
 int ubifs_load(char *filename, u32 addr, u32 size)
 {
 	loff_t actread;
+	void *buf;
 	int err;
 
 	printf("Loading file '%s' to addr 0x%08x...\n", filename, addr);
 
-	err = ubifs_read(filename, (void *)(uintptr_t)addr, 0, size, &actread);
+	buf = map_sysmem(addr, size);
+	err = ubifs_read(filename, buf, 0, size, &actread);
+	unmap_sysmem(buf);
 	if (err == 0) {
 		env_set_hex("filesize", actread);
 		printf("Done\n");
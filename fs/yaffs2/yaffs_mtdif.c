@@ -18,6 +18,7 @@
 
 
 #include "yaffs_mtdif.h"
+#include "yaffs_mtdif2.h"
 
 #include <linux/mtd/mtd.h>
 #include <linux/types.h>
@@ -134,15 +135,15 @@ int nandmtd_ReadChunkFromNAND(struct yaffs_dev *dev, int chunkInNAND, u8 *data,
 int nandmtd_EraseBlockInNAND(struct yaffs_dev *dev, int blockNumber)
 {
 	struct mtd_info *mtd = (struct mtd_info *)(dev->driver_context);
-	__u32 addr =
-	    ((loff_t) blockNumber) * dev->data_bytes_per_chunk
+	loff_t addr =
+	    ((loff_t) blockNumber) * dev->param.total_bytes_per_chunk
 		* dev->param.chunks_per_block;
 	struct erase_info ei;
 	int retval = 0;
 
 	ei.mtd = mtd;
 	ei.addr = addr;
-	ei.len = dev->data_bytes_per_chunk * dev->param.chunks_per_block;
+	ei.len = dev->param.total_bytes_per_chunk * dev->param.chunks_per_block;
 	ei.time = 1000;
 	ei.retries = 2;
 	ei.callback = NULL;
@@ -150,6 +151,7 @@ int nandmtd_EraseBlockInNAND(struct yaffs_dev *dev, int blockNumber)
 
 	/* Todo finish off the ei if required */
 
+	nandmtd2_drop_read_cache();
 
 	retval = mtd_erase(mtd, &ei);
 
@@ -32,6 +32,98 @@
 #define yaffs_dev_to_mtd(dev) ((struct mtd_info *)((dev)->driver_context))
 #define yaffs_dev_to_lc(dev) ((struct yaffs_linux_context *)((dev)->os_context))
 
+/*
+ * Chunks read in sequence, as when restoring the checkpoint or reading a
+ * file, are read ahead with their tags in one MTD call, which lets the
+ * NAND driver use the chip's cache read commands. The read-ahead starts
+ * at two chunks and doubles up to CONFIG_YAFFS2_READ_CHUNKS while the
+ * reads stay sequential, so that short runs such as a small checkpoint do
+ * not read much more than they need. Reads moving forward by less than
+ * CONFIG_YAFFS2_READ_CHUNKS chunks count as sequential, so that the
+ * summary chunks at the end of each block do not stop the read-ahead. A
+ * read-ahead that reports corrected or uncorrectable ECC errors is thrown
+ * away and the chunks are read one by one, so that each gets its own ECC
+ * result.
+ */
+static struct {
+	struct yaffs_dev *dev;	/* Device the chunks were read from */
+	int first;		/* First chunk held */
+	int count;		/* Number of chunks held, 0 if none */
+	int next;		/* Chunk following the last one read */
+	int window;		/* Chunks to read ahead next time */
+	int size;		/* Size of buf */
+	u8 *buf;		/* Data of the chunks, then the tags of each */
+} rd;
+
+void nandmtd2_drop_read_cache(void)
+{
+	rd.count = 0;
+	rd.dev = NULL;
+}
+
+/* Read ahead count chunks from nand_chunk, stopping at the end of its block */
+static int nandmtd2_read_ahead(struct yaffs_dev *dev, int nand_chunk,
+			       int count)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	struct mtd_oob_ops ops;
+	int chunk_size = dev->param.total_bytes_per_chunk;
+	int oob_size = dev->param.inband_tags ? 0 : mtd->oobavail;
+	int left = dev->param.chunks_per_block -
+		   nand_chunk % dev->param.chunks_per_block;
+	int size;
+
+	if (count > left)
+		count = left;
+	if (count < 2)
+		return -EINVAL;
+
+	size = CONFIG_YAFFS2_READ_CHUNKS * (chunk_size + oob_size);
+	if (rd.size < size) {
+		free(rd.buf);
+		rd.buf = malloc(size);
+		rd.size = rd.buf ? size : 0;
+		if (!rd.buf)
+			return -ENOMEM;
+	}
+
+	rd.count = 0;
+	ops.mode = MTD_OPS_AUTO_OOB;
+	ops.len = count * chunk_size;
+	ops.ooblen = count * oob_size;
+	ops.ooboffs = 0;
+	ops.datbuf = rd.buf;
+	ops.oobbuf = oob_size ? rd.buf + ops.len : NULL;
+	if (mtd_read_oob(mtd, (loff_t)nand_chunk * chunk_size, &ops))
+		return -EIO;
+
+	rd.dev = dev;
+	rd.first = nand_chunk;
+	rd.count = count;
+
+	return 0;
+}
+
+/* Copy a chunk and the start of its OOB from the read-ahead if it has it */
+static int nandmtd2_read_cached(struct yaffs_dev *dev, int nand_chunk,
+				u8 *data, u8 *spare, int spare_len)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	int chunk_size = dev->param.total_bytes_per_chunk;
+	int i = nand_chunk - rd.first;
+
+	if (rd.dev != dev || i < 0 || i >= rd.count)
+		return -ENOENT;
+
+	if (data)
+		memcpy(data, rd.buf + i * chunk_size, chunk_size);
+	if (spare)
+		memcpy(spare, rd.buf + rd.count * chunk_size +
+		       i * mtd->oobavail, spare_len);
+
+	return 0;
+}
+
 
 /* NB For use with inband tags....
  * We assume that the data buffer is of size total_bytes_per_chunk so
@@ -77,6 +169,8 @@ int nandmtd2_write_chunk_tags(struct yaffs_dev *dev, int nand_chunk,
 		yaffs_pack_tags2(&pt, tags, !dev->param.no_tags_ecc);
 	}
 
+	nandmtd2_drop_read_cache();
+
 	ops.mode = MTD_OPS_AUTO_OOB;
 	ops.ooblen = (dev->param.inband_tags) ? 0 : packed_tags_size;
 	ops.len = dev->param.total_bytes_per_chunk;
@@ -120,7 +214,22 @@ int nandmtd2_read_chunk_tags(struct yaffs_dev *dev, int nand_chunk,
 
 	}
 
-	if (dev->param.inband_tags || (data && !tags))
+	if (data) {
+		if (nand_chunk < rd.next ||
+		    nand_chunk >= rd.next + CONFIG_YAFFS2_READ_CHUNKS) {
+			rd.window = 1;
+		} else if (nandmtd2_read_cached(dev, nand_chunk, NULL, NULL, 0)) {
+			rd.window = min(rd.window * 2, CONFIG_YAFFS2_READ_CHUNKS);
+			nandmtd2_read_ahead(dev, nand_chunk, rd.window);
+		}
+		rd.next = nand_chunk + 1;
+	}
+
+	if (!nandmtd2_read_cached(dev, nand_chunk, data,
+				  dev->param.inband_tags ? NULL : local_spare,
+				  packed_tags_size))
+		retval = 0;
+	else if (dev->param.inband_tags || (data && !tags))
 		retval = mtd_read(mtd, addr, dev->param.total_bytes_per_chunk,
 				   &dummy, data);
 	else if (tags) {
@@ -178,10 +287,12 @@ int nandmtd2_MarkNANDBlockBad(struct yaffs_dev *dev, int blockNo)
 	yaffs_trace(YAFFS_TRACE_MTD,
 		"nandmtd2_MarkNANDBlockBad %d", blockNo);
 
+	nandmtd2_drop_read_cache();
+
 	retval =
 	    mtd_block_markbad(mtd,
-			       blockNo * dev->param.chunks_per_block *
-			       dev->data_bytes_per_chunk);
+			       (loff_t)blockNo * dev->param.chunks_per_block *
+			       dev->param.total_bytes_per_chunk);
 
 	if (retval == 0)
 		return YAFFS_OK;
@@ -199,8 +310,8 @@ int nandmtd2_QueryNANDBlock(struct yaffs_dev *dev, int blockNo,
 	yaffs_trace(YAFFS_TRACE_MTD, "nandmtd2_QueryNANDBlock %d", blockNo);
 	retval =
 	    mtd_block_isbad(mtd,
-			     blockNo * dev->param.chunks_per_block *
-			     dev->data_bytes_per_chunk);
+			     (loff_t)blockNo * dev->param.chunks_per_block *
+			     dev->param.total_bytes_per_chunk);
 
 	if (retval) {
 		yaffs_trace(YAFFS_TRACE_MTD, "block is bad");
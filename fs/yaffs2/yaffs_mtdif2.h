@@ -26,5 +26,6 @@ int nandmtd2_read_chunk_tags(struct yaffs_dev *dev, int chunkInNAND,
 int nandmtd2_MarkNANDBlockBad(struct yaffs_dev *dev, int blockNo);
 int nandmtd2_QueryNANDBlock(struct yaffs_dev *dev, int blockNo,
 			    enum yaffs_block_state *state, u32 *sequenceNumber);
+void nandmtd2_drop_read_cache(void);
 
 #endif
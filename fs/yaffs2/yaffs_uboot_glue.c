@@ -164,7 +164,6 @@ void cmd_yaffs_devconfig(char *_mp, int flash_dev,
 	struct yaffs_dev *dev = NULL;
 	struct yaffs_dev *chk;
 	char *mp = NULL;
-	struct nand_chip *chip;
 
 	mtd = get_nand_dev_by_index(flash_dev);
 	if (!mtd) {
@@ -187,15 +186,13 @@ void cmd_yaffs_devconfig(char *_mp, int flash_dev,
 	}
 
 	if (end_block == 0)
-		end_block = lldiv(mtd->size, mtd->erasesize - 1);
+		end_block = lldiv(mtd->size, mtd->erasesize) - 1;
 
 	if (end_block < start_block) {
 		printf("Bad start/end\n");
 		goto err;
 	}
 
-	chip =  mtd_to_nand(mtd);
-
 	/* Check for any conflicts */
 	yaffs_dev_rewind();
 	while (1) {
@@ -228,9 +225,12 @@ void cmd_yaffs_devconfig(char *_mp, int flash_dev,
 	dev->param.is_yaffs2 = 1;
 	dev->param.use_nand_ecc = 1;
 	dev->param.n_reserved_blocks = 5;
-	if (chip->ecc.layout->oobavail < sizeof(struct yaffs_packed_tags2))
+	if (mtd->oobavail < sizeof(struct yaffs_packed_tags2))
 		dev->param.inband_tags = 1;
 	dev->param.n_caches = 10;
+	dev->param.skip_checkpt_rd = !IS_ENABLED(CONFIG_YAFFS2_CHECKPOINT);
+	dev->param.skip_checkpt_wr = !IS_ENABLED(CONFIG_YAFFS2_CHECKPOINT);
+	dev->param.disable_summary = !IS_ENABLED(CONFIG_YAFFS2_SUMMARY);
 	dev->param.write_chunk_tags_fn = nandmtd2_write_chunk_tags;
 	dev->param.read_chunk_tags_fn = nandmtd2_read_chunk_tags;
 	dev->param.erase_fn = nandmtd_EraseBlockInNAND;
@@ -333,7 +333,12 @@ void read_a_file(char *fn)
 
 void cmd_yaffs_mount(char *mp)
 {
-	int retval = yaffs_mount(mp);
+	int retval;
+
+	/* The flash may have been written since the last yaffs command */
+	nandmtd2_drop_read_cache();
+
+	retval = yaffs_mount(mp);
 	if (retval < 0)
 		printf("Error mounting %s, return value: %d, %s\n", mp,
 			yaffsfs_GetError(), yaffs_error_str());
@@ -345,6 +350,7 @@ void cmd_yaffs_umount(char *mp)
 	if (yaffs_unmount(mp) == -1)
 		printf("Error umounting %s, return value: %d, %s\n", mp,
 			yaffsfs_GetError(), yaffs_error_str());
+	nandmtd2_drop_read_cache();
 }
 
 void cmd_yaffs_write_file(char *yaffsName, char bval, int sizeOfFile)
@@ -16,6 +16,7 @@
 #include <linux/stat.h>
 #include <linux/time.h>
 #include <linux/ctype.h>
+#include <linux/list.h>
 #include <asm/byteorder.h>
 #include "zfs_common.h"
 #include "div64.h"
@@ -176,6 +177,29 @@ struct zfs_data {
 
 };
 
+/*
+ * Decompressed metadata blocks, most recently used first. Every command
+ * mounts the pool afresh, so the cache lives outside struct zfs_data and
+ * is shared by all mounts. A block is identified by its pool, address,
+ * birth txg and checksum, so contents that have since been freed and
+ * overwritten are never mistaken for the block.
+ */
+struct zfs_cached_block {
+	struct list_head list;
+	uint64_t pool_guid;
+	dva_t dva;
+	uint64_t birth;
+	zio_cksum_t cksum;
+	size_t size;
+	char data[];
+};
+
+static LIST_HEAD(zfs_block_cache);
+static size_t zfs_block_cache_bytes;
+
+/* Largest run of adjacent file blocks fetched with a single device read */
+#define ZFS_READ_RUN_SIZE	(1 << 20)
+
 
 
 
@@ -183,11 +207,66 @@ static int
 zlib_decompress(void *s, void *d,
 				uint32_t slen, uint32_t dlen)
 {
-	if (zlib_decompress(s, d, slen, dlen) < 0)
+	unsigned long len = slen;
+
+	/* skip the two byte zlib header */
+	if (zunzip(d, dlen, s, &len, 1, 2) < 0)
 		return ZFS_ERR_BAD_FS;
 	return ZFS_ERR_NONE;
 }
 
+/*
+ * Zero length encoding: a length byte up to n is followed by that many
+ * literal bytes, a larger one stands for (length - n) zero bytes.
+ */
+static int
+zle_decompress(void *s, void *d,
+			   uint32_t slen, uint32_t dlen)
+{
+	unsigned char *src = s, *s_end = src + slen;
+	unsigned char *dst = d, *d_end = dst + dlen;
+	const int n = 64;
+
+	while (src < s_end && dst < d_end) {
+		int len = 1 + *src++;
+
+		if (len <= n) {
+			if (len > s_end - src || len > d_end - dst)
+				return ZFS_ERR_BAD_FS;
+			memcpy(dst, src, len);
+			src += len;
+		} else {
+			len -= n;
+			if (len > d_end - dst)
+				return ZFS_ERR_BAD_FS;
+			memset(dst, 0, len);
+		}
+		dst += len;
+	}
+
+	return dst == d_end ? ZFS_ERR_NONE : ZFS_ERR_BAD_FS;
+}
+
+#ifdef CONFIG_LZ4
+static int
+lz4_decompress(void *s, void *d,
+			   uint32_t slen, uint32_t dlen)
+{
+	size_t bufsiz, outsiz = dlen;
+
+	/* the raw LZ4 block is preceded by its big-endian length */
+	if (slen < sizeof(uint32_t))
+		return ZFS_ERR_BAD_FS;
+	bufsiz = be32_to_cpu(*(uint32_t *) s);
+	if (bufsiz > slen - sizeof(uint32_t))
+		return ZFS_ERR_BAD_FS;
+
+	if (ulz4_block((char *) s + sizeof(uint32_t), bufsiz, d, &outsiz))
+		return ZFS_ERR_BAD_FS;
+	return ZFS_ERR_NONE;
+}
+#endif
+
 static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{"inherit", NULL},		/* ZIO_COMPRESS_INHERIT */
 	{"on", lzjb_decompress},	/* ZIO_COMPRESS_ON */
@@ -203,6 +282,12 @@ static decomp_entry_t decomp_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{"gzip-7", zlib_decompress},  /* ZIO_COMPRESS_GZIP7 */
 	{"gzip-8", zlib_decompress},  /* ZIO_COMPRESS_GZIP8 */
 	{"gzip-9", zlib_decompress},  /* ZIO_COMPRESS_GZIP9 */
+	{"zle", zle_decompress},	/* ZIO_COMPRESS_ZLE */
+#ifdef CONFIG_LZ4
+	{"lz4", lz4_decompress},	/* ZIO_COMPRESS_LZ4 */
+#else
+	{"lz4", NULL},		/* ZIO_COMPRESS_LZ4 */
+#endif
 };
 
 
@@ -214,6 +299,13 @@ static int
 zio_read(blkptr_t *bp, zfs_endian_t endian, void **buf,
 		 size_t *size, struct zfs_data *data);
 
+static int
+zio_read_cached(blkptr_t *bp, zfs_endian_t endian, const void **buf,
+				struct zfs_data *data);
+
+static inline size_t
+get_lsize(blkptr_t *bp, zfs_endian_t endian);
+
 /*
  * Our own version of log2().  Same thing as highbit()-1.
  */
@@ -338,14 +430,12 @@ vdev_uberblock_compare(uberblock_t *ub1, uberblock_t *ub2)
  * Three pieces of information are needed to verify an uberblock: the magic
  * number, the version number, and the checksum.
  *
- * Currently Implemented: version number, magic number, label txg
- * Need to Implement: checksum
+ * Currently Implemented: version number, magic number, label txg, checksum
  *
  */
 static int
 uberblock_verify(uberblock_t *uber, int offset, struct zfs_data *data)
 {
-	int err;
 	zfs_endian_t endian = UNKNOWN_ENDIAN;
 	zio_cksum_t zc;
 
@@ -356,13 +446,13 @@ uberblock_verify(uberblock_t *uber, int offset, struct zfs_data *data)
 	}
 
 	if (zfs_to_cpu64(uber->ub_magic, LITTLE_ENDIAN) == UBERBLOCK_MAGIC
-		&& zfs_to_cpu64(uber->ub_version, LITTLE_ENDIAN) > 0
-		&& zfs_to_cpu64(uber->ub_version, LITTLE_ENDIAN) <= SPA_VERSION)
+		&& SPA_VERSION_IS_SUPPORTED(zfs_to_cpu64(uber->ub_version,
+												 LITTLE_ENDIAN)))
 		endian = LITTLE_ENDIAN;
 
 	if (zfs_to_cpu64(uber->ub_magic, BIG_ENDIAN) == UBERBLOCK_MAGIC
-		&& zfs_to_cpu64(uber->ub_version, BIG_ENDIAN) > 0
-		&& zfs_to_cpu64(uber->ub_version, BIG_ENDIAN) <= SPA_VERSION)
+		&& SPA_VERSION_IS_SUPPORTED(zfs_to_cpu64(uber->ub_version,
+												 BIG_ENDIAN)))
 		endian = BIG_ENDIAN;
 
 	if (endian == UNKNOWN_ENDIAN) {
@@ -372,20 +462,27 @@ uberblock_verify(uberblock_t *uber, int offset, struct zfs_data *data)
 
 	memset(&zc, 0, sizeof(zc));
 	zc.zc_word[0] = cpu_to_zfs64(offset, endian);
-	err = zio_checksum_verify(zc, ZIO_CHECKSUM_LABEL, endian,
-							  (char *) uber, UBERBLOCK_SIZE(data->vdev_ashift));
+	return zio_checksum_verify(zc, ZIO_CHECKSUM_LABEL, endian,
+							   (char *) uber, UBERBLOCK_SIZE(data->vdev_ashift));
+}
 
-	if (!err) {
-		/* Check that the data pointed by the rootbp is usable. */
-		void *osp = NULL;
-		size_t ospsize;
-		err = zio_read(&uber->ub_rootbp, endian, &osp, &ospsize, data);
-		free(osp);
+/*
+ * Check that the data pointed by the rootbp of an uberblock is usable.
+ */
+static int
+uberblock_check_rootbp(uberblock_t *uber, struct zfs_data *data)
+{
+	zfs_endian_t endian;
+	const void *osp;
+	int err;
 
-		if (!err && ospsize < OBJSET_PHYS_SIZE_V14) {
-			printf("uberblock rootbp points to invalid data\n");
-			return ZFS_ERR_BAD_FS;
-		}
+	endian = zfs_to_cpu64(uber->ub_magic, LITTLE_ENDIAN) == UBERBLOCK_MAGIC
+		? LITTLE_ENDIAN : BIG_ENDIAN;
+
+	err = zio_read_cached(&uber->ub_rootbp, endian, &osp, data);
+	if (!err && get_lsize(&uber->ub_rootbp, endian) < OBJSET_PHYS_SIZE_V14) {
+		printf("uberblock rootbp points to invalid data\n");
+		return ZFS_ERR_BAD_FS;
 	}
 
 	return err;
@@ -393,6 +490,8 @@ uberblock_verify(uberblock_t *uber, int offset, struct zfs_data *data)
 
 /*
  * Find the best uberblock.
+ * Only the object set of the most recent valid uberblock is read; older
+ * ones are only looked at if it turns out to be unusable.
  * Return:
  *	  Success - Pointer to the best uberblock.
  *	  Failure - NULL
@@ -400,10 +499,10 @@ uberblock_verify(uberblock_t *uber, int offset, struct zfs_data *data)
 static uberblock_t *find_bestub(char *ub_array, struct zfs_data *data)
 {
 	const uint64_t sector = data->vdev_phys_sector;
-	uberblock_t *ubbest = NULL;
+	uberblock_t *ubbest;
 	uberblock_t *ubnext;
-	unsigned int i, offset, pickedub = 0;
-	int err = ZFS_ERR_NONE;
+	char valid[VDEV_UBERBLOCK_RING >> UBERBLOCK_SHIFT];
+	unsigned int i, offset, pickedub;
 
 	const unsigned int UBCOUNT = UBERBLOCK_COUNT(data->vdev_ashift);
 	const uint64_t UBBYTES = UBERBLOCK_SIZE(data->vdev_ashift);
@@ -412,19 +511,28 @@ static uberblock_t *find_bestub(char *ub_array, struct zfs_data *data)
 		ubnext = (uberblock_t *) (i * UBBYTES + ub_array);
 		offset = (sector << SPA_MINBLOCKSHIFT) + VDEV_PHYS_SIZE + (i * UBBYTES);
 
-		err = uberblock_verify(ubnext, offset, data);
-		if (err)
-			continue;
+		valid[i] = !uberblock_verify(ubnext, offset, data);
+	}
 
-		if (ubbest == NULL || vdev_uberblock_compare(ubnext, ubbest) > 0) {
-			ubbest = ubnext;
-			pickedub = i;
+	do {
+		ubbest = NULL;
+		pickedub = 0;
+		for (i = 0; i < UBCOUNT; i++) {
+			ubnext = (uberblock_t *) (i * UBBYTES + ub_array);
+			if (valid[i] && (ubbest == NULL ||
+							 vdev_uberblock_compare(ubnext, ubbest) > 0)) {
+				ubbest = ubnext;
+				pickedub = i;
+			}
 		}
-	}
+		if (!ubbest)
+			return NULL;
+
+		valid[pickedub] = 0;
+	} while (uberblock_check_rootbp(ubbest, data));
 
-	if (ubbest)
-		debug("zfs Found best uberblock at idx %d, txg %llu\n",
-			  pickedub, (unsigned long long) ubbest->ub_txg);
+	debug("zfs Found best uberblock at idx %d, txg %llu\n",
+		  pickedub, (unsigned long long) ubbest->ub_txg);
 
 	return ubbest;
 }
@@ -436,6 +544,37 @@ get_psize(blkptr_t *bp, zfs_endian_t endian)
 			<< SPA_MINBLOCKSHIFT;
 }
 
+/*
+ * Embedded block pointers reuse bit 39, the top bit of the compression
+ * field, which no compression algorithm ever sets.
+ */
+static inline int
+bp_is_embedded(blkptr_t *bp, zfs_endian_t endian)
+{
+	return (zfs_to_cpu64((bp)->blk_prop, endian) >> 39) & 1;
+}
+
+/*
+ * A hole has no DVA. With the hole_birth feature it has a birth txg
+ * though, so BP_IS_HOLE() alone does not spot it.
+ */
+static inline int
+bp_is_hole(blkptr_t *bp, zfs_endian_t endian)
+{
+	return !bp_is_embedded(bp, endian) &&
+		bp->blk_dva[0].dva_word[0] == 0 && bp->blk_dva[0].dva_word[1] == 0;
+}
+
+static inline size_t
+get_lsize(blkptr_t *bp, zfs_endian_t endian)
+{
+	uint64_t prop = zfs_to_cpu64((bp)->blk_prop, endian);
+
+	if (bp_is_embedded(bp, endian))
+		return (prop & 0x1ffffff) + 1;
+	return ((prop & 0xffff) + 1) << SPA_MINBLOCKSHIFT;
+}
+
 static uint64_t
 dva_get_offset(dva_t *dva, zfs_endian_t endian)
 {
@@ -443,6 +582,25 @@ dva_get_offset(dva_t *dva, zfs_endian_t endian)
 							 endian) << SPA_MINBLOCKSHIFT;
 }
 
+static inline uint64_t
+dva_get_asize(dva_t *dva, zfs_endian_t endian)
+{
+	return (zfs_to_cpu64((dva)->dva_word[0], endian) & 0xffffff)
+		<< SPA_MINBLOCKSHIFT;
+}
+
+static inline uint32_t
+dva_get_vdev(dva_t *dva, zfs_endian_t endian)
+{
+	return zfs_to_cpu64((dva)->dva_word[0], endian) >> 32;
+}
+
+static inline int
+dva_is_gang(dva_t *dva, zfs_endian_t endian)
+{
+	return (zfs_to_cpu64((dva)->dva_word[1], endian) >> 63) & 1;
+}
+
 /*
  * Read a block of data based on the gang block address dva,
  * and put its data in buf.
@@ -552,137 +710,429 @@ zio_read_data(blkptr_t *bp, zfs_endian_t endian, void *buf,
 	return err;
 }
 
+static int
+zio_decompress(unsigned int comp, void *src, void *dst,
+			   size_t psize, size_t lsize)
+{
+	if (comp >= ZIO_COMPRESS_FUNCTIONS) {
+		printf("compression algorithm %u not supported\n", (unsigned int) comp);
+		return ZFS_ERR_NOT_IMPLEMENTED_YET;
+	}
+
+	if (decomp_table[comp].decomp_func == NULL) {
+		printf("compression algorithm %s not supported\n", decomp_table[comp].name);
+		return ZFS_ERR_NOT_IMPLEMENTED_YET;
+	}
+
+	return decomp_table[comp].decomp_func(src, dst, psize, lsize);
+}
+
+/*
+ * Unpack the data held by an embedded block pointer and decompress it
+ * into buf.
+ */
+static int
+zio_read_embedded(blkptr_t *bp, zfs_endian_t endian, void *buf)
+{
+	uint64_t prop = zfs_to_cpu64(bp->blk_prop, endian);
+	unsigned int comp = (prop >> 32) & 0x7f;
+	size_t lsize = (prop & 0x1ffffff) + 1;
+	size_t psize = ((prop >> 25) & 0x7f) + 1;
+	uint64_t payload[BPE_PAYLOAD_SIZE / sizeof(uint64_t)];
+	uint64_t *wp;
+	int i = 0;
+
+	if (((prop >> 40) & 0xff) != BP_EMBEDDED_TYPE_DATA) {
+		printf("zfs unknown embedded block pointer type\n");
+		return ZFS_ERR_NOT_IMPLEMENTED_YET;
+	}
+
+	if (psize > BPE_PAYLOAD_SIZE ||
+		(comp == ZIO_COMPRESS_OFF && lsize != psize)) {
+		printf("zfs invalid embedded block pointer\n");
+		return ZFS_ERR_BAD_FS;
+	}
+
+	/* The payload is little-endian within each word, in native order */
+	for (wp = (uint64_t *) bp; wp < (uint64_t *) (bp + 1); wp++) {
+		if (BPE_IS_PAYLOADWORD(bp, wp))
+			payload[i++] = cpu_to_le64(zfs_to_cpu64(*wp, endian));
+	}
+
+	if (comp == ZIO_COMPRESS_OFF) {
+		memcpy(buf, payload, lsize);
+		return ZFS_ERR_NONE;
+	}
+
+	return zio_decompress(comp, payload, buf, psize, lsize);
+}
+
 /*
  * Read in a block of data, verify its checksum, decompress if needed,
- * and put the uncompressed data in buf.
+ * and put the uncompressed data in buf, which must hold the logical size
+ * of the block.
  */
 static int
-zio_read(blkptr_t *bp, zfs_endian_t endian, void **buf,
-		 size_t *size, struct zfs_data *data)
+zio_read_into(blkptr_t *bp, zfs_endian_t endian, void *buf,
+			  struct zfs_data *data)
 {
 	size_t lsize, psize;
 	unsigned int comp;
-	char *compbuf = NULL;
+	char *compbuf;
 	int err;
 
-	*buf = NULL;
+	if (bp_is_embedded(bp, endian))
+		return zio_read_embedded(bp, endian, buf);
 
 	comp = (zfs_to_cpu64((bp)->blk_prop, endian)>>32) & 0xff;
-	lsize = (BP_IS_HOLE(bp) ? 0 :
-			 (((zfs_to_cpu64((bp)->blk_prop, endian) & 0xffff) + 1)
-			  << SPA_MINBLOCKSHIFT));
+	lsize = get_lsize(bp, endian);
 	psize = get_psize(bp, endian);
 
-	if (size)
-		*size = lsize;
+	if (comp == ZIO_COMPRESS_OFF)
+		return zio_read_data(bp, endian, buf, data);
 
-	if (comp >= ZIO_COMPRESS_FUNCTIONS) {
-		printf("compression algorithm %u not supported\n", (unsigned int) comp);
-		return ZFS_ERR_NOT_IMPLEMENTED_YET;
+	compbuf = malloc(psize);
+	if (!compbuf)
+		return ZFS_ERR_OUT_OF_MEMORY;
+
+	err = zio_read_data(bp, endian, compbuf, data);
+	if (!err)
+		err = zio_decompress(comp, compbuf, buf, psize, lsize);
+	free(compbuf);
+
+	return err;
+}
+
+static struct zfs_cached_block *
+zfs_cache_lookup(blkptr_t *bp, struct zfs_data *data)
+{
+	struct zfs_cached_block *cb;
+
+	list_for_each_entry(cb, &zfs_block_cache, list) {
+		if (cb->pool_guid == data->pool_guid &&
+			cb->birth == bp->blk_birth &&
+			!memcmp(&cb->dva, &bp->blk_dva[0], sizeof(cb->dva)) &&
+			!memcmp(&cb->cksum, &bp->blk_cksum, sizeof(cb->cksum))) {
+			list_move(&cb->list, &zfs_block_cache);
+			return cb;
+		}
 	}
 
-	if (comp != ZIO_COMPRESS_OFF && decomp_table[comp].decomp_func == NULL) {
-		printf("compression algorithm %s not supported\n", decomp_table[comp].name);
-		return ZFS_ERR_NOT_IMPLEMENTED_YET;
+	return NULL;
+}
+
+/*
+ * Add a block at the head of the cache, dropping the least recently used
+ * ones beyond CONFIG_ZFS_BLOCK_CACHE_SIZE. The block just added always
+ * stays, however large it is.
+ */
+static void
+zfs_cache_add(struct zfs_cached_block *cb)
+{
+	struct zfs_cached_block *old;
+
+	list_add(&cb->list, &zfs_block_cache);
+	zfs_block_cache_bytes += cb->size;
+
+	while (zfs_block_cache_bytes > CONFIG_ZFS_BLOCK_CACHE_SIZE &&
+		   zfs_block_cache.prev != &cb->list) {
+		old = list_last_entry(&zfs_block_cache, struct zfs_cached_block,
+							  list);
+		list_del(&old->list);
+		zfs_block_cache_bytes -= old->size;
+		free(old);
 	}
+}
 
-	if (comp != ZIO_COMPRESS_OFF) {
-		compbuf = malloc(psize);
-		if (!compbuf)
-			return ZFS_ERR_OUT_OF_MEMORY;
-	} else {
-		compbuf = *buf = malloc(lsize);
+/*
+ * Read in a block through the block cache. The data returned in buf
+ * belongs to the cache and stays valid until the next block is read
+ * through it.
+ */
+static int
+zio_read_cached(blkptr_t *bp, zfs_endian_t endian, const void **buf,
+				struct zfs_data *data)
+{
+	struct zfs_cached_block *cb;
+	size_t lsize;
+	int err;
+
+	if (bp_is_embedded(bp, endian) || bp_is_hole(bp, endian)) {
+		printf("zfs unexpected embedded block pointer or hole\n");
+		return ZFS_ERR_BAD_FS;
 	}
 
-	err = zio_read_data(bp, endian, compbuf, data);
+	cb = zfs_cache_lookup(bp, data);
+	if (cb) {
+		*buf = cb->data;
+		return ZFS_ERR_NONE;
+	}
+
+	lsize = get_lsize(bp, endian);
+	cb = malloc(sizeof(*cb) + lsize);
+	if (!cb)
+		return ZFS_ERR_OUT_OF_MEMORY;
+
+	err = zio_read_into(bp, endian, cb->data, data);
 	if (err) {
-		free(compbuf);
-		*buf = NULL;
+		free(cb);
 		return err;
 	}
 
-	if (comp != ZIO_COMPRESS_OFF) {
-		*buf = malloc(lsize);
-		if (!*buf) {
-			free(compbuf);
-			return ZFS_ERR_OUT_OF_MEMORY;
-		}
+	cb->pool_guid = data->pool_guid;
+	cb->dva = bp->blk_dva[0];
+	cb->birth = bp->blk_birth;
+	cb->cksum = bp->blk_cksum;
+	cb->size = lsize;
+	zfs_cache_add(cb);
 
-		err = decomp_table[comp].decomp_func(compbuf, *buf, psize, lsize);
-		free(compbuf);
-		if (err) {
-			free(*buf);
-			*buf = NULL;
-			return err;
-		}
+	*buf = cb->data;
+	return ZFS_ERR_NONE;
+}
+
+/*
+ * Read in a block of data, verify its checksum, decompress if needed,
+ * and put the uncompressed data in a newly allocated buf.
+ */
+static int
+zio_read(blkptr_t *bp, zfs_endian_t endian, void **buf,
+		 size_t *size, struct zfs_data *data)
+{
+	const void *cached;
+	size_t lsize;
+	int err;
+
+	*buf = NULL;
+
+	lsize = get_lsize(bp, endian);
+	if (size)
+		*size = lsize;
+
+	*buf = malloc(lsize);
+	if (!*buf)
+		return ZFS_ERR_OUT_OF_MEMORY;
+
+	if (bp_is_embedded(bp, endian)) {
+		err = zio_read_embedded(bp, endian, *buf);
+	} else {
+		err = zio_read_cached(bp, endian, &cached, data);
+		if (!err)
+			memcpy(*buf, cached, lsize);
+	}
+	if (err) {
+		free(*buf);
+		*buf = NULL;
 	}
 
-	return ZFS_ERR_NONE;
+	return err;
 }
 
 /*
  * Get the block from a block id.
  * push the block onto the stack.
  *
+ * Indirect blocks go through the block cache, so do level 0 blocks of
+ * anything but file contents, which would only push metadata out of it.
  */
 static int
 dmu_read(dnode_end_t *dn, uint64_t blkid, void **buf,
 		 zfs_endian_t *endian_out, struct zfs_data *data)
 {
 	int idx, level;
-	blkptr_t *bp_array = dn->dn.dn_blkptr;
+	const blkptr_t *bp_array = dn->dn.dn_blkptr;
 	int epbs = dn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
-	blkptr_t *bp;
-	void *tmpbuf = 0;
+	blkptr_t bp;
+	const void *tmpbuf;
 	zfs_endian_t endian;
 	int err = ZFS_ERR_NONE;
 
-	bp = malloc(sizeof(blkptr_t));
-	if (!bp)
-		return ZFS_ERR_OUT_OF_MEMORY;
-
 	endian = dn->endian;
 	for (level = dn->dn.dn_nlevels - 1; level >= 0; level--) {
 		idx = (blkid >> (epbs * level)) & ((1 << epbs) - 1);
-		*bp = bp_array[idx];
-		if (bp_array != dn->dn.dn_blkptr) {
-			free(bp_array);
-			bp_array = 0;
-		}
+		bp = bp_array[idx];
 
-		if (BP_IS_HOLE(bp)) {
+		if (bp_is_hole(&bp, endian)) {
 			size_t size = zfs_to_cpu16(dn->dn.dn_datablkszsec,
 											dn->endian)
 				<< SPA_MINBLOCKSHIFT;
 			*buf = malloc(size);
-			if (*buf) {
+			if (!*buf) {
 				err = ZFS_ERR_OUT_OF_MEMORY;
 				break;
 			}
 			memset(*buf, 0, size);
-			endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
+			endian = (zfs_to_cpu64(bp.blk_prop, endian) >> 63) & 1;
 			break;
 		}
 		if (level == 0) {
-			err = zio_read(bp, endian, buf, 0, data);
-			endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
+			if (dn->dn.dn_type == DMU_OT_PLAIN_FILE_CONTENTS) {
+				*buf = malloc(get_lsize(&bp, endian));
+				if (!*buf) {
+					err = ZFS_ERR_OUT_OF_MEMORY;
+					break;
+				}
+				err = zio_read_into(&bp, endian, *buf, data);
+				if (err) {
+					free(*buf);
+					*buf = NULL;
+				}
+			} else {
+				err = zio_read(&bp, endian, buf, 0, data);
+			}
+			endian = (zfs_to_cpu64(bp.blk_prop, endian) >> 63) & 1;
 			break;
 		}
-		err = zio_read(bp, endian, &tmpbuf, 0, data);
-		endian = (zfs_to_cpu64(bp->blk_prop, endian) >> 63) & 1;
+		err = zio_read_cached(&bp, endian, &tmpbuf, data);
+		endian = (zfs_to_cpu64(bp.blk_prop, endian) >> 63) & 1;
 		if (err)
 			break;
 		bp_array = tmpbuf;
 	}
-	if (bp_array != dn->dn.dn_blkptr)
-		free(bp_array);
 	if (endian_out)
 		*endian_out = endian;
 
-	free(bp);
 	return err;
 }
 
+/*
+ * Read up to nblks consecutive level 0 blocks of a file, starting at
+ * blkid, straight into buf. Their block pointers are taken from a single
+ * level 1 indirect block, or the dnode itself, and blocks lying next to
+ * each other on the disk are fetched with a single device read before
+ * being verified and decompressed one by one.
+ *
+ * Returns the number of blocks read, which stops short at the end of the
+ * indirect block and may be 0, or an error.
+ */
+static int
+dmu_read_run(dnode_end_t *dn, uint64_t blkid, uint64_t nblks, char *buf,
+			 struct zfs_data *data)
+{
+	int epbs = dn->dn.dn_indblkshift - SPA_BLKPTRSHIFT;
+	size_t blksz = zfs_to_cpu16(dn->dn.dn_datablkszsec, dn->endian)
+		<< SPA_MINBLOCKSHIFT;
+	const blkptr_t *bp_array = dn->dn.dn_blkptr;
+	zfs_endian_t endian = dn->endian;
+	blkptr_t *bps, *bp;
+	const void *tmpbuf;
+	char *runbuf = NULL;
+	uint64_t first, count, i, j;
+	int idx, level;
+	int err = ZFS_ERR_NONE;
+
+	for (level = dn->dn.dn_nlevels - 1; level > 0; level--) {
+		blkptr_t ibp;
+
+		idx = (blkid >> (epbs * level)) & ((1 << epbs) - 1);
+		ibp = bp_array[idx];
+		if (bp_is_hole(&ibp, endian))
+			return 0;
+		err = zio_read_cached(&ibp, endian, &tmpbuf, data);
+		endian = (zfs_to_cpu64(ibp.blk_prop, endian) >> 63) & 1;
+		if (err)
+			return err;
+		bp_array = tmpbuf;
+	}
+
+	if (dn->dn.dn_nlevels == 1) {
+		if (blkid >= dn->dn.dn_nblkptr)
+			return 0;
+		first = blkid;
+		count = dn->dn.dn_nblkptr - first;
+	} else {
+		first = blkid & ((1 << epbs) - 1);
+		count = (1 << epbs) - first;
+	}
+	if (count > nblks)
+		count = nblks;
+
+	/* Take a copy, reading blocks below may evict the indirect block */
+	bps = malloc(count * sizeof(*bps));
+	if (!bps)
+		return ZFS_ERR_OUT_OF_MEMORY;
+	memcpy(bps, bp_array + first, count * sizeof(*bps));
+
+	for (i = 0; i < count && !err; i = j) {
+		uint64_t start, end;
+		char *dst = buf + i * blksz;
+
+		bp = &bps[i];
+		j = i + 1;
+		if (bp_is_hole(bp, endian)) {
+			memset(dst, 0, blksz);
+			continue;
+		}
+		if (bp_is_embedded(bp, endian) ||
+			dva_is_gang(&bp->blk_dva[0], endian) ||
+			get_lsize(bp, endian) != blksz) {
+			if (get_lsize(bp, endian) != blksz)
+				err = ZFS_ERR_BAD_FS;
+			else
+				err = zio_read_into(bp, endian, dst, data);
+			continue;
+		}
+
+		/* Gather the following blocks stored right after this one */
+		start = dva_get_offset(&bp->blk_dva[0], endian);
+		end = start + dva_get_asize(&bp->blk_dva[0], endian);
+		for (; j < count; j++) {
+			blkptr_t *next = &bps[j];
+
+			if (bp_is_hole(next, endian) || bp_is_embedded(next, endian) ||
+				dva_is_gang(&next->blk_dva[0], endian) ||
+				get_lsize(next, endian) != blksz ||
+				dva_get_vdev(&next->blk_dva[0], endian) !=
+				dva_get_vdev(&bp->blk_dva[0], endian) ||
+				dva_get_offset(&next->blk_dva[0], endian) != end ||
+				end + dva_get_asize(&next->blk_dva[0], endian) - start >
+				ZFS_READ_RUN_SIZE)
+				break;
+			end += dva_get_asize(&next->blk_dva[0], endian);
+		}
+
+		if (j == i + 1) {
+			err = zio_read_into(bp, endian, dst, data);
+			continue;
+		}
+
+		if (!runbuf) {
+			runbuf = malloc(ZFS_READ_RUN_SIZE);
+			if (!runbuf) {
+				err = ZFS_ERR_OUT_OF_MEMORY;
+				break;
+			}
+		}
+		if (zfs_devread(DVA_OFFSET_TO_PHYS_SECTOR(start), 0, end - start,
+						runbuf))
+			end = start;	/* fall back to reading block by block */
+
+		for (; i < j && !err; i++) {
+			char *src = runbuf + dva_get_offset(&bps[i].blk_dva[0],
+												endian) - start;
+			size_t psize = get_psize(&bps[i], endian);
+			unsigned int comp;
+
+			bp = &bps[i];
+			dst = buf + i * blksz;
+			comp = (zfs_to_cpu64(bp->blk_prop, endian) >> 32) & 0xff;
+			if (end == start ||
+				zio_checksum_verify(bp->blk_cksum,
+									(zfs_to_cpu64(bp->blk_prop, endian)
+									 >> 40) & 0xff,
+									endian, src, psize))
+				err = zio_read_into(bp, endian, dst, data);
+			else if (comp == ZIO_COMPRESS_OFF)
+				memcpy(dst, src, blksz);
+			else
+				err = zio_decompress(comp, src, dst, psize, blksz);
+		}
+	}
+
+	free(runbuf);
+	free(bps);
+	return err ? err : count;
+}
+
 /*
  * mzap_lookup: Looks up property described by "name" and returns the value
  * in "value".
@@ -1708,6 +2158,60 @@ int_zfs_fetch_nvlist(struct zfs_data *data, char **nvlist)
 	return ZFS_ERR_NONE;
 }
 
+/*
+ * Features that may be active in a pool we read. All the others listed
+ * as needed for reading by the label must be inactive.
+ */
+static const char *const zfs_features_for_read[] = {
+#ifdef CONFIG_LZ4
+	"org.illumos:lz4_compress",
+#endif
+	"com.delphix:hole_birth",
+	"com.delphix:embedded_data",
+	"com.delphix:extensible_dataset",
+	NULL
+};
+
+static int
+check_pool_features(char *nvlist)
+{
+	const char *const *feature;
+	char *features, *nvpair, *name;
+	int encode_size, name_len;
+	int err = ZFS_ERR_NONE;
+
+	features = zfs_nvlist_lookup_nvlist(nvlist,
+										ZPOOL_CONFIG_FEATURES_FOR_READ);
+	if (!features)
+		return ZFS_ERR_NONE;
+
+	/*
+	 * The values are empty, so walk the names by hand rather than with
+	 * nvlist_find_value(). Skip the header, nvl_version and nvl_nvflag.
+	 */
+	nvpair = features + 4 * 3;
+	while ((encode_size = be32_to_cpu(*(uint32_t *) nvpair))) {
+		/* skip the encode/decode size */
+		name_len = be32_to_cpu(*(uint32_t *) (nvpair + 4 * 2));
+		name = nvpair + 4 * 3;
+
+		for (feature = zfs_features_for_read; *feature; feature++) {
+			if (strlen(*feature) == name_len &&
+				!strncmp(*feature, name, name_len))
+				break;
+		}
+		if (!*feature) {
+			printf("zpool feature %.*s not supported\n", name_len, name);
+			err = ZFS_ERR_NOT_IMPLEMENTED_YET;
+		}
+
+		nvpair += encode_size;	/* goto the next nvpair */
+	}
+
+	free(features);
+	return err;
+}
+
 /*
  * Check the disk label information and retrieve needed vdev name-value pairs.
  *
@@ -1765,14 +2269,21 @@ check_pool_label(struct zfs_data *data)
 		return ZFS_ERR_BAD_FS;
 	}
 
-	if (version > SPA_VERSION) {
+	if (!SPA_VERSION_IS_SUPPORTED(version)) {
 		free(nvlist);
-		printf("SPA version too new %llu > %llu\n",
-			   (unsigned long long) version,
-			   (unsigned long long) SPA_VERSION);
+		printf("SPA version not supported %llu\n",
+			   (unsigned long long) version);
 		return ZFS_ERR_NOT_IMPLEMENTED_YET;
 	}
 
+	if (version == SPA_VERSION_FEATURES) {
+		err = check_pool_features(nvlist);
+		if (err) {
+			free(nvlist);
+			return err;
+		}
+	}
+
 	vdevnvlist = zfs_nvlist_lookup_nvlist(nvlist, ZPOOL_CONFIG_VDEV_TREE);
 	if (!vdevnvlist) {
 		free(nvlist);
@@ -2100,9 +2611,9 @@ zfs_read(zfs_file_t file, char *buf, uint64_t len)
 
 	/*
 	 * Entire Dnode is too big to fit into the space available.	 We
-	 * will need to read it in chunks.	This could be optimized to
-	 * read in as large a chunk as there is space available, but for
-	 * now, this only reads in one data block at a time.
+	 * will need to read it in chunks. Runs of whole blocks are read
+	 * straight into the buffer provided, the partial blocks at either
+	 * end go through file_buf.
 	 */
 	length = len;
 	red = 0;
@@ -2112,7 +2623,24 @@ zfs_read(zfs_file_t file, char *buf, uint64_t len)
 		 * Find requested blkid and the offset within that block.
 		 */
 		uint64_t blkid = file->offset + red;
-		blkid = do_div(blkid, blksz);
+		uint64_t blkoff = do_div(blkid, blksz);
+
+		if (blkoff == 0 && length >= blksz) {
+			uint64_t nblks = length;
+
+			do_div(nblks, blksz);
+			err = dmu_read_run(&(data->dnode), blkid, nblks, buf, data);
+			if (err < 0)
+				return -1;
+			if (err > 0) {
+				movesize = err * blksz;
+				buf += movesize;
+				length -= movesize;
+				red += movesize;
+				continue;
+			}
+		}
+
 		free(data->file_buf);
 		data->file_buf = 0;
 
@@ -2125,7 +2653,7 @@ zfs_read(zfs_file_t file, char *buf, uint64_t len)
 		data->file_start = blkid * blksz;
 		data->file_end = data->file_start + blksz;
 
-		movesize = min(length, data->file_end - (int)file->offset - red);
+		movesize = min(length, data->file_end - file->offset - red);
 
 		memmove(buf, data->file_buf + file->offset + red
 				- data->file_start, movesize);
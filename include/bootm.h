@@ -56,6 +56,25 @@ int do_bootm_states(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[],
 
 void arch_preboot_os(void);
 
+/**
+ * bootm_uncompress() - decompress a buffer
+ *
+ * This does the work of bootm_decomp_image() without any messages, so it
+ * can also be used to time the decompressors.
+ *
+ * @comp:	Compression algorithm that is used (IH_COMP_...)
+ * @load_buf:	Place to decompress to
+ * @image_buf:	Address to decompress from
+ * @image_len:	Number of bytes in @image_buf to decompress
+ * @unc_len:	Available space for decompression
+ * @sizep:	Returns the number of bytes decompressed. On error, this is at
+ *		least @unc_len if the space ran out.
+ * @return 0 if OK, -ENOSYS if @comp is not supported, else the non-zero
+ * error code of the decompressor
+ */
+int bootm_uncompress(int comp, void *load_buf, void *image_buf,
+		     ulong image_len, uint unc_len, ulong *sizep);
+
 /**
  * bootm_decomp_image() - decompress the operating system
  *
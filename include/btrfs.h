@@ -0,0 +1,272 @@
+/*
+ * R/O Btrfs filesystem implementation
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _BTRFS_H_
+#define _BTRFS_H_
+
+#include <asm/byteorder.h>
+
+#define BTRFS_MAGIC		0x4d5f53665248425fULL	/* "_BHRfS_M" */
+#define BTRFS_SUPER_INFO_OFFSET	0x10000
+#define BTRFS_SUPER_INFO_SIZE	4096
+
+#define BTRFS_CSUM_SIZE		32
+#define BTRFS_FSID_SIZE		16
+#define BTRFS_UUID_SIZE		16
+#define BTRFS_LABEL_SIZE	256
+#define BTRFS_SYSTEM_CHUNK_ARRAY_SIZE	2048
+#define BTRFS_MAX_LEVEL		8
+#define BTRFS_NAME_LEN		255
+
+/* Checksum types; only CRC32C is verified */
+#define BTRFS_CSUM_TYPE_CRC32	0
+
+/* Incompatible features */
+#define BTRFS_FEATURE_INCOMPAT_MIXED_BACKREF	(1ULL << 0)
+#define BTRFS_FEATURE_INCOMPAT_DEFAULT_SUBVOL	(1ULL << 1)
+#define BTRFS_FEATURE_INCOMPAT_MIXED_GROUPS	(1ULL << 2)
+#define BTRFS_FEATURE_INCOMPAT_COMPRESS_LZO	(1ULL << 3)
+#define BTRFS_FEATURE_INCOMPAT_COMPRESS_ZSTD	(1ULL << 4)
+#define BTRFS_FEATURE_INCOMPAT_BIG_METADATA	(1ULL << 5)
+#define BTRFS_FEATURE_INCOMPAT_EXTENDED_IREF	(1ULL << 6)
+#define BTRFS_FEATURE_INCOMPAT_RAID56		(1ULL << 7)
+#define BTRFS_FEATURE_INCOMPAT_SKINNY_METADATA	(1ULL << 8)
+#define BTRFS_FEATURE_INCOMPAT_NO_HOLES		(1ULL << 9)
+#define BTRFS_FEATURE_INCOMPAT_METADATA_UUID	(1ULL << 10)
+#define BTRFS_FEATURE_INCOMPAT_RAID1C34		(1ULL << 11)
+
+/* Tree and inode object ids */
+#define BTRFS_ROOT_TREE_OBJECTID	1
+#define BTRFS_FS_TREE_OBJECTID		5
+#define BTRFS_ROOT_TREE_DIR_OBJECTID	6
+#define BTRFS_FIRST_CHUNK_TREE_OBJECTID	256
+
+/* Item key types */
+#define BTRFS_INODE_ITEM_KEY		1
+#define BTRFS_INODE_REF_KEY		12
+#define BTRFS_DIR_ITEM_KEY		84
+#define BTRFS_DIR_INDEX_KEY		96
+#define BTRFS_EXTENT_DATA_KEY		108
+#define BTRFS_ROOT_ITEM_KEY		132
+#define BTRFS_CHUNK_ITEM_KEY		228
+
+/* Chunk profiles that spread data over several stripes */
+#define BTRFS_BLOCK_GROUP_RAID0		(1ULL << 3)
+#define BTRFS_BLOCK_GROUP_RAID10	(1ULL << 6)
+#define BTRFS_BLOCK_GROUP_RAID5		(1ULL << 7)
+#define BTRFS_BLOCK_GROUP_RAID6		(1ULL << 8)
+#define BTRFS_BLOCK_GROUP_STRIPED	(BTRFS_BLOCK_GROUP_RAID0 | \
+					 BTRFS_BLOCK_GROUP_RAID10 | \
+					 BTRFS_BLOCK_GROUP_RAID5 | \
+					 BTRFS_BLOCK_GROUP_RAID6)
+
+/* Directory entry types */
+#define BTRFS_FT_REG_FILE	1
+#define BTRFS_FT_DIR		2
+#define BTRFS_FT_SYMLINK	7
+
+/* File extents */
+#define BTRFS_FILE_EXTENT_INLINE	0
+#define BTRFS_FILE_EXTENT_REG		1
+#define BTRFS_FILE_EXTENT_PREALLOC	2
+
+#define BTRFS_COMPRESS_NONE	0
+#define BTRFS_COMPRESS_ZLIB	1
+#define BTRFS_COMPRESS_LZO	2
+#define BTRFS_COMPRESS_ZSTD	3
+
+/* Largest decompressed size of a compressed extent */
+#define BTRFS_MAX_UNCOMPRESSED	(128 * 1024)
+
+/* Inode modes */
+#define BTRFS_S_IFMT		0170000
+#define BTRFS_S_IFDIR		0040000
+#define BTRFS_S_IFREG		0100000
+#define BTRFS_S_IFLNK		0120000
+
+struct btrfs_dev_item {
+	__le64	devid;
+	__le64	total_bytes;
+	__le64	bytes_used;
+	__le32	io_align;
+	__le32	io_width;
+	__le32	sector_size;
+	__le64	type;
+	__le64	generation;
+	__le64	start_offset;
+	__le32	dev_group;
+	u8	seek_speed;
+	u8	bandwidth;
+	u8	uuid[BTRFS_UUID_SIZE];
+	u8	fsid[BTRFS_UUID_SIZE];
+} __packed;
+
+/* The backup roots following the system chunk array are not used */
+struct btrfs_super_block {
+	u8	csum[BTRFS_CSUM_SIZE];
+	u8	fsid[BTRFS_FSID_SIZE];
+	__le64	bytenr;
+	__le64	flags;
+	__le64	magic;
+	__le64	generation;
+	__le64	root;
+	__le64	chunk_root;
+	__le64	log_root;
+	__le64	log_root_transid;
+	__le64	total_bytes;
+	__le64	bytes_used;
+	__le64	root_dir_objectid;
+	__le64	num_devices;
+	__le32	sectorsize;
+	__le32	nodesize;
+	__le32	__unused_leafsize;
+	__le32	stripesize;
+	__le32	sys_chunk_array_size;
+	__le64	chunk_root_generation;
+	__le64	compat_flags;
+	__le64	compat_ro_flags;
+	__le64	incompat_flags;
+	__le16	csum_type;
+	u8	root_level;
+	u8	chunk_root_level;
+	u8	log_root_level;
+	struct btrfs_dev_item dev_item;
+	char	label[BTRFS_LABEL_SIZE];
+	__le64	cache_generation;
+	__le64	uuid_tree_generation;
+	u8	reserved[240];
+	u8	sys_chunk_array[BTRFS_SYSTEM_CHUNK_ARRAY_SIZE];
+} __packed;
+
+struct btrfs_disk_key {
+	__le64	objectid;
+	u8	type;
+	__le64	offset;
+} __packed;
+
+/* Every tree block starts with this header */
+struct btrfs_header {
+	u8	csum[BTRFS_CSUM_SIZE];
+	u8	fsid[BTRFS_FSID_SIZE];
+	__le64	bytenr;
+	__le64	flags;
+	u8	chunk_tree_uuid[BTRFS_UUID_SIZE];
+	__le64	generation;
+	__le64	owner;
+	__le32	nritems;
+	u8	level;
+} __packed;
+
+/* Leaves hold items, whose data is at offset from the end of the header */
+struct btrfs_item {
+	struct btrfs_disk_key key;
+	__le32	offset;
+	__le32	size;
+} __packed;
+
+/* Nodes hold pointers to the blocks of the level below */
+struct btrfs_key_ptr {
+	struct btrfs_disk_key key;
+	__le64	blockptr;
+	__le64	generation;
+} __packed;
+
+struct btrfs_stripe {
+	__le64	devid;
+	__le64	offset;
+	u8	dev_uuid[BTRFS_UUID_SIZE];
+} __packed;
+
+struct btrfs_chunk {
+	__le64	length;
+	__le64	owner;
+	__le64	stripe_len;
+	__le64	type;
+	__le32	io_align;
+	__le32	io_width;
+	__le32	sector_size;
+	__le16	num_stripes;
+	__le16	sub_stripes;
+	struct btrfs_stripe stripe[];
+} __packed;
+
+struct btrfs_timespec {
+	__le64	sec;
+	__le32	nsec;
+} __packed;
+
+struct btrfs_inode_item {
+	__le64	generation;
+	__le64	transid;
+	__le64	size;
+	__le64	nbytes;
+	__le64	block_group;
+	__le32	nlink;
+	__le32	uid;
+	__le32	gid;
+	__le32	mode;
+	__le64	rdev;
+	__le64	flags;
+	__le64	sequence;
+	__le64	reserved[4];
+	struct btrfs_timespec atime;
+	struct btrfs_timespec ctime;
+	struct btrfs_timespec mtime;
+	struct btrfs_timespec otime;
+} __packed;
+
+/* Items of subvolumes created by older kernels end after level */
+struct btrfs_root_item {
+	struct btrfs_inode_item inode;
+	__le64	generation;
+	__le64	root_dirid;
+	__le64	bytenr;
+	__le64	byte_limit;
+	__le64	bytes_used;
+	__le64	last_snapshot;
+	__le64	flags;
+	__le32	refs;
+	struct btrfs_disk_key drop_progress;
+	u8	drop_level;
+	u8	level;
+} __packed;
+
+struct btrfs_dir_item {
+	struct btrfs_disk_key location;
+	__le64	transid;
+	__le16	data_len;
+	__le16	name_len;
+	u8	type;
+	/* + char name[name_len], then data_len bytes of xattr data */
+} __packed;
+
+struct btrfs_file_extent_item {
+	__le64	generation;
+	__le64	ram_bytes;
+	u8	compression;
+	u8	encryption;
+	__le16	other_encoding;
+	u8	type;
+	/* Inline extents: the data follows; the rest is for the others */
+	__le64	disk_bytenr;
+	__le64	disk_num_bytes;
+	__le64	offset;
+	__le64	num_bytes;
+} __packed;
+
+/* Size of the part of btrfs_file_extent_item used by inline extents */
+#define BTRFS_FILE_EXTENT_INLINE_DATA_START \
+	offsetof(struct btrfs_file_extent_item, disk_bytenr)
+
+int btrfs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info);
+int btrfs_ls(const char *dirname);
+int btrfs_exists(const char *filename);
+int btrfs_size(const char *filename, loff_t *size);
+int btrfs_read_file(const char *filename, void *buf, loff_t offset,
+		    loff_t len, loff_t *actread);
+void btrfs_close(void);
+
+#endif /* _BTRFS_H_ */
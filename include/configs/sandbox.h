@@ -47,6 +47,14 @@
 
 /* SPI - enable all SPI flash types for testing purposes */
 
+/* NAND - a simulated chip is connected with --nand */
+#ifdef CONFIG_NAND
+#define CONFIG_SYS_MAX_NAND_DEVICE	1
+#define CONFIG_SYS_NAND_ONFI_DETECTION
+#define CONFIG_MTD_DEVICE
+#define CONFIG_MTD_PARTITIONS
+#endif
+
 #define CONFIG_I2C_EDID
 
 /* Memory things - we don't really want a memory test */
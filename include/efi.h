@@ -77,6 +77,9 @@ struct efi_device_path;
 #define EFI_IP_ADDRESS_CONFLICT		(EFI_ERROR_MASK | 34)
 #define EFI_HTTP_ERROR			(EFI_ERROR_MASK | 35)
 
+/* Warnings, which are not errors */
+#define EFI_WARN_DELETE_FAILURE		2
+
 typedef unsigned long efi_status_t;
 typedef u64 efi_physical_addr_t;
 typedef u64 efi_virtual_addr_t;
@@ -63,6 +63,7 @@ extern const efi_guid_t efi_guid_console_control;
 extern const efi_guid_t efi_guid_device_path;
 extern const efi_guid_t efi_guid_loaded_image;
 extern const efi_guid_t efi_guid_device_path_to_text_protocol;
+extern const efi_guid_t efi_simple_file_system_protocol_guid;
 
 extern unsigned int __efi_runtime_start, __efi_runtime_stop;
 extern unsigned int __efi_runtime_rel_start, __efi_runtime_rel_stop;
@@ -103,6 +104,7 @@ struct efi_object {
 /**
  * struct efi_event
  *
+ * @link:		Link in the list of all events
  * @type:		Type of event, see efi_create_event
  * @notify_tpl:		Task priority level of notifications
  * @trigger_time:	Period of the timer
@@ -110,9 +112,11 @@ struct efi_object {
  * @nofify_function:	Function to call when the event is triggered
  * @notify_context:	Data to be passed to the notify function
  * @trigger_type:	Type of timer, see efi_set_timer
+ * @timer_index:	Position in the queue of running timers, or -1
  * @signaled:		The notify function was already called
  */
 struct efi_event {
+	struct list_head link;
 	uint32_t type;
 	UINTN notify_tpl;
 	void (EFIAPI *notify_function)(struct efi_event *event, void *context);
@@ -120,6 +124,7 @@ struct efi_event {
 	u64 trigger_next;
 	u64 trigger_time;
 	enum efi_timer_delay trigger_type;
+	int timer_index;
 	int signaled;
 };
 
@@ -131,6 +136,15 @@ extern struct list_head efi_obj_list;
 int efi_console_register(void);
 /* Called by bootefi to make all disk storage accessible as EFI objects */
 int efi_disk_register(void);
+/* Called by bootefi before starting a payload, to reset disk readahead */
+void efi_disk_prepare(void);
+/* Called by bootefi when a payload returns, to free readahead buffers */
+void efi_disk_finish(void);
+/* Called by efi_disk_register() to make the files on a disk available */
+struct efi_simple_file_system_protocol *
+efi_simple_file_system(const struct blk_desc *desc, int part);
+/* Called when a disk was written to, to forget the files looked up on it */
+void efi_file_drop_cache(struct efi_simple_file_system_protocol *volume);
 /* Called by bootefi to make GOP (graphical) interface available */
 int efi_gop_register(void);
 /* Called by bootefi to make the network interface available */
@@ -143,6 +157,8 @@ void efi_net_set_dhcp_ack(void *pkt, int len);
 
 /* Called from places to check whether a timer expired */
 void efi_timer_check(void);
+/* Called while a payload waits for an event, until timer_get_us() >= until */
+void efi_idle(u64 until);
 /* PE loader implementation */
 void *efi_load_pe(void *efi, struct efi_loaded_image *loaded_image_info);
 /* Called once to store the pristine gd pointer */
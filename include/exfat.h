@@ -0,0 +1,105 @@
+/*
+ * R/O exFAT filesystem implementation
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _EXFAT_H_
+#define _EXFAT_H_
+
+#include <asm/byteorder.h>
+
+#define EXFAT_SIGN		"EXFAT   "
+#define EXFAT_SIGNLEN		8
+
+/* Cluster numbers */
+#define EXFAT_FIRST_CLUSTER	2
+#define EXFAT_BAD_CLUSTER	0xfffffff7
+#define EXFAT_EOF_CLUSTER	0xffffffff
+
+/* Directory entry types */
+#define EXFAT_ENTRY_EOD		0x00	/* End of directory */
+#define EXFAT_ENTRY_INUSE	0x80	/* Set unless the entry is deleted */
+#define EXFAT_ENTRY_BITMAP	0x81	/* Allocation bitmap */
+#define EXFAT_ENTRY_UPCASE	0x82	/* Up-case table */
+#define EXFAT_ENTRY_LABEL	0x83	/* Volume label */
+#define EXFAT_ENTRY_FILE	0x85	/* File, followed by secondaries */
+#define EXFAT_ENTRY_STREAM	0xc0	/* Stream extension */
+#define EXFAT_ENTRY_NAME	0xc1	/* File name */
+
+/* File attributes */
+#define EXFAT_ATTR_DIR		0x0010
+
+/* Stream extension flags */
+#define EXFAT_SF_ALLOC_POSSIBLE	0x01
+#define EXFAT_SF_CONTIGUOUS	0x02	/* NoFatChain: no FAT chain to follow */
+
+#define EXFAT_NAME_CHARS	15	/* Characters per name entry */
+#define EXFAT_MAX_NAME_LEN	255
+#define EXFAT_MAX_DIR_SIZE	(256 << 20)
+
+struct exfat_boot_sector {
+	__u8	jump_boot[3];
+	char	fs_name[EXFAT_SIGNLEN];
+	__u8	must_be_zero[53];
+	__le64	partition_offset;
+	__le64	volume_length;		/* In sectors */
+	__le32	fat_offset;		/* In sectors */
+	__le32	fat_length;		/* In sectors */
+	__le32	cluster_heap_offset;	/* In sectors */
+	__le32	cluster_count;
+	__le32	root_cluster;
+	__le32	serial;
+	__le16	revision;
+	__le16	flags;
+	__u8	sector_shift;		/* log2 of bytes per sector */
+	__u8	cluster_shift;		/* log2 of sectors per cluster */
+	__u8	num_fats;
+	__u8	drive_select;
+	__u8	percent_in_use;
+	__u8	reserved[7];
+} __packed;
+
+struct exfat_dentry {
+	__u8	type;
+	union {
+		struct {
+			__u8	secondary_count;
+			__le16	checksum;
+			__le16	attr;
+			__u8	reserved[26];
+		} __packed file;
+		struct {
+			__u8	flags;
+			__u8	reserved1;
+			__u8	name_len;
+			__le16	name_hash;
+			__le16	reserved2;
+			__le64	valid_size;
+			__le32	reserved3;
+			__le32	start_cluster;
+			__le64	size;
+		} __packed stream;
+		struct {
+			__u8	flags;
+			__le16	name[EXFAT_NAME_CHARS];
+		} __packed name;
+		struct {
+			__u8	flags;
+			__u8	reserved[18];
+			__le32	start_cluster;
+			__le64	size;
+		} __packed bitmap;
+	};
+} __packed;
+
+int exfat_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info);
+int exfat_ls(const char *dirname);
+int exfat_exists(const char *filename);
+int exfat_size(const char *filename, loff_t *size);
+int exfat_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
+		    loff_t *actread);
+int exfat_uuid(char *uuid_str);
+void exfat_close(void);
+
+#endif /* _EXFAT_H_ */
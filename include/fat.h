@@ -11,6 +11,7 @@
 #define _FAT_H_
 
 #include <asm/byteorder.h>
+#include <fs.h>
 
 #define CONFIG_SUPPORT_VFAT
 /* Maximum Long File Name length supported here is 128 UTF-16 code units */
@@ -121,6 +122,13 @@ typedef struct boot_sector {
 	__u16	reserved2[6];	/* Unused */
 } boot_sector;
 
+/* FAT32 FSInfo sector, holding free cluster hints */
+#define FSINFO_LEAD_SIG		0x41615252
+#define FSINFO_STRUC_SIG	0x61417272
+#define FSINFO_STRUC_SIG_OFF	484
+#define FSINFO_FREE_COUNT_OFF	488
+#define FSINFO_NEXT_FREE_OFF	492
+
 typedef struct volume_info
 {
 	__u8 drive_number;	/* BIOS drive number */
@@ -197,6 +205,7 @@ file_read_func		file_fat_read;
 int file_cd(const char *path);
 int file_fat_detectfs(void);
 int file_fat_ls(const char *dir);
+int fat_readdir(const char *dirname, fs_dirent_cb cb, void *priv);
 int fat_exists(const char *filename);
 int fat_size(const char *filename, loff_t *size);
 int file_fat_read_at(const char *filename, loff_t pos, void *buffer,
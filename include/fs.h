@@ -13,6 +13,9 @@
 #define FS_TYPE_EXT	2
 #define FS_TYPE_SANDBOX	3
 #define FS_TYPE_UBIFS	4
+#define FS_TYPE_EXFAT	5
+#define FS_TYPE_SQUASHFS	6
+#define FS_TYPE_BTRFS	7
 
 /*
  * Tell the fs layer which block device an partition to use for future
@@ -34,6 +37,29 @@ int fs_set_blk_dev(const char *ifname, const char *dev_part_str, int fstype);
  */
 int fs_ls(const char *dirname);
 
+/*
+ * fs_dirent_cb - Called by fs_readdir() for each entry of a directory
+ *
+ * @priv: Private data passed to fs_readdir()
+ * @name: Name of the entry
+ * @size: Size of the entry in bytes, 0 for directories
+ * @isdir: true if the entry is a directory
+ */
+typedef void (*fs_dirent_cb)(void *priv, const char *name, loff_t size,
+			     bool isdir);
+
+/*
+ * fs_readdir - Go through the entries of directory "dirname" on the partition
+ * previously set by fs_set_blk_dev(). The "." and ".." entries are skipped.
+ * Not all filesystem types support this.
+ *
+ * @dirname: Name of the directory
+ * @cb: Function to call for each entry
+ * @priv: Private data passed to @cb
+ * @return 0 if ok, non-zero if "dirname" is not a directory or on error
+ */
+int fs_readdir(const char *dirname, fs_dirent_cb cb, void *priv);
+
 /*
  * Determine whether a file exists
  *
@@ -78,6 +104,19 @@ int fs_read(const char *filename, ulong addr, loff_t offset, loff_t len,
 int fs_write(const char *filename, ulong addr, loff_t offset, loff_t len,
 	     loff_t *actwrite);
 
+/*
+ * fs_cache_invalidate - Forget the filesystem kept mounted by the fs layer
+ *
+ * This must be called whenever the underlying device is modified or a
+ * filesystem driver is pointed at another device behind the fs layer's
+ * back. The next fs_set_blk_dev() will then probe the filesystem again.
+ */
+#if CONFIG_IS_ENABLED(FS_CACHE)
+void fs_cache_invalidate(void);
+#else
+static inline void fs_cache_invalidate(void) {}
+#endif
+
 /*
  * Common implementation for various filesystem commands, optionally limited
  * to a specific filesystem type via the fstype parameter.
@@ -3,6 +3,7 @@
 #ifdef __KERNEL__
 
 #include <asm/types.h>
+#include <region_tree.h>
 /*
  * Logical memory blocks.
  *
@@ -11,17 +12,12 @@
  * SPDX-License-Identifier:	GPL-2.0+
  */
 
-#define MAX_LMB_REGIONS 8
-
-struct lmb_property {
-	phys_addr_t base;
-	phys_size_t size;
-};
-
+/*
+ * Regions are kept in a tree sorted by address, with nodes allocated as
+ * needed, so there is no limit on how many there can be.
+ */
 struct lmb_region {
-	unsigned long cnt;
-	phys_size_t size;
-	struct lmb_property region[MAX_LMB_REGIONS+1];
+	struct region_tree tree;
 };
 
 struct lmb {
@@ -31,6 +27,10 @@ struct lmb {
 
 extern struct lmb lmb;
 
+/*
+ * Start again with no memory or reservations. @lmb must be zeroed or have
+ * been set up by lmb_init() before, as the regions it holds are freed.
+ */
 extern void lmb_init(struct lmb *lmb);
 extern long lmb_add(struct lmb *lmb, phys_addr_t base, phys_size_t size);
 extern long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size);
@@ -44,12 +44,6 @@ extern long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size);
 
 extern void lmb_dump_all(struct lmb *lmb);
 
-static inline phys_size_t
-lmb_size_bytes(struct lmb_region *type, unsigned long region_nr)
-{
-	return type->region[region_nr].size;
-}
-
 void board_lmb_reserve(struct lmb *lmb);
 void arch_lmb_reserve(struct lmb *lmb);
 
@@ -170,6 +170,23 @@ void os_usleep(unsigned long usec);
  */
 uint64_t os_get_nsec(void);
 
+/**
+ * Call a function for each item of an array on host threads
+ *
+ * The items are shared out between up to one thread per host CPU (but at
+ * least two), including the calling thread, and this returns once every
+ * item has been handled.
+ * The function must not call back into U-Boot code which is not thread-safe.
+ *
+ * \param func		Function to call, with a pointer to the item
+ * \param items		Array of items
+ * \param size		Size of each item in bytes
+ * \param count		Number of items
+ * \return number of threads used
+ */
+int os_run_threads(void (*func)(void *item), void *items, size_t size,
+		   int count);
+
 /**
  * Parse arguments and update sandbox state.
  *
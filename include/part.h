@@ -396,6 +396,18 @@ int gpt_verify_partitions(struct blk_desc *dev_desc,
  */
 int get_disk_guid(struct blk_desc *dev_desc, char *guid);
 
+/**
+ * part_efi_cache_invalidate() - Drop the cached GPT of a device
+ *
+ * With CONFIG_PARTITION_CACHE the last validated GPT header and entry
+ * array are kept in memory. This is called by part_cache_invalidate()
+ * when the device is written or re-initialised.
+ *
+ * @param iftype - IF_TYPE_x for type of device
+ * @param dev - device index of particular type
+ */
+void part_efi_cache_invalidate(int iftype, int dev);
+
 #endif
 
 #if CONFIG_IS_ENABLED(DOS_PARTITION)
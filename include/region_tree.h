@@ -0,0 +1,141 @@
+/*
+ * Sorted trees of non-overlapping address ranges
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __REGION_TREE_H
+#define __REGION_TREE_H
+
+#include <linux/rbtree.h>
+#include <linux/types.h>
+
+/**
+ * struct region_node - one address range in a region tree
+ *
+ * Nodes are embedded in the caller's own structures, which are found with
+ * container_of(). Ranges in a tree never overlap; keeping it that way is up
+ * to the caller, usually by looking for overlaps with region_find() first.
+ *
+ * @rb:		Node in the tree, sorted by @start
+ * @start:	First address of the range
+ * @size:	Size of the range in bytes
+ * @free:	The range is available to region_find_free()
+ * @max_free:	Size of the largest free range in this subtree, internal
+ */
+struct region_node {
+	struct rb_node rb;
+	u64 start;
+	u64 size;
+	bool free;
+	u64 max_free;
+};
+
+/**
+ * struct region_tree - a set of non-overlapping address ranges
+ *
+ * A zeroed tree is empty, so static trees need no setting up.
+ *
+ * @root:	Root of the tree
+ * @count:	Number of ranges in the tree
+ */
+struct region_tree {
+	struct rb_root root;
+	unsigned long count;
+};
+
+static inline void region_tree_init(struct region_tree *tree)
+{
+	tree->root = RB_ROOT;
+	tree->count = 0;
+}
+
+static inline u64 region_end(const struct region_node *node)
+{
+	return node->start + node->size;
+}
+
+/**
+ * region_insert() - add a range to a tree
+ *
+ * @tree:	Tree to add to
+ * @node:	Range to add, with @start, @size and @free set up. It must not
+ *		overlap any range already in @tree.
+ */
+void region_insert(struct region_tree *tree, struct region_node *node);
+
+/**
+ * region_remove() - take a range out of a tree
+ *
+ * @tree:	Tree holding @node
+ * @node:	Range to remove, which the caller may then free
+ */
+void region_remove(struct region_tree *tree, struct region_node *node);
+
+/**
+ * region_update() - update a tree after a range in it has changed
+ *
+ * This must be called after changing @size or @free of a range in a tree.
+ * @start may be changed too, as long as the range keeps its place in the
+ * order and does not overlap its neighbours.
+ *
+ * @node:	Range which has changed
+ */
+void region_update(struct region_node *node);
+
+/**
+ * region_find() - find the first range overlapping an area
+ *
+ * The other ranges overlapping the area follow with region_next(), up to
+ * the first one which starts at or after @start + @size.
+ *
+ * @tree:	Tree to search
+ * @start:	Start of the area
+ * @size:	Size of the area in bytes
+ * @return lowest range overlapping the area, or NULL if none
+ */
+struct region_node *region_find(struct region_tree *tree, u64 start,
+				u64 size);
+
+/**
+ * region_find_free() - find the highest free range an area fits in
+ *
+ * The highest place for the area in the range returned starts at
+ * min(region_end(node), @max_addr) - @size.
+ *
+ * @tree:	Tree to search
+ * @size:	Size of the area in bytes
+ * @max_addr:	Address which the end of the area may not go beyond
+ * @return highest free range with room for the area below @max_addr, or NULL
+ * if none
+ */
+struct region_node *region_find_free(struct region_tree *tree, u64 size,
+				     u64 max_addr);
+
+static inline struct region_node *region_entry(struct rb_node *rb)
+{
+	return rb ? rb_entry(rb, struct region_node, rb) : NULL;
+}
+
+/* Walk the ranges of a tree in order of address */
+static inline struct region_node *region_first(struct region_tree *tree)
+{
+	return region_entry(rb_first(&tree->root));
+}
+
+static inline struct region_node *region_last(struct region_tree *tree)
+{
+	return region_entry(rb_last(&tree->root));
+}
+
+static inline struct region_node *region_next(struct region_node *node)
+{
+	return region_entry(rb_next(&node->rb));
+}
+
+static inline struct region_node *region_prev(struct region_node *node)
+{
+	return region_entry(rb_prev(&node->rb));
+}
+
+#endif /* __REGION_TREE_H */
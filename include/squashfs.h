@@ -0,0 +1,158 @@
+/*
+ * R/O SquashFS filesystem implementation
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _SQUASHFS_H_
+#define _SQUASHFS_H_
+
+#include <asm/byteorder.h>
+
+#define SQUASHFS_MAGIC		0x73717368	/* "hsqs" */
+#define SQUASHFS_MAJOR		4
+
+/* Compressors */
+#define SQUASHFS_COMP_GZIP	1
+#define SQUASHFS_COMP_LZMA	2
+#define SQUASHFS_COMP_LZO	3
+#define SQUASHFS_COMP_XZ	4
+#define SQUASHFS_COMP_LZ4	5
+
+/* Superblock flags */
+#define SQUASHFS_FLAG_COMP_OPT	0x0400	/* Compressor options follow */
+
+/* Metadata blocks: 16-bit length header, then up to 8 KiB of data */
+#define SQUASHFS_METADATA_SIZE	8192
+#define SQUASHFS_META_UNCOMP	0x8000
+#define SQUASHFS_META_LEN(h)	((h) & ~SQUASHFS_META_UNCOMP)
+
+/* Data block and fragment sizes */
+#define SQUASHFS_DATA_UNCOMP	(1 << 24)
+#define SQUASHFS_DATA_LEN(s)	((s) & ~SQUASHFS_DATA_UNCOMP)
+#define SQUASHFS_MAX_BLOCK_LOG	20
+#define SQUASHFS_NO_FRAGMENT	0xffffffff
+
+/* Inode references: metadata block offset << 16 | offset in the block */
+#define SQUASHFS_REF_BLOCK(r)	((u32)((r) >> 16))
+#define SQUASHFS_REF_OFFSET(r)	((u16)(r))
+
+/* Inode types */
+#define SQUASHFS_DIR_TYPE	1
+#define SQUASHFS_REG_TYPE	2
+#define SQUASHFS_SYMLINK_TYPE	3
+#define SQUASHFS_LDIR_TYPE	8
+#define SQUASHFS_LREG_TYPE	9
+#define SQUASHFS_LSYMLINK_TYPE	10
+
+#define SQUASHFS_NAME_LEN	256
+#define SQUASHFS_DIR_COUNT	256	/* Maximum entries per directory header */
+
+struct squashfs_super_block {
+	__le32	s_magic;
+	__le32	inodes;
+	__le32	mkfs_time;
+	__le32	block_size;
+	__le32	fragments;
+	__le16	compression;
+	__le16	block_log;
+	__le16	flags;
+	__le16	no_ids;
+	__le16	s_major;
+	__le16	s_minor;
+	__le64	root_inode;
+	__le64	bytes_used;
+	__le64	id_table_start;
+	__le64	xattr_id_table_start;
+	__le64	inode_table_start;
+	__le64	directory_table_start;
+	__le64	fragment_table_start;
+	__le64	lookup_table_start;
+} __packed;
+
+struct squashfs_base_inode {
+	__le16	inode_type;
+	__le16	mode;
+	__le16	uid;
+	__le16	guid;
+	__le32	mtime;
+	__le32	inode_number;
+} __packed;
+
+struct squashfs_dir_inode {
+	struct squashfs_base_inode base;
+	__le32	start_block;
+	__le32	nlink;
+	__le16	file_size;
+	__le16	offset;
+	__le32	parent_inode;
+} __packed;
+
+struct squashfs_ldir_inode {
+	struct squashfs_base_inode base;
+	__le32	nlink;
+	__le32	file_size;
+	__le32	start_block;
+	__le32	parent_inode;
+	__le16	i_count;
+	__le16	offset;
+	__le32	xattr;
+} __packed;
+
+struct squashfs_reg_inode {
+	struct squashfs_base_inode base;
+	__le32	start_block;
+	__le32	fragment;
+	__le32	offset;
+	__le32	file_size;
+	/* + __le32 block_list[] */
+} __packed;
+
+struct squashfs_lreg_inode {
+	struct squashfs_base_inode base;
+	__le64	start_block;
+	__le64	file_size;
+	__le64	sparse;
+	__le32	nlink;
+	__le32	fragment;
+	__le32	offset;
+	__le32	xattr;
+	/* + __le32 block_list[] */
+} __packed;
+
+struct squashfs_symlink_inode {
+	struct squashfs_base_inode base;
+	__le32	nlink;
+	__le32	symlink_size;
+	/* + char symlink[] */
+} __packed;
+
+struct squashfs_dir_header {
+	__le32	count;		/* Number of entries following, minus one */
+	__le32	start_block;	/* Metadata block holding their inodes */
+	__le32	inode_number;
+} __packed;
+
+struct squashfs_dir_entry {
+	__le16	offset;
+	__le16	inode_number;	/* Signed, relative to the header's */
+	__le16	type;
+	__le16	size;		/* Name length minus one */
+	/* + char name[] */
+} __packed;
+
+struct squashfs_fragment_entry {
+	__le64	start_block;
+	__le32	size;
+	__le32	unused;
+} __packed;
+
+int squashfs_set_blk_dev(struct blk_desc *rbdd, disk_partition_t *info);
+int squashfs_ls(const char *dirname);
+int squashfs_exists(const char *filename);
+int squashfs_size(const char *filename, loff_t *size);
+int squashfs_read_file(const char *filename, void *buf, loff_t offset,
+		       loff_t len, loff_t *actread);
+void squashfs_close(void);
+
+#endif /* _SQUASHFS_H_ */
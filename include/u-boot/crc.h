@@ -28,4 +28,17 @@ uint32_t crc32_no_comp (uint32_t, const unsigned char *, uint);
 void crc32_wd_buf(const unsigned char *input, uint ilen,
 		    unsigned char *output, uint chunk_sz);
 
+/**
+ * crc32c - Calculate the CRC32C (Castagnoli) checksum of a buffer
+ *
+ * Like the Linux function of the same name the CRC is neither pre- nor
+ * post-inverted; callers normally seed it with ~0.
+ *
+ * @crc:	Initial CRC value
+ * @buf:	Input buffer
+ * @len:	Input buffer length
+ * @return updated CRC
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
 #endif /* _UBOOT_CRC_H */
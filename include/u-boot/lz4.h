@@ -0,0 +1,60 @@
+/*
+ * LZ4 frame decompression: block-parallel interface
+ *
+ * ulz4fn() and ulz4_block(), which decompress a whole frame or a single raw
+ * block in one call, are declared in common.h.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __LZ4_H
+#define __LZ4_H
+
+#include <linux/types.h>
+
+/**
+ * struct ulz4_job - one block of a frame to decompress
+ *
+ * @src:		Block data
+ * @srcn:		Size of the block data
+ * @dst:		Where to decompress the block to
+ * @dstn:		Space at @dst on entry, size decompressed on return
+ * @not_compressed:	The block is stored rather than compressed
+ * @ret:		0 if OK, else -ve error code, set by ulz4_run_jobs()
+ */
+struct ulz4_job {
+	const void *src;
+	size_t srcn;
+	void *dst;
+	size_t dstn;
+	bool not_compressed;
+	int ret;
+};
+
+/**
+ * ulz4_decode_job() - decompress a single block of a frame
+ *
+ * This touches nothing but the job and the memory it points to, so it may
+ * run on any CPU.
+ *
+ * @job:	Block to decompress
+ * @return 0 if OK, -ENOBUFS if a stored block does not fit, -EPROTO if the
+ * block is corrupt or does not fit
+ */
+int ulz4_decode_job(struct ulz4_job *job);
+
+/**
+ * ulz4_run_jobs() - decompress the blocks of a frame
+ *
+ * With CONFIG_LZ4_PARALLEL, ulz4fn() hands the blocks of a frame with
+ * independent blocks to this function in one go, and each job writes to its
+ * own part of the output buffer. The default decompresses them one after
+ * another; platforms which can run code on other CPUs may override it to
+ * call ulz4_decode_job() for several jobs at once. Sandbox uses host threads.
+ *
+ * @jobs:	Blocks to decompress, each of which has @ret set on return
+ * @count:	Number of blocks
+ */
+void ulz4_run_jobs(struct ulz4_job *jobs, int count);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Zstandard decompression
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ZSTD_H
+#define __ZSTD_H
+
+#include <linux/types.h>
+
+/**
+ * zstd_decompress() - decompress a buffer holding one or more zstd frames
+ *
+ * The whole output buffer serves as the decompression window, so no
+ * workspace beyond the decoder context (about 160KB) is allocated.
+ *
+ * @src:	Compressed data
+ * @srcn:	Size of the compressed data in bytes
+ * @dst:	Buffer for the decompressed data
+ * @dstn:	Size of @dst on entry, number of bytes decompressed on return.
+ *		If @dst is too small, this is set to its size.
+ * @return 0 if OK, -ENOSPC if @dst is too small, -ENOMEM if the decoder
+ * context cannot be allocated, -EPROTONOSUPPORT if @src is not zstd data,
+ * -EPROTO if it is corrupt
+ */
+int zstd_decompress(const void *src, size_t srcn, void *dst, size_t *dstn);
+
+/**
+ * struct zstd_stream - state of a streaming decompression
+ *
+ * Streaming decompression keeps a window of the most recent output in its
+ * own workspace, so the input and output can be processed piecewise with a
+ * fixed amount of memory, supplied by the caller.
+ *
+ * @dstream:	zstd decoder, placed at the start of the workspace
+ */
+struct zstd_stream {
+	void *dstream;
+};
+
+/**
+ * zstd_stream_workspace_size() - get the workspace needed to stream frames
+ *
+ * @window_log:	log2 of the largest window size to accept, between 10 and 31.
+ *		zstd uses windows of up to 8MB (23) at its default levels.
+ * @return size of the workspace in bytes
+ */
+size_t zstd_stream_workspace_size(uint window_log);
+
+/**
+ * zstd_stream_init() - set up a streaming decompression
+ *
+ * @zs:		Stream to set up
+ * @workspace:	Workspace, which must stay valid until the stream is finished
+ *		with, aligned to 8 bytes
+ * @size:	Size of the workspace, see zstd_stream_workspace_size()
+ * @window_log:	log2 of the largest window size to accept. Frames needing a
+ *		larger window are rejected rather than overrunning @workspace.
+ * @return 0 if OK, -ENOMEM if @workspace is too small, -EINVAL if
+ * @window_log is out of range
+ */
+int zstd_stream_init(struct zstd_stream *zs, void *workspace, size_t size,
+		     uint window_log);
+
+/**
+ * zstd_stream_decompress() - decompress part of a stream
+ *
+ * This consumes as much of @src and fills as much of @dst as it can. Call
+ * it again with the rest of the input or more output space until it
+ * reports the end of a frame. The next call then starts on a new frame.
+ *
+ * @zs:		Stream to use
+ * @src:	Compressed data
+ * @srcn:	Size of @src on entry, number of bytes consumed on return
+ * @dst:	Buffer for the decompressed data
+ * @dstn:	Size of @dst on entry, number of bytes decompressed on return
+ * @return 1 at the end of a frame, 0 if more input or output space is
+ * needed, -E2BIG if the frame needs a larger window than the stream was set
+ * up for, -EPROTONOSUPPORT if @src is not zstd data, -EPROTO if it is
+ * corrupt
+ */
+int zstd_stream_decompress(struct zstd_stream *zs, const void *src,
+			   size_t *srcn, void *dst, size_t *dstn);
+
+#endif
@@ -254,6 +254,16 @@ typedef struct blkptr {
 #define	BP_IS_GANG(bp)		DVA_GET_GANG(BP_IDENTITY(bp))
 #define	BP_IS_HOLE(bp)		((bp)->blk_birth == 0)
 
+/*
+ * Embedded block pointers (com.delphix:embedded_data) hold up to 112 bytes
+ * of compressed data in place of the DVAs and checksum. The payload fills
+ * every word of the block pointer but blk_prop and blk_birth.
+ */
+#define	BPE_IS_PAYLOADWORD(bp, wp)					\
+	((wp) != &(bp)->blk_prop && (wp) != &(bp)->blk_birth)
+#define	BPE_PAYLOAD_SIZE		112
+#define	BP_EMBEDDED_TYPE_DATA		0
+
 /* BP_IS_RAIDZ(bp) assumes no block compression */
 #define	BP_IS_RAIDZ(bp)		(DVA_GET_ASIZE(&(bp)->blk_dva[0]) > \
 							 BP_GET_PSIZE(bp))
@@ -0,0 +1,105 @@
+/*
+ * CRC32C (Castagnoli) as used by ext4, btrfs and others
+ *
+ * The generic implementation processes eight bytes per step using
+ * "slicing-by-8" tables, which are built on first use. When the compiler
+ * targets a CPU with CRC32C instructions (ARMv8 CRC extension, x86 SSE4.2)
+ * those are used instead.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <u-boot/crc.h>
+
+#define CRC32C_POLY_LE	0x82f63b78
+
+#if defined(CONFIG_ARM64) && defined(__ARM_FEATURE_CRC32)
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const u8 *p = buf;
+
+	for (; len && ((ulong)p & 7); len--)
+		asm("crc32cb %w0, %w0, %w1" : "+r" (crc) : "r" (*p++));
+	for (; len >= 8; len -= 8, p += 8)
+		asm("crc32cx %w0, %w0, %x1" : "+r" (crc) : "r" (*(u64 *)p));
+	for (; len; len--)
+		asm("crc32cb %w0, %w0, %w1" : "+r" (crc) : "r" (*p++));
+
+	return crc;
+}
+
+#elif defined(__x86_64__) && defined(__SSE4_2__)
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const u8 *p = buf;
+	u64 crc64;
+
+	for (; len && ((ulong)p & 7); len--)
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*p++));
+	crc64 = crc;
+	for (; len >= 8; len -= 8, p += 8)
+		asm("crc32q %1, %0" : "+r" (crc64) : "rm" (*(u64 *)p));
+	crc = crc64;
+	for (; len; len--)
+		asm("crc32b %1, %0" : "+r" (crc) : "rm" (*p++));
+
+	return crc;
+}
+
+#else
+
+static uint32_t crc32c_table[8][256];
+static bool crc32c_table_ready;
+
+static void crc32c_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY_LE : 0);
+		crc32c_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++) {
+		crc = crc32c_table[0][i];
+		for (j = 1; j < 8; j++) {
+			crc = (crc >> 8) ^ crc32c_table[0][crc & 0xff];
+			crc32c_table[j][i] = crc;
+		}
+	}
+	crc32c_table_ready = true;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	const uint32_t (*t)[256] = crc32c_table;
+	const u8 *p = buf;
+	uint32_t lo, hi;
+
+	if (!crc32c_table_ready)
+		crc32c_init();
+
+	for (; len && ((ulong)p & 3); len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+	for (; len >= 8; len -= 8, p += 8) {
+		lo = crc ^ le32_to_cpu(*(const u32 *)p);
+		hi = le32_to_cpu(*(const u32 *)(p + 4));
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+		      t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+		      t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+		      t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+
+	for (; len; len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+	return crc;
+}
+
+#endif
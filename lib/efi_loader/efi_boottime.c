@@ -237,11 +237,102 @@ static efi_status_t EFIAPI efi_free_pool_ext(void *buffer)
 	return EFI_EXIT(r);
 }
 
+/* This list contains all events created and not closed yet */
+static LIST_HEAD(efi_events);
+
 /*
- * Our event capabilities are very limited. Only a small limited
- * number of events is allowed to coexist.
+ * Running timers are kept in a binary min-heap ordered by trigger_next, so
+ * that checking them only looks at the ones which are due. There is room in
+ * it for every timer event, which is made when the event is created.
  */
-static struct efi_event efi_events[16];
+static struct efi_event **efi_timers;
+static int efi_timer_count;
+static int efi_timer_events;
+static int efi_timer_max;
+
+static bool efi_event_valid(struct efi_event *event)
+{
+	struct efi_event *evt;
+
+	list_for_each_entry(evt, &efi_events, link) {
+		if (evt == event)
+			return true;
+	}
+
+	return false;
+}
+
+static void efi_timer_place(struct efi_event *event, int i)
+{
+	efi_timers[i] = event;
+	event->timer_index = i;
+}
+
+static void efi_timer_up(int i)
+{
+	struct efi_event *event = efi_timers[i];
+	int parent;
+
+	while (i) {
+		parent = (i - 1) / 2;
+		if (efi_timers[parent]->trigger_next <= event->trigger_next)
+			break;
+		efi_timer_place(efi_timers[parent], i);
+		i = parent;
+	}
+	efi_timer_place(event, i);
+}
+
+static void efi_timer_down(int i)
+{
+	struct efi_event *event = efi_timers[i];
+	int child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= efi_timer_count)
+			break;
+		if (child + 1 < efi_timer_count &&
+		    efi_timers[child + 1]->trigger_next <
+		    efi_timers[child]->trigger_next)
+			child++;
+		if (event->trigger_next <= efi_timers[child]->trigger_next)
+			break;
+		efi_timer_place(efi_timers[child], i);
+		i = child;
+	}
+	efi_timer_place(event, i);
+}
+
+static void efi_timer_queue(struct efi_event *event)
+{
+	efi_timer_place(event, efi_timer_count++);
+	efi_timer_up(event->timer_index);
+}
+
+static void efi_timer_dequeue(struct efi_event *event)
+{
+	struct efi_event *last;
+	int i = event->timer_index;
+
+	if (i < 0)
+		return;
+
+	event->timer_index = -1;
+	last = efi_timers[--efi_timer_count];
+	if (last == event)
+		return;
+
+	efi_timer_place(last, i);
+	efi_timer_up(i);
+	efi_timer_down(last->timer_index);
+}
+
+/* Time at which the next timer is due, or -1ULL if none is running */
+static u64 efi_timer_next(void)
+{
+	return efi_timer_count ? efi_timers[0]->trigger_next : -1ULL;
+}
 
 efi_status_t efi_create_event(uint32_t type, UINTN notify_tpl,
 			      void (EFIAPI *notify_function) (
@@ -249,7 +340,7 @@ efi_status_t efi_create_event(uint32_t type, UINTN notify_tpl,
 					void *context),
 			      void *notify_context, struct efi_event **event)
 {
-	int i;
+	struct efi_event *evt;
 
 	if (event == NULL)
 		return EFI_INVALID_PARAMETER;
@@ -261,20 +352,34 @@ efi_status_t efi_create_event(uint32_t type, UINTN notify_tpl,
 	    notify_function == NULL)
 		return EFI_INVALID_PARAMETER;
 
-	for (i = 0; i < ARRAY_SIZE(efi_events); ++i) {
-		if (efi_events[i].type)
-			continue;
-		efi_events[i].type = type;
-		efi_events[i].notify_tpl = notify_tpl;
-		efi_events[i].notify_function = notify_function;
-		efi_events[i].notify_context = notify_context;
-		/* Disable timers on bootup */
-		efi_events[i].trigger_next = -1ULL;
-		efi_events[i].signaled = 0;
-		*event = &efi_events[i];
-		return EFI_SUCCESS;
+	if ((type & EVT_TIMER) && efi_timer_events == efi_timer_max) {
+		int max = efi_timer_max ? efi_timer_max * 2 : 16;
+		struct efi_event **timers;
+
+		timers = realloc(efi_timers, max * sizeof(*timers));
+		if (!timers)
+			return EFI_OUT_OF_RESOURCES;
+		efi_timers = timers;
+		efi_timer_max = max;
 	}
-	return EFI_OUT_OF_RESOURCES;
+
+	evt = calloc(1, sizeof(*evt));
+	if (!evt)
+		return EFI_OUT_OF_RESOURCES;
+
+	evt->type = type;
+	evt->notify_tpl = notify_tpl;
+	evt->notify_function = notify_function;
+	evt->notify_context = notify_context;
+	/* Disable timers on bootup */
+	evt->trigger_next = -1ULL;
+	evt->timer_index = -1;
+	if (type & EVT_TIMER)
+		efi_timer_events++;
+	list_add_tail(&evt->link, &efi_events);
+	*event = evt;
+
+	return EFI_SUCCESS;
 }
 
 static efi_status_t EFIAPI efi_create_event_ext(
@@ -297,59 +402,72 @@ static efi_status_t EFIAPI efi_create_event_ext(
  */
 void efi_timer_check(void)
 {
-	int i;
+	struct efi_event *event;
 	u64 now = timer_get_us();
 
-	for (i = 0; i < ARRAY_SIZE(efi_events); ++i) {
-		if (!efi_events[i].type ||
-		    !(efi_events[i].type & EVT_TIMER) ||
-		    efi_events[i].trigger_type == EFI_TIMER_STOP ||
-		    now < efi_events[i].trigger_next)
-			continue;
-		if (efi_events[i].trigger_type == EFI_TIMER_PERIODIC) {
-			efi_events[i].trigger_next +=
-				efi_events[i].trigger_time;
-			efi_events[i].signaled = 0;
+	/* The notify functions may set or close any timer, this one too */
+	while (efi_timer_count && efi_timers[0]->trigger_next <= now) {
+		event = efi_timers[0];
+		if (event->trigger_type == EFI_TIMER_PERIODIC) {
+			event->trigger_next += event->trigger_time;
+			/* Skip the periods we were too busy to notice */
+			if (event->trigger_next <= now)
+				event->trigger_next = now +
+					max_t(u64, event->trigger_time, 1);
+			efi_timer_down(0);
+			event->signaled = 0;
+		} else {
+			/* Relative timers only fire once */
+			efi_timer_dequeue(event);
+			event->trigger_next = -1ULL;
 		}
-		efi_signal_event(&efi_events[i]);
+		efi_signal_event(event);
 	}
 	WATCHDOG_RESET();
 }
 
+/*
+ * Nothing but a timer can signal an event while the payload waits, so
+ * there is no point checking before the next one is due. Architectures
+ * which can put the CPU into a low power state until then override this.
+ */
+void __weak efi_idle(u64 until)
+{
+	while (timer_get_us() < until)
+		WATCHDOG_RESET();
+}
+
 efi_status_t efi_set_timer(struct efi_event *event, enum efi_timer_delay type,
 			   uint64_t trigger_time)
 {
-	int i;
-
 	/*
 	 * The parameter defines a multiple of 100ns.
 	 * We use multiples of 1000ns. So divide by 10.
 	 */
 	trigger_time = efi_div10(trigger_time);
 
-	for (i = 0; i < ARRAY_SIZE(efi_events); ++i) {
-		if (event != &efi_events[i])
-			continue;
+	if (!efi_event_valid(event) || !(event->type & EVT_TIMER))
+		return EFI_INVALID_PARAMETER;
 
-		if (!(event->type & EVT_TIMER))
-			break;
-		switch (type) {
-		case EFI_TIMER_STOP:
-			event->trigger_next = -1ULL;
-			break;
-		case EFI_TIMER_PERIODIC:
-		case EFI_TIMER_RELATIVE:
-			event->trigger_next =
-				timer_get_us() + trigger_time;
-			break;
-		default:
-			return EFI_INVALID_PARAMETER;
-		}
-		event->trigger_type = type;
-		event->trigger_time = trigger_time;
-		return EFI_SUCCESS;
+	switch (type) {
+	case EFI_TIMER_STOP:
+		event->trigger_next = -1ULL;
+		break;
+	case EFI_TIMER_PERIODIC:
+	case EFI_TIMER_RELATIVE:
+		event->trigger_next = timer_get_us() + trigger_time;
+		break;
+	default:
+		return EFI_INVALID_PARAMETER;
 	}
-	return EFI_INVALID_PARAMETER;
+	event->trigger_type = type;
+	event->trigger_time = trigger_time;
+
+	efi_timer_dequeue(event);
+	if (type != EFI_TIMER_STOP)
+		efi_timer_queue(event);
+
+	return EFI_SUCCESS;
 }
 
 static efi_status_t EFIAPI efi_set_timer_ext(struct efi_event *event,
@@ -364,7 +482,7 @@ static efi_status_t EFIAPI efi_wait_for_event(unsigned long num_events,
 					      struct efi_event **event,
 					      unsigned long *index)
 {
-	int i, j;
+	int i;
 
 	EFI_ENTRY("%ld, %p, %p", num_events, event, index);
 
@@ -372,23 +490,20 @@ static efi_status_t EFIAPI efi_wait_for_event(unsigned long num_events,
 	if (!num_events || !event)
 		return EFI_EXIT(EFI_INVALID_PARAMETER);
 	for (i = 0; i < num_events; ++i) {
-		for (j = 0; j < ARRAY_SIZE(efi_events); ++j) {
-			if (event[i] == &efi_events[j])
-				goto known_event;
-		}
-		return EFI_EXIT(EFI_INVALID_PARAMETER);
-known_event:
-		if (!event[i]->type || event[i]->type & EVT_NOTIFY_SIGNAL)
+		if (!efi_event_valid(event[i]) ||
+		    event[i]->type & EVT_NOTIFY_SIGNAL)
 			return EFI_EXIT(EFI_INVALID_PARAMETER);
 	}
 
 	/* Wait for signal */
+	efi_timer_check();
 	for (;;) {
 		for (i = 0; i < num_events; ++i) {
 			if (event[i]->signaled)
 				goto out;
 		}
-		/* Allow events to occur. */
+		/* Sleep until the next timer is due, then let it fire. */
+		efi_idle(efi_timer_next());
 		efi_timer_check();
 	}
 
@@ -406,50 +521,36 @@ out:
 
 static efi_status_t EFIAPI efi_signal_event_ext(struct efi_event *event)
 {
-	int i;
-
 	EFI_ENTRY("%p", event);
-	for (i = 0; i < ARRAY_SIZE(efi_events); ++i) {
-		if (event != &efi_events[i])
-			continue;
+	if (efi_event_valid(event))
 		efi_signal_event(event);
-		break;
-	}
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
 static efi_status_t EFIAPI efi_close_event(struct efi_event *event)
 {
-	int i;
-
 	EFI_ENTRY("%p", event);
-	for (i = 0; i < ARRAY_SIZE(efi_events); ++i) {
-		if (event == &efi_events[i]) {
-			event->type = 0;
-			event->trigger_next = -1ULL;
-			event->signaled = 0;
-			return EFI_EXIT(EFI_SUCCESS);
-		}
-	}
-	return EFI_EXIT(EFI_INVALID_PARAMETER);
+	if (!efi_event_valid(event))
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+
+	efi_timer_dequeue(event);
+	if (event->type & EVT_TIMER)
+		efi_timer_events--;
+	list_del(&event->link);
+	free(event);
+
+	return EFI_EXIT(EFI_SUCCESS);
 }
 
 static efi_status_t EFIAPI efi_check_event(struct efi_event *event)
 {
-	int i;
-
 	EFI_ENTRY("%p", event);
 	efi_timer_check();
-	for (i = 0; i < ARRAY_SIZE(efi_events); ++i) {
-		if (event != &efi_events[i])
-			continue;
-		if (!event->type || event->type & EVT_NOTIFY_SIGNAL)
-			break;
-		if (event->signaled)
-			return EFI_EXIT(EFI_SUCCESS);
-		return EFI_EXIT(EFI_NOT_READY);
-	}
-	return EFI_EXIT(EFI_INVALID_PARAMETER);
+	if (!efi_event_valid(event) || event->type & EVT_NOTIFY_SIGNAL)
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+	if (event->signaled)
+		return EFI_EXIT(EFI_SUCCESS);
+	return EFI_EXIT(EFI_NOT_READY);
 }
 
 static efi_status_t EFIAPI efi_install_protocol_interface(void **handle,
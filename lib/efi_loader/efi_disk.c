@@ -10,6 +10,7 @@
 #include <blk.h>
 #include <dm.h>
 #include <efi_loader.h>
+#include <fs.h>
 #include <inttypes.h>
 #include <part.h>
 #include <malloc.h>
@@ -33,8 +34,36 @@ struct efi_disk_obj {
 	lbaint_t offset;
 	/* Internal block device */
 	const struct blk_desc *desc;
+	/* Name of the disk, for statistics */
+	char name[32];
+	/* Simple file system protocol on the disk, if there is memory for it */
+	struct efi_simple_file_system_protocol *volume;
+	/*
+	 * Readahead window: ra_count blocks from ra_lba are in ra_buf, which
+	 * is allocated on the first sequential read and freed by
+	 * efi_disk_finish()
+	 */
+	void *ra_buf;
+	lbaint_t ra_lba;
+	lbaint_t ra_count;
+	/* Size of the last readahead, which doubles while reads are sequential */
+	lbaint_t ra_size;
+	/* Block after the last one read, to detect sequential reads */
+	lbaint_t next_lba;
+	/* Block I/O statistics since the payload was started */
+	struct efi_disk_stats {
+		unsigned long reads;
+		unsigned long ra_hits;	/* reads served from readahead */
+		unsigned long writes;
+		u64 read_blocks;	/* blocks read by the payload */
+		u64 dev_blocks;		/* blocks read from the device */
+		u64 write_blocks;
+	} stats;
 };
 
+/* Largest readahead in bytes, or 0 if disabled */
+#define EFI_DISK_READAHEAD	(CONFIG_EFI_DISK_READAHEAD * 1024)
+
 static efi_status_t EFIAPI efi_disk_reset(struct efi_block_io *this,
 			char extended_verification)
 {
@@ -47,6 +76,106 @@ enum efi_disk_direction {
 	EFI_DISK_WRITE,
 };
 
+/* Call func for each EFI disk, or each EFI disk on desc if it is not NULL */
+static void efi_disk_for_each(const struct blk_desc *desc,
+			      void (*func)(struct efi_disk_obj *diskobj))
+{
+	struct efi_object *obj;
+
+	list_for_each_entry(obj, &efi_obj_list, link) {
+		struct efi_disk_obj *diskobj;
+
+		if (obj->protocols[0].guid != &efi_block_io_guid)
+			continue;
+		diskobj = container_of(obj, struct efi_disk_obj, parent);
+		if (!desc || diskobj->desc == desc)
+			func(diskobj);
+	}
+}
+
+/* Forget the data read ahead and the files looked up on a disk */
+static void efi_disk_drop_cached(struct efi_disk_obj *diskobj)
+{
+	diskobj->ra_count = 0;
+	diskobj->ra_size = 0;
+	if (diskobj->volume)
+		efi_file_drop_cache(diskobj->volume);
+}
+
+/*
+ * Read blocks, serving them from the readahead window where possible.
+ *
+ * Payloads like GRUB read files in small pieces, each of which would be a
+ * separate device access. When a read carries on where the last one or the
+ * readahead window ended, read ahead instead: twice as much as last time, up
+ * to EFI_DISK_READAHEAD bytes, so that the following reads come from memory.
+ * Other reads go straight to the device, through the block cache if there
+ * is one.
+ */
+static lbaint_t efi_disk_read(struct efi_disk_obj *diskobj, lbaint_t lba,
+			      lbaint_t blocks, void *buffer)
+{
+	struct blk_desc *desc = (struct blk_desc *)diskobj->desc;
+	lbaint_t ra_end = diskobj->ra_lba + diskobj->ra_count;
+	lbaint_t ra_max = EFI_DISK_READAHEAD / desc->blksz;
+	lbaint_t done = 0, size, n;
+	bool sequential;
+
+	sequential = lba == diskobj->next_lba || lba == ra_end;
+	diskobj->next_lba = lba + blocks;
+	diskobj->stats.reads++;
+	diskobj->stats.read_blocks += blocks;
+
+	if (lba >= diskobj->ra_lba && lba < ra_end) {
+		done = min(blocks, ra_end - lba);
+		memcpy(buffer, diskobj->ra_buf + (lba - diskobj->ra_lba) *
+		       desc->blksz, done * desc->blksz);
+		if (done == blocks) {
+			diskobj->stats.ra_hits++;
+			return blocks;
+		}
+		/* The rest follows on from the window */
+		sequential = true;
+		lba += done;
+		buffer += done * desc->blksz;
+		blocks -= done;
+	}
+
+	size = 0;
+	if (sequential) {
+		size = max(diskobj->ra_size * 2, blocks * 4);
+		size = min(size, ra_max);
+		size = min(size, desc->lba - lba);
+	}
+	if (size > blocks && !diskobj->ra_buf)
+		diskobj->ra_buf = malloc(EFI_DISK_READAHEAD);
+	if (size <= blocks || !diskobj->ra_buf) {
+		if (!sequential)
+			diskobj->ra_size = 0;
+		n = blk_dread(desc, lba, blocks, buffer);
+		diskobj->stats.dev_blocks += n;
+		return done + n;
+	}
+
+	diskobj->ra_count = 0;
+	n = blk_dread(desc, lba, size, diskobj->ra_buf);
+	diskobj->stats.dev_blocks += n;
+	if (n != size) {
+		/* The error may lie beyond the blocks asked for */
+		diskobj->ra_size = 0;
+		n = blk_dread(desc, lba, blocks, buffer);
+		diskobj->stats.dev_blocks += n;
+		return done + n;
+	}
+
+	diskobj->ra_lba = lba;
+	diskobj->ra_count = size;
+	diskobj->ra_size = size;
+	memcpy(buffer, diskobj->ra_buf, blocks * desc->blksz);
+
+	return done + blocks;
+}
+
 static efi_status_t EFIAPI efi_disk_rw_blocks(struct efi_block_io *this,
 			u32 media_id, u64 lba, unsigned long buffer_size,
 			void *buffer, enum efi_disk_direction direction)
@@ -70,10 +199,16 @@ static efi_status_t EFIAPI efi_disk_rw_blocks(struct efi_block_io *this,
 	if (buffer_size & (blksz - 1))
 		return EFI_DEVICE_ERROR;
 
-	if (direction == EFI_DISK_READ)
-		n = blk_dread(desc, lba, blocks, buffer);
-	else
+	if (direction == EFI_DISK_READ) {
+		n = efi_disk_read(diskobj, lba, blocks, buffer);
+	} else {
+		/* Other handles may have read from the same device */
+		efi_disk_for_each(desc, efi_disk_drop_cached);
+		fs_cache_invalidate();
+		diskobj->stats.writes++;
+		diskobj->stats.write_blocks += blocks;
 		n = blk_dwrite(desc, lba, blocks, buffer);
+	}
 
 	/* We don't do interrupts, so check for timers cooperatively */
 	efi_timer_check();
@@ -174,7 +309,8 @@ static void efi_disk_add_dev(const char *name,
 			     const char *if_typename,
 			     const struct blk_desc *desc,
 			     int dev_index,
-			     lbaint_t offset)
+			     lbaint_t offset,
+			     int part)
 {
 	struct efi_disk_obj *diskobj;
 	struct efi_device_path_file_path *dp;
@@ -192,12 +328,20 @@ static void efi_disk_add_dev(const char *name,
 	diskobj->parent.protocols[0].protocol_interface = &diskobj->ops;
 	diskobj->parent.protocols[1].guid = &efi_guid_device_path;
 	diskobj->parent.protocols[1].protocol_interface = dp;
+	diskobj->volume = efi_simple_file_system(desc, part);
+	if (diskobj->volume) {
+		diskobj->parent.protocols[2].guid =
+			&efi_simple_file_system_protocol_guid;
+		diskobj->parent.protocols[2].protocol_interface =
+			diskobj->volume;
+	}
 	diskobj->parent.handle = diskobj;
 	diskobj->ops = block_io_disk_template;
 	diskobj->ifname = if_typename;
 	diskobj->dev_index = dev_index;
 	diskobj->offset = offset;
 	diskobj->desc = desc;
+	strlcpy(diskobj->name, name, sizeof(diskobj->name));
 
 	/* Fill in EFI IO Media info (for read/write callbacks) */
 	diskobj->media.removable_media = desc->removable;
@@ -240,7 +384,7 @@ static int efi_disk_create_eltorito(struct blk_desc *desc,
 		snprintf(devname, sizeof(devname), "%s:%d", pdevname,
 			 part);
 		efi_disk_add_dev(devname, if_typename, desc, diskid,
-				 info.start);
+				 info.start, part);
 		part++;
 		disks++;
 	}
@@ -249,6 +393,45 @@ static int efi_disk_create_eltorito(struct blk_desc *desc,
 	return disks;
 }
 
+static void efi_disk_reset_stats(struct efi_disk_obj *diskobj)
+{
+	efi_disk_drop_cached(diskobj);
+	memset(&diskobj->stats, 0, sizeof(diskobj->stats));
+}
+
+/*
+ * Forget what earlier payloads read, as U-Boot may have written to the
+ * disks since. This gets called from do_bootefi_exec().
+ */
+void efi_disk_prepare(void)
+{
+	efi_disk_for_each(NULL, efi_disk_reset_stats);
+}
+
+static void efi_disk_release(struct efi_disk_obj *diskobj)
+{
+	struct efi_disk_stats *st = &diskobj->stats;
+
+	if (st->reads || st->writes)
+		debug("%s: %lu reads of %llu blocks, %lu from readahead, %llu blocks from device, %lu writes of %llu blocks\n",
+		      diskobj->name, st->reads, st->read_blocks, st->ra_hits,
+		      st->dev_blocks, st->writes, st->write_blocks);
+
+	free(diskobj->ra_buf);
+	diskobj->ra_buf = NULL;
+	diskobj->ra_count = 0;
+	diskobj->ra_size = 0;
+}
+
+/*
+ * Free the readahead buffers once the payload has returned to bootefi, as
+ * the disk objects stay around for the next one.
+ */
+void efi_disk_finish(void)
+{
+	efi_disk_for_each(NULL, efi_disk_release);
+}
+
 /*
  * U-Boot doesn't have a list of all online disk devices. So when running our
  * EFI payload, we scan through all of the potentially available ones and
@@ -273,7 +456,8 @@ int efi_disk_register(void)
 		const char *if_typename = dev->driver->name;
 
 		printf("Scanning disk %s...\n", dev->name);
-		efi_disk_add_dev(dev->name, if_typename, desc, desc->devnum, 0);
+		efi_disk_add_dev(dev->name, if_typename, desc, desc->devnum, 0,
+				 0);
 		disks++;
 
 		/*
@@ -309,7 +493,7 @@ int efi_disk_register(void)
 
 			snprintf(devname, sizeof(devname), "%s%d",
 				 if_typename, i);
-			efi_disk_add_dev(devname, if_typename, desc, i, 0);
+			efi_disk_add_dev(devname, if_typename, desc, i, 0, 0);
 			disks++;
 
 			/*
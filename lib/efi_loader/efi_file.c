@@ -0,0 +1,685 @@
+/*
+ *  EFI simple file system protocol, on top of U-Boot's fs layer
+ *
+ *  SPDX-License-Identifier:     GPL-2.0+
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <efi_loader.h>
+#include <fs.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <part.h>
+
+const efi_guid_t efi_simple_file_system_protocol_guid =
+	EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_GUID;
+static const efi_guid_t efi_file_info_guid = EFI_FILE_INFO_GUID;
+static const efi_guid_t efi_file_system_info_guid = EFI_FILE_SYSTEM_INFO_GUID;
+
+/* Most paths to remember on a volume once no handle refers to them */
+#define EFI_FILE_CACHE_MAX	32
+
+struct file_system {
+	struct efi_simple_file_system_protocol base;
+	/* Device and partition as given to fs_set_blk_dev() */
+	const char *ifname;
+	char dev_part[16];
+	/* Size of the partition, set when the volume is opened */
+	u64 volume_size;
+	u32 block_size;
+	/* Paths looked up on the volume, most recently used first */
+	struct list_head nodes;
+	int unused;
+};
+
+/*
+ * What is known about a path on a volume. Every handle to the same path
+ * shares a node, and nodes no handle refers to are kept for a while: GRUB
+ * and systemd-boot open the same files over and over again, and looking
+ * them up each time means walking the directories on the device.
+ */
+struct file_node {
+	struct list_head lh;
+	char *path;
+	bool dir;
+	loff_t size;
+	int refs;
+};
+
+struct file_dirent {
+	char *name;
+	loff_t size;
+	bool dir;
+};
+
+struct file_handle {
+	struct efi_file_handle base;
+	struct file_system *fs;
+	struct file_node *node;
+	/* Offset in a file, or index of the next entry of a directory */
+	u64 offset;
+	/* Entries of a directory, collected when it is first read */
+	struct file_dirent *dirents;
+	int nr_dirents;
+	bool listed;
+	bool nomem;
+};
+
+static const struct efi_file_handle efi_file_handle_template;
+
+/* Point the fs layer at the volume, which it forgets after each operation */
+static int efi_file_mount(struct file_system *fs)
+{
+	return fs_set_blk_dev(fs->ifname, fs->dev_part, FS_TYPE_ANY);
+}
+
+static void efi_file_node_free(struct file_system *fs, struct file_node *node)
+{
+	list_del(&node->lh);
+	free(node->path);
+	free(node);
+	fs->unused--;
+}
+
+static void efi_file_node_put(struct file_system *fs, struct file_node *node)
+{
+	struct file_node *n, *tmp;
+
+	if (--node->refs)
+		return;
+
+	fs->unused++;
+	list_for_each_entry_safe_reverse(n, tmp, &fs->nodes, lh) {
+		if (fs->unused <= EFI_FILE_CACHE_MAX)
+			break;
+		if (!n->refs)
+			efi_file_node_free(fs, n);
+	}
+}
+
+static void efi_file_skip_dirent(void *priv, const char *name, loff_t size,
+				 bool isdir)
+{
+}
+
+/* Look up a path on the volume, taking over the memory holding it */
+static struct file_node *efi_file_node_get(struct file_system *fs, char *path)
+{
+	struct file_node *node;
+	int ret;
+
+	list_for_each_entry(node, &fs->nodes, lh) {
+		if (!strcmp(node->path, path)) {
+			free(path);
+			list_move(&node->lh, &fs->nodes);
+			if (!node->refs++)
+				fs->unused--;
+			return node;
+		}
+	}
+
+	node = calloc(1, sizeof(*node));
+	if (!node) {
+		free(path);
+		return NULL;
+	}
+
+	if (!strcmp(path, "/")) {
+		node->dir = true;
+	} else if (efi_file_mount(fs)) {
+		goto err;
+	} else {
+		ret = fs_size(path, &node->size);
+		/*
+		 * Depending on the filesystem, fs_size() fails for directories
+		 * or gives them a size of 0, so see if they can be listed.
+		 * Filesystems that cannot list directories still find them.
+		 */
+		if ((ret || !node->size) && !efi_file_mount(fs) &&
+		    !fs_readdir(path, efi_file_skip_dirent, NULL)) {
+			node->dir = true;
+			node->size = 0;
+		} else if (ret) {
+			if (efi_file_mount(fs) || !fs_exists(path))
+				goto err;
+			node->dir = true;
+			node->size = 0;
+		}
+	}
+
+	node->path = path;
+	node->refs = 1;
+	list_add(&node->lh, &fs->nodes);
+
+	return node;
+
+err:
+	free(node);
+	free(path);
+	return NULL;
+}
+
+/*
+ * Forget what is known about files no handle refers to, as U-Boot or the
+ * payload may have written to the device since.
+ */
+void efi_file_drop_cache(struct efi_simple_file_system_protocol *volume)
+{
+	struct file_system *fs = container_of(volume, struct file_system,
+					      base);
+	struct file_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &fs->nodes, lh) {
+		if (!node->refs)
+			efi_file_node_free(fs, node);
+	}
+}
+
+/*
+ * Turn a UEFI file name, relative to directory dir unless it starts with a
+ * backslash, into the absolute path the fs layer expects. Returns NULL if
+ * the name has characters the fs layer cannot take, or if out of memory.
+ */
+static char *efi_file_path(const char *dir, const s16 *name)
+{
+	const s16 *p, *end;
+	size_t len = strlen(dir) + 2;
+	char *path, *q;
+
+	for (p = name; *p; p++) {
+		if (*p < 0x20 || *p > 0x7e)
+			return NULL;
+		len++;
+	}
+
+	path = malloc(len);
+	if (!path)
+		return NULL;
+
+	q = path;
+	if (*name != '\\' && strcmp(dir, "/")) {
+		strcpy(path, dir);
+		q += strlen(dir);
+	}
+	*q = 0;
+
+	for (p = name; *p; p = end) {
+		while (*p == '\\' || *p == '/')
+			p++;
+		for (end = p; *end && *end != '\\' && *end != '/'; end++)
+			;
+
+		if (end == p || (end - p == 1 && p[0] == '.'))
+			continue;
+		if (end - p == 2 && p[0] == '.' && p[1] == '.') {
+			while (q > path && *--q != '/')
+				;
+			*q = 0;
+			continue;
+		}
+
+		*q++ = '/';
+		while (p < end)
+			*q++ = *p++;
+		*q = 0;
+	}
+
+	if (q == path)
+		strcpy(path, "/");
+
+	return path;
+}
+
+static struct file_handle *efi_file_new(struct file_system *fs,
+					struct file_node *node)
+{
+	struct file_handle *fh;
+
+	fh = calloc(1, sizeof(*fh));
+	if (!fh)
+		return NULL;
+
+	fh->base = efi_file_handle_template;
+	fh->fs = fs;
+	fh->node = node;
+
+	return fh;
+}
+
+static efi_status_t EFIAPI efi_file_open(struct efi_file_handle *file,
+			struct efi_file_handle **new_handle,
+			s16 *file_name, u64 open_mode, u64 attributes)
+{
+	struct file_handle *fh = container_of(file, struct file_handle, base);
+	struct file_system *fs = fh->fs;
+	struct file_node *node;
+	const char *dir = fh->node->path;
+	char *parent = NULL, *path, *sep;
+
+	EFI_ENTRY("%p, %p, %p, %llx, %llx", file, new_handle, file_name,
+		  open_mode, attributes);
+
+	if (!new_handle || !file_name || !(open_mode & EFI_FILE_MODE_READ))
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+
+	/* Nothing can be written through the fs layer in place */
+	if (open_mode & (EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE))
+		return EFI_EXIT(EFI_WRITE_PROTECTED);
+
+	/* Names are relative to the directory a file is in */
+	if (!fh->node->dir) {
+		parent = strdup(dir);
+		if (!parent)
+			return EFI_EXIT(EFI_OUT_OF_RESOURCES);
+		sep = strrchr(parent, '/');
+		/* Keep the slash of files in the root directory */
+		sep[sep == parent] = 0;
+		dir = parent;
+	}
+
+	path = efi_file_path(dir, file_name);
+	free(parent);
+	if (!path)
+		return EFI_EXIT(EFI_NOT_FOUND);
+
+	debug("EFI: %s: %s\n", __func__, path);
+
+	node = efi_file_node_get(fs, path);
+	if (!node)
+		return EFI_EXIT(EFI_NOT_FOUND);
+
+	fh = efi_file_new(fs, node);
+	if (!fh) {
+		efi_file_node_put(fs, node);
+		return EFI_EXIT(EFI_OUT_OF_RESOURCES);
+	}
+
+	*new_handle = &fh->base;
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+static void efi_file_free(struct file_handle *fh)
+{
+	int i;
+
+	for (i = 0; i < fh->nr_dirents; i++)
+		free(fh->dirents[i].name);
+	free(fh->dirents);
+	efi_file_node_put(fh->fs, fh->node);
+	free(fh);
+}
+
+static efi_status_t EFIAPI efi_file_close(struct efi_file_handle *file)
+{
+	EFI_ENTRY("%p", file);
+	efi_file_free(container_of(file, struct file_handle, base));
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+static efi_status_t EFIAPI efi_file_delete(struct efi_file_handle *file)
+{
+	EFI_ENTRY("%p", file);
+	efi_file_free(container_of(file, struct file_handle, base));
+	return EFI_EXIT(EFI_WARN_DELETE_FAILURE);
+}
+
+/*
+ * Read part of a file into memory. Large reads go straight from the
+ * filesystem driver into the payload's buffer, unless the payload's memory
+ * may be out of the reach of DMA.
+ */
+static int efi_file_read_at(struct file_system *fs, const char *path,
+			    void *buffer, loff_t offset, loff_t len,
+			    loff_t *actread)
+{
+#ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
+	loff_t chunk, done = 0;
+
+	while (done < len) {
+		chunk = min(len - done, (loff_t)EFI_LOADER_BOUNCE_BUFFER_SIZE);
+		if (efi_file_mount(fs) ||
+		    fs_read(path, map_to_sysmem(efi_bounce_buffer),
+			    offset + done, chunk, actread))
+			return -1;
+		memcpy(buffer + done, efi_bounce_buffer, *actread);
+		done += *actread;
+		if (*actread != chunk)
+			break;
+	}
+	*actread = done;
+
+	return 0;
+#else
+	if (efi_file_mount(fs))
+		return -1;
+
+	return fs_read(path, map_to_sysmem(buffer), offset, len, actread);
+#endif
+}
+
+/* Fill in an EFI_FILE_INFO record, or say how much room it takes */
+static efi_status_t efi_file_fill_info(unsigned long *buffer_size,
+				       struct efi_file_info *info,
+				       const char *name, loff_t size, bool dir)
+{
+	unsigned long len = sizeof(*info) + (strlen(name) + 1) * 2;
+
+	if (*buffer_size < len) {
+		*buffer_size = len;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	/* The fs layer knows nothing of times or attributes */
+	memset(info, 0, len);
+	info->size = len;
+	info->file_size = size;
+	info->physical_size = size;
+	if (dir)
+		info->attribute = EFI_FILE_DIRECTORY;
+	ascii2unicode((u16 *)info->file_name, name);
+	*buffer_size = len;
+
+	return EFI_SUCCESS;
+}
+
+static void efi_file_add_dirent(void *priv, const char *name, loff_t size,
+				bool isdir)
+{
+	struct file_handle *fh = priv;
+	struct file_dirent *ents;
+
+	if (fh->nomem)
+		return;
+
+	ents = realloc(fh->dirents, (fh->nr_dirents + 1) * sizeof(*ents));
+	if (!ents) {
+		fh->nomem = true;
+		return;
+	}
+	fh->dirents = ents;
+
+	ents += fh->nr_dirents;
+	ents->name = strdup(name);
+	if (!ents->name) {
+		fh->nomem = true;
+		return;
+	}
+	ents->size = size;
+	ents->dir = isdir;
+	fh->nr_dirents++;
+}
+
+/*
+ * Reading a directory returns one EFI_FILE_INFO record per call, and
+ * nothing once all entries have been returned. The fs layer goes through
+ * a whole directory at once, so the entries are collected on the first
+ * read and handed out from there.
+ */
+static efi_status_t efi_file_read_dir(struct file_handle *fh,
+				      unsigned long *buffer_size,
+				      struct efi_file_info *info)
+{
+	struct file_dirent *ent;
+	efi_status_t r;
+
+	if (!fh->listed) {
+		if (efi_file_mount(fh->fs) ||
+		    fs_readdir(fh->node->path, efi_file_add_dirent, fh))
+			return EFI_DEVICE_ERROR;
+		fh->listed = true;
+	}
+	if (fh->nomem)
+		return EFI_OUT_OF_RESOURCES;
+
+	if (fh->offset >= fh->nr_dirents) {
+		*buffer_size = 0;
+		return EFI_SUCCESS;
+	}
+
+	ent = &fh->dirents[fh->offset];
+	r = efi_file_fill_info(buffer_size, info, ent->name, ent->size,
+			       ent->dir);
+	if (r == EFI_SUCCESS)
+		fh->offset++;
+
+	return r;
+}
+
+static efi_status_t EFIAPI efi_file_read(struct efi_file_handle *file,
+			unsigned long *buffer_size, void *buffer)
+{
+	struct file_handle *fh = container_of(file, struct file_handle, base);
+	struct file_node *node = fh->node;
+	loff_t len, actread;
+
+	EFI_ENTRY("%p, %p, %p", file, buffer_size, buffer);
+
+	if (!buffer_size || (*buffer_size && !buffer))
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+
+	if (node->dir)
+		return EFI_EXIT(efi_file_read_dir(fh, buffer_size, buffer));
+
+	if (fh->offset > node->size)
+		return EFI_EXIT(EFI_DEVICE_ERROR);
+
+	len = min((u64)*buffer_size, node->size - fh->offset);
+	if (len) {
+		/* A length of 0 would read the whole file */
+		if (efi_file_read_at(fh->fs, node->path, buffer, fh->offset,
+				     len, &actread))
+			return EFI_EXIT(EFI_DEVICE_ERROR);
+		len = actread;
+	}
+
+	/* We don't do interrupts, so check for timers cooperatively */
+	efi_timer_check();
+
+	fh->offset += len;
+	*buffer_size = len;
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+static efi_status_t EFIAPI efi_file_write(struct efi_file_handle *file,
+			unsigned long *buffer_size, void *buffer)
+{
+	struct file_handle *fh = container_of(file, struct file_handle, base);
+
+	EFI_ENTRY("%p, %p, %p", file, buffer_size, buffer);
+
+	if (fh->node->dir)
+		return EFI_EXIT(EFI_UNSUPPORTED);
+
+	return EFI_EXIT(EFI_ACCESS_DENIED);
+}
+
+static efi_status_t EFIAPI efi_file_getpos(struct efi_file_handle *file,
+			u64 *pos)
+{
+	struct file_handle *fh = container_of(file, struct file_handle, base);
+
+	EFI_ENTRY("%p, %p", file, pos);
+
+	if (fh->node->dir)
+		return EFI_EXIT(EFI_UNSUPPORTED);
+
+	*pos = fh->offset;
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+static efi_status_t EFIAPI efi_file_setpos(struct efi_file_handle *file,
+			u64 pos)
+{
+	struct file_handle *fh = container_of(file, struct file_handle, base);
+
+	EFI_ENTRY("%p, %llx", file, pos);
+
+	if (fh->node->dir) {
+		/* Only rewinding is allowed, to read the entries again */
+		if (pos)
+			return EFI_EXIT(EFI_UNSUPPORTED);
+		fh->offset = 0;
+		return EFI_EXIT(EFI_SUCCESS);
+	}
+
+	/* All ones means the end of the file */
+	if (pos == ~0ULL)
+		pos = fh->node->size;
+	fh->offset = pos;
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+static efi_status_t efi_file_get_file_info(struct file_handle *fh,
+					   unsigned long *buffer_size,
+					   struct efi_file_info *info)
+{
+	struct file_node *node = fh->node;
+	const char *name = strrchr(node->path, '/') + 1;
+
+	return efi_file_fill_info(buffer_size, info, name, node->size,
+				  node->dir);
+}
+
+static efi_status_t efi_file_get_system_info(struct file_handle *fh,
+					     unsigned long *buffer_size,
+					     struct efi_file_system_info *info)
+{
+	unsigned long size = sizeof(*info) + sizeof(s16);
+
+	if (*buffer_size < size) {
+		*buffer_size = size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	memset(info, 0, size);
+	info->size = size;
+	info->read_only = 1;
+	info->volume_size = fh->fs->volume_size;
+	info->block_size = fh->fs->block_size;
+	*buffer_size = size;
+
+	return EFI_SUCCESS;
+}
+
+static efi_status_t EFIAPI efi_file_getinfo(struct efi_file_handle *file,
+			efi_guid_t *info_type, unsigned long *buffer_size,
+			void *buffer)
+{
+	struct file_handle *fh = container_of(file, struct file_handle, base);
+	efi_status_t r;
+
+	EFI_ENTRY("%p, %p, %p, %p", file, info_type, buffer_size, buffer);
+
+	if (!info_type || !buffer_size || (*buffer_size && !buffer))
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+
+	if (!guidcmp(info_type, &efi_file_info_guid))
+		r = efi_file_get_file_info(fh, buffer_size, buffer);
+	else if (!guidcmp(info_type, &efi_file_system_info_guid))
+		r = efi_file_get_system_info(fh, buffer_size, buffer);
+	else
+		r = EFI_UNSUPPORTED;
+
+	return EFI_EXIT(r);
+}
+
+static efi_status_t EFIAPI efi_file_setinfo(struct efi_file_handle *file,
+			efi_guid_t *info_type, unsigned long buffer_size,
+			void *buffer)
+{
+	EFI_ENTRY("%p, %p, %lx, %p", file, info_type, buffer_size, buffer);
+	return EFI_EXIT(EFI_WRITE_PROTECTED);
+}
+
+static efi_status_t EFIAPI efi_file_flush(struct efi_file_handle *file)
+{
+	/* Handles are only ever opened for reading */
+	EFI_ENTRY("%p", file);
+	return EFI_EXIT(EFI_ACCESS_DENIED);
+}
+
+static const struct efi_file_handle efi_file_handle_template = {
+	.rev = EFI_FILE_PROTOCOL_REVISION,
+	.open = efi_file_open,
+	.close = efi_file_close,
+	.delete = efi_file_delete,
+	.read = efi_file_read,
+	.write = efi_file_write,
+	.getpos = efi_file_getpos,
+	.setpos = efi_file_setpos,
+	.getinfo = efi_file_getinfo,
+	.setinfo = efi_file_setinfo,
+	.flush = efi_file_flush,
+};
+
+static efi_status_t EFIAPI efi_open_volume(
+			struct efi_simple_file_system_protocol *this,
+			struct efi_file_handle **root)
+{
+	struct file_system *fs = container_of(this, struct file_system, base);
+	struct blk_desc *desc;
+	disk_partition_t info;
+	struct file_node *node;
+	struct file_handle *fh;
+	char *path;
+
+	EFI_ENTRY("%p, %p", this, root);
+
+	/* Disks without a filesystem U-Boot knows have nothing to open */
+	if (blk_get_device_part_str(fs->ifname, fs->dev_part, &desc, &info,
+				    1) < 0 || efi_file_mount(fs))
+		return EFI_EXIT(EFI_UNSUPPORTED);
+	fs->volume_size = (u64)info.size * info.blksz;
+	fs->block_size = info.blksz;
+
+	path = strdup("/");
+	node = path ? efi_file_node_get(fs, path) : NULL;
+	if (!node)
+		return EFI_EXIT(EFI_OUT_OF_RESOURCES);
+
+	fh = efi_file_new(fs, node);
+	if (!fh) {
+		efi_file_node_put(fs, node);
+		return EFI_EXIT(EFI_OUT_OF_RESOURCES);
+	}
+
+	*root = &fh->base;
+
+	return EFI_EXIT(EFI_SUCCESS);
+}
+
+/*
+ * Create the simple file system protocol for a disk, to be installed on its
+ * object. A partition of 0 stands for the one U-Boot would boot from, which
+ * is the whole disk if it has no partition table. The disk is not probed
+ * until the payload opens the volume.
+ *
+ * This gets called from efi_disk_register().
+ */
+struct efi_simple_file_system_protocol *
+efi_simple_file_system(const struct blk_desc *desc, int part)
+{
+	struct file_system *fs;
+
+	fs = calloc(1, sizeof(*fs));
+	if (!fs)
+		return NULL;
+
+	fs->base.rev = EFI_FILE_PROTOCOL_REVISION;
+	fs->base.open_volume = efi_open_volume;
+	fs->ifname = blk_get_if_type_name(desc->if_type);
+	if (part)
+		snprintf(fs->dev_part, sizeof(fs->dev_part), "%x:%x",
+			 desc->devnum, part);
+	else
+		snprintf(fs->dev_part, sizeof(fs->dev_part), "%x:auto",
+			 desc->devnum);
+	INIT_LIST_HEAD(&fs->nodes);
+
+	return &fs->base;
+}
@@ -9,151 +9,173 @@
 #include <common.h>
 #include <efi_loader.h>
 #include <malloc.h>
+#include <region_tree.h>
 #include <asm/global_data.h>
 #include <libfdt_env.h>
-#include <linux/list_sort.h>
 #include <inttypes.h>
 #include <watchdog.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
 struct efi_mem_list {
-	struct list_head link;
+	struct region_node node;	/* free if conventional memory */
 	struct efi_mem_desc desc;
 };
 
-#define EFI_CARVE_NO_OVERLAP		-1
-#define EFI_CARVE_LOOP_AGAIN		-2
-#define EFI_CARVE_OVERLAPS_NONRAM	-3
-
-/* This list contains all memory map items */
-LIST_HEAD(efi_mem);
+/* This tree contains all memory map items, sorted by address */
+static struct region_tree efi_mem;
 
 #ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
 void *efi_bounce_buffer;
 #endif
 
 /*
- * U-Boot services each EFI AllocatePool request as a separate
- * (multiple) page allocation.  We have to track the number of pages
- * to be able to free the correct amount later.
  * EFI requires 8 byte alignment for pool allocations, so we can
- * prepend each allocation with an 64 bit header tracking the
- * allocation size, and hand out the remainder to the caller.
+ * prepend each allocation with a 16 byte header telling efi_free_pool()
+ * where it came from, and hand out the remainder to the caller.
+ *
+ * Allocations of up to EFI_POOL_MAX_CHUNK bytes, header included, are
+ * carved from slabs of EFI_POOL_SLAB_PAGES pages. Each slab serves a
+ * single memory type and chunk size, so it is one entry in the memory
+ * map however many allocations it holds, and allocating or freeing a
+ * chunk leaves the map alone. Larger allocations are serviced as a
+ * separate (multiple) page allocation, and we track the number of
+ * pages to be able to free the correct amount later.
  */
 struct efi_pool_allocation {
-	u64 num_pages;
+	u64 num_pages;		/* pages of a large allocation, else 0 */
+	u64 slab;		/* slab of a small allocation, else 0 */
 	char data[];
 };
 
-/*
- * Sorts the memory list from highest address to lowest address
- *
- * When allocating memory we should always start from the highest
- * address chunk, so sort the memory list such that the first list
- * iterator gets the highest address and goes lower from there.
- */
-static int efi_mem_cmp(void *priv, struct list_head *a, struct list_head *b)
+#define EFI_POOL_MIN_CHUNK	32
+#define EFI_POOL_CLASSES	7
+#define EFI_POOL_MAX_CHUNK	(EFI_POOL_MIN_CHUNK << (EFI_POOL_CLASSES - 1))
+#define EFI_POOL_SLAB_PAGES	4
+
+/* Slabs of one memory type and chunk size */
+struct efi_pool {
+	struct list_head partial;	/* slabs with free chunks */
+	unsigned int chunk_size;
+};
+
+/* Header at the start of the pages of a slab, followed by its chunks */
+struct efi_pool_slab {
+	struct list_head link;		/* in its pool's partial list */
+	struct efi_pool *pool;
+	struct efi_pool_allocation *free;	/* first free chunk */
+	unsigned int used;		/* chunks handed out */
+};
+
+/* Free chunks are linked through their data */
+#define efi_pool_next(alloc)	(*(struct efi_pool_allocation **)(alloc)->data)
+
+static struct efi_pool efi_pools[EFI_MAX_MEMORY_TYPE][EFI_POOL_CLASSES];
+
+static struct efi_mem_list *efi_mem_entry(struct region_node *node)
 {
-	struct efi_mem_list *mema = list_entry(a, struct efi_mem_list, link);
-	struct efi_mem_list *memb = list_entry(b, struct efi_mem_list, link);
+	return node ? container_of(node, struct efi_mem_list, node) : NULL;
+}
 
-	if (mema->desc.physical_start == memb->desc.physical_start)
-		return 0;
-	else if (mema->desc.physical_start < memb->desc.physical_start)
-		return 1;
-	else
-		return -1;
+/* Set the range of a map entry, keeping its tree node in step */
+static void efi_mem_set(struct efi_mem_list *map, uint64_t start,
+			uint64_t end)
+{
+	map->desc.physical_start = start;
+	map->desc.virtual_start = start;
+	map->desc.num_pages = (end - start) >> EFI_PAGE_SHIFT;
+	map->node.start = start;
+	map->node.size = end - start;
+	map->node.free = map->desc.type == EFI_CONVENTIONAL_MEMORY;
 }
 
-static void efi_mem_sort(void)
+/* Get the neighbour of a new entry at addr, if it can be merged with it */
+static struct efi_mem_list *efi_mem_neighbour(uint64_t addr,
+					      struct efi_mem_desc *desc)
 {
-	list_sort(NULL, &efi_mem, efi_mem_cmp);
+	struct efi_mem_list *map;
+
+	map = efi_mem_entry(region_find(&efi_mem, addr, 1));
+	if (map && map->desc.type == desc->type &&
+	    map->desc.attribute == desc->attribute)
+		return map;
+
+	return NULL;
 }
 
 /*
- * Unmaps all memory occupied by the carve_desc region from the
- * list entry pointed to by map.
- *
- * Returns EFI_CARVE_NO_OVERLAP if the regions don't overlap.
- * Returns EFI_CARVE_OVERLAPS_NONRAM if the carve and map overlap,
- *    and the map contains anything but free ram.
- *    (only when overlap_only_ram is true)
- * Returns EFI_CARVE_LOOP_AGAIN if the mapping list should be traversed
- *    again, as it has been altered
- * Returns the number of overlapping pages. The pages are removed from
- *     the mapping list.
+ * Checks that all memory in the range is free RAM, i.e. that the map entries
+ * overlapping it are conventional memory and leave no gaps.
+ */
+static bool efi_mem_is_free(uint64_t start, uint64_t end)
+{
+	struct region_node *node;
+	uint64_t covered = start;
+
+	for (node = region_find(&efi_mem, start, end - start);
+	     node && node->start < end; node = region_next(node)) {
+		if (!node->free || node->start > covered)
+			return false;
+		covered = region_end(node);
+	}
+
+	return covered >= end;
+}
+
+/*
+ * Unmaps all memory in the range from the map entries overlapping it,
+ * shrinking, splitting or removing them.
  *
- * In case of EFI_CARVE_OVERLAPS_NONRAM it is the callers responsibility
- * to readd the already carved out pages to the mapping.
+ * Returns false if out of memory, in which case the map is unchanged.
  */
-static int efi_mem_carve_out(struct efi_mem_list *map,
-			     struct efi_mem_desc *carve_desc,
-			     bool overlap_only_ram)
+static bool efi_mem_carve_out(uint64_t start, uint64_t end)
 {
-	struct efi_mem_list *newmap;
-	struct efi_mem_desc *map_desc = &map->desc;
-	uint64_t map_start = map_desc->physical_start;
-	uint64_t map_end = map_start + (map_desc->num_pages << EFI_PAGE_SHIFT);
-	uint64_t carve_start = carve_desc->physical_start;
-	uint64_t carve_end = carve_start +
-			     (carve_desc->num_pages << EFI_PAGE_SHIFT);
-
-	/* check whether we're overlapping */
-	if ((carve_end <= map_start) || (carve_start >= map_end))
-		return EFI_CARVE_NO_OVERLAP;
-
-	/* We're overlapping with non-RAM, warn the caller if desired */
-	if (overlap_only_ram && (map_desc->type != EFI_CONVENTIONAL_MEMORY))
-		return EFI_CARVE_OVERLAPS_NONRAM;
-
-	/* Sanitize carve_start and carve_end to lie within our bounds */
-	carve_start = max(carve_start, map_start);
-	carve_end = min(carve_end, map_end);
-
-	/* Carving at the beginning of our map? Just move it! */
-	if (carve_start == map_start) {
-		if (map_end == carve_end) {
-			/* Full overlap, just remove map */
-			list_del(&map->link);
-			free(map);
+	struct region_node *node, *next;
+	struct efi_mem_list *map, *newmap;
+	uint64_t map_start, map_end;
+
+	for (node = region_find(&efi_mem, start, end - start);
+	     node && node->start < end; node = next) {
+		map = efi_mem_entry(node);
+		map_start = node->start;
+		map_end = region_end(node);
+		next = region_next(node);
+
+		if (map_start < start && map_end > end) {
+			/*
+			 * The range is inside this entry, which must be the
+			 * only one overlapping it, so split the entry:
+			 *
+			 * [ map | range | newmap ]
+			 */
+			newmap = calloc(1, sizeof(*newmap));
+			if (!newmap)
+				return false;
+			newmap->desc = map->desc;
+			efi_mem_set(newmap, end, map_end);
+			region_insert(&efi_mem, &newmap->node);
+			efi_mem_set(map, map_start, start);
+			region_update(node);
+		} else if (map_start < start) {
+			efi_mem_set(map, map_start, start);
+			region_update(node);
+		} else if (map_end > end) {
+			efi_mem_set(map, end, map_end);
+			region_update(node);
 		} else {
-			map->desc.physical_start = carve_end;
-			map->desc.num_pages = (map_end - carve_end)
-					      >> EFI_PAGE_SHIFT;
+			region_remove(&efi_mem, node);
+			free(map);
 		}
-
-		return (carve_end - carve_start) >> EFI_PAGE_SHIFT;
 	}
 
-	/*
-	 * Overlapping maps, just split the list map at carve_start,
-	 * it will get moved or removed in the next iteration.
-	 *
-	 * [ map_desc |__carve_start__| newmap ]
-	 */
-
-	/* Create a new map from [ carve_start ... map_end ] */
-	newmap = calloc(1, sizeof(*newmap));
-	newmap->desc = map->desc;
-	newmap->desc.physical_start = carve_start;
-	newmap->desc.num_pages = (map_end - carve_start) >> EFI_PAGE_SHIFT;
-	/* Insert before current entry (descending address order) */
-	list_add_tail(&newmap->link, &map->link);
-
-	/* Shrink the map to [ map_start ... carve_start ] */
-	map_desc->num_pages = (carve_start - map_start) >> EFI_PAGE_SHIFT;
-
-	return EFI_CARVE_LOOP_AGAIN;
+	return true;
 }
 
 uint64_t efi_add_memory_map(uint64_t start, uint64_t pages, int memory_type,
 			    bool overlap_only_ram)
 {
-	struct list_head *lhandle;
-	struct efi_mem_list *newlist;
-	bool carve_again;
-	uint64_t carved_pages = 0;
+	struct efi_mem_list *newlist, *prev, *next;
+	uint64_t end = start + (pages << EFI_PAGE_SHIFT);
 
 	debug("%s: 0x%" PRIx64 " 0x%" PRIx64 " %d %s\n", __func__,
 	      start, pages, memory_type, overlap_only_ram ? "yes" : "no");
@@ -161,11 +183,18 @@ uint64_t efi_add_memory_map(uint64_t start, uint64_t pages, int memory_type,
 	if (!pages)
 		return start;
 
+	if (overlap_only_ram && !efi_mem_is_free(start, end)) {
+		/*
+		 * The payload wanted to have RAM overlaps, but we overlapped
+		 * with a non-RAM or an unallocated region. Error out.
+		 */
+		return 0;
+	}
+
 	newlist = calloc(1, sizeof(*newlist));
+	if (!newlist)
+		return 0;
 	newlist->desc.type = memory_type;
-	newlist->desc.physical_start = start;
-	newlist->desc.virtual_start = start;
-	newlist->desc.num_pages = pages;
 
 	switch (memory_type) {
 	case EFI_RUNTIME_SERVICES_CODE:
@@ -181,98 +210,44 @@ uint64_t efi_add_memory_map(uint64_t start, uint64_t pages, int memory_type,
 		break;
 	}
 
-	/* Add our new map */
-	do {
-		carve_again = false;
-		list_for_each(lhandle, &efi_mem) {
-			struct efi_mem_list *lmem;
-			int r;
-
-			lmem = list_entry(lhandle, struct efi_mem_list, link);
-			r = efi_mem_carve_out(lmem, &newlist->desc,
-					      overlap_only_ram);
-			switch (r) {
-			case EFI_CARVE_OVERLAPS_NONRAM:
-				/*
-				 * The user requested to only have RAM overlaps,
-				 * but we hit a non-RAM region. Error out.
-				 */
-				return 0;
-			case EFI_CARVE_NO_OVERLAP:
-				/* Just ignore this list entry */
-				break;
-			case EFI_CARVE_LOOP_AGAIN:
-				/*
-				 * We split an entry, but need to loop through
-				 * the list again to actually carve it.
-				 */
-				carve_again = true;
-				break;
-			default:
-				/* We carved a number of pages */
-				carved_pages += r;
-				carve_again = true;
-				break;
-			}
-
-			if (carve_again) {
-				/* The list changed, we need to start over */
-				break;
-			}
-		}
-	} while (carve_again);
-
-	if (overlap_only_ram && (carved_pages != pages)) {
-		/*
-		 * The payload wanted to have RAM overlaps, but we overlapped
-		 * with an unallocated region. Error out.
-		 */
+	if (!efi_mem_carve_out(start, end)) {
+		free(newlist);
 		return 0;
 	}
 
-	/* Add our new map */
-        list_add_tail(&newlist->link, &efi_mem);
-
-	/* And make sure memory is listed in descending order */
-	efi_mem_sort();
+	/*
+	 * Merge with neighbours of the same kind, so that freed pages go back
+	 * into the free region they came from instead of fragmenting the map
+	 */
+	prev = start ? efi_mem_neighbour(start - 1, &newlist->desc) : NULL;
+	next = efi_mem_neighbour(end, &newlist->desc);
+	if (next) {
+		end = region_end(&next->node);
+		region_remove(&efi_mem, &next->node);
+		free(next);
+	}
+	if (prev) {
+		efi_mem_set(prev, prev->node.start, end);
+		region_update(&prev->node);
+		free(newlist);
+	} else {
+		efi_mem_set(newlist, start, end);
+		region_insert(&efi_mem, &newlist->node);
+	}
 
 	return start;
 }
 
 static uint64_t efi_find_free_memory(uint64_t len, uint64_t max_addr)
 {
-	struct list_head *lhandle;
-
-	list_for_each(lhandle, &efi_mem) {
-		struct efi_mem_list *lmem = list_entry(lhandle,
-			struct efi_mem_list, link);
-		struct efi_mem_desc *desc = &lmem->desc;
-		uint64_t desc_len = desc->num_pages << EFI_PAGE_SHIFT;
-		uint64_t desc_end = desc->physical_start + desc_len;
-		uint64_t curmax = min(max_addr, desc_end);
-		uint64_t ret = curmax - len;
-
-		/* We only take memory from free RAM */
-		if (desc->type != EFI_CONVENTIONAL_MEMORY)
-			continue;
-
-		/* Out of bounds for max_addr */
-		if ((ret + len) > max_addr)
-			continue;
-
-		/* Out of bounds for upper map limit */
-		if ((ret + len) > desc_end)
-			continue;
-
-		/* Out of bounds for lower map limit */
-		if (ret < desc->physical_start)
-			continue;
-
-		/* Return the highest address in this map within bounds */
-		return ret;
-	}
+	struct region_node *node;
 
-	return 0;
+	/* Take the highest address within bounds from free RAM */
+	node = region_find_free(&efi_mem, len, max_addr);
+	if (!node)
+		return 0;
+
+	return min(region_end(node), max_addr) - len;
 }
 
 efi_status_t efi_allocate_pages(int type, int memory_type,
@@ -343,7 +318,6 @@ efi_status_t efi_free_pages(uint64_t memory, unsigned long pages)
 	uint64_t r = 0;
 
 	r = efi_add_memory_map(memory, pages, EFI_CONVENTIONAL_MEMORY, false);
-	/* Merging of adjacent free regions is missing */
 
 	if (r == memory)
 		return EFI_SUCCESS;
@@ -351,23 +325,102 @@ efi_status_t efi_free_pages(uint64_t memory, unsigned long pages)
 	return EFI_NOT_FOUND;
 }
 
+/* Get the slab pool for an allocation, or NULL if it needs pages */
+static struct efi_pool *efi_pool_get(int pool_type, unsigned long size)
+{
+	struct efi_pool *pool;
+	unsigned long need = size + sizeof(struct efi_pool_allocation);
+	int class;
+
+	if (pool_type < 0 || pool_type >= EFI_MAX_MEMORY_TYPE ||
+	    need > EFI_POOL_MAX_CHUNK)
+		return NULL;
+
+	class = need <= EFI_POOL_MIN_CHUNK ? 0 :
+		fls(need - 1) - fls(EFI_POOL_MIN_CHUNK - 1);
+	pool = &efi_pools[pool_type][class];
+	if (!pool->chunk_size) {
+		INIT_LIST_HEAD(&pool->partial);
+		pool->chunk_size = EFI_POOL_MIN_CHUNK << class;
+	}
+
+	return pool;
+}
+
+/* Set up a new slab for a pool, with all its chunks free */
+static struct efi_pool_slab *efi_pool_grow(struct efi_pool *pool,
+					   int pool_type)
+{
+	struct efi_pool_slab *slab;
+	struct efi_pool_allocation *alloc;
+	efi_physical_addr_t t;
+	void *chunk, *end;
+
+	if (efi_allocate_pages(0, pool_type, EFI_POOL_SLAB_PAGES, &t) !=
+	    EFI_SUCCESS)
+		return NULL;
+
+	slab = (void *)(uintptr_t)t;
+	slab->pool = pool;
+	slab->used = 0;
+	slab->free = NULL;
+	chunk = (void *)slab + ALIGN(sizeof(*slab), 16);
+	end = (void *)slab + (EFI_POOL_SLAB_PAGES << EFI_PAGE_SHIFT);
+	for (; chunk + pool->chunk_size <= end; chunk += pool->chunk_size) {
+		alloc = chunk;
+		alloc->num_pages = 0;
+		alloc->slab = 0;
+		efi_pool_next(alloc) = slab->free;
+		slab->free = alloc;
+	}
+	list_add(&slab->link, &pool->partial);
+
+	return slab;
+}
+
 efi_status_t efi_allocate_pool(int pool_type, unsigned long size,
 			       void **buffer)
 {
 	efi_status_t r;
 	efi_physical_addr_t t;
-	u64 num_pages = (size + sizeof(u64) + EFI_PAGE_MASK) >> EFI_PAGE_SHIFT;
+	struct efi_pool_allocation *alloc;
+	struct efi_pool_slab *slab;
+	struct efi_pool *pool;
+	u64 num_pages;
 
 	if (size == 0) {
 		*buffer = NULL;
 		return EFI_SUCCESS;
 	}
 
+	pool = efi_pool_get(pool_type, size);
+	if (pool) {
+		if (list_empty(&pool->partial))
+			slab = efi_pool_grow(pool, pool_type);
+		else
+			slab = list_first_entry(&pool->partial,
+						struct efi_pool_slab, link);
+		if (!slab)
+			return EFI_OUT_OF_RESOURCES;
+
+		alloc = slab->free;
+		slab->free = efi_pool_next(alloc);
+		slab->used++;
+		if (!slab->free)
+			list_del(&slab->link);
+
+		alloc->slab = (uintptr_t)slab;
+		*buffer = alloc->data;
+		return EFI_SUCCESS;
+	}
+
+	num_pages = (size + sizeof(*alloc) + EFI_PAGE_MASK) >> EFI_PAGE_SHIFT;
 	r = efi_allocate_pages(0, pool_type, num_pages, &t);
 
 	if (r == EFI_SUCCESS) {
-		struct efi_pool_allocation *alloc = (void *)(uintptr_t)t;
+		alloc = (void *)(uintptr_t)t;
 		alloc->num_pages = num_pages;
+		alloc->slab = 0;
 		*buffer = alloc->data;
 	}
 
@@ -378,17 +431,41 @@ efi_status_t efi_free_pool(void *buffer)
 {
 	efi_status_t r;
 	struct efi_pool_allocation *alloc;
+	struct efi_pool_slab *slab;
 
 	if (buffer == NULL)
 		return EFI_INVALID_PARAMETER;
 
 	alloc = container_of(buffer, struct efi_pool_allocation, data);
-	/* Sanity check, was the supplied address returned by allocate_pool */
-	assert(((uintptr_t)alloc & EFI_PAGE_MASK) == 0);
 
-	r = efi_free_pages((uintptr_t)alloc, alloc->num_pages);
+	if (alloc->num_pages) {
+		/* Sanity check, was the address returned by allocate_pool */
+		assert(((uintptr_t)alloc & EFI_PAGE_MASK) == 0);
 
-	return r;
+		r = efi_free_pages((uintptr_t)alloc, alloc->num_pages);
+
+		return r;
+	}
+
+	/* Chunks are marked free with a zero slab, catching double frees */
+	slab = (void *)(uintptr_t)alloc->slab;
+	if (!slab)
+		return EFI_INVALID_PARAMETER;
+	alloc->slab = 0;
+
+	if (!slab->free)
+		list_add(&slab->link, &slab->pool->partial);
+	efi_pool_next(alloc) = slab->free;
+	slab->free = alloc;
+	slab->used--;
+
+	/* Give back empty slabs, but keep one per pool to avoid thrashing */
+	if (!slab->used && !list_is_singular(&slab->pool->partial)) {
+		list_del(&slab->link);
+		return efi_free_pages((uintptr_t)slab, EFI_POOL_SLAB_PAGES);
+	}
+
+	return EFI_SUCCESS;
 }
 
 efi_status_t efi_get_memory_map(unsigned long *memory_map_size,
@@ -398,13 +475,10 @@ efi_status_t efi_get_memory_map(unsigned long *memory_map_size,
 			       uint32_t *descriptor_version)
 {
 	ulong map_size = 0;
-	int map_entries = 0;
-	struct list_head *lhandle;
+	int map_entries = efi_mem.count;
+	struct region_node *node;
 	unsigned long provided_map_size = *memory_map_size;
 
-	list_for_each(lhandle, &efi_mem)
-		map_entries++;
-
 	map_size = map_entries * sizeof(struct efi_mem_desc);
 
 	*memory_map_size = map_size;
@@ -418,17 +492,11 @@ efi_status_t efi_get_memory_map(unsigned long *memory_map_size,
 	if (descriptor_version)
 		*descriptor_version = EFI_MEMORY_DESCRIPTOR_VERSION;
 
-	/* Copy list into array */
+	/* Copy the map into the array in ascending order */
 	if (memory_map) {
-		/* Return the list in ascending order */
-		memory_map = &memory_map[map_entries - 1];
-		list_for_each(lhandle, &efi_mem) {
-			struct efi_mem_list *lmem;
-
-			lmem = list_entry(lhandle, struct efi_mem_list, link);
-			*memory_map = lmem->desc;
-			memory_map--;
-		}
+		for (node = region_first(&efi_mem); node;
+		     node = region_next(node))
+			*memory_map++ = efi_mem_entry(node)->desc;
 	}
 
 	*map_key = 0;
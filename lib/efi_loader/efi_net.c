@@ -17,8 +17,35 @@ DECLARE_GLOBAL_DATA_PTR;
 static const efi_guid_t efi_net_guid = EFI_SIMPLE_NETWORK_GUID;
 static const efi_guid_t efi_pxe_guid = EFI_PXE_GUID;
 static struct efi_pxe_packet *dhcp_ack;
-static bool new_rx_packet;
-static void *new_tx_packet;
+
+/*
+ * Packets received but not yet handed to the payload. eth_rx() may pass on
+ * a whole burst of packets at once, so keep a ring of them rather than just
+ * the last one, which made the payload's peer retransmit what was dropped.
+ */
+#define EFI_NET_RX_SLOTS	32
+
+struct efi_net_rx_packet {
+	int len;
+	uchar data[PKTSIZE_ALIGN];
+};
+
+static struct efi_net_rx_packet *rx_ring;
+static unsigned int rx_head;	/* next slot to fill */
+static unsigned int rx_tail;	/* next slot to hand out */
+
+/*
+ * Buffers transmitted but not yet given back by get_status(). We send
+ * synchronously, so every transmit completes at once, but the payload may
+ * transmit several buffers before asking for any of them back.
+ */
+#define EFI_NET_TX_SLOTS	32
+
+static void *tx_done[EFI_NET_TX_SLOTS];
+static unsigned int tx_head, tx_tail;
+
+/* Mode of the exposed device, whose receive filters efi_net_push() applies */
+static struct efi_simple_network_mode *efi_net_mode;
 
 struct efi_net_obj {
 	/* Generic EFI object parent class data */
@@ -38,6 +65,9 @@ static efi_status_t EFIAPI efi_net_start(struct efi_simple_network *this)
 {
 	EFI_ENTRY("%p", this);
 
+	if (this->mode->state == EFI_NETWORK_STOPPED)
+		this->mode->state = EFI_NETWORK_STARTED;
+
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
@@ -45,15 +75,26 @@ static efi_status_t EFIAPI efi_net_stop(struct efi_simple_network *this)
 {
 	EFI_ENTRY("%p", this);
 
+	this->mode->state = EFI_NETWORK_STOPPED;
+
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
+/* Forget packets received and buffers transmitted so far */
+static void efi_net_flush(void)
+{
+	rx_tail = rx_head;
+	tx_tail = tx_head;
+}
+
 static efi_status_t EFIAPI efi_net_initialize(struct efi_simple_network *this,
 					      ulong extra_rx, ulong extra_tx)
 {
 	EFI_ENTRY("%p, %lx, %lx", this, extra_rx, extra_tx);
 
 	eth_init();
+	efi_net_flush();
+	this->mode->state = EFI_NETWORK_INITIALIZED;
 
 	return EFI_EXIT(EFI_SUCCESS);
 }
@@ -63,6 +104,8 @@ static efi_status_t EFIAPI efi_net_reset(struct efi_simple_network *this,
 {
 	EFI_ENTRY("%p, %x", this, extended_verification);
 
+	efi_net_flush();
+
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
@@ -70,6 +113,10 @@ static efi_status_t EFIAPI efi_net_shutdown(struct efi_simple_network *this)
 {
 	EFI_ENTRY("%p", this);
 
+	efi_net_flush();
+	if (this->mode->state == EFI_NETWORK_INITIALIZED)
+		this->mode->state = EFI_NETWORK_STARTED;
+
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
@@ -78,10 +125,33 @@ static efi_status_t EFIAPI efi_net_receive_filters(
 		int reset_mcast_filter, ulong mcast_filter_count,
 		struct efi_mac_address *mcast_filter)
 {
+	struct efi_simple_network_mode *mode = this->mode;
+	ulong i;
+
 	EFI_ENTRY("%p, %x, %x, %x, %lx, %p", this, enable, disable,
 		  reset_mcast_filter, mcast_filter_count, mcast_filter);
 
-	/* XXX Do we care? */
+	if ((enable | disable) & ~mode->receive_filter_mask)
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+	if (!reset_mcast_filter &&
+	    (mcast_filter_count > mode->max_mcast_filter_count ||
+	     (mcast_filter_count && !mcast_filter)))
+		return EFI_EXIT(EFI_INVALID_PARAMETER);
+	for (i = 0; !reset_mcast_filter && i < mcast_filter_count; i++) {
+		/* Multicast addresses have the group bit set */
+		if (!(mcast_filter[i].mac_addr[0] & 1))
+			return EFI_EXIT(EFI_INVALID_PARAMETER);
+	}
+
+	mode->receive_filter_setting |= enable;
+	mode->receive_filter_setting &= ~disable;
+	if (reset_mcast_filter) {
+		mode->mcast_filter_count = 0;
+	} else if (mcast_filter_count) {
+		mode->mcast_filter_count = mcast_filter_count;
+		memcpy(mode->mcast_filter, mcast_filter,
+		       mcast_filter_count * sizeof(*mcast_filter));
+	}
 
 	return EFI_EXIT(EFI_SUCCESS);
 }
@@ -124,18 +194,80 @@ static efi_status_t EFIAPI efi_net_nvdata(struct efi_simple_network *this,
 	return EFI_EXIT(EFI_INVALID_PARAMETER);
 }
 
+/* Check a received packet against the receive filters of the payload */
+static bool efi_net_wanted(struct efi_simple_network_mode *mode,
+			   struct ethernet_hdr *et)
+{
+	u32 filter = mode->receive_filter_setting;
+	u32 i;
+
+	if (filter & EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS)
+		return true;
+	if (!(et->et_dest[0] & 1))
+		return (filter & EFI_SIMPLE_NETWORK_RECEIVE_UNICAST) &&
+		       !memcmp(et->et_dest, mode->current_address.mac_addr,
+			       ARP_HLEN);
+	if (!memcmp(et->et_dest, net_bcast_ethaddr, ARP_HLEN))
+		return filter & EFI_SIMPLE_NETWORK_RECEIVE_BROADCAST;
+	if (filter & EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS_MULTICAST)
+		return true;
+	if (!(filter & EFI_SIMPLE_NETWORK_RECEIVE_MULTICAST))
+		return false;
+	for (i = 0; i < mode->mcast_filter_count; i++) {
+		if (!memcmp(et->et_dest, mode->mcast_filter[i].mac_addr,
+			    ARP_HLEN))
+			return true;
+	}
+
+	return false;
+}
+
+static void efi_net_push(void *pkt, int len)
+{
+	struct efi_net_rx_packet *slot;
+
+	if (len > PKTSIZE_ALIGN || !efi_net_wanted(efi_net_mode, pkt))
+		return;
+
+	/* Drop the packet if the payload has not kept up */
+	if (rx_head - rx_tail == EFI_NET_RX_SLOTS)
+		return;
+
+	slot = &rx_ring[rx_head % EFI_NET_RX_SLOTS];
+	memcpy(slot->data, pkt, len);
+	slot->len = len;
+	rx_head++;
+}
+
+/* Pass on whatever the network device has received since the last call */
+static void efi_net_poll(void)
+{
+	push_packet = efi_net_push;
+	eth_rx();
+	push_packet = NULL;
+}
+
 static efi_status_t EFIAPI efi_net_get_status(struct efi_simple_network *this,
 					      u32 *int_status, void **txbuf)
 {
 	EFI_ENTRY("%p, %p, %p", this, int_status, txbuf);
 
-	/* We send packets synchronously, so nothing is outstanding */
-	if (int_status)
+	efi_net_poll();
+
+	if (int_status) {
 		*int_status = 0;
-	if (txbuf)
-		*txbuf = new_tx_packet;
+		if (rx_head != rx_tail)
+			*int_status |= EFI_SIMPLE_NETWORK_RECEIVE_INTERRUPT;
+		if (tx_head != tx_tail)
+			*int_status |= EFI_SIMPLE_NETWORK_TRANSMIT_INTERRUPT;
+	}
 
-	new_tx_packet = NULL;
+	/* Give back one transmitted buffer per call */
+	if (txbuf) {
+		*txbuf = NULL;
+		if (tx_head != tx_tail)
+			*txbuf = tx_done[tx_tail++ % EFI_NET_TX_SLOTS];
+	}
 
 	return EFI_EXIT(EFI_SUCCESS);
 }
@@ -148,11 +280,30 @@ static efi_status_t EFIAPI efi_net_transmit(struct efi_simple_network *this,
 	EFI_ENTRY("%p, %lx, %lx, %p, %p, %p, %p", this, header_size,
 		  buffer_size, buffer, src_addr, dest_addr, protocol);
 
-	if (header_size) {
-		/* We would need to create the header if header_size != 0 */
+	if (this->mode->state == EFI_NETWORK_STOPPED)
+		return EFI_EXIT(EFI_NOT_STARTED);
+	if (buffer_size < ETHER_HDR_SIZE)
+		return EFI_EXIT(EFI_BUFFER_TOO_SMALL);
+	if (buffer_size > PKTSIZE)
 		return EFI_EXIT(EFI_INVALID_PARAMETER);
+
+	if (header_size) {
+		struct ethernet_hdr *et = buffer;
+
+		/* Fill in the media header for the payload */
+		if (header_size != ETHER_HDR_SIZE || !dest_addr || !protocol)
+			return EFI_EXIT(EFI_INVALID_PARAMETER);
+		if (!src_addr)
+			src_addr = &this->mode->current_address;
+		memcpy(et->et_dest, dest_addr->mac_addr, ARP_HLEN);
+		memcpy(et->et_src, src_addr->mac_addr, ARP_HLEN);
+		et->et_protlen = htons(*protocol);
 	}
 
+	/* The buffer cannot be given back until an earlier one has been */
+	if (tx_head - tx_tail == EFI_NET_TX_SLOTS)
+		return EFI_EXIT(EFI_NOT_READY);
+
 #ifdef CONFIG_EFI_LOADER_BOUNCE_BUFFER
 	/* Ethernet packets always fit, just bounce */
 	memcpy(efi_bounce_buffer, buffer, buffer_size);
@@ -161,40 +312,49 @@ static efi_status_t EFIAPI efi_net_transmit(struct efi_simple_network *this,
 	net_send_packet(buffer, buffer_size);
 #endif
 
-	new_tx_packet = buffer;
+	tx_done[tx_head++ % EFI_NET_TX_SLOTS] = buffer;
 
 	return EFI_EXIT(EFI_SUCCESS);
 }
 
-static void efi_net_push(void *pkt, int len)
-{
-	new_rx_packet = true;
-}
-
 static efi_status_t EFIAPI efi_net_receive(struct efi_simple_network *this,
 		ulong *header_size, ulong *buffer_size, void *buffer,
 		struct efi_mac_address *src_addr,
 		struct efi_mac_address *dest_addr, u16 *protocol)
 {
+	struct efi_net_rx_packet *slot;
+	struct ethernet_hdr *et;
+
 	EFI_ENTRY("%p, %p, %p, %p, %p, %p, %p", this, header_size,
 		  buffer_size, buffer, src_addr, dest_addr, protocol);
 
-	push_packet = efi_net_push;
-	eth_rx();
-	push_packet = NULL;
+	if (this->mode->state == EFI_NETWORK_STOPPED)
+		return EFI_EXIT(EFI_NOT_STARTED);
 
-	if (!new_rx_packet)
+	if (rx_head == rx_tail)
+		efi_net_poll();
+	if (rx_head == rx_tail)
 		return EFI_EXIT(EFI_NOT_READY);
 
-	if (*buffer_size < net_rx_packet_len) {
+	slot = &rx_ring[rx_tail % EFI_NET_RX_SLOTS];
+	if (*buffer_size < slot->len) {
 		/* Packet doesn't fit, try again with bigger buf */
-		*buffer_size = net_rx_packet_len;
+		*buffer_size = slot->len;
 		return EFI_EXIT(EFI_BUFFER_TOO_SMALL);
 	}
 
-	memcpy(buffer, net_rx_packet, net_rx_packet_len);
-	*buffer_size = net_rx_packet_len;
-	new_rx_packet = false;
+	memcpy(buffer, slot->data, slot->len);
+	*buffer_size = slot->len;
+	et = (struct ethernet_hdr *)slot->data;
+	if (header_size)
+		*header_size = ETHER_HDR_SIZE;
+	if (src_addr)
+		memcpy(src_addr->mac_addr, et->et_src, ARP_HLEN);
+	if (dest_addr)
+		memcpy(dest_addr->mac_addr, et->et_dest, ARP_HLEN);
+	if (protocol)
+		*protocol = ntohs(et->et_protlen);
+	rx_tail++;
 
 	return EFI_EXIT(EFI_SUCCESS);
 }
@@ -231,6 +391,12 @@ int efi_net_register(void **handle)
 
 	/* We only expose the "active" eth device, so one is enough */
 	netobj = calloc(1, sizeof(*netobj));
+	if (!rx_ring)
+		rx_ring = malloc(EFI_NET_RX_SLOTS * sizeof(*rx_ring));
+	if (!netobj || !rx_ring) {
+		free(netobj);
+		return -ENOMEM;
+	}
 
 	/* Fill in object data */
 	netobj->parent.protocols[0].guid = &efi_net_guid;
@@ -259,7 +425,32 @@ int efi_net_register(void **handle)
 	netobj->dp_end = dp_end;
 	memcpy(netobj->dp_mac.mac.addr, eth_get_ethaddr(), 6);
 	memcpy(netobj->net_mode.current_address.mac_addr, eth_get_ethaddr(), 6);
+	memcpy(netobj->net_mode.permanent_address.mac_addr, eth_get_ethaddr(),
+	       6);
+	memset(netobj->net_mode.broadcast_address.mac_addr, 0xff, 6);
+	netobj->net_mode.hwaddr_size = ARP_HLEN;
+	netobj->net_mode.media_header_size = ETHER_HDR_SIZE;
 	netobj->net_mode.max_packet_size = PKTSIZE;
+	netobj->net_mode.media_present = 1;
+	netobj->net_mode.max_mcast_filter_count =
+		ARRAY_SIZE(netobj->net_mode.mcast_filter);
+	netobj->net_mode.receive_filter_mask =
+		EFI_SIMPLE_NETWORK_RECEIVE_UNICAST |
+		EFI_SIMPLE_NETWORK_RECEIVE_MULTICAST |
+		EFI_SIMPLE_NETWORK_RECEIVE_BROADCAST |
+		EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS |
+		EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS_MULTICAST;
+	/*
+	 * Payloads such as GRUB never set receive filters, and U-Boot used
+	 * to pass on everything the device received, so start out with all
+	 * but other stations' unicast packets.
+	 */
+	netobj->net_mode.receive_filter_setting =
+		EFI_SIMPLE_NETWORK_RECEIVE_UNICAST |
+		EFI_SIMPLE_NETWORK_RECEIVE_BROADCAST |
+		EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS_MULTICAST;
+	efi_net_mode = &netobj->net_mode;
+	efi_net_flush();
 
 	netobj->pxe.mode = &netobj->pxe_mode;
 	if (dhcp_ack)
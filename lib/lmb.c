@@ -9,165 +9,86 @@
 
 #include <common.h>
 #include <lmb.h>
+#include <malloc.h>
 
 #define LMB_ALLOC_ANYWHERE	0
 
-void lmb_dump_all(struct lmb *lmb)
-{
 #ifdef DEBUG
-	unsigned long i;
+static void lmb_dump_region(struct lmb_region *rgn, const char *name)
+{
+	struct region_node *node;
+	unsigned long i = 0;
 
-	debug("lmb_dump_all:\n");
-	debug("    memory.cnt		   = 0x%lx\n", lmb->memory.cnt);
-	debug("    memory.size		   = 0x%llx\n",
-	      (unsigned long long)lmb->memory.size);
-	for (i=0; i < lmb->memory.cnt ;i++) {
-		debug("    memory.reg[0x%lx].base   = 0x%llx\n", i,
-			(long long unsigned)lmb->memory.region[i].base);
+	debug("    %s.cnt		   = 0x%lx\n", name, rgn->tree.count);
+	for (node = region_first(&rgn->tree); node; node = region_next(node)) {
+		debug("    %s.reg[0x%lx].base   = 0x%llx\n", name, i++,
+		      (unsigned long long)node->start);
 		debug("		   .size   = 0x%llx\n",
-			(long long unsigned)lmb->memory.region[i].size);
+		      (unsigned long long)node->size);
 	}
-
-	debug("\n    reserved.cnt	   = 0x%lx\n",
-		lmb->reserved.cnt);
-	debug("    reserved.size	   = 0x%llx\n",
-		(long long unsigned)lmb->reserved.size);
-	for (i=0; i < lmb->reserved.cnt ;i++) {
-		debug("    reserved.reg[0x%lx].base = 0x%llx\n", i,
-			(long long unsigned)lmb->reserved.region[i].base);
-		debug("		     .size = 0x%llx\n",
-			(long long unsigned)lmb->reserved.region[i].size);
-	}
-#endif /* DEBUG */
-}
-
-static long lmb_addrs_overlap(phys_addr_t base1,
-		phys_size_t size1, phys_addr_t base2, phys_size_t size2)
-{
-	return ((base1 < (base2+size2)) && (base2 < (base1+size1)));
-}
-
-static long lmb_addrs_adjacent(phys_addr_t base1, phys_size_t size1,
-		phys_addr_t base2, phys_size_t size2)
-{
-	if (base2 == base1 + size1)
-		return 1;
-	else if (base1 == base2 + size2)
-		return -1;
-
-	return 0;
 }
+#endif /* DEBUG */
 
-static long lmb_regions_adjacent(struct lmb_region *rgn,
-		unsigned long r1, unsigned long r2)
+void lmb_dump_all(struct lmb *lmb)
 {
-	phys_addr_t base1 = rgn->region[r1].base;
-	phys_size_t size1 = rgn->region[r1].size;
-	phys_addr_t base2 = rgn->region[r2].base;
-	phys_size_t size2 = rgn->region[r2].size;
-
-	return lmb_addrs_adjacent(base1, size1, base2, size2);
+#ifdef DEBUG
+	debug("lmb_dump_all:\n");
+	lmb_dump_region(&lmb->memory, "memory");
+	debug("\n");
+	lmb_dump_region(&lmb->reserved, "reserved");
+#endif /* DEBUG */
 }
 
-static void lmb_remove_region(struct lmb_region *rgn, unsigned long r)
+static void lmb_free_regions(struct lmb_region *rgn)
 {
-	unsigned long i;
+	struct region_node *node, *next;
 
-	for (i = r; i < rgn->cnt - 1; i++) {
-		rgn->region[i].base = rgn->region[i + 1].base;
-		rgn->region[i].size = rgn->region[i + 1].size;
-	}
-	rgn->cnt--;
-}
-
-/* Assumption: base addr of region 1 < base addr of region 2 */
-static void lmb_coalesce_regions(struct lmb_region *rgn,
-		unsigned long r1, unsigned long r2)
-{
-	rgn->region[r1].size += rgn->region[r2].size;
-	lmb_remove_region(rgn, r2);
+	rbtree_postorder_for_each_entry_safe(node, next, &rgn->tree.root, rb)
+		free(node);
+	region_tree_init(&rgn->tree);
 }
 
 void lmb_init(struct lmb *lmb)
 {
-	/* Create a dummy zero size LMB which will get coalesced away later.
-	 * This simplifies the lmb_add() code below...
-	 */
-	lmb->memory.region[0].base = 0;
-	lmb->memory.region[0].size = 0;
-	lmb->memory.cnt = 1;
-	lmb->memory.size = 0;
-
-	/* Ditto. */
-	lmb->reserved.region[0].base = 0;
-	lmb->reserved.region[0].size = 0;
-	lmb->reserved.cnt = 1;
-	lmb->reserved.size = 0;
+	lmb_free_regions(&lmb->memory);
+	lmb_free_regions(&lmb->reserved);
 }
 
-/* This routine called with relocation disabled. */
+/*
+ * Add a region, merging it with any regions it overlaps or adjoins so that
+ * those in the tree stay disjoint. Returns 0, or -1 if out of memory.
+ */
 static long lmb_add_region(struct lmb_region *rgn, phys_addr_t base, phys_size_t size)
 {
-	unsigned long coalesced = 0;
-	long adjacent, i;
+	struct region_node *node, *next;
+	u64 end = (u64)base + size;
+	u64 lo = base ? base - 1 : 0;
 
-	if ((rgn->cnt == 1) && (rgn->region[0].size == 0)) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
+	if (!size)
 		return 0;
-	}
-
-	/* First try and coalesce this LMB with another. */
-	for (i=0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		phys_size_t rgnsize = rgn->region[i].size;
-
-		if ((rgnbase == base) && (rgnsize == size))
-			/* Already have this region, so we're done */
-			return 0;
-
-		adjacent = lmb_addrs_adjacent(base,size,rgnbase,rgnsize);
-		if ( adjacent > 0 ) {
-			rgn->region[i].base -= size;
-			rgn->region[i].size += size;
-			coalesced++;
-			break;
-		}
-		else if ( adjacent < 0 ) {
-			rgn->region[i].size += size;
-			coalesced++;
-			break;
-		}
-	}
-
-	if ((i < rgn->cnt-1) && lmb_regions_adjacent(rgn, i, i+1) ) {
-		lmb_coalesce_regions(rgn, i, i+1);
-		coalesced++;
-	}
-
-	if (coalesced)
-		return coalesced;
-	if (rgn->cnt >= MAX_LMB_REGIONS)
-		return -1;
 
-	/* Couldn't coalesce the LMB, so add it to the sorted table. */
-	for (i = rgn->cnt-1; i >= 0; i--) {
-		if (base < rgn->region[i].base) {
-			rgn->region[i+1].base = rgn->region[i].base;
-			rgn->region[i+1].size = rgn->region[i].size;
-		} else {
-			rgn->region[i+1].base = base;
-			rgn->region[i+1].size = size;
-			break;
-		}
+	/* Look one byte further either side to find adjoining regions */
+	node = region_find(&rgn->tree, lo, end + 1 - lo);
+	if (!node) {
+		node = calloc(1, sizeof(*node));
+		if (!node)
+			return -1;
+		node->start = base;
+		node->size = size;
+		region_insert(&rgn->tree, node);
+		return 0;
 	}
 
-	if (base < rgn->region[0].base) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
+	/* Grow the first region over the new one and any others it meets */
+	while ((next = region_next(node)) && next->start <= end) {
+		end = max(end, region_end(next));
+		region_remove(&rgn->tree, next);
+		free(next);
 	}
-
-	rgn->cnt++;
+	end = max(end, region_end(node));
+	node->start = min(node->start, (u64)base);
+	node->size = end - node->start;
+	region_update(node);
 
 	return 0;
 }
@@ -183,41 +104,35 @@ long lmb_add(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 {
 	struct lmb_region *rgn = &(lmb->reserved);
-	phys_addr_t rgnbegin, rgnend;
-	phys_addr_t end = base + size;
-	int i;
-
-	rgnbegin = rgnend = 0; /* supress gcc warnings */
+	struct region_node *node, *tail;
+	u64 end = (u64)base + size;
+	u64 rgnend;
 
 	/* Find the region where (base, size) belongs to */
-	for (i=0; i < rgn->cnt; i++) {
-		rgnbegin = rgn->region[i].base;
-		rgnend = rgnbegin + rgn->region[i].size;
-
-		if ((rgnbegin <= base) && (end <= rgnend))
-			break;
-	}
-
-	/* Didn't find the region */
-	if (i == rgn->cnt)
+	node = region_find(&rgn->tree, base, size);
+	if (!node || node->start > base || region_end(node) < end)
 		return -1;
+	rgnend = region_end(node);
 
 	/* Check to see if we are removing entire region */
-	if ((rgnbegin == base) && (rgnend == end)) {
-		lmb_remove_region(rgn, i);
+	if ((node->start == base) && (rgnend == end)) {
+		region_remove(&rgn->tree, node);
+		free(node);
 		return 0;
 	}
 
 	/* Check to see if region is matching at the front */
-	if (rgnbegin == base) {
-		rgn->region[i].base = end;
-		rgn->region[i].size -= size;
+	if (node->start == base) {
+		node->start = end;
+		node->size -= size;
+		region_update(node);
 		return 0;
 	}
 
 	/* Check to see if the region is matching at the end */
 	if (rgnend == end) {
-		rgn->region[i].size -= size;
+		node->size -= size;
+		region_update(node);
 		return 0;
 	}
 
@@ -225,8 +140,16 @@ long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	 * We need to split the entry -  adjust the current one to the
 	 * beginging of the hole and add the region after hole.
 	 */
-	rgn->region[i].size = base - rgn->region[i].base;
-	return lmb_add_region(rgn, end, rgnend - end);
+	tail = calloc(1, sizeof(*tail));
+	if (!tail)
+		return -1;
+	node->size = base - node->start;
+	region_update(node);
+	tail->start = end;
+	tail->size = rgnend - end;
+	region_insert(&rgn->tree, tail);
+
+	return 0;
 }
 
 long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size)
@@ -236,20 +159,12 @@ long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	return lmb_add_region(_rgn, base, size);
 }
 
-static long lmb_overlaps_region(struct lmb_region *rgn, phys_addr_t base,
-				phys_size_t size)
+/* Returns the lowest region overlapping (base, size), or NULL if none */
+static struct region_node *lmb_overlaps_region(struct lmb_region *rgn,
+					       phys_addr_t base,
+					       phys_size_t size)
 {
-	unsigned long i;
-
-	for (i=0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		phys_size_t rgnsize = rgn->region[i].size;
-		if ( lmb_addrs_overlap(base,size,rgnbase,rgnsize) ) {
-			break;
-		}
-	}
-
-	return (i < rgn->cnt) ? i : -1;
+	return region_find(&rgn->tree, base, size);
 }
 
 phys_addr_t lmb_alloc(struct lmb *lmb, phys_size_t size, ulong align)
@@ -282,13 +197,14 @@ static phys_addr_t lmb_align_up(phys_addr_t addr, ulong size)
 
 phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phys_addr_t max_addr)
 {
-	long i, j;
+	struct region_node *mem, *res;
 	phys_addr_t base = 0;
 	phys_addr_t res_base;
 
-	for (i = lmb->memory.cnt-1; i >= 0; i--) {
-		phys_addr_t lmbbase = lmb->memory.region[i].base;
-		phys_size_t lmbsize = lmb->memory.region[i].size;
+	for (mem = region_last(&lmb->memory.tree); mem;
+	     mem = region_prev(mem)) {
+		phys_addr_t lmbbase = mem->start;
+		phys_size_t lmbsize = mem->size;
 
 		if (lmbsize < size)
 			continue;
@@ -304,8 +220,8 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phy
 			continue;
 
 		while (base && lmbbase <= base) {
-			j = lmb_overlaps_region(&lmb->reserved, base, size);
-			if (j < 0) {
+			res = lmb_overlaps_region(&lmb->reserved, base, size);
+			if (!res) {
 				/* This area isn't reserved, take it */
 				if (lmb_add_region(&lmb->reserved, base,
 							lmb_align_up(size,
@@ -313,7 +229,7 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phy
 					return 0;
 				return base;
 			}
-			res_base = lmb->reserved.region[j].base;
+			res_base = res->start;
 			if (res_base < size)
 				break;
 			base = lmb_align_down(res_base - size, align);
@@ -324,15 +240,7 @@ phys_addr_t __lmb_alloc_base(struct lmb *lmb, phys_size_t size, ulong align, phy
 
 int lmb_is_reserved(struct lmb *lmb, phys_addr_t addr)
 {
-	int i;
-
-	for (i = 0; i < lmb->reserved.cnt; i++) {
-		phys_addr_t upper = lmb->reserved.region[i].base +
-			lmb->reserved.region[i].size - 1;
-		if ((addr >= lmb->reserved.region[i].base) && (addr <= upper))
-			return 1;
-	}
-	return 0;
+	return region_find(&lmb->reserved.tree, addr, 1) != NULL;
 }
 
 __weak void board_lmb_reserve(struct lmb *lmb)
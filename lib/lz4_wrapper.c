@@ -6,8 +6,10 @@
 
 #include <common.h>
 #include <compiler.h>
+#include <malloc.h>
 #include <linux/kernel.h>
 #include <linux/types.h>
+#include <u-boot/lz4.h>
 
 static u16 LZ4_readLE16(const void *src) { return le16_to_cpu(*(u16 *)src); }
 static void LZ4_copy4(void *dst, const void *src) { *(u32 *)dst = *(u32 *)src; }
@@ -63,12 +65,117 @@ struct lz4_block_header {
 	/* + u32 block_checksum iff has_block_checksum is set */
 } __packed;
 
+/* Check a frame header of which the first sizeof(*h) bytes are present */
+static int ulz4_check_header(const struct lz4_frame_header *h)
+{
+	/* We assume there's always only a single, standard frame. */
+	if (le32_to_cpu(h->magic) != LZ4F_MAGIC || h->version != 1)
+		return -EPROTONOSUPPORT;	/* unknown format */
+	if (h->reserved0 || h->reserved1 || h->reserved2)
+		return -EINVAL;	/* reserved must be zero */
+	if (!h->independent_blocks)
+		return -EPROTONOSUPPORT; /* we can't support this yet */
+
+	return 0;
+}
+
+/* Size of the whole frame header, including the optional fields */
+static size_t ulz4_header_size(const struct lz4_frame_header *h)
+{
+	return sizeof(*h) + (h->has_content_size ? sizeof(u64) : 0) +
+		sizeof(u8);
+}
+
+/* Largest block in the frame, or 0 if the descriptor is invalid */
+static size_t ulz4_block_max(const struct lz4_frame_header *h)
+{
+	if (h->max_block_size < 4)
+		return 0;
+
+	return 1 << (8 + 2 * h->max_block_size);
+}
+
+/**
+ * ulz4fn_parallel() - decompress the blocks of a frame with ulz4_run_jobs()
+ *
+ * Every block is decompressed to its own block_max-sized slot of the output
+ * buffer, as only the last block of a frame is normally shorter than that.
+ * Gaps left by any other short blocks are closed up afterwards.
+ *
+ * @return 0 if OK, -EAGAIN if the frame must be decompressed serially,
+ * either because it does not suit this or to report an error
+ */
+static int ulz4fn_parallel(const void *src, size_t srcn, const void *in,
+			   void *dst, size_t *dstn, size_t block_max,
+			   int has_block_checksum)
+{
+	struct ulz4_job *jobs;
+	const void *pos;
+	size_t out;
+	int count, i;
+
+	/* In-place decompression would overwrite blocks not yet read */
+	if (dst < src + srcn && src < dst + *dstn)
+		return -EAGAIN;
+
+	for (pos = in, count = 0; ; count++) {
+		struct lz4_block_header b;
+
+		if (pos - src + sizeof(b) > srcn)
+			return -EAGAIN;
+		b.raw = le32_to_cpu(*(u32 *)pos);
+		pos += sizeof(b);
+		if (!b.size)
+			break;
+		if (pos - src + b.size > srcn || b.size > block_max)
+			return -EAGAIN;
+		pos += b.size;
+		if (has_block_checksum)
+			pos += sizeof(u32);
+	}
+	if (count < 2 || (count - 1) * block_max >= *dstn)
+		return -EAGAIN;
+
+	jobs = calloc(count, sizeof(*jobs));
+	if (!jobs)
+		return -EAGAIN;
+	for (pos = in, i = 0; i < count; i++) {
+		struct lz4_block_header b;
+
+		b.raw = le32_to_cpu(*(u32 *)pos);
+		pos += sizeof(b);
+		jobs[i].src = pos;
+		jobs[i].srcn = b.size;
+		jobs[i].not_compressed = b.not_compressed;
+		jobs[i].dst = dst + i * block_max;
+		jobs[i].dstn = min(block_max, *dstn - i * block_max);
+		pos += b.size;
+		if (has_block_checksum)
+			pos += sizeof(u32);
+	}
+
+	ulz4_run_jobs(jobs, count);
+
+	for (i = 0, out = 0; i < count && !jobs[i].ret; i++) {
+		if (jobs[i].dst != dst + out)
+			memmove(dst + out, jobs[i].dst, jobs[i].dstn);
+		out += jobs[i].dstn;
+	}
+	free(jobs);
+	if (i < count)
+		return -EAGAIN;
+
+	*dstn = out;
+	return 0;
+}
+
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 {
 	const void *end = dst + *dstn;
 	const void *in = src;
 	void *out = dst;
 	int has_block_checksum;
+	size_t block_max;
 	int ret;
 	*dstn = 0;
 
@@ -78,19 +185,23 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 		if (srcn < sizeof(*h) + sizeof(u64) + sizeof(u8))
 			return -EINVAL;	/* input overrun */
 
-		/* We assume there's always only a single, standard frame. */
-		if (le32_to_cpu(h->magic) != LZ4F_MAGIC || h->version != 1)
-			return -EPROTONOSUPPORT;	/* unknown format */
-		if (h->reserved0 || h->reserved1 || h->reserved2)
-			return -EINVAL;	/* reserved must be zero */
-		if (!h->independent_blocks)
-			return -EPROTONOSUPPORT; /* we can't support this yet */
+		ret = ulz4_check_header(h);
+		if (ret)
+			return ret;
 		has_block_checksum = h->has_block_checksum;
+		block_max = ulz4_block_max(h);
+		in += ulz4_header_size(h);
+	}
+
+	if (IS_ENABLED(CONFIG_LZ4_PARALLEL) && block_max) {
+		size_t size = end - out;
 
-		in += sizeof(*h);
-		if (h->has_content_size)
-			in += sizeof(u64);
-		in += sizeof(u8);
+		ret = ulz4fn_parallel(src, srcn, in, dst, &size, block_max,
+				      has_block_checksum);
+		if (ret != -EAGAIN) {
+			*dstn = size;
+			return ret;
+		}
 	}
 
 	while (1) {
@@ -137,3 +248,38 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 	*dstn = out - dst;
 	return ret;
 }
+
+int ulz4_block(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	int ret;
+
+	/* constant folding essential, do not touch params! */
+	ret = LZ4_decompress_generic(src, dst, srcn, *dstn, endOnInputSize,
+				     full, 0, noDict, dst, NULL, 0);
+	if (ret < 0)
+		return -EPROTO;	/* decompression error */
+
+	*dstn = ret;
+	return 0;
+}
+
+int ulz4_decode_job(struct ulz4_job *job)
+{
+	if (job->not_compressed) {
+		if (job->srcn > job->dstn)
+			return -ENOBUFS;	/* output overrun */
+		memcpy(job->dst, job->src, job->srcn);
+		job->dstn = job->srcn;
+		return 0;
+	}
+
+	return ulz4_block(job->src, job->srcn, job->dst, &job->dstn);
+}
+
+__weak void ulz4_run_jobs(struct ulz4_job *jobs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		jobs[i].ret = ulz4_decode_job(&jobs[i]);
+}
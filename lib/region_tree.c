@@ -0,0 +1,128 @@
+/*
+ * Sorted trees of non-overlapping address ranges
+ *
+ * Each node caches the size of the largest free range below it, so that
+ * region_find_free() can skip whole subtrees without room. Insertion,
+ * removal and both searches take O(log n) time.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <region_tree.h>
+#include <linux/rbtree_augmented.h>
+
+static u64 region_compute_max(struct region_node *node)
+{
+	u64 max = node->free ? node->size : 0;
+	struct region_node *child;
+
+	child = region_entry(node->rb.rb_left);
+	if (child && child->max_free > max)
+		max = child->max_free;
+	child = region_entry(node->rb.rb_right);
+	if (child && child->max_free > max)
+		max = child->max_free;
+
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, region_augment, struct region_node, rb, u64,
+		     max_free, region_compute_max)
+
+void region_insert(struct region_tree *tree, struct region_node *node)
+{
+	struct rb_node **link = &tree->root.rb_node, *parent = NULL;
+	u64 max = node->free ? node->size : 0;
+	struct region_node *entry;
+
+	while (*link) {
+		parent = *link;
+		entry = region_entry(parent);
+		if (entry->max_free < max)
+			entry->max_free = max;
+		if (node->start < entry->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	node->max_free = max;
+	rb_link_node(&node->rb, parent, link);
+	rb_insert_augmented(&node->rb, &tree->root, &region_augment);
+	tree->count++;
+}
+
+void region_remove(struct region_tree *tree, struct region_node *node)
+{
+	rb_erase_augmented(&node->rb, &tree->root, &region_augment);
+	tree->count--;
+}
+
+void region_update(struct region_node *node)
+{
+	/* Recompute this node even if its cached value looks current */
+	node->max_free = region_compute_max(node);
+	region_augment_propagate(rb_parent(&node->rb), NULL);
+}
+
+struct region_node *region_find(struct region_tree *tree, u64 start,
+				u64 size)
+{
+	struct rb_node *rb = tree->root.rb_node;
+	struct region_node *node, *found = NULL;
+
+	/* Ranges are disjoint, so their ends are sorted like their starts */
+	while (rb) {
+		node = region_entry(rb);
+		if (region_end(node) > start) {
+			found = node;
+			rb = rb->rb_left;
+		} else {
+			rb = rb->rb_right;
+		}
+	}
+
+	if (found && found->start < start + size)
+		return found;
+
+	return NULL;
+}
+
+static bool region_fits(struct region_node *node, u64 size, u64 max_addr)
+{
+	u64 end = min(region_end(node), max_addr);
+
+	return node->free && end > node->start && end - node->start >= size;
+}
+
+static struct region_node *region_find_free_below(struct rb_node *rb,
+						  u64 size, u64 max_addr)
+{
+	struct region_node *node, *found;
+
+	while (rb) {
+		node = region_entry(rb);
+		if (node->max_free < size)
+			return NULL;
+
+		/* Try higher ranges first, unless they all start too high */
+		if (node->start < max_addr) {
+			found = region_find_free_below(rb->rb_right, size,
+						       max_addr);
+			if (found)
+				return found;
+			if (region_fits(node, size, max_addr))
+				return node;
+		}
+		rb = rb->rb_left;
+	}
+
+	return NULL;
+}
+
+struct region_node *region_find_free(struct region_tree *tree, u64 size,
+				     u64 max_addr)
+{
+	return region_find_free_below(tree->root.rb_node, size, max_addr);
+}
@@ -8,4 +8,8 @@
    subject to change. Applications should only use zlib.h.
  */
 
+/* Input and output space that inflate() must have to call inflate_fast() */
+#define INFLATE_FAST_MIN_INPUT 16
+#define INFLATE_FAST_MIN_OUTPUT (258 + 16)
+
 void inflate_fast OF((z_streamp strm, unsigned start));
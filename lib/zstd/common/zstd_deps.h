@@ -0,0 +1,81 @@
+/*
+ * U-Boot replacement for the zstd file of the same name, which provides the
+ * C library dependencies of zstd. See lib/zstd/README.txt
+ *
+ * SPDX-License-Identifier:	GPL-2.0+ BSD-3-Clause
+ */
+
+/* Need:
+ * NULL
+ * INT_MAX
+ * UINT_MAX
+ * ZSTD_memcpy()
+ * ZSTD_memset()
+ * ZSTD_memmove()
+ */
+#ifndef ZSTD_DEPS_COMMON
+#define ZSTD_DEPS_COMMON
+
+#include <limits.h>
+#include <stddef.h>
+
+#define ZSTD_memcpy(d,s,l) __builtin_memcpy((d),(s),(l))
+#define ZSTD_memmove(d,s,l) __builtin_memmove((d),(s),(l))
+#define ZSTD_memset(p,v,l) __builtin_memset((p),(v),(l))
+
+#endif /* ZSTD_DEPS_COMMON */
+
+/* Need:
+ * ZSTD_malloc()
+ * ZSTD_free()
+ * ZSTD_calloc()
+ *
+ * These are U-Boot's malloc(), declared here as <malloc.h> cannot be
+ * included alongside the <stdint.h> types that zstd uses.
+ */
+#ifdef ZSTD_DEPS_NEED_MALLOC
+#ifndef ZSTD_DEPS_MALLOC
+#define ZSTD_DEPS_MALLOC
+
+void *malloc(size_t size);
+void *calloc(size_t n, size_t size);
+void free(void *ptr);
+
+#define ZSTD_malloc(s) malloc(s)
+#define ZSTD_calloc(n,s) calloc((n), (s))
+#define ZSTD_free(p) free((p))
+
+#endif /* ZSTD_DEPS_MALLOC */
+#endif /* ZSTD_DEPS_NEED_MALLOC */
+
+/*
+ * Provides 64-bit math support.
+ * Need:
+ * U64 ZSTD_div64(U64 dividend, U32 divisor)
+ */
+#ifdef ZSTD_DEPS_NEED_MATH64
+#ifndef ZSTD_DEPS_MATH64
+#define ZSTD_DEPS_MATH64
+
+#define ZSTD_div64(dividend, divisor) ((dividend) / (divisor))
+
+#endif /* ZSTD_DEPS_MATH64 */
+#endif /* ZSTD_DEPS_NEED_MATH64 */
+
+/* Debug levels above 0 are not supported: there is no assert() or stderr */
+#if defined(ZSTD_DEPS_NEED_ASSERT) || defined(ZSTD_DEPS_NEED_IO)
+#error "zstd cannot be built with DEBUGLEVEL > 0 in U-Boot"
+#endif
+
+/* Only requested when <stdint.h> is known to be present.
+ * Need:
+ * intptr_t
+ */
+#ifdef ZSTD_DEPS_NEED_STDINT
+#ifndef ZSTD_DEPS_STDINT
+#define ZSTD_DEPS_STDINT
+
+#include <stdint.h>
+
+#endif /* ZSTD_DEPS_STDINT */
+#endif /* ZSTD_DEPS_NEED_STDINT */
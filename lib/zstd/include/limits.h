@@ -0,0 +1,31 @@
+/*
+ * Stub permitting the zstd sources, which expect a C library, to be built
+ * unmodified without pulling in any U-Boot header
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ZSTD_STUB_LIMITS_H
+#define __ZSTD_STUB_LIMITS_H
+
+/* U-Boot code including zstd.h may already have these from linux/kernel.h */
+#ifndef CHAR_BIT
+#define CHAR_BIT	__CHAR_BIT__
+#endif
+#ifndef USHRT_MAX
+#define USHRT_MAX	(__SHRT_MAX__ * 2 + 1)
+#endif
+#ifndef INT_MAX
+#define INT_MAX		__INT_MAX__
+#endif
+#ifndef UINT_MAX
+#define UINT_MAX	(__INT_MAX__ * 2U + 1U)
+#endif
+#ifndef ULONG_MAX
+#define ULONG_MAX	(__LONG_MAX__ * 2UL + 1UL)
+#endif
+#ifndef ULLONG_MAX
+#define ULLONG_MAX	(__LONG_LONG_MAX__ * 2ULL + 1ULL)
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ * Stub permitting the zstd sources, which expect a C library, to be built
+ * unmodified without pulling in any U-Boot header
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __ZSTD_STUB_STRING_H
+#define __ZSTD_STUB_STRING_H
+
+#include <stddef.h>
+
+void *memcpy(void *dest, const void *src, size_t count);
+void *memmove(void *dest, const void *src, size_t count);
+void *memset(void *s, int c, size_t count);
+int memcmp(const void *cs, const void *ct, size_t count);
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * U-Boot interface to the Zstandard decompressor
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <u-boot/zstd.h>
+
+#define ZSTD_STATIC_LINKING_ONLY	/* static workspaces */
+#include "zstd.h"
+#include "zstd_errors.h"
+
+/* Turn a zstd error code into an errno value, as documented in zstd.h */
+static int zstd_errno(size_t ret)
+{
+	debug("zstd: %s\n", ZSTD_getErrorName(ret));
+	switch (ZSTD_getErrorCode(ret)) {
+	case ZSTD_error_dstSize_tooSmall:
+		return -ENOSPC;
+	case ZSTD_error_memory_allocation:
+	case ZSTD_error_workSpace_tooSmall:
+		return -ENOMEM;
+	case ZSTD_error_frameParameter_windowTooLarge:
+		return -E2BIG;
+	case ZSTD_error_prefix_unknown:
+	case ZSTD_error_version_unsupported:
+	case ZSTD_error_frameParameter_unsupported:
+		return -EPROTONOSUPPORT;
+	default:
+		return -EPROTO;
+	}
+}
+
+int zstd_decompress(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	size_t size = ZSTD_estimateDCtxSize();
+	ZSTD_DCtx *dctx;
+	void *workspace;
+	size_t ret;
+
+	workspace = malloc(size);
+	if (!workspace)
+		return -ENOMEM;
+	dctx = ZSTD_initStaticDCtx(workspace, size);
+	ret = ZSTD_decompressDCtx(dctx, dst, *dstn, src, srcn);
+	free(workspace);
+	if (ZSTD_isError(ret))
+		return zstd_errno(ret);
+	*dstn = ret;
+
+	return 0;
+}
+
+size_t zstd_stream_workspace_size(uint window_log)
+{
+	if (window_log > ZSTD_WINDOWLOG_MAX)
+		window_log = ZSTD_WINDOWLOG_MAX;
+
+	return ZSTD_estimateDStreamSize((size_t)1 << window_log);
+}
+
+int zstd_stream_init(struct zstd_stream *zs, void *workspace, size_t size,
+		     uint window_log)
+{
+	ZSTD_DStream *ds;
+
+	if (window_log < ZSTD_WINDOWLOG_MIN || window_log > ZSTD_WINDOWLOG_MAX)
+		return -EINVAL;
+	if (size < zstd_stream_workspace_size(window_log))
+		return -ENOMEM;
+	ds = ZSTD_initStaticDStream(workspace, size);
+	if (!ds)
+		return -ENOMEM;
+	ZSTD_DCtx_setParameter(ds, ZSTD_d_windowLogMax, window_log);
+	zs->dstream = ds;
+
+	return 0;
+}
+
+int zstd_stream_decompress(struct zstd_stream *zs, const void *src,
+			   size_t *srcn, void *dst, size_t *dstn)
+{
+	ZSTD_inBuffer in = { src, *srcn, 0 };
+	ZSTD_outBuffer out = { dst, *dstn, 0 };
+	size_t ret;
+
+	ret = ZSTD_decompressStream(zs->dstream, &out, &in);
+	*srcn = in.pos;
+	*dstn = out.pos;
+	if (ZSTD_isError(ret)) {
+		/* Start afresh with the next frame after an error */
+		ZSTD_DCtx_reset(zs->dstream, ZSTD_reset_session_only);
+		return zstd_errno(ret);
+	}
+
+	return ret == 0;
+}
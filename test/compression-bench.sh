@@ -0,0 +1,117 @@
+#!/bin/bash
+
+# SPDX-License-Identifier:	GPL-2.0+
+
+# This script times U-Boot's decompressors on sandbox.
+
+# Each corpus is compressed with every algorithm that both the host and
+# U-Boot support and wrapped in a legacy image with mkimage. The images are
+# loaded into memory and 'ut compression bench' decompresses each of them to
+# the load address for at least a second, reporting the throughput. The
+# CRC of the decompressed data is then compared with that of the corpus.
+#
+# By default the corpora are a stripped sandbox U-Boot, standing in for a
+# kernel, and a tar archive of include/, standing in for an initramfs. Other
+# files of up to 8MB (CONFIG_SYS_BOOTM_LEN) can be given instead:
+#
+#    cd u-boot
+#    ./test/compression-bench.sh [file...]
+#
+# The important part of the log is the table printed by 'ut compression
+# bench' and the lines containing either "PASS" or "FAILURE". The MB/s
+# column is the uncompressed size divided by the decompression time.
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+bdir=${odir}/bench
+maxsize=$((8 << 20))
+# Images go above the 8MB decompressed at the load address (0) and the CRC
+crcaddr=900000
+imgaddr=$((16 << 20))
+
+for prereq in crc32 tar strip; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+# Print the CRC32 of a file as U-Boot stores it in memory, for itest.l
+crc_of() {
+    local crc=0x`crc32 $1`
+
+    printf %02x%02x%02x%02x \
+        $((${crc} & 0xff)) \
+        $(((${crc} >> 8) & 0xff)) \
+        $(((${crc} >> 16) & 0xff)) \
+        $((${crc} >> 24))
+}
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8
+
+rm -rf ${bdir}
+mkdir -p ${bdir}
+corpora="$@"
+if [ -z "${corpora}" ]; then
+    strip -o ${bdir}/kernel ${odir}/u-boot
+    tar cf - --sort=name --mtime=@0 --owner=0 --group=0 include | \
+        head -c $((7 << 20)) > ${bdir}/initramfs
+    corpora="${bdir}/kernel ${bdir}/initramfs"
+fi
+
+# Host command producing each format, as U-Boot expects it
+compressor() {
+    case $1 in
+    none)	echo cat ;;
+    gzip)	echo "gzip -9 -n -c" ;;
+    bzip2)	echo "bzip2 -9 -c" ;;
+    lzma)	echo "lzma -9 -c" ;;
+    lzo)	echo "lzop -9 -c" ;;
+    lz4)	echo "lz4 -9 -c" ;;
+    zstd)	echo "zstd -19 -q -c" ;;
+    esac
+}
+
+cmds=
+addr=${imgaddr}
+for corpus in ${corpora}; do
+    size=`stat -c %s ${corpus}`
+    if [ ${size} -gt ${maxsize} ]; then
+        echo "${corpus} is larger than ${maxsize} bytes, skipping"
+        continue
+    fi
+    name=`basename ${corpus}`
+    crc=`crc_of ${corpus}`
+    for comp in none gzip bzip2 lzma lzo lz4 zstd; do
+        set -- `compressor ${comp}`
+        if [ ! -x "`which $1`" ]; then
+            echo "Missing $1 binary, not timing ${comp}"
+            continue
+        fi
+        $@ < ${corpus} > ${bdir}/${name}.${comp}
+        img=${bdir}/${name}.${comp}.img
+        ./${odir}/tools/mkimage -A sandbox -O linux -T kernel -C ${comp} \
+            -a 0 -e 0 -n ${name} -d ${bdir}/${name}.${comp} ${img} \
+            >/dev/null
+        cmds="${cmds}
+host load hostfs - `printf %x ${addr}` ${img}
+ut compression bench `printf %x ${addr}`
+crc32 0 `printf %x ${size}` ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE ${name} ${comp}; \
+else echo PASS; fi"
+        # Keep the images 1MB aligned
+        addr=$(((addr + `stat -c %s ${img}` + (1 << 20)) & ~((1 << 20) - 1)))
+    done
+done
+
+./${odir}/u-boot << EOF
+${cmds}
+reset
+EOF
+if [ $? -ne 0 ]; then
+    echo U-Boot exit status indicates an error
+    exit $?
+fi
@@ -9,9 +9,12 @@
 #include <common.h>
 #include <bootm.h>
 #include <command.h>
+#include <div64.h>
 #include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
+#include <test/suites.h>
 
 #include <u-boot/zlib.h>
 #include <bzlib.h>
@@ -21,6 +24,8 @@
 #include <lzma/LzmaTools.h>
 
 #include <linux/lzo.h>
+#include <u-boot/lz4.h>
+#include <u-boot/zstd.h>
 
 static const char plain[] =
 	"I am a highly compressable bit of text.\n"
@@ -117,12 +122,39 @@ static const char lz4_compressed[] =
 	"\x9d\x12\x8c\x9d";
 static const unsigned long lz4_compressed_size = 276;
 
+/* zstd -19 -c /tmp/plain.txt > /tmp/plain.zst */
+static const char zstd_compressed[] =
+	"\x28\xb5\x2f\xfd\x64\x5e\x00\xad\x05\x00\x42\x4e\x26\x17\x90\x3b"
+	"\x07\x04\x5a\x13\x8b\xa7\x65\x34\x12\x21\x6d\xb0\x39\xbb\xae\xe8"
+	"\xba\xc9\xcd\x5e\x02\x49\xd0\x2b\xa9\xfa\x96\x92\xe7\x1f\x19\x19"
+	"\x7c\x8f\xf1\x9d\x54\x37\xfc\xd6\x0a\xf3\x0c\x93\x56\xc7\x52\x4f"
+	"\x0a\x62\x3e\xd1\xa5\x83\x17\x31\xab\x5d\x8f\x57\xf3\xcc\x3b\x58"
+	"\xf8\x91\x8c\xf1\x2a\x5c\x89\xdd\xf2\x9b\x15\xb7\x92\x5b\xbe\xba"
+	"\xab\xd5\xd1\x34\xdf\xf0\x02\x0e\x61\xcd\x7b\xd6\x01\xfc\xc2\xa7"
+	"\xd4\xd1\x3d\x26\x9c\x10\x49\xb8\x5b\xcd\xba\x7c\xf7\xac\x4b\xad"
+	"\xb7\x31\x1c\xbc\xf9\xcb\x62\x8e\x2e\x9b\x0f\xd3\x87\x57\x45\x12"
+	"\x16\xfa\x3a\x79\xde\x65\xf8\xcc\x48\xd5\x43\xa6\xbd\xc3\x91\x29"
+	"\x65\x29\xa7\x5b\x9a\x08\x08\x00\x60\x13\x00\x63\xa3\x8e\x28\x94"
+	"\x79\x41\x2a\x78\xc2\x91\x70\x9f\xaa\x6a\x21\x7a\xa1\xaa\x0c\xe4"
+	"\xf4\x6e\xfa";
+static const unsigned long zstd_compressed_size = 195;
+
+/* Frame header of a zstd stream using a 2MB window */
+static const char zstd_large_window[] = "\x28\xb5\x2f\xfd\x00\x58";
+
 
 #define TEST_BUFFER_SIZE	512
+#define BENCH_MIN_US		1000000
+
+#ifndef CONFIG_SYS_BOOTM_LEN
+/* as in common/bootm.c */
+#define CONFIG_SYS_BOOTM_LEN	0x800000
+#endif
 
 typedef int (*mutate_func)(void *, unsigned long, void *, unsigned long,
 			   unsigned long *);
 
+#if defined(CONFIG_GZIP) && defined(CONFIG_GZIP_COMPRESSED)
 static int compress_using_gzip(void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
 			       unsigned long *out_size)
@@ -150,7 +182,9 @@ static int uncompress_using_gzip(void *in, unsigned long in_size,
 
 	return ret;
 }
+#endif /* CONFIG_GZIP && CONFIG_GZIP_COMPRESSED */
 
+#ifdef CONFIG_BZIP2
 static int compress_using_bzip2(void *in, unsigned long in_size,
 				void *out, unsigned long out_max,
 				unsigned long *out_size)
@@ -183,7 +217,9 @@ static int uncompress_using_bzip2(void *in, unsigned long in_size,
 
 	return (ret != BZ_OK);
 }
+#endif /* CONFIG_BZIP2 */
 
+#ifdef CONFIG_LZMA
 static int compress_using_lzma(void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
 			       unsigned long *out_size)
@@ -215,7 +251,9 @@ static int uncompress_using_lzma(void *in, unsigned long in_size,
 
 	return (ret != SZ_OK);
 }
+#endif /* CONFIG_LZMA */
 
+#ifdef CONFIG_LZO
 static int compress_using_lzo(void *in, unsigned long in_size,
 			      void *out, unsigned long out_max,
 			      unsigned long *out_size)
@@ -248,7 +286,9 @@ static int uncompress_using_lzo(void *in, unsigned long in_size,
 
 	return (ret != LZO_E_OK);
 }
+#endif /* CONFIG_LZO */
 
+#ifdef CONFIG_LZ4
 static int compress_using_lz4(void *in, unsigned long in_size,
 			      void *out, unsigned long out_max,
 			      unsigned long *out_size)
@@ -281,6 +321,42 @@ static int uncompress_using_lz4(void *in, unsigned long in_size,
 
 	return (ret != 0);
 }
+#endif /* CONFIG_LZ4 */
+
+#ifdef CONFIG_ZSTD
+static int compress_using_zstd(void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	assert(in_size == strlen(plain));
+	assert(memcmp(plain, in, in_size) == 0);
+
+	if (zstd_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_compressed, zstd_compressed_size);
+	if (out_size)
+		*out_size = zstd_compressed_size;
+
+	return 0;
+}
+
+static int uncompress_using_zstd(void *in, unsigned long in_size,
+				 void *out, unsigned long out_max,
+				 unsigned long *out_size)
+{
+	int ret;
+	size_t input_size = in_size;
+	size_t output_size = out_max;
+
+	ret = zstd_decompress(in, input_size, out, &output_size);
+	if (out_size)
+		*out_size = output_size;
+
+	return (ret != 0);
+}
+#endif /* CONFIG_ZSTD */
 
 #define errcheck(statement) if (!(statement)) { \
 	fprintf(stderr, "\tFailed: %s\n", #statement); \
@@ -371,22 +447,393 @@ out:
 	return ret;
 }
 
-static int do_ut_compression(cmd_tbl_t *cmdtp, int flag, int argc,
-			     char *const argv[])
+#if defined(CONFIG_GZIP) && defined(CONFIG_GZIP_COMPRESSED)
+#define INFLATE_STREAM_SIZE	(96 << 10)
+#define INFLATE_STREAM_CHUNK	1000
+
+/**
+ * run_inflate_stream_test() - Test inflate() with small output buffers
+ *
+ * The data is made of pieces of the plain text copied from all over itself,
+ * so that matches reach back up to the whole 32KB window. Collecting the
+ * output in pieces large enough for inflate_fast() makes it copy matches
+ * both from the sliding window and from the output just written.
+ *
+ * @return 0 if OK, 1 on failure
+ */
+static int run_inflate_stream_test(void)
+{
+	unsigned long comp_size = INFLATE_STREAM_SIZE;
+	unsigned char *orig_buf, *comp_buf, *out_buf;
+	uint seed = 1, pos, len;
+	z_stream s;
+	int ret;
+
+	printf(" testing inflate stream ...\n");
+
+	orig_buf = malloc(INFLATE_STREAM_SIZE);
+	comp_buf = malloc(INFLATE_STREAM_SIZE);
+	out_buf = malloc(INFLATE_STREAM_SIZE + 1);
+	memset(&s, '\0', sizeof(s));
+	errcheck(orig_buf != NULL);
+	errcheck(comp_buf != NULL);
+	errcheck(out_buf != NULL);
+
+	memcpy(orig_buf, plain, strlen(plain));
+	for (pos = strlen(plain); pos < INFLATE_STREAM_SIZE; pos += len) {
+		seed = seed * 1103515245 + 12345;
+		len = min_t(uint, 3 + (seed >> 16) % 64,
+			    INFLATE_STREAM_SIZE - pos);
+		memcpy(orig_buf + pos, orig_buf + (seed >> 8) % (pos - len),
+		       len);
+		if (seed & 0x80)
+			orig_buf[pos + len / 2] = seed >> 24;
+	}
+	errcheck(gzip(comp_buf, &comp_size, orig_buf,
+		      INFLATE_STREAM_SIZE) == 0);
+	printf("\tcompressed_size:%lu\n", comp_size);
+
+	/* Skip the 10-byte gzip header written by gzip() */
+	errcheck(inflateInit2(&s, -MAX_WBITS) == Z_OK);
+	s.next_in = comp_buf + 10;
+	s.avail_in = comp_size - 10;
+	s.next_out = out_buf;
+	memset(out_buf, 'A', INFLATE_STREAM_SIZE + 1);
+	do {
+		s.avail_out = INFLATE_STREAM_CHUNK;
+		ret = inflate(&s, Z_SYNC_FLUSH);
+	} while (ret == Z_OK);
+	errcheck(ret == Z_STREAM_END);
+	printf("\tuncompressed_size:%lu\n", s.total_out);
+	errcheck(s.total_out == INFLATE_STREAM_SIZE);
+	errcheck(memcmp(orig_buf, out_buf, INFLATE_STREAM_SIZE) == 0);
+	errcheck(out_buf[INFLATE_STREAM_SIZE] == 'A');
+
+	/* Got here, everything is fine. */
+	ret = 0;
+
+out:
+	printf(" inflate stream: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	inflateEnd(&s);
+	free(out_buf);
+	free(comp_buf);
+	free(orig_buf);
+
+	return ret;
+}
+#endif /* CONFIG_GZIP && CONFIG_GZIP_COMPRESSED */
+
+#ifdef CONFIG_LZ4
+/* lz4_compressed is a header, one block, an end mark and a checksum */
+#define LZ4_HEADER_SIZE		7
+#define LZ4_BLOCK_SIZE		(lz4_compressed_size - LZ4_HEADER_SIZE - 4 - 8)
+#define LZ4_MULTI_COUNT		8
+#define LZ4_MULTI_BLOCK_MAX	(64 << 10)
+#define LZ4_MULTI_BUFFER_SIZE	(LZ4_MULTI_COUNT * LZ4_MULTI_BLOCK_MAX)
+
+/**
+ * make_lz4_multi() - Build an LZ4 frame of several blocks
+ *
+ * The frame has the header of lz4_compressed, changed to declare 64KB
+ * blocks, and alternates its block with the plain text stored uncompressed.
+ * Each block therefore decompresses to the plain text, which is much less
+ * than the block size.
+ *
+ * @buf:	Buffer for the frame
+ * @return size of the frame
+ */
+static size_t make_lz4_multi(char *buf)
+{
+	ulong plain_size = strlen(plain);
+	char *p = buf;
+	int i;
+
+	memcpy(p, lz4_compressed, LZ4_HEADER_SIZE);
+	p[5] = 0x40;
+	p += LZ4_HEADER_SIZE;
+	for (i = 0; i < LZ4_MULTI_COUNT; i++) {
+		if (i & 1) {
+			put_unaligned_le32(plain_size | 1U << 31, p);
+			memcpy(p + 4, plain, plain_size);
+			p += 4 + plain_size;
+		} else {
+			memcpy(p, lz4_compressed + LZ4_HEADER_SIZE,
+			       4 + LZ4_BLOCK_SIZE);
+			p += 4 + LZ4_BLOCK_SIZE;
+		}
+	}
+	memcpy(p, lz4_compressed + lz4_compressed_size - 8, 8);
+
+	return p + 8 - buf;
+}
+
+/* Check that @buf holds LZ4_MULTI_COUNT copies of the plain text */
+static int check_lz4_multi(const char *buf, size_t size)
+{
+	ulong plain_size = strlen(plain);
+	int i;
+
+	if (size != LZ4_MULTI_COUNT * plain_size)
+		return -1;
+	for (i = 0; i < LZ4_MULTI_COUNT; i++) {
+		if (memcmp(buf + i * plain_size, plain, plain_size))
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * run_lz4_multi_test() - Test ulz4fn() with a frame of several blocks
+ *
+ * With CONFIG_LZ4_PARALLEL and room for every block to have its own slot of
+ * the output buffer, the blocks are decompressed by ulz4_run_jobs(). With
+ * just enough room they are decompressed one after another.
+ *
+ * @return 0 if OK, 1 on failure
+ */
+static int run_lz4_multi_test(void)
+{
+	char *multi_buf, *uncompressed_buf;
+	size_t multi_size, out_size;
+	int ret;
+
+	printf(" testing lz4 multi-block ...\n");
+
+	multi_buf = malloc(TEST_BUFFER_SIZE * LZ4_MULTI_COUNT);
+	uncompressed_buf = malloc(LZ4_MULTI_BUFFER_SIZE);
+	errcheck(multi_buf != NULL);
+	errcheck(uncompressed_buf != NULL);
+	multi_size = make_lz4_multi(multi_buf);
+	printf("\tcompressed_size:%lu\n", (ulong)multi_size);
+
+	out_size = LZ4_MULTI_BUFFER_SIZE;
+	errcheck(ulz4fn(multi_buf, multi_size, uncompressed_buf,
+			&out_size) == 0);
+	printf("\tuncompressed_size:%lu\n", (ulong)out_size);
+	errcheck(check_lz4_multi(uncompressed_buf, out_size) == 0);
+
+	out_size = LZ4_MULTI_COUNT * strlen(plain);
+	memset(uncompressed_buf, 'A', LZ4_MULTI_BUFFER_SIZE);
+	errcheck(ulz4fn(multi_buf, multi_size, uncompressed_buf,
+			&out_size) == 0);
+	errcheck(check_lz4_multi(uncompressed_buf, out_size) == 0);
+	errcheck(uncompressed_buf[out_size] == 'A');
+
+	/* A block which does not fit fails whichever way it is handled */
+	out_size = LZ4_MULTI_BUFFER_SIZE;
+	put_unaligned_le32(LZ4_MULTI_BLOCK_MAX | 1U << 31,
+			   multi_buf + LZ4_HEADER_SIZE);
+	errcheck(ulz4fn(multi_buf, multi_size, uncompressed_buf,
+			&out_size) != 0);
+	printf("\tbad block rejected\n");
+
+	/* Got here, everything is fine. */
+	ret = 0;
+
+out:
+	printf(" lz4 multi-block: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	free(uncompressed_buf);
+	free(multi_buf);
+
+	return ret;
+}
+#endif /* CONFIG_LZ4 */
+
+#ifdef CONFIG_ZSTD
+/**
+ * run_zstd_stream_test() - Test zstd decompression with a bounded workspace
+ *
+ * The input is fed a byte at a time and the output collected in small
+ * pieces, which exercises every point at which the decoder can stop.
+ *
+ * @return 0 if OK, 1 on failure
+ */
+static int run_zstd_stream_test(void)
+{
+	ulong orig_size = strlen(plain);
+	const uint window_log = 10;
+	struct zstd_stream zs;
+	size_t in_pos, out_pos, in_size, out_size;
+	void *uncompressed_buf;
+	void *workspace;
+	size_t size;
+	int ret;
+
+	printf(" testing zstd stream ...\n");
+
+	size = zstd_stream_workspace_size(window_log);
+	printf("\tworkspace_size:%lu\n", (ulong)size);
+	workspace = malloc(size);
+	uncompressed_buf = malloc(TEST_BUFFER_SIZE);
+	errcheck(workspace != NULL);
+	errcheck(uncompressed_buf != NULL);
+
+	/* A workspace too small for the window is refused */
+	errcheck(zstd_stream_init(&zs, workspace, size - 1, window_log) ==
+		 -ENOMEM);
+	errcheck(zstd_stream_init(&zs, workspace, size, 9) == -EINVAL);
+
+	/* Decompresses piecewise. */
+	errcheck(zstd_stream_init(&zs, workspace, size, window_log) == 0);
+	memset(uncompressed_buf, 'A', TEST_BUFFER_SIZE);
+	in_pos = 0;
+	out_pos = 0;
+	do {
+		in_size = min_t(size_t, zstd_compressed_size - in_pos, 1);
+		out_size = min_t(size_t, TEST_BUFFER_SIZE - out_pos, 16);
+		ret = zstd_stream_decompress(&zs, zstd_compressed + in_pos,
+					     &in_size,
+					     uncompressed_buf + out_pos,
+					     &out_size);
+		in_pos += in_size;
+		out_pos += out_size;
+	} while (!ret && (in_size || out_size));
+	errcheck(ret == 1);
+	printf("\tuncompressed_size:%lu\n", (ulong)out_pos);
+	errcheck(in_pos == zstd_compressed_size);
+	errcheck(out_pos == orig_size);
+	errcheck(memcmp(plain, uncompressed_buf, orig_size) == 0);
+	errcheck(((char *)uncompressed_buf)[orig_size] == 'A');
+
+	/* A frame needing a larger window than allowed is rejected */
+	in_pos = sizeof(zstd_large_window) - 1;
+	out_pos = TEST_BUFFER_SIZE;
+	errcheck(zstd_stream_decompress(&zs, zstd_large_window, &in_pos,
+					uncompressed_buf, &out_pos) == -E2BIG);
+	printf("\tlarge window rejected\n");
+
+	/* The stream recovers for the next frame after an error. */
+	in_pos = zstd_compressed_size;
+	out_pos = TEST_BUFFER_SIZE;
+	errcheck(zstd_stream_decompress(&zs, zstd_compressed, &in_pos,
+					uncompressed_buf, &out_pos) == 1);
+	errcheck(out_pos == orig_size);
+
+	/* Got here, everything is fine. */
+	ret = 0;
+
+out:
+	printf(" zstd stream: %s\n", ret == 0 ? "ok" : "FAILED");
+
+	free(uncompressed_buf);
+	free(workspace);
+
+	return ret;
+}
+#endif /* CONFIG_ZSTD */
+
+/**
+ * run_bench() - Time decompression of a legacy image
+ *
+ * The image is decompressed to the load address, as bootm would, over and
+ * over until at least BENCH_MIN_US has passed.
+ *
+ * @addr:	Address of the image
+ * @return 0 if OK, 1 on failure
+ */
+static int run_bench(ulong addr)
+{
+	const image_header_t *hdr = map_sysmem(addr, 0);
+	ulong start, elapsed, size;
+	ulong image_len, rate;
+	void *image_buf;
+	uint runs = 0;
+	int comp;
+	int ret;
+
+	if (!image_check_magic(hdr) || !image_check_hcrc(hdr)) {
+		printf("%08lx: not a valid image\n", addr);
+		return 1;
+	}
+	comp = image_get_comp(hdr);
+	image_buf = (void *)image_get_data(hdr);
+	image_len = image_get_data_size(hdr);
+	if (addr < load_addr + CONFIG_SYS_BOOTM_LEN &&
+	    addr + image_get_image_size(hdr) > load_addr) {
+		printf("%08lx: image overlaps the load address %08lx\n",
+		       addr, load_addr);
+		return 1;
+	}
+
+	start = timer_get_us();
+	do {
+		ret = bootm_uncompress(comp, map_sysmem(load_addr, 0),
+				       image_buf, image_len,
+				       CONFIG_SYS_BOOTM_LEN, &size);
+		if (ret) {
+			printf("%08lx: %s: uncompress error %d\n", addr,
+			       genimg_get_comp_name(comp), ret);
+			return 1;
+		}
+		runs++;
+		elapsed = timer_get_us() - start;
+	} while (elapsed < BENCH_MIN_US);
+
+	/* Bytes per microsecond are MB/s, keep one decimal place */
+	rate = lldiv((u64)size * runs * 10, elapsed);
+	printf("%-6s %-20.20s %9lu %9lu %5u %9lu %5lu.%lu\n",
+	       genimg_get_comp_short_name(comp), image_get_name(hdr),
+	       image_len, size, runs, elapsed / runs, rate / 10, rate % 10);
+
+	return 0;
+}
+
+static int do_ut_compression_bench(int argc, char *const argv[])
 {
 	int err = 0;
+	int i;
+
+	if (argc < 1)
+		return CMD_RET_USAGE;
+
+	printf("%-6s %-20s %9s %9s %5s %9s %7s\n", "Comp", "Name", "Size",
+	       "Uncomp", "Runs", "us/run", "MB/s");
+	for (i = 0; i < argc; i++)
+		err |= run_bench(simple_strtoul(argv[i], NULL, 16));
 
+	return err ? CMD_RET_FAILURE : 0;
+}
+
+int do_ut_compression(cmd_tbl_t *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	int err = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+		return do_ut_compression_bench(argc - 2, argv + 2);
+
+#if defined(CONFIG_GZIP) && defined(CONFIG_GZIP_COMPRESSED)
 	err += run_test("gzip", compress_using_gzip, uncompress_using_gzip);
+	err += run_inflate_stream_test();
+#endif
+#ifdef CONFIG_BZIP2
 	err += run_test("bzip2", compress_using_bzip2, uncompress_using_bzip2);
+#endif
+#ifdef CONFIG_LZMA
 	err += run_test("lzma", compress_using_lzma, uncompress_using_lzma);
+#endif
+#ifdef CONFIG_LZO
 	err += run_test("lzo", compress_using_lzo, uncompress_using_lzo);
+#endif
+#ifdef CONFIG_LZ4
 	err += run_test("lz4", compress_using_lz4, uncompress_using_lz4);
+	err += run_lz4_multi_test();
+#endif
+#ifdef CONFIG_ZSTD
+	err += run_test("zstd", compress_using_zstd, uncompress_using_zstd);
+	err += run_zstd_stream_test();
+#endif
 
 	printf("ut_compression %s\n", err == 0 ? "ok" : "FAILED");
 
 	return err;
 }
 
+#ifdef CONFIG_SANDBOX
+
 static int compress_using_none(void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
 			       unsigned long *out_size)
@@ -453,11 +900,24 @@ static int do_ut_image_decomp(cmd_tbl_t *cmdtp, int flag, int argc,
 {
 	int err = 0;
 
-	err = run_bootm_test(IH_COMP_GZIP, compress_using_gzip);
+#if defined(CONFIG_GZIP) && defined(CONFIG_GZIP_COMPRESSED)
+	err |= run_bootm_test(IH_COMP_GZIP, compress_using_gzip);
+#endif
+#ifdef CONFIG_BZIP2
 	err |= run_bootm_test(IH_COMP_BZIP2, compress_using_bzip2);
+#endif
+#ifdef CONFIG_LZMA
 	err |= run_bootm_test(IH_COMP_LZMA, compress_using_lzma);
+#endif
+#ifdef CONFIG_LZO
 	err |= run_bootm_test(IH_COMP_LZO, compress_using_lzo);
+#endif
+#ifdef CONFIG_LZ4
 	err |= run_bootm_test(IH_COMP_LZ4, compress_using_lz4);
+#endif
+#ifdef CONFIG_ZSTD
+	err |= run_bootm_test(IH_COMP_ZSTD, compress_using_zstd);
+#endif
 	err |= run_bootm_test(IH_COMP_NONE, compress_using_none);
 
 	printf("ut_image_decomp %s\n", err == 0 ? "ok" : "FAILED");
@@ -467,10 +927,11 @@ static int do_ut_image_decomp(cmd_tbl_t *cmdtp, int flag, int argc,
 
 U_BOOT_CMD(
 	ut_compression,	5,	1,	do_ut_compression,
-	"Basic test of compressors: gzip bzip2 lzma lzo", ""
+	"Basic test of compressors: gzip bzip2 lzma lzo lz4 zstd", ""
 );
 
 U_BOOT_CMD(
 	ut_image_decomp,	5,	1, do_ut_image_decomp,
 	"Basic test of bootm decompression", ""
 );
+#endif /* CONFIG_SANDBOX */
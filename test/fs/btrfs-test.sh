@@ -0,0 +1,134 @@
+#!/bin/bash
+
+# SPDX-License-Identifier:	GPL-2.0+
+
+# This script tests and times U-Boot's Btrfs support on sandbox.
+
+# A directory holding a large file, a symlink to it, many small files that
+# end up stored inline in the tree and, when mkfs.btrfs can create one, a
+# subvolume is turned into a Btrfs image, uncompressed and with each of the
+# compressors U-Boot can read. The large file is then loaded in one go and
+# in pieces at offsets that are not block aligned, which exercises the
+# cached extent items and decompressed extent, and every small file is
+# loaded in turn, which exercises the tree block cache. The CRC of
+# everything read is compared with that of the original.
+#
+# To execute the test, simply run it from the U-Boot source root directory:
+#
+#    cd u-boot
+#    ./test/fs/btrfs-test.sh
+#
+# The important part of the log is the lines containing either "PASS" or
+# "FAILURE", and the "time:" lines following each timed command.
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+srcdir=${odir}/btrfs-root
+img=${odir}/btrfs.img
+fill=/dev/urandom
+testfn=big.bin
+piece=$((300 * 1024 + 123))
+crcaddr=0
+readaddr=4000000
+nsmall=200
+
+for prereq in mkfs.btrfs dd crc32; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+# Print the CRC32 of a file as U-Boot stores it in memory, for itest.l
+crc_of() {
+    local crc=0x`crc32 $1`
+
+    printf %02x%02x%02x%02x \
+        $((${crc} & 0xff)) \
+        $(((${crc} >> 8) & 0xff)) \
+        $(((${crc} >> 16) & 0xff)) \
+        $((${crc} >> 24))
+}
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8
+
+rm -rf ${srcdir}
+mkdir -p ${srcdir}/small ${srcdir}/subvol
+# Half random, half zeroes so that some extents compress and some do not
+dd if=${fill} of=${srcdir}/${testfn} bs=1M count=4 >/dev/null 2>&1
+dd if=/dev/zero bs=1M count=4 >> ${srcdir}/${testfn} 2>/dev/null
+dd if=${fill} bs=1000 count=7 >> ${srcdir}/${testfn} 2>/dev/null
+ln -s ${testfn} ${srcdir}/link.bin
+ln -s ../${testfn} ${srcdir}/subvol/link.bin
+for ((i = 0; i < ${nsmall}; i++)); do
+    dd if=${fill} of=${srcdir}/small/${i}.bin bs=$((i * 37 + 1)) count=1 \
+        >/dev/null 2>&1
+done
+
+# Make subvol/ a subvolume if this mkfs.btrfs knows how to
+subvol=
+if mkfs.btrfs --help 2>&1 | grep -q -e --subvol; then
+    subvol="--subvol subvol"
+fi
+
+# Commands checking the large file in one go and in pieces
+crc=`crc_of ${srcdir}/${testfn}`
+size=`stat -c %s ${srcdir}/${testfn}`
+cmds="time load host 0 ${readaddr} ${testfn}
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi
+load host 0 ${readaddr} link.bin
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi
+load host 0 ${readaddr} subvol/link.bin
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi"
+for ((off = 0; off < size; off += piece)); do
+    dd if=${srcdir}/${testfn} of=${odir}/piece.bin bs=1 skip=${off} \
+        count=${piece} >/dev/null 2>&1
+    cmds="${cmds}
+load host 0 ${readaddr} ${testfn} `printf %x ${piece}` `printf %x ${off}`
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != `crc_of ${odir}/piece.bin`; then echo FAILURE; \
+else echo PASS; fi"
+done
+
+# Commands checking all the small files
+small="echo Small files"
+for ((i = 0; i < ${nsmall}; i++)); do
+    small="${small}
+load host 0 ${readaddr} small/${i}.bin
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != `crc_of ${srcdir}/small/${i}.bin`; then \
+echo FAILURE small/${i}.bin; fi"
+done
+
+for comp in no zlib lzo; do
+    rm -f ${img}
+    compress=
+    if [ ${comp} != no ]; then
+        compress="--compress ${comp}"
+    fi
+    truncate -s 64M ${img}
+    mkfs.btrfs -q --rootdir ${srcdir} ${subvol} ${compress} ${img} \
+        >/dev/null 2>&1
+    if [ $? -ne 0 ]; then
+        echo "Could not create ${comp} compression image, skipping"
+        continue
+    fi
+
+    echo "Compression: ${comp}"
+    ./sandbox/u-boot << EOF
+host bind 0 ${img}
+${cmds}
+${small}
+reset
+EOF
+    if [ $? -ne 0 ]; then
+        echo U-Boot exit status indicates an error
+        exit $?
+    fi
+done
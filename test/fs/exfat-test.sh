@@ -0,0 +1,166 @@
+#!/bin/bash
+
+# SPDX-License-Identifier:	GPL-2.0+
+
+# This script tests and times U-Boot's exFAT support on sandbox.
+
+# An exFAT image is made with mkfs.exfat and filled through a loop mount.
+# The first file written to the empty filesystem gets consecutive clusters,
+# so Linux marks it NoFatChain and U-Boot reads it with a single block read.
+# The rest of the filesystem is then filled with files of many sizes, every
+# other one of which is removed, so that the next file written is scattered
+# over the holes left behind and has to be followed through the FAT. Both
+# files are loaded in one go and in pieces at offsets that are not cluster
+# aligned, and a number of small files are loaded in turn. The CRC of
+# everything read is compared with that of the original.
+#
+# To execute the test, simply run it from the U-Boot source root directory:
+#
+#    cd u-boot
+#    ./test/fs/exfat-test.sh
+#
+# The important part of the log is the lines containing either "PASS" or
+# "FAILURE", and the "time:" lines following each timed command.
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+srcdir=${odir}/exfat-root
+img=${odir}/exfat.img
+mnt=${odir}/mnt
+fill=/dev/urandom
+contigfn=contig.bin
+fragfn=frag.bin
+piece=$((300 * 1024 + 123))
+crcaddr=0
+readaddr=4000000
+nsmall=50
+
+for prereq in fallocate mkfs.exfat dd crc32; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+# Print the CRC32 of a file as U-Boot stores it in memory, for itest.l
+crc_of() {
+    local crc=0x`crc32 $1`
+
+    printf %02x%02x%02x%02x \
+        $((${crc} & 0xff)) \
+        $(((${crc} >> 8) & 0xff)) \
+        $(((${crc} >> 16) & 0xff)) \
+        $((${crc} >> 24))
+}
+
+# Print the commands checking file $1 in one go and in pieces
+check_cmds() {
+    local fn=$1
+    local size=`stat -c %s ${srcdir}/${fn}`
+    local off
+
+    echo "time load host 0:0 ${readaddr} ${fn}
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != `crc_of ${srcdir}/${fn}`; then echo FAILURE; \
+else echo PASS; fi"
+    for ((off = 0; off < size; off += piece)); do
+        dd if=${srcdir}/${fn} of=${odir}/piece.bin bs=1 skip=${off} \
+            count=${piece} >/dev/null 2>&1
+        echo "load host 0:0 ${readaddr} ${fn} `printf %x ${piece}` \
+`printf %x ${off}`
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != `crc_of ${odir}/piece.bin`; then echo FAILURE; \
+else echo PASS; fi"
+    done
+}
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8
+
+rm -rf ${srcdir}
+mkdir -p ${srcdir}/small ${mnt}
+# Half random, half zeroes, with a tail that is not a whole cluster
+dd if=${fill} of=${srcdir}/${contigfn} bs=1M count=4 >/dev/null 2>&1
+dd if=/dev/zero bs=1M count=4 >> ${srcdir}/${contigfn} 2>/dev/null
+dd if=${fill} bs=1000 count=7 >> ${srcdir}/${contigfn} 2>/dev/null
+# Smaller than the holes left below added together
+dd if=${fill} of=${srcdir}/${fragfn} bs=511 count=12000 >/dev/null 2>&1
+for ((i = 0; i < ${nsmall}; i++)); do
+    dd if=${fill} of=${srcdir}/small/${i}.bin bs=$((i * 137 + 1)) count=1 \
+        >/dev/null 2>&1
+done
+
+rm -f ${img}
+fallocate -l 64M ${img}
+if [ $? -ne 0 ]; then
+    echo fallocate failed - using dd instead
+    dd if=/dev/zero of=${img} bs=1024 count=$((64 * 1024))
+    if [ $? -ne 0 ]; then
+        echo Could not create empty disk image
+        exit $?
+    fi
+fi
+mkfs.exfat ${img} >/dev/null
+if [ $? -ne 0 ]; then
+    echo Could not create exFAT filesystem
+    exit $?
+fi
+
+sudo mount -o loop,uid=$(id -u) ${img} ${mnt}
+if [ $? -ne 0 ]; then
+    echo Could not mount test filesystem
+    exit $?
+fi
+
+cp ${srcdir}/${contigfn} ${mnt}/
+cp -r ${srcdir}/small ${mnt}/
+sync
+for ((sects = 8; sects < 512; sects += 8)); do
+    dd if=${fill} of=${mnt}/keep-${sects}.img bs=512 count=${sects} \
+        >/dev/null 2>&1
+    dd if=${fill} of=${mnt}/remove-${sects}.img bs=512 count=${sects} \
+        >/dev/null 2>&1
+done
+# Use up the free space so that only the holes are left to allocate from
+dd if=/dev/zero of=${mnt}/filler.img bs=1M >/dev/null 2>&1
+sync
+rm -f ${mnt}/remove-*.img
+sync
+cp ${srcdir}/${fragfn} ${mnt}/
+if ! cmp -s ${srcdir}/${fragfn} ${mnt}/${fragfn}; then
+    echo Could not write fragmented file
+    sudo umount ${mnt}
+    exit 1
+fi
+
+sudo umount ${mnt}
+if [ $? -ne 0 ]; then
+    echo Could not unmount test filesystem
+    exit $?
+fi
+
+# Commands checking all the small files
+small="echo Small files"
+for ((i = 0; i < ${nsmall}; i++)); do
+    small="${small}
+load host 0:0 ${readaddr} small/${i}.bin
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != `crc_of ${srcdir}/small/${i}.bin`; then \
+echo FAILURE small/${i}.bin; fi"
+done
+
+./sandbox/u-boot << EOF
+host bind 0 ${img}
+echo NoFatChain file
+`check_cmds ${contigfn}`
+echo FAT chained file
+`check_cmds ${fragfn}`
+${small}
+reset
+EOF
+if [ $? -ne 0 ]; then
+    echo U-Boot exit status indicates an error
+    exit $?
+fi
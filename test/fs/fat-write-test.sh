@@ -0,0 +1,121 @@
+#!/bin/bash
+
+# SPDX-License-Identifier:	GPL-2.0+
+
+# This script tests and times U-Boot's FAT write support with large files.
+
+# fatwrite allocates clusters as contiguous runs from a free cluster bitmap
+# built when the write starts, keeps modified FAT sectors in memory until the
+# file is complete and updates the FAT32 FSInfo sector. This test writes a
+# large file to a fresh filesystem, to one with a fragmented free space and
+# to one whose FSInfo next free cluster hint lies near the end, so that the
+# allocation has to wrap around. It overwrites the file and reads each copy
+# back to validate its CRC. The time taken by each fatwrite is printed so
+# that runs before and after a change to fs/fat can be compared.
+#
+# To execute the test, simply run it from the U-Boot source root directory:
+#
+#    cd u-boot
+#    ./test/fs/fat-write-test.sh
+#
+# The important part of the log is the lines containing either "PASS" or
+# "FAILURE", and the "time:" lines following each fatwrite.
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+img=${odir}/fat-write.img
+mnt=${odir}/mnt
+fill=/dev/urandom
+testfn=${odir}/fat-write.bin
+crcaddr=0
+loadaddr=1000
+readaddr=3000000
+
+for prereq in fallocate mkfs.fat dd crc32; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+make O=${odir} -s sandbox_defconfig && make O=${odir} -s -j8
+
+dd if=${fill} of=${testfn} bs=1M count=32 >/dev/null 2>&1
+crc=0x`crc32 ${testfn}`
+crc=`printf %02x%02x%02x%02x \
+    $((${crc} & 0xff)) \
+    $(((${crc} >> 8) & 0xff)) \
+    $(((${crc} >> 16) & 0xff)) \
+    $((${crc} >> 24))`
+
+mkdir -p ${mnt}
+for layout in fresh fragmented late-hint; do
+    rm -f ${img}
+    fallocate -l 256M ${img}
+    if [ $? -ne 0 ]; then
+        echo fallocate failed - using dd instead
+        dd if=/dev/zero of=${img} bs=1024 count=$((256 * 1024))
+        if [ $? -ne 0 ]; then
+            echo Could not create empty disk image
+            exit $?
+        fi
+    fi
+    # Small clusters make for the largest FAT to scan and update
+    mkfs.fat -F 32 -s 1 ${img}
+    if [ $? -ne 0 ]; then
+        echo Could not create FAT filesystem
+        exit $?
+    fi
+
+    if [ ${layout} = late-hint ]; then
+        # Point the next free cluster hint at cluster 500000 of about 520000
+        fsinfo=`od -An -tu2 -j48 -N2 ${img}`
+        printf '\x20\xa1\x07\x00' | dd of=${img} bs=1 \
+            seek=$((${fsinfo} * 512 + 492)) conv=notrunc >/dev/null 2>&1
+    fi
+
+    if [ ${layout} = fragmented ]; then
+        sudo mount -o loop,uid=$(id -u) ${img} ${mnt}
+        if [ $? -ne 0 ]; then
+            echo Could not mount test filesystem
+            exit $?
+        fi
+
+        for ((sects=8; sects < 512; sects += 8)); do
+            fn=${mnt}/keep-${sects}.img
+            dd if=${fill} of=${fn} bs=512 count=${sects} >/dev/null 2>&1
+            fn=${mnt}/remove-${sects}.img
+            dd if=${fill} of=${fn} bs=512 count=${sects} >/dev/null 2>&1
+        done
+
+        rm -f ${mnt}/remove-*.img
+
+        sudo umount ${mnt}
+        if [ $? -ne 0 ]; then
+            echo Could not unmount test filesystem
+            exit $?
+        fi
+    fi
+
+    echo "Layout: ${layout}"
+    ./sandbox/u-boot << EOF
+host bind 0 ${img}
+host load hostfs - ${loadaddr} ${testfn}
+time fatwrite host 0:0 ${loadaddr} write.bin \$filesize
+load host 0:0 ${readaddr} write.bin
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi
+time fatwrite host 0:0 ${loadaddr} write.bin \$filesize
+load host 0:0 ${readaddr} write.bin
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi
+reset
+EOF
+    if [ $? -ne 0 ]; then
+        echo U-Boot exit status indicates an error
+        exit $?
+    fi
+done
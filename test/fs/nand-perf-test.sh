@@ -0,0 +1,120 @@
+#!/bin/bash
+
+# SPDX-License-Identifier:	GPL-2.0+
+
+# This script tests and times the NAND, UBI and UBIFS code on sandbox.
+
+# Sandbox is started with a simulated NAND chip (--nand, see
+# drivers/mtd/nand/sandbox_nand.c) whose busy and transfer times are added to
+# the sandbox timer, so that the "time:" lines below show how long the
+# commands would take with a real chip of the same timings. A UBIFS image
+# holding a large file is written into a UBI volume, then a freshly started
+# U-Boot attaches UBI, mounts UBIFS and loads the file, and reads the raw
+# NAND. The same is repeated with bit-flips injected into page reads, and
+# the raw read once more with the chip's read cache commands disabled.
+#
+# To execute the test, simply run it from the U-Boot source root directory:
+#
+#    cd u-boot
+#    ./test/fs/nand-perf-test.sh
+#
+# Pass "bulk" as the argument to build U-Boot with CONFIG_UBIFS_BULK_READ,
+# so that the UBIFS loads can be checked and timed with bulk-read enabled.
+#
+# The important part of the log is the lines containing either "PASS" or
+# "FAILURE", and the "time:" lines following each timed command.
+#
+# All temporary files used by this script are created in ./sandbox to avoid
+# polluting the source tree. test/fs/fs-test.sh also uses this directory for
+# the same purpose.
+
+odir=sandbox
+nand=${odir}/nand.bin
+timing=tr=25,tprog=250,tbers=2000,tcyc=25
+srcdir=${odir}/ubifs-root
+ubifs=${odir}/ubifs.img
+fill=/dev/urandom
+testfn=big.bin
+crcaddr=0
+loadaddr=1000
+readaddr=4000000
+parts="setenv mtdids nand0=nand0; setenv mtdparts mtdparts=nand0:-(ubi)"
+
+for prereq in mkfs.ubifs dd crc32; do
+    if [ ! -x "`which $prereq`" ]; then
+        echo "Missing $prereq binary. Exiting!"
+        exit 1
+    fi
+done
+
+make O=${odir} -s sandbox_defconfig
+if [ "$1" = bulk ]; then
+    echo CONFIG_UBIFS_BULK_READ=y >> ${odir}/.config
+    make O=${odir} -s olddefconfig
+fi
+make O=${odir} -s -j8
+
+rm -rf ${srcdir}
+mkdir -p ${srcdir}
+dd if=${fill} of=${srcdir}/${testfn} bs=1M count=16 >/dev/null 2>&1
+crc=0x`crc32 ${srcdir}/${testfn}`
+crc=`printf %02x%02x%02x%02x \
+    $((${crc} & 0xff)) \
+    $(((${crc} >> 8) & 0xff)) \
+    $(((${crc} >> 16) & 0xff)) \
+    $((${crc} >> 24))`
+
+# 2 KiB pages, 128 KiB blocks, sub-page writes: UBI data starts at 2 KiB
+mkfs.ubifs -m 2048 -e 129024 -c 900 -r ${srcdir} -o ${ubifs}
+if [ $? -ne 0 ]; then
+    echo Could not create UBIFS image
+    exit $?
+fi
+
+rm -f ${nand}
+./sandbox/u-boot --nand ${nand},${timing} << EOF
+${parts}
+nand erase.chip
+ubi part ubi
+ubi create vol
+host load hostfs - ${loadaddr} ${ubifs}
+ubi write ${loadaddr} vol \$filesize
+reset
+EOF
+if [ $? -ne 0 ]; then
+    echo U-Boot exit status indicates an error
+    exit $?
+fi
+
+for flip in 0 1000; do
+    if [ ${flip} -eq 0 ]; then
+        echo "No bit-flips"
+    else
+        echo "Bit-flip every ${flip} page reads"
+    fi
+    ./sandbox/u-boot --nand ${nand},${timing},flip=${flip} << EOF
+${parts}
+time ubi part ubi
+ubifsmount ubi0:vol
+time ubifsload ${readaddr} ${testfn}
+crc32 ${readaddr} \$filesize ${crcaddr}
+if itest.l *${crcaddr} != ${crc}; then echo FAILURE; else echo PASS; fi
+ubifsumount
+time nand read ${readaddr} 0 1000000
+reset
+EOF
+    if [ $? -ne 0 ]; then
+        echo U-Boot exit status indicates an error
+        exit $?
+    fi
+done
+
+echo "Raw read without READ CACHE SEQUENTIAL"
+./sandbox/u-boot --nand ${nand},${timing},cache=0 << EOF
+time nand read ${readaddr} 0 1000000
+reset
+EOF
+if [ $? -ne 0 ]; then
+    echo U-Boot exit status indicates an error
+    exit $?
+fi